@@ -22,6 +22,7 @@
 
 #include "config.h"
 #include "secrets.h"
+#include "espnow_protocol.h"
 
 // ============================================================================
 // Global Objects
@@ -31,25 +32,86 @@ Adafruit_BMP280 bmp280;
 BH1750 bh1750;
 
 // ============================================================================
-// Data Structure for ESP-NOW
+// Sensor Data (latest reading; every reading is also buffered for the batch)
 // ============================================================================
 typedef struct {
-  char nodeType[16];
   float temperature;
   float humidity;
   float pressure;
   float light;
-  int32_t rssi;
-  unsigned long timestamp;
-} ESPNowData;
+} SensorReading;
+
+// Sensors found at cold boot (persisted, so warm wakes skip probing)
+#define SENSOR_AHT20 0x01
+#define SENSOR_BMP280 0x02
+#define SENSOR_BH1750 0x04
+
+// ============================================================================
+// RTC State (survives deep sleep; setup() runs again on every wake)
+// ============================================================================
+#define RTC_STATE_MAGIC 0x57534E34  // "WSN4" (bump when the layout changes)
+#define RTC_PRESSURE_BASE 50000     // Pa offset for the 16-bit pressure field
+#define RTC_FLAG_SEND_NEXT 0x01     // Next wake transmits (radio calibrated on wake)
+#define RTC_FLAG_SYNCED 0x02        // Clock and slot received from the central node
+#define RTC_FLAG_IN_SLOT 0x04       // Next wake lands on the assigned TDMA slot
+#define MAX_DRIFT_PPM 100000        // Sleep timer correction limit (10%)
+
+// Compact sample for RTC memory (12 bytes instead of the 20-byte WxSample)
+typedef struct {
+  uint32_t timestamp;    // Node clock, ms
+  int16_t temperature;   // centi-degC
+  uint16_t humidity;     // centi-%RH
+  uint16_t pressure;     // Pa above RTC_PRESSURE_BASE
+  uint16_t light;        // lux
+} RtcSample;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t crc;          // CRC32 of everything after this field
+  uint32_t sequence;     // Last packet sequence number sent
+  uint32_t headSample;   // Sample number of the oldest sample in the ring
+  uint32_t clockMs;      // Node clock at the start of this wake
+  uint32_t lastSendMs;   // Node clock of the last transmit
+  uint32_t nextSendMs;   // Node clock of the next assigned slot (valid when synced)
+  uint32_t sendIntervalMs; // Transmit period (TDMA frame from the central node)
+  uint32_t lastSyncMs;   // Node clock of the last time sync
+  int32_t driftPpm;      // Measured sleep timer error, applied to every deep sleep
+  uint16_t sendWakeMs;   // Measured wake-to-sleep time of the last transmit cycle
+  uint16_t readWakeMs;   // Same for the last read-only cycle
+  uint8_t centralMac[6]; // ESP-NOW peer
+  uint8_t channel;
+  uint8_t sensorMask;    // SENSOR_* bits
+  uint8_t sampleHead;    // Oldest sample in the ring
+  uint8_t sampleCount;
+  uint8_t flags;         // RTC_FLAG_*
+  uint8_t reserved;
+  uint8_t bmpCalib[24];  // BMP280 trimming parameters (registers 0x88-0x9F)
+  RtcSample samples[RTC_SAMPLE_CAPACITY];
+} RTCState;
+
+static_assert(sizeof(RTCState) <= 512, "RTC user memory is 512 bytes");
+static_assert(sizeof(RTCState) % 4 == 0, "RTC memory is accessed in 32-bit words");
+static_assert(RTC_SAMPLE_CAPACITY <= 255, "ring indices are uint8_t");
 
 // ============================================================================
 // Global State
 // ============================================================================
-ESPNowData sensorData;
+SensorReading sensorData;
+BatchEncoder batchEncoder;
 unsigned long lastSendTime = 0;
 unsigned long lastReadTime = 0;
 uint8_t sendFailureCount = 0;
+RTCState rtcState;
+volatile bool sendDone = false;  // Set by the ESP-NOW send callback
+volatile uint8_t sendStatus = 0;
+volatile bool ackReceived = false;  // Set by the ESP-NOW receive callback
+AckPacket lastAck;
+uint16_t probeWindowMs = 0;         // Diagnostics window granted by the last ACK
+uint32_t probeAwakeMs = 0;          // Time spent echoing probes this wake
+uint8_t probeFrame[ESPNOW_MAX_PAYLOAD];  // Probe waiting to be echoed
+volatile uint8_t probeLength = 0;
+uint32_t ackReceivedAt = 0;         // Node clock when lastAck arrived
+uint8_t ownMac[6];
 
 // ============================================================================
 // Setup Function
@@ -57,18 +119,56 @@ uint8_t sendFailureCount = 0;
 void setup() {
   // Initialize serial
   Serial.begin(115200);
-  delay(1000);
 
-  Serial.println(F("\n\n========================================"));
-  Serial.println(F("ESP-01S Exterior Node - Multi-Sensor"));
-  Serial.println(F("TCA9548A Multiplexer"));
-  Serial.println(F("========================================\n"));
+  bool warmWake = restoreState();
 
   // Initialize I2C
   Wire.begin(I2C_SDA, I2C_SCL);
   Wire.setClock(I2C_FREQ);
+
+  if (!warmWake) {
+    coldBoot();
+  }
+
+  if (!ENABLE_DEEP_SLEEP) {
+    initESPNow();
+    Serial.println(F("[INIT] Setup complete\n"));
+    return;
+  }
+
+  // Fast path: read, transmit if due, sleep. Sensors keep their configuration
+  // across the ESP's deep sleep, so nothing is re-initialized on a warm wake.
+  bool transmit = (rtcState.flags & RTC_FLAG_SEND_NEXT) != 0;
+  readSensors();
+
+  if (transmit) {
+    initESPNow();
+    sendData();
+  }
+
+  enterDeepSleep(transmit);
+}
+
+/**
+ * Full initialization after power-on or reset: probe sensors, start fresh RTC state
+ */
+void coldBoot() {
+  delay(1000);  // Give the serial monitor time to attach
+
+  Serial.println(F("\n\n========================================"));
+  Serial.println(F("ESP-01S Exterior Node - Multi-Sensor"));
+  Serial.println(F("TCA9548A Multiplexer"));
+  Serial.println(F("========================================\n"));
   Serial.println(F("[OK] I2C initialized"));
 
+  memset(&rtcState, 0, sizeof(rtcState));
+  rtcState.magic = RTC_STATE_MAGIC;
+  uint8_t centralMAC[] = ESPNOW_MAC_CENTRAL;
+  memcpy(rtcState.centralMac, centralMAC, 6);
+  rtcState.channel = ESPNOW_CHANNEL;
+  rtcState.sendIntervalMs = DATA_SEND_INTERVAL;
+  rtcState.flags = RTC_FLAG_SEND_NEXT;  // Announce the node right away, get a slot
+
   // Initialize sensors
   bool sensorsReady = true;
 
@@ -77,17 +177,23 @@ void setup() {
     sensorsReady = false;
   }
 
-  if (!initAHT20()) {
+  if (initAHT20()) {
+    rtcState.sensorMask |= SENSOR_AHT20;
+  } else {
     Serial.println(F("[ERROR] AHT20 initialization failed"));
     sensorsReady = false;
   }
 
-  if (!initBMP280()) {
+  if (initBMP280()) {
+    rtcState.sensorMask |= SENSOR_BMP280;
+  } else {
     Serial.println(F("[ERROR] BMP280 initialization failed"));
     sensorsReady = false;
   }
 
-  if (!initBH1750()) {
+  if (initBH1750()) {
+    rtcState.sensorMask |= SENSOR_BH1750;
+  } else {
     Serial.println(F("[ERROR] BH1750 initialization failed"));
     sensorsReady = false;
   }
@@ -96,10 +202,6 @@ void setup() {
   pinMode(D0, OUTPUT);  // Status LED
   digitalWrite(D0, sensorsReady ? LOW : HIGH);
 
-  // Initialize WiFi for ESP-NOW
-  WiFi.mode(WIFI_STA);
-  WiFi.disconnect();
-
   uint8_t macAddr[6];
   WiFi.macAddress(macAddr);
   Serial.print(F("[INFO] MAC Address: "));
@@ -109,32 +211,15 @@ void setup() {
   }
   Serial.println();
 
-  // Initialize ESP-NOW
-  if (esp_now_init() != 0) {
-    Serial.println(F("[ERROR] ESP-NOW initialization failed"));
-  }
-
-  esp_now_set_self_role(ESP_NOW_ROLE_CONTROLLER);
-  esp_now_register_send_cb(onDataSent);
-
-  // Add central node as peer
-  uint8_t centralMAC[] = ESPNOW_MAC_CENTRAL;
-  addPeer(centralMAC);
-
   // Initialize data structure
-  strcpy(sensorData.nodeType, NODE_TYPE);
   sensorData.temperature = 0;
   sensorData.humidity = 0;
   sensorData.pressure = 0;
   sensorData.light = 0;
-  sensorData.rssi = 0;
-  sensorData.timestamp = millis();
-
-  Serial.println(F("[INIT] Setup complete\n"));
 }
 
 // ============================================================================
-// Main Loop
+// Main Loop (only reached with deep sleep disabled)
 // ============================================================================
 void loop() {
   unsigned long now = millis();
@@ -145,22 +230,169 @@ void loop() {
     lastReadTime = now;
   }
 
-  // Send data periodically
-  if (now - lastSendTime >= DATA_SEND_INTERVAL) {
+  // Send data periodically, on the assigned slot once the central has synced us
+  bool synced = rtcState.flags & RTC_FLAG_SYNCED;
+  if (synced ? (int32_t)(nodeClock() - rtcState.nextSendMs) >= 0 : now - lastSendTime >= DATA_SEND_INTERVAL) {
+    if (synced) rtcState.flags |= RTC_FLAG_IN_SLOT;
     sendData();
     lastSendTime = now;
 
-    // Prepare for deep sleep
-    if (ENABLE_DEEP_SLEEP) {
-      Serial.println(F("[SLEEP] Entering deep sleep..."));
-      delay(100);
-      ESP.deepSleep(DEEP_SLEEP_TIME * 1000);
+    // No ACK = no new slot; keep the current one
+    while ((rtcState.flags & RTC_FLAG_SYNCED) && (int32_t)(nodeClock() - rtcState.nextSendMs) >= 0) {
+      rtcState.nextSendMs += rtcState.sendIntervalMs;
     }
   }
 
   delay(100);
 }
 
+// ============================================================================
+// RTC State
+// ============================================================================
+
+/**
+ * CRC32 (IEEE 802.3, bitwise; runs once per wake over <512 bytes)
+ */
+uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t stateCrc() {
+  const uint8_t* start = (const uint8_t*)&rtcState + offsetof(RTCState, crc) + sizeof(rtcState.crc);
+  return crc32(start, sizeof(rtcState) - (start - (const uint8_t*)&rtcState));
+}
+
+/**
+ * Load RTC state after a deep sleep wake
+ * @return true if the state is valid (warm wake), false on power-on/reset
+ */
+bool restoreState() {
+  if (ESP.getResetInfoPtr()->reason != REASON_DEEP_SLEEP_AWAKE) {
+    return false;
+  }
+
+  ESP.rtcUserMemoryRead(0, (uint32_t*)&rtcState, sizeof(rtcState));
+  return rtcState.magic == RTC_STATE_MAGIC && rtcState.crc == stateCrc() &&
+         rtcState.sampleHead < RTC_SAMPLE_CAPACITY && rtcState.sampleCount <= RTC_SAMPLE_CAPACITY;
+}
+
+void saveState() {
+  rtcState.crc = stateCrc();
+  ESP.rtcUserMemoryWrite(0, (uint32_t*)&rtcState, sizeof(rtcState));
+}
+
+/**
+ * Node clock: continues across deep sleep (ROM boot time is not counted)
+ */
+uint32_t nodeClock() {
+  return rtcState.clockMs + millis();
+}
+
+/**
+ * Adopt the central clock from an ACK and schedule the next transmit on the assigned slot
+ */
+void applyTimeSync(const AckPacket& ack, uint32_t receivedAt) {
+  int32_t offset = (int32_t)(ack.centralTime - receivedAt);
+
+  if (rtcState.flags & RTC_FLAG_SYNCED) {
+    // Residual offset since the last sync = sleep timer drift not yet corrected
+    uint32_t elapsed = receivedAt - rtcState.lastSyncMs;
+    if (elapsed > 0 && (uint32_t)abs(offset) < elapsed / 10) {  // Else the central rebooted
+      int32_t residualPpm = (int64_t)offset * 1000000 / elapsed;
+      rtcState.driftPpm = constrain(rtcState.driftPpm + residualPpm / 2, -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+    }
+  }
+
+  // Move the node clock (and everything stamped with it) onto the central time base
+  rtcState.clockMs += offset;
+  rtcState.lastSendMs += offset;
+  for (uint8_t i = 0; i < rtcState.sampleCount; i++) {
+    rtcState.samples[(rtcState.sampleHead + i) % RTC_SAMPLE_CAPACITY].timestamp += offset;
+  }
+
+  rtcState.lastSyncMs = ack.centralTime;
+  rtcState.nextSendMs = ack.centralTime + ack.nextSlotMs;
+  rtcState.sendIntervalMs = ack.frameMs;
+  rtcState.flags |= RTC_FLAG_SYNCED;
+
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[SYNC] Slot "));
+    Serial.print(ack.slot);
+    Serial.print(F(" in "));
+    Serial.print(ack.nextSlotMs);
+    Serial.print(F(" ms, offset "));
+    Serial.print(offset);
+    Serial.print(F(" ms, drift "));
+    Serial.print(rtcState.driftPpm);
+    Serial.println(F(" ppm"));
+  }
+}
+
+/**
+ * Record the measured awake time and sleep until the next reading is due.
+ * Once synced, reads are phased so that one wake lands exactly on the slot.
+ */
+void enterDeepSleep(bool transmitted) {
+  uint32_t awakeMs = millis();
+  uint32_t cycleMs = awakeMs - probeAwakeMs;  // Diagnostics are not part of the cycle
+  if (transmitted) {
+    rtcState.sendWakeMs = cycleMs > 0xFFFF ? 0xFFFF : cycleMs;
+  } else {
+    rtcState.readWakeMs = cycleMs > 0xFFFF ? 0xFFFF : cycleMs;
+  }
+
+  uint32_t now = rtcState.clockMs + awakeMs;
+  uint32_t sleepMs;
+  bool slotWake = false;
+  bool sendNext;
+
+  if (rtcState.flags & RTC_FLAG_SYNCED) {
+    // A slot too close to reach is skipped (the central counts it as missed)
+    while ((int32_t)(rtcState.nextSendMs - now) < MIN_SLEEP_TIME) {
+      rtcState.nextSendMs += rtcState.sendIntervalMs;
+    }
+    uint32_t untilSlot = rtcState.nextSendMs - now;
+    sleepMs = untilSlot % SENSOR_READ_INTERVAL;
+    if (sleepMs < MIN_SLEEP_TIME) sleepMs += SENSOR_READ_INTERVAL;
+    slotWake = sleepMs == untilSlot;
+    sendNext = slotWake;
+  } else {
+    // Not synced yet: free-running, transmit when the send interval has elapsed
+    // (half a read interval early rather than a whole one late)
+    sleepMs = SENSOR_READ_INTERVAL > awakeMs + MIN_SLEEP_TIME
+                ? SENSOR_READ_INTERVAL - awakeMs : MIN_SLEEP_TIME;
+    sendNext = now + sleepMs - rtcState.lastSendMs + SENSOR_READ_INTERVAL / 2 >= rtcState.sendIntervalMs;
+  }
+
+  // Never let the ring overflow, even off-slot
+  if (rtcState.sampleCount >= RTC_SAMPLE_CAPACITY - 1) sendNext = true;
+
+  rtcState.clockMs = now + sleepMs;
+  rtcState.flags &= ~(RTC_FLAG_SEND_NEXT | RTC_FLAG_IN_SLOT);
+  if (sendNext) rtcState.flags |= RTC_FLAG_SEND_NEXT;
+  if (slotWake) rtcState.flags |= RTC_FLAG_IN_SLOT;
+  saveState();
+
+  if (DEBUG_SERIAL) {
+    Serial.print(F("[SLEEP] Awake "));
+    Serial.print(awakeMs);
+    Serial.println(F(" ms"));
+    Serial.flush();
+  }
+
+  // Correct the requested time by the measured drift of the sleep timer.
+  // Read-only wakes skip RF calibration and never power the radio.
+  uint64_t sleepUs = (uint64_t)sleepMs * 1000 * 1000000 / (1000000 + rtcState.driftPpm);
+  ESP.deepSleep(sleepUs, sendNext ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+}
+
 // ============================================================================
 // I2C Multiplexer Control
 // ============================================================================
@@ -234,6 +466,17 @@ bool initBMP280() {
     Adafruit_BMP280::STANDBY_MS_500
   );
 
+  // Keep the trimming parameters so warm wakes can compensate raw readings
+  Wire.beginTransmission(BMP280_ADDR);
+  Wire.write(0x88);
+  if (Wire.endTransmission() != 0 ||
+      Wire.requestFrom((uint8_t)BMP280_ADDR, (uint8_t)sizeof(rtcState.bmpCalib)) != sizeof(rtcState.bmpCalib)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < sizeof(rtcState.bmpCalib); i++) {
+    rtcState.bmpCalib[i] = Wire.read();
+  }
+
   Serial.println(F("[OK] BMP280 initialized"));
   return true;
 }
@@ -255,52 +498,195 @@ bool initBH1750() {
 // ============================================================================
 // Sensor Reading
 // ============================================================================
+// Sensors are read through raw registers so a warm wake needs no library
+// begin(): BMP280 and BH1750 measure continuously on their own, only the
+// AHT20 needs a triggered conversion.
 
 /**
- * Read all sensor data
+ * Start an AHT20 measurement (result ready ~80 ms later)
  */
-void readSensors() {
-  Serial.println(F("[SENSOR] Reading..."));
+bool triggerAHT20() {
+  selectMuxChannel(MUX_CHANNEL_SENSORS);
+  Wire.beginTransmission(AHT20_ADDR);
+  Wire.write(0xAC);
+  Wire.write(0x33);
+  Wire.write(0x00);
+  return Wire.endTransmission() == 0;
+}
+
+/**
+ * Collect the AHT20 result, polling the busy bit
+ */
+bool readAHT20(float& temperature, float& humidity) {
+  selectMuxChannel(MUX_CHANNEL_SENSORS);
+
+  uint8_t data[6];
+  unsigned long start = millis();
+  do {
+    if (millis() - start > 150) return false;
+    yield();
+    if (Wire.requestFrom((uint8_t)AHT20_ADDR, (uint8_t)6) != 6) return false;
+    for (uint8_t i = 0; i < 6; i++) data[i] = Wire.read();
+  } while (data[0] & 0x80);
+
+  uint32_t rawHumidity = ((uint32_t)data[1] << 12) | ((uint32_t)data[2] << 4) | (data[3] >> 4);
+  uint32_t rawTemperature = ((uint32_t)(data[3] & 0x0F) << 16) | ((uint32_t)data[4] << 8) | data[5];
+  humidity = rawHumidity * 100.0f / 1048576.0f;
+  temperature = rawTemperature * 200.0f / 1048576.0f - 50.0f;
+  return true;
+}
 
-  // Read AHT20
+/**
+ * Read the latest BMP280 pressure (Bosch integer compensation, datasheet 3.11.3)
+ */
+bool readBMP280(float& pressure) {
   selectMuxChannel(MUX_CHANNEL_SENSORS);
-  sensors_event_t humidity, temp;
-  aht20.getEvent(&humidity, &temp);
 
-  sensorData.temperature = temp.temperature;
-  sensorData.humidity = humidity.relative_humidity;
+  Wire.beginTransmission(BMP280_ADDR);
+  Wire.write(0xF7);
+  if (Wire.endTransmission() != 0 || Wire.requestFrom((uint8_t)BMP280_ADDR, (uint8_t)6) != 6) {
+    return false;
+  }
+  uint8_t data[6];
+  for (uint8_t i = 0; i < 6; i++) data[i] = Wire.read();
+
+  int32_t adcP = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+  int32_t adcT = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+
+  const uint8_t* c = rtcState.bmpCalib;
+  uint16_t digT1 = c[0] | (c[1] << 8);
+  int16_t digT2 = c[2] | (c[3] << 8);
+  int16_t digT3 = c[4] | (c[5] << 8);
+  uint16_t digP1 = c[6] | (c[7] << 8);
+  int16_t digP[10];  // digP[2..9] = dig_P2..dig_P9
+  for (uint8_t k = 2; k <= 9; k++) {
+    digP[k] = c[6 + 2 * (k - 1)] | (c[7 + 2 * (k - 1)] << 8);
+  }
+
+  int32_t var1 = ((((adcT >> 3) - ((int32_t)digT1 << 1))) * digT2) >> 11;
+  int32_t var2 = (((((adcT >> 4) - (int32_t)digT1) * ((adcT >> 4) - (int32_t)digT1)) >> 12) * digT3) >> 14;
+  int32_t tFine = var1 + var2;
+
+  int64_t p1 = (int64_t)tFine - 128000;
+  int64_t p2 = p1 * p1 * digP[6];
+  p2 += (p1 * digP[5]) << 17;
+  p2 += (int64_t)digP[4] << 35;
+  p1 = ((p1 * p1 * digP[3]) >> 8) + ((p1 * digP[2]) << 12);
+  p1 = ((((int64_t)1) << 47) + p1) * digP1 >> 33;
+  if (p1 == 0) return false;  // Avoid division by zero (no calibration)
+
+  int64_t p = 1048576 - adcP;
+  p = (((p << 31) - p2) * 3125) / p1;
+  p1 = ((int64_t)digP[9] * (p >> 13) * (p >> 13)) >> 25;
+  p2 = ((int64_t)digP[8] * p) >> 19;
+  p = ((p + p1 + p2) >> 8) + ((int64_t)digP[7] << 4);
+
+  pressure = (uint32_t)p / 25600.0f;  // Q24.8 Pa -> hPa
+  return true;
+}
+
+/**
+ * Read the latest BH1750 measurement (continuous high-res mode, default MTreg)
+ */
+bool readBH1750(float& light) {
+  selectMuxChannel(MUX_CHANNEL_LIGHT);
+
+  if (Wire.requestFrom((uint8_t)BH1750_ADDR, (uint8_t)2) != 2) return false;
+  uint16_t raw = (uint16_t)Wire.read() << 8;
+  raw |= Wire.read();
+  light = raw / 1.2f;
+  return true;
+}
+
+/**
+ * Read all sensor data; the sample is buffered only if every present sensor answered
+ */
+void readSensors() {
+  if (DEBUG_SERIAL) {
+    Serial.println(F("[SENSOR] Reading..."));
+  }
+
+  bool ok = true;
+
+  // Start the AHT20 conversion first and read the others while it runs
+  bool readAht = rtcState.sensorMask & SENSOR_AHT20;
+  if (readAht && !triggerAHT20()) ok = false;
+
+  if (rtcState.sensorMask & SENSOR_BMP280) {
+    if (!readBMP280(sensorData.pressure)) ok = false;
+  }
+
+  if (rtcState.sensorMask & SENSOR_BH1750) {
+    if (!readBH1750(sensorData.light)) ok = false;
+  }
+
+  if (readAht && ok) {
+    if (!readAHT20(sensorData.temperature, sensorData.humidity)) ok = false;
+  }
+
+  if (!ok) {
+    Serial.println(F("[WARNING] Sensor read failed, sample skipped"));
+    return;
+  }
 
   if (DEBUG_SENSORS) {
-    Serial.print(F("[AHT20] T="));
+    Serial.print(F("[SENSOR] T="));
     Serial.print(sensorData.temperature);
     Serial.print(F("°C H="));
     Serial.print(sensorData.humidity);
-    Serial.println(F("%"));
+    Serial.print(F("% P="));
+    Serial.print(sensorData.pressure);
+    Serial.print(F(" hPa Light="));
+    Serial.print(sensorData.light);
+    Serial.println(F(" lux"));
   }
 
-  // Read BMP280
-  selectMuxChannel(MUX_CHANNEL_SENSORS);
-  sensorData.pressure = bmp280.readPressure() / 100.0;  // Convert to hPa
+  bufferSample();
+}
 
-  if (DEBUG_SENSORS) {
-    Serial.print(F("[BMP280] P="));
-    Serial.print(sensorData.pressure);
-    Serial.println(F(" hPa"));
+/**
+ * Channels this node can report, from the sensors found at cold boot
+ */
+uint8_t channelMask() {
+  uint8_t mask = 0;
+  if (rtcState.sensorMask & SENSOR_AHT20) mask |= WX_MASK(WX_CH_TEMPERATURE) | WX_MASK(WX_CH_HUMIDITY);
+  if (rtcState.sensorMask & SENSOR_BMP280) mask |= WX_MASK(WX_CH_PRESSURE);
+  if (rtcState.sensorMask & SENSOR_BH1750) mask |= WX_MASK(WX_CH_LIGHT);
+  return mask;
+}
+
+/**
+ * Append the latest reading to the RTC sample ring (overwrites the oldest when full)
+ */
+void bufferSample() {
+  if (rtcState.sampleCount == RTC_SAMPLE_CAPACITY) {
+    rtcState.sampleHead = (rtcState.sampleHead + 1) % RTC_SAMPLE_CAPACITY;
+    rtcState.sampleCount--;
+    rtcState.headSample++;  // Lost for good; the central sees the gap
   }
 
-  // Read BH1750
-  selectMuxChannel(MUX_CHANNEL_LIGHT);
-  if (bh1750.measurementReady()) {
-    sensorData.light = bh1750.readLightLevel();
+  RtcSample& sample = rtcState.samples[(rtcState.sampleHead + rtcState.sampleCount) % RTC_SAMPLE_CAPACITY];
+  rtcState.sampleCount++;
 
-    if (DEBUG_SENSORS) {
-      Serial.print(F("[BH1750] Light="));
-      Serial.print(sensorData.light);
-      Serial.println(F(" lux"));
-    }
-  }
+  sample.timestamp = nodeClock();
+  sample.temperature = constrain(wxToFixed(WX_CH_TEMPERATURE, sensorData.temperature), -32768, 32767);
+  sample.humidity = constrain(wxToFixed(WX_CH_HUMIDITY, sensorData.humidity), 0, 65535);
+  sample.pressure = constrain(wxToFixed(WX_CH_PRESSURE, sensorData.pressure) - RTC_PRESSURE_BASE, 0, 65535);
+  sample.light = constrain((int32_t)(sensorData.light + 0.5f), 0, 65535);
+}
 
-  sensorData.timestamp = millis();
+/**
+ * Expand a ring entry to the wire format
+ */
+WxSample ringSample(uint8_t index) {
+  const RtcSample& stored = rtcState.samples[(rtcState.sampleHead + index) % RTC_SAMPLE_CAPACITY];
+  WxSample sample;
+  sample.timestamp = stored.timestamp;
+  sample.values[WX_CH_TEMPERATURE] = stored.temperature;
+  sample.values[WX_CH_HUMIDITY] = stored.humidity;
+  sample.values[WX_CH_PRESSURE] = (int32_t)stored.pressure + RTC_PRESSURE_BASE;
+  sample.values[WX_CH_LIGHT] = (int32_t)stored.light * 10;
+  return sample;
 }
 
 // ============================================================================
@@ -308,47 +694,256 @@ void readSensors() {
 // ============================================================================
 
 /**
- * Send sensor data via ESP-NOW
+ * Bring up the radio and ESP-NOW with the peer kept in RTC memory
+ */
+void initESPNow() {
+  WiFi.persistent(false);  // Don't write WiFi config to flash on every wake
+  WiFi.mode(WIFI_STA);
+  wifi_set_channel(rtcState.channel);  // ESP8266 transmits on the current channel
+  WiFi.macAddress(ownMac);
+
+  if (esp_now_init() != 0) {
+    Serial.println(F("[ERROR] ESP-NOW initialization failed"));
+  }
+
+  esp_now_set_self_role(ESP_NOW_ROLE_COMBO);  // Also receives ACKs
+  esp_now_register_send_cb(onDataSent);
+  esp_now_register_recv_cb(onDataReceived);
+
+  addPeer(rtcState.centralMac);
+}
+
+/**
+ * Send all buffered samples via ESP-NOW as delta-encoded batch packets.
+ * Samples stay in the ring until the central acknowledges them.
  */
 void sendData() {
-  Serial.println(F("[ESPNOW] Sending data..."));
+  rtcState.lastSendMs = nodeClock();
 
-  uint8_t centralMAC[] = ESPNOW_MAC_CENTRAL;
+  uint8_t mask = channelMask();
+  if (mask == 0) {
+    Serial.println(F("[WARNING] No sensors, nothing to send"));
+    return;
+  }
+
+  if (rtcState.sampleCount == 0) {
+    readSensors();  // Try to send at least the current reading
+  }
+  if (rtcState.sampleCount == 0) {
+    return;
+  }
+
+  if (DEBUG_SERIAL) {
+    Serial.print(F("[ESPNOW] Sending "));
+    Serial.print(rtcState.sampleCount);
+    Serial.println(F(" samples..."));
+  }
+
+  uint8_t sent = 0;
+
+  // Normally one packet; split only if the samples exceed 250 bytes
+  while (sent < rtcState.sampleCount) {
+    rtcState.sequence++;
+    uint8_t packed = 0;
+
+    if (transmitBatch(sent, mask, packed)) {
+      sent += packed;
+      sendFailureCount = 0;
+    } else {
+      Serial.println(F("[ERROR] ESP-NOW batch not acknowledged"));
+      sendFailureCount++;
+      break;  // Store and forward: the rest stays in RTC memory for the next transmit
+    }
+  }
+
+  // Drop the acknowledged samples
+  rtcState.sampleHead = (rtcState.sampleHead + sent) % RTC_SAMPLE_CAPACITY;
+  rtcState.headSample += sent;
+  rtcState.sampleCount -= sent;
+
+  if (DEBUG_SERIAL && rtcState.sampleCount > 0) {
+    Serial.print(F("[ESPNOW] "));
+    Serial.print(rtcState.sampleCount);
+    Serial.println(F(" samples kept for the next transmit"));
+  }
+
+  if (probeWindowMs > 0) {
+    echoProbes();
+  }
+}
+
+/**
+ * Link diagnostics: stay awake for the window the central granted in its ACK
+ * and return every probe as soon as it arrives
+ */
+void echoProbes() {
+  unsigned long start = millis();
+  uint16_t window = probeWindowMs;
+  probeWindowMs = 0;
+  probeLength = 0;
+
+  // Ready echo (probeId 0): the central starts probing once it hears it
+  ProbePacket ready;
+  memset(&ready, 0, sizeof(ready));
+  ready.version = ESPNOW_PROTOCOL_VERSION;
+  ready.msgType = ESPNOW_MSG_ECHO;
+  memcpy(ready.target, ownMac, 6);
+  esp_now_send(rtcState.centralMac, (uint8_t*)&ready, sizeof(ready));
+
+  uint8_t echo[ESPNOW_MAX_PAYLOAD];
+  uint16_t echoed = 0;
+
+  while (millis() - start < window) {
+    if (probeLength > 0) {
+      uint8_t length = probeLength;
+      memcpy(echo, probeFrame, length);
+      probeLength = 0;  // The central sends the next probe only after this echo
+
+      echo[offsetof(ProbePacket, msgType)] = ESPNOW_MSG_ECHO;
+      esp_now_send(rtcState.centralMac, echo, length);
+      echoed++;
+
+      if (echo[offsetof(ProbePacket, remaining)] == 0) break;
+    }
+    yield();
+  }
+
+  probeAwakeMs += millis() - start;
+
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[DIAG] Echoed "));
+    Serial.print(echoed);
+    Serial.print(F(" probes in "));
+    Serial.print(millis() - start);
+    Serial.println(F(" ms"));
+  }
+}
+
+/**
+ * Encode ring samples from offset on into one batch packet (current sequence)
+ * @return number of samples packed
+ */
+uint8_t buildBatch(uint8_t offset, uint8_t mask, uint8_t attempt) {
+  batchEncoder.begin(NODE_ID, NODE_TYPE, rtcState.sequence, nodeClock(), mask);
+  batchEncoder.setWakeTimes(rtcState.sendWakeMs, rtcState.readWakeMs);
+  batchEncoder.setFlags((rtcState.flags & RTC_FLAG_IN_SLOT) ? BATCH_FLAG_IN_SLOT : 0);
+  batchEncoder.setDelivery(rtcState.headSample + offset, attempt);
+
+  uint8_t packed = 0;
+  while (offset + packed < rtcState.sampleCount && batchEncoder.add(ringSample(offset + packed))) {
+    packed++;
+  }
+  return packed;
+}
 
-  int result = esp_now_send(centralMAC, (uint8_t*)&sensorData, sizeof(sensorData));
+/**
+ * Send one batch, retrying with backoff and jitter until the central ACKs it
+ * @param packed set to the number of samples in the batch
+ * @return true once acknowledged
+ */
+bool transmitBatch(uint8_t offset, uint8_t mask, uint8_t& packed) {
+  for (uint8_t attempt = 0; attempt <= ESPNOW_MAX_RETRIES; attempt++) {
+    if (attempt > 0) {
+      // Exponential backoff plus jitter, so nodes that collided do not retry in lockstep
+      delay((ESPNOW_RETRY_BACKOFF_MS << (attempt - 1)) + random(ESPNOW_RETRY_JITTER_MS + 1));
+    }
+
+    // Re-encoded every attempt so sample ages stay relative to this transmission
+    packed = buildBatch(offset, mask, attempt);
+    if (packed == 0) return false;
+
+    sendDone = false;
+    ackReceived = false;
+    int result = esp_now_send(rtcState.centralMac, (uint8_t*)batchEncoder.data(), batchEncoder.size());
+
+    // Wait for the MAC-layer ACK instead of a fixed delay
+    unsigned long start = millis();
+    while (result == 0 && !sendDone && millis() - start < ESPNOW_SEND_TIMEOUT) {
+      yield();
+    }
+
+    // Then for the central's ACK (delivery, time sync and our slot)
+    if (result == 0 && sendDone && sendStatus == 0) {
+      start = millis();
+      while (!ackReceived && millis() - start < ESPNOW_ACK_TIMEOUT) {
+        yield();
+      }
+    }
+
+    if (ackReceived) {
+      if (DEBUG_ESPNOW) {
+        Serial.print(F("[ESPNOW] Batch acknowledged, bytes: "));
+        Serial.print(batchEncoder.size());
+        Serial.print(F(", attempt "));
+        Serial.println(attempt);
+      }
+      applyTimeSync(lastAck, ackReceivedAt);
+      probeWindowMs = lastAck.probeWindowMs < DIAG_MAX_WINDOW_MS ? lastAck.probeWindowMs : DIAG_MAX_WINDOW_MS;
+      return true;
+    }
 
-  if (result == 0) {
     if (DEBUG_ESPNOW) {
-      Serial.println(F("[ESPNOW] Send initiated"));
+      Serial.print(F("[ESPNOW] No ACK, result "));
+      Serial.print(result);
+      Serial.print(F(", status "));
+      Serial.println(sendDone ? sendStatus : -1);
     }
-    sendFailureCount = 0;
-  } else {
-    Serial.print(F("[ERROR] ESP-NOW send failed: "));
-    Serial.println(result);
-    sendFailureCount++;
   }
+
+  return false;
 }
 
 /**
  * Add peer for ESP-NOW
  */
 void addPeer(uint8_t* macAddr) {
-  esp_now_add_peer(macAddr, ESP_NOW_ROLE_SLAVE, ESPNOW_CHANNEL, NULL, 0);
+  esp_now_add_peer(macAddr, ESP_NOW_ROLE_SLAVE, rtcState.channel, NULL, 0);
 
-  Serial.print(F("[ESPNOW] Added peer: "));
-  for (int i = 0; i < 6; i++) {
-    Serial.print(macAddr[i], HEX);
-    if (i < 5) Serial.print(":");
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[ESPNOW] Added peer: "));
+    for (int i = 0; i < 6; i++) {
+      Serial.print(macAddr[i], HEX);
+      if (i < 5) Serial.print(":");
+    }
+    Serial.println();
   }
-  Serial.println();
 }
 
 /**
  * ESP-NOW send callback
  */
-void onDataSent(uint8_t* mac_addr, uint8_t sendStatus) {
+void onDataSent(uint8_t* mac_addr, uint8_t status) {
+  sendStatus = status;
+  sendDone = true;
+
   if (DEBUG_ESPNOW) {
     Serial.print(F("[ESPNOW] Send status: "));
-    Serial.println(sendStatus == 0 ? F("Success") : F("Failed"));
+    Serial.println(status == 0 ? F("Success") : F("Failed"));
+  }
+}
+
+/**
+ * ESP-NOW receive callback: ACK with time sync and slot assignment, or a
+ * diagnostics probe (kept for echoProbes())
+ */
+void onDataReceived(uint8_t* mac_addr, uint8_t* data, uint8_t data_len) {
+  if (data_len >= 2 && data[1] == ESPNOW_MSG_PROBE) {
+    ProbePacket probe;
+    if (probeLength == 0 && memcmp(mac_addr, rtcState.centralMac, 6) == 0 &&
+        parseProbe(data, data_len, ESPNOW_MSG_PROBE, probe) && memcmp(probe.target, ownMac, 6) == 0) {
+      memcpy(probeFrame, data, data_len);
+      probeLength = data_len;
+    }
+    return;
   }
+
+  AckPacket ack;
+  if (ackReceived || memcmp(mac_addr, rtcState.centralMac, 6) != 0 ||
+      !parseAck(data, data_len, ownMac, ack) || ack.sequence != rtcState.sequence) {
+    return;  // Not for us, or stale
+  }
+
+  lastAck = ack;
+  ackReceivedAt = nodeClock();
+  ackReceived = true;
 }
@@ -39,8 +39,21 @@
 // Update Intervals (milliseconds)
 // ============================================================================
 #define SENSOR_READ_INTERVAL 30000  // Read every 30 seconds
-#define DATA_SEND_INTERVAL 300000   // Send to central every 5 minutes
-#define DEEP_SLEEP_TIME 300000      // 5 minutes deep sleep
+#define DATA_SEND_INTERVAL 300000   // Send to central every 5 minutes (until the central assigns a slot)
+
+// With deep sleep the node wakes once per SENSOR_READ_INTERVAL: read, append
+// to the RTC sample ring, transmit only when DATA_SEND_INTERVAL has elapsed.
+// Readings buffered between transmits (10 expected per send interval + margin,
+// sized to fit RTC user memory)
+#define RTC_SAMPLE_CAPACITY 48
+
+#define ESPNOW_SEND_TIMEOUT 50      // Max wait for the MAC-layer send callback (ms)
+#define ESPNOW_ACK_TIMEOUT 30       // Max wait for the central's ACK / time sync (ms)
+#define ESPNOW_MAX_RETRIES 3        // Retransmissions per batch before keeping it for later
+#define ESPNOW_RETRY_BACKOFF_MS 10  // First retry delay, doubled on every further retry
+#define ESPNOW_RETRY_JITTER_MS 20   // Random extra delay per retry (0..n ms)
+#define MIN_SLEEP_TIME 1000         // Never sleep shorter than this (ms)
+#define DIAG_MAX_WINDOW_MS 500      // Cap on the central's link diagnostics window (awake time)
 
 // ============================================================================
 // Timing Configuration
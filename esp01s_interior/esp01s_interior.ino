@@ -17,6 +17,7 @@
 
 #include "config.h"
 #include "secrets.h"
+#include "espnow_protocol.h"
 
 // ============================================================================
 // Global Objects
@@ -24,25 +25,71 @@
 DHT dht(DHT_PIN, DHT22);
 
 // ============================================================================
-// Data Structure for ESP-NOW
+// Sensor Data (every valid reading is buffered for the next batch)
 // ============================================================================
+#define NODE_CHANNEL_MASK (WX_MASK(WX_CH_TEMPERATURE) | WX_MASK(WX_CH_HUMIDITY))
+
+// ============================================================================
+// RTC State (survives deep sleep; setup() runs again on every wake)
+// ============================================================================
+#define RTC_STATE_MAGIC 0x57534E34  // "WSN4" (bump when the layout changes)
+#define RTC_FLAG_SEND_NEXT 0x01     // Next wake transmits (radio calibrated on wake)
+#define RTC_FLAG_SYNCED 0x02        // Clock and slot received from the central node
+#define RTC_FLAG_IN_SLOT 0x04       // Next wake lands on the assigned TDMA slot
+#define MAX_DRIFT_PPM 100000        // Sleep timer correction limit (10%)
+
+// Compact sample for RTC memory (8 bytes instead of the 20-byte WxSample)
+typedef struct {
+  uint32_t timestamp;    // Node clock, ms
+  int16_t temperature;   // centi-degC
+  uint16_t humidity;     // centi-%RH
+} RtcSample;
+
 typedef struct {
-  char nodeType[16];
-  float temperature;
-  float humidity;
-  float pressure;
-  float light;
-  int32_t rssi;
-  unsigned long timestamp;
-} ESPNowData;
+  uint32_t magic;
+  uint32_t crc;          // CRC32 of everything after this field
+  uint32_t sequence;     // Last packet sequence number sent
+  uint32_t headSample;   // Sample number of the oldest sample in the ring
+  uint32_t clockMs;      // Node clock at the start of this wake
+  uint32_t lastSendMs;   // Node clock of the last transmit
+  uint32_t nextSendMs;   // Node clock of the next assigned slot (valid when synced)
+  uint32_t sendIntervalMs; // Transmit period (TDMA frame from the central node)
+  uint32_t lastSyncMs;   // Node clock of the last time sync
+  int32_t driftPpm;      // Measured sleep timer error, applied to every deep sleep
+  uint16_t sendWakeMs;   // Measured wake-to-sleep time of the last transmit cycle
+  uint16_t readWakeMs;   // Same for the last read-only cycle
+  uint8_t centralMac[6]; // ESP-NOW peer
+  uint8_t channel;
+  uint8_t sampleHead;    // Oldest sample in the ring
+  uint8_t sampleCount;
+  uint8_t flags;         // RTC_FLAG_*
+  uint8_t reserved[2];
+  RtcSample samples[RTC_SAMPLE_CAPACITY];
+} RTCState;
+
+static_assert(sizeof(RTCState) <= 512, "RTC user memory is 512 bytes");
+static_assert(sizeof(RTCState) % 4 == 0, "RTC memory is accessed in 32-bit words");
+static_assert(RTC_SAMPLE_CAPACITY <= 255, "ring indices are uint8_t");
 
 // ============================================================================
 // Global State
 // ============================================================================
-ESPNowData sensorData;
+BatchEncoder batchEncoder;
 unsigned long lastSendTime = 0;
 unsigned long lastReadTime = 0;
 uint8_t sendFailureCount = 0;
+RTCState rtcState;
+bool warmWake = false;           // Woke from deep sleep with valid RTC state
+volatile bool sendDone = false;  // Set by the ESP-NOW send callback
+volatile uint8_t sendStatus = 0;
+volatile bool ackReceived = false;  // Set by the ESP-NOW receive callback
+AckPacket lastAck;
+uint16_t probeWindowMs = 0;         // Diagnostics window granted by the last ACK
+uint32_t probeAwakeMs = 0;          // Time spent echoing probes this wake
+uint8_t probeFrame[ESPNOW_MAX_PAYLOAD];  // Probe waiting to be echoed
+volatile uint8_t probeLength = 0;
+uint32_t ackReceivedAt = 0;         // Node clock when lastAck arrived
+uint8_t ownMac[6];
 
 // ============================================================================
 // Setup Function
@@ -50,12 +97,52 @@ uint8_t sendFailureCount = 0;
 void setup() {
   // Initialize serial for debugging
   Serial.begin(115200);
-  delay(1000);
+
+  warmWake = restoreState();
+
+  if (warmWake) {
+    dht.begin();  // Pin setup only; the sensor stayed powered and settled
+  } else {
+    coldBoot();
+  }
+
+  if (!ENABLE_DEEP_SLEEP) {
+    initESPNow();
+    setStatusLED(LED_OK);
+    Serial.println(F("[INIT] Setup complete\n"));
+    return;
+  }
+
+  // Fast path: read, transmit if due, sleep
+  bool transmit = (rtcState.flags & RTC_FLAG_SEND_NEXT) != 0;
+  readSensors();
+
+  if (transmit) {
+    initESPNow();
+    sendData();
+  }
+
+  enterDeepSleep(transmit);
+}
+
+/**
+ * Full initialization after power-on or reset: settle the sensor, start fresh RTC state
+ */
+void coldBoot() {
+  delay(1000);  // Give the serial monitor time to attach
 
   Serial.println(F("\n\n========================================"));
   Serial.println(F("ESP-01S Interior Node - DHT22"));
   Serial.println(F("========================================\n"));
 
+  memset(&rtcState, 0, sizeof(rtcState));
+  rtcState.magic = RTC_STATE_MAGIC;
+  uint8_t centralMAC[] = ESPNOW_MAC_CENTRAL;
+  memcpy(rtcState.centralMac, centralMAC, 6);
+  rtcState.channel = ESPNOW_CHANNEL;
+  rtcState.sendIntervalMs = DATA_SEND_INTERVAL;
+  rtcState.flags = RTC_FLAG_SEND_NEXT;  // Announce the node right away, get a slot
+
   // Initialize GPIO
   pinMode(D0, OUTPUT);  // Status LED (optional)
   digitalWrite(D0, LOW);
@@ -68,10 +155,6 @@ void setup() {
     // Continue anyway
   }
 
-  // Initialize WiFi for ESP-NOW
-  WiFi.mode(WIFI_STA);
-  WiFi.disconnect();  // Disable normal WiFi
-
   // Get this node's MAC address
   uint8_t macAddr[6];
   WiFi.macAddress(macAddr);
@@ -81,38 +164,10 @@ void setup() {
     if (i < 5) Serial.print(":");
   }
   Serial.println();
-
-  // Initialize ESP-NOW
-  if (esp_now_init() != 0) {
-    Serial.println(F("[ERROR] ESP-NOW initialization failed"));
-    setStatusLED(LED_ERROR);
-    delay(5000);
-  }
-
-  // Register send callback
-  esp_now_set_self_role(ESP_NOW_ROLE_CONTROLLER);
-  esp_now_register_send_cb(onDataSent);
-  esp_now_register_recv_cb(onDataReceived);
-
-  // Add central node as peer
-  uint8_t centralMAC[] = ESPNOW_MAC_CENTRAL;
-  addPeer(centralMAC);
-
-  // Initialize ESP-NOW data structure
-  strcpy(sensorData.nodeType, NODE_TYPE);
-  sensorData.temperature = 0;
-  sensorData.humidity = 0;
-  sensorData.pressure = 0;
-  sensorData.light = 0;
-  sensorData.rssi = 0;
-  sensorData.timestamp = millis();
-
-  setStatusLED(LED_OK);
-  Serial.println(F("[INIT] Setup complete\n"));
 }
 
 // ============================================================================
-// Main Loop
+// Main Loop (only reached with deep sleep disabled)
 // ============================================================================
 void loop() {
   unsigned long now = millis();
@@ -123,19 +178,16 @@ void loop() {
     lastReadTime = now;
   }
 
-  // Send data periodically
-  if (now - lastSendTime >= DATA_SEND_INTERVAL) {
+  // Send data periodically, on the assigned slot once the central has synced us
+  bool synced = rtcState.flags & RTC_FLAG_SYNCED;
+  if (synced ? (int32_t)(nodeClock() - rtcState.nextSendMs) >= 0 : now - lastSendTime >= DATA_SEND_INTERVAL) {
+    if (synced) rtcState.flags |= RTC_FLAG_IN_SLOT;
     sendData();
     lastSendTime = now;
 
-    // After sending, prepare for deep sleep
-    if (ENABLE_DEEP_SLEEP) {
-      Serial.println(F("[SLEEP] Entering deep sleep..."));
-      delay(100);  // Let serial flush
-
-      // Deep sleep for 5 minutes
-      ESP.deepSleep(DEEP_SLEEP_TIME * 1000);
-      // Note: After deep sleep, setup() runs again
+    // No ACK = no new slot; keep the current one
+    while ((rtcState.flags & RTC_FLAG_SYNCED) && (int32_t)(nodeClock() - rtcState.nextSendMs) >= 0) {
+      rtcState.nextSendMs += rtcState.sendIntervalMs;
     }
   }
 
@@ -143,6 +195,153 @@ void loop() {
   delay(100);
 }
 
+// ============================================================================
+// RTC State
+// ============================================================================
+
+/**
+ * CRC32 (IEEE 802.3, bitwise; runs once per wake over <512 bytes)
+ */
+uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t stateCrc() {
+  const uint8_t* start = (const uint8_t*)&rtcState + offsetof(RTCState, crc) + sizeof(rtcState.crc);
+  return crc32(start, sizeof(rtcState) - (start - (const uint8_t*)&rtcState));
+}
+
+/**
+ * Load RTC state after a deep sleep wake
+ * @return true if the state is valid (warm wake), false on power-on/reset
+ */
+bool restoreState() {
+  if (ESP.getResetInfoPtr()->reason != REASON_DEEP_SLEEP_AWAKE) {
+    return false;
+  }
+
+  ESP.rtcUserMemoryRead(0, (uint32_t*)&rtcState, sizeof(rtcState));
+  return rtcState.magic == RTC_STATE_MAGIC && rtcState.crc == stateCrc() &&
+         rtcState.sampleHead < RTC_SAMPLE_CAPACITY && rtcState.sampleCount <= RTC_SAMPLE_CAPACITY;
+}
+
+void saveState() {
+  rtcState.crc = stateCrc();
+  ESP.rtcUserMemoryWrite(0, (uint32_t*)&rtcState, sizeof(rtcState));
+}
+
+/**
+ * Node clock: continues across deep sleep (ROM boot time is not counted)
+ */
+uint32_t nodeClock() {
+  return rtcState.clockMs + millis();
+}
+
+/**
+ * Adopt the central clock from an ACK and schedule the next transmit on the assigned slot
+ */
+void applyTimeSync(const AckPacket& ack, uint32_t receivedAt) {
+  int32_t offset = (int32_t)(ack.centralTime - receivedAt);
+
+  if (rtcState.flags & RTC_FLAG_SYNCED) {
+    // Residual offset since the last sync = sleep timer drift not yet corrected
+    uint32_t elapsed = receivedAt - rtcState.lastSyncMs;
+    if (elapsed > 0 && (uint32_t)abs(offset) < elapsed / 10) {  // Else the central rebooted
+      int32_t residualPpm = (int64_t)offset * 1000000 / elapsed;
+      rtcState.driftPpm = constrain(rtcState.driftPpm + residualPpm / 2, -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+    }
+  }
+
+  // Move the node clock (and everything stamped with it) onto the central time base
+  rtcState.clockMs += offset;
+  rtcState.lastSendMs += offset;
+  for (uint8_t i = 0; i < rtcState.sampleCount; i++) {
+    rtcState.samples[(rtcState.sampleHead + i) % RTC_SAMPLE_CAPACITY].timestamp += offset;
+  }
+
+  rtcState.lastSyncMs = ack.centralTime;
+  rtcState.nextSendMs = ack.centralTime + ack.nextSlotMs;
+  rtcState.sendIntervalMs = ack.frameMs;
+  rtcState.flags |= RTC_FLAG_SYNCED;
+
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[SYNC] Slot "));
+    Serial.print(ack.slot);
+    Serial.print(F(" in "));
+    Serial.print(ack.nextSlotMs);
+    Serial.print(F(" ms, offset "));
+    Serial.print(offset);
+    Serial.print(F(" ms, drift "));
+    Serial.print(rtcState.driftPpm);
+    Serial.println(F(" ppm"));
+  }
+}
+
+/**
+ * Record the measured awake time and sleep until the next reading is due.
+ * Once synced, reads are phased so that one wake lands exactly on the slot.
+ */
+void enterDeepSleep(bool transmitted) {
+  uint32_t awakeMs = millis();
+  uint32_t cycleMs = awakeMs - probeAwakeMs;  // Diagnostics are not part of the cycle
+  if (transmitted) {
+    rtcState.sendWakeMs = cycleMs > 0xFFFF ? 0xFFFF : cycleMs;
+  } else {
+    rtcState.readWakeMs = cycleMs > 0xFFFF ? 0xFFFF : cycleMs;
+  }
+
+  uint32_t now = rtcState.clockMs + awakeMs;
+  uint32_t sleepMs;
+  bool slotWake = false;
+  bool sendNext;
+
+  if (rtcState.flags & RTC_FLAG_SYNCED) {
+    // A slot too close to reach is skipped (the central counts it as missed)
+    while ((int32_t)(rtcState.nextSendMs - now) < MIN_SLEEP_TIME) {
+      rtcState.nextSendMs += rtcState.sendIntervalMs;
+    }
+    uint32_t untilSlot = rtcState.nextSendMs - now;
+    sleepMs = untilSlot % SENSOR_READ_INTERVAL;
+    if (sleepMs < MIN_SLEEP_TIME) sleepMs += SENSOR_READ_INTERVAL;
+    slotWake = sleepMs == untilSlot;
+    sendNext = slotWake;
+  } else {
+    // Not synced yet: free-running, transmit when the send interval has elapsed
+    // (half a read interval early rather than a whole one late)
+    sleepMs = SENSOR_READ_INTERVAL > awakeMs + MIN_SLEEP_TIME
+                ? SENSOR_READ_INTERVAL - awakeMs : MIN_SLEEP_TIME;
+    sendNext = now + sleepMs - rtcState.lastSendMs + SENSOR_READ_INTERVAL / 2 >= rtcState.sendIntervalMs;
+  }
+
+  // Never let the ring overflow, even off-slot
+  if (rtcState.sampleCount >= RTC_SAMPLE_CAPACITY - 1) sendNext = true;
+
+  rtcState.clockMs = now + sleepMs;
+  rtcState.flags &= ~(RTC_FLAG_SEND_NEXT | RTC_FLAG_IN_SLOT);
+  if (sendNext) rtcState.flags |= RTC_FLAG_SEND_NEXT;
+  if (slotWake) rtcState.flags |= RTC_FLAG_IN_SLOT;
+  saveState();
+
+  if (DEBUG_SERIAL) {
+    Serial.print(F("[SLEEP] Awake "));
+    Serial.print(awakeMs);
+    Serial.println(F(" ms"));
+    Serial.flush();
+  }
+
+  // Correct the requested time by the measured drift of the sleep timer.
+  // Read-only wakes skip RF calibration and never power the radio.
+  uint64_t sleepUs = (uint64_t)sleepMs * 1000 * 1000000 / (1000000 + rtcState.driftPpm);
+  ESP.deepSleep(sleepUs, sendNext ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+}
+
 // ============================================================================
 // Helper Functions
 // ============================================================================
@@ -181,9 +380,19 @@ void readSensors() {
     return;
   }
 
-  sensorData.temperature = temp;
-  sensorData.humidity = humidity;
-  sensorData.timestamp = millis();
+  // Buffer the reading in the RTC ring for the next batch (overwrite the oldest when full)
+  if (rtcState.sampleCount == RTC_SAMPLE_CAPACITY) {
+    rtcState.sampleHead = (rtcState.sampleHead + 1) % RTC_SAMPLE_CAPACITY;
+    rtcState.sampleCount--;
+    rtcState.headSample++;  // Lost for good; the central sees the gap
+  }
+
+  RtcSample& sample = rtcState.samples[(rtcState.sampleHead + rtcState.sampleCount) % RTC_SAMPLE_CAPACITY];
+  rtcState.sampleCount++;
+
+  sample.timestamp = nodeClock();
+  sample.temperature = constrain(wxToFixed(WX_CH_TEMPERATURE, temp), -32768, 32767);
+  sample.humidity = constrain(wxToFixed(WX_CH_HUMIDITY, humidity), 0, 65535);
 
   if (DEBUG_DHT) {
     Serial.print(F("[DHT22] Temp: "));
@@ -197,63 +406,268 @@ void readSensors() {
 }
 
 /**
- * Send data via ESP-NOW
+ * Expand a ring entry to the wire format
+ */
+WxSample ringSample(uint8_t index) {
+  const RtcSample& stored = rtcState.samples[(rtcState.sampleHead + index) % RTC_SAMPLE_CAPACITY];
+  WxSample sample;
+  sample.timestamp = stored.timestamp;
+  sample.values[WX_CH_TEMPERATURE] = stored.temperature;
+  sample.values[WX_CH_HUMIDITY] = stored.humidity;
+  return sample;
+}
+
+/**
+ * Bring up the radio and ESP-NOW with the peer kept in RTC memory
+ */
+void initESPNow() {
+  WiFi.persistent(false);  // Don't write WiFi config to flash on every wake
+  WiFi.mode(WIFI_STA);
+  wifi_set_channel(rtcState.channel);  // ESP8266 transmits on the current channel
+  WiFi.macAddress(ownMac);
+
+  if (esp_now_init() != 0) {
+    Serial.println(F("[ERROR] ESP-NOW initialization failed"));
+    setStatusLED(LED_ERROR);
+  }
+
+  // Register send callback
+  esp_now_set_self_role(ESP_NOW_ROLE_COMBO);  // Also receives ACKs
+  esp_now_register_send_cb(onDataSent);
+  esp_now_register_recv_cb(onDataReceived);
+
+  addPeer(rtcState.centralMac);
+}
+
+/**
+ * Send all buffered samples via ESP-NOW as delta-encoded batch packets.
+ * Samples stay in the ring until the central acknowledges them.
  */
 void sendData() {
-  Serial.println(F("[ESPNOW] Sending data..."));
+  rtcState.lastSendMs = nodeClock();
 
-  uint8_t centralMAC[] = ESPNOW_MAC_CENTRAL;
+  if (rtcState.sampleCount == 0) {
+    readSensors();  // Try to send at least the current reading
+  }
+  if (rtcState.sampleCount == 0) {
+    Serial.println(F("[WARNING] No valid DHT22 samples to send"));
+    return;
+  }
+
+  if (DEBUG_SERIAL) {
+    Serial.print(F("[ESPNOW] Sending "));
+    Serial.print(rtcState.sampleCount);
+    Serial.println(F(" samples..."));
+  }
+
+  uint8_t sent = 0;
+
+  // Normally one packet; split only if the samples exceed 250 bytes
+  while (sent < rtcState.sampleCount) {
+    rtcState.sequence++;
+    uint8_t packed = 0;
+
+    if (transmitBatch(sent, packed)) {
+      sent += packed;
+      sendFailureCount = 0;
+    } else {
+      Serial.println(F("[ERROR] ESP-NOW batch not acknowledged"));
+      sendFailureCount++;
+      setStatusLED(LED_ERROR);
+      break;  // Store and forward: the rest stays in RTC memory for the next transmit
+    }
+  }
+
+  // Drop the acknowledged samples
+  rtcState.sampleHead = (rtcState.sampleHead + sent) % RTC_SAMPLE_CAPACITY;
+  rtcState.headSample += sent;
+  rtcState.sampleCount -= sent;
+
+  if (DEBUG_SERIAL && rtcState.sampleCount > 0) {
+    Serial.print(F("[ESPNOW] "));
+    Serial.print(rtcState.sampleCount);
+    Serial.println(F(" samples kept for the next transmit"));
+  }
+
+  if (probeWindowMs > 0) {
+    echoProbes();
+  }
+}
+
+/**
+ * Link diagnostics: stay awake for the window the central granted in its ACK
+ * and return every probe as soon as it arrives
+ */
+void echoProbes() {
+  unsigned long start = millis();
+  uint16_t window = probeWindowMs;
+  probeWindowMs = 0;
+  probeLength = 0;
+
+  // Ready echo (probeId 0): the central starts probing once it hears it
+  ProbePacket ready;
+  memset(&ready, 0, sizeof(ready));
+  ready.version = ESPNOW_PROTOCOL_VERSION;
+  ready.msgType = ESPNOW_MSG_ECHO;
+  memcpy(ready.target, ownMac, 6);
+  esp_now_send(rtcState.centralMac, (uint8_t*)&ready, sizeof(ready));
+
+  uint8_t echo[ESPNOW_MAX_PAYLOAD];
+  uint16_t echoed = 0;
+
+  while (millis() - start < window) {
+    if (probeLength > 0) {
+      uint8_t length = probeLength;
+      memcpy(echo, probeFrame, length);
+      probeLength = 0;  // The central sends the next probe only after this echo
+
+      echo[offsetof(ProbePacket, msgType)] = ESPNOW_MSG_ECHO;
+      esp_now_send(rtcState.centralMac, echo, length);
+      echoed++;
+
+      if (echo[offsetof(ProbePacket, remaining)] == 0) break;
+    }
+    yield();
+  }
+
+  probeAwakeMs += millis() - start;
+
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[DIAG] Echoed "));
+    Serial.print(echoed);
+    Serial.print(F(" probes in "));
+    Serial.print(millis() - start);
+    Serial.println(F(" ms"));
+  }
+}
 
-  int result = esp_now_send(centralMAC, (uint8_t*)&sensorData, sizeof(sensorData));
+/**
+ * Encode ring samples from offset on into one batch packet (current sequence)
+ * @return number of samples packed
+ */
+uint8_t buildBatch(uint8_t offset, uint8_t attempt) {
+  batchEncoder.begin(NODE_ID, NODE_TYPE, rtcState.sequence, nodeClock(), NODE_CHANNEL_MASK);
+  batchEncoder.setWakeTimes(rtcState.sendWakeMs, rtcState.readWakeMs);
+  batchEncoder.setFlags((rtcState.flags & RTC_FLAG_IN_SLOT) ? BATCH_FLAG_IN_SLOT : 0);
+  batchEncoder.setDelivery(rtcState.headSample + offset, attempt);
+
+  uint8_t packed = 0;
+  while (offset + packed < rtcState.sampleCount && batchEncoder.add(ringSample(offset + packed))) {
+    packed++;
+  }
+  return packed;
+}
+
+/**
+ * Send one batch, retrying with backoff and jitter until the central ACKs it
+ * @param packed set to the number of samples in the batch
+ * @return true once acknowledged
+ */
+bool transmitBatch(uint8_t offset, uint8_t& packed) {
+  for (uint8_t attempt = 0; attempt <= ESPNOW_MAX_RETRIES; attempt++) {
+    if (attempt > 0) {
+      // Exponential backoff plus jitter, so nodes that collided do not retry in lockstep
+      delay((ESPNOW_RETRY_BACKOFF_MS << (attempt - 1)) + random(ESPNOW_RETRY_JITTER_MS + 1));
+    }
+
+    // Re-encoded every attempt so sample ages stay relative to this transmission
+    packed = buildBatch(offset, attempt);
+    if (packed == 0) return false;
+
+    sendDone = false;
+    ackReceived = false;
+    int result = esp_now_send(rtcState.centralMac, (uint8_t*)batchEncoder.data(), batchEncoder.size());
+
+    // Wait for the MAC-layer ACK instead of a fixed delay
+    unsigned long start = millis();
+    while (result == 0 && !sendDone && millis() - start < ESPNOW_SEND_TIMEOUT) {
+      yield();
+    }
+
+    // Then for the central's ACK (delivery, time sync and our slot)
+    if (result == 0 && sendDone && sendStatus == 0) {
+      start = millis();
+      while (!ackReceived && millis() - start < ESPNOW_ACK_TIMEOUT) {
+        yield();
+      }
+    }
+
+    if (ackReceived) {
+      if (DEBUG_ESPNOW) {
+        Serial.print(F("[ESPNOW] Batch acknowledged, bytes: "));
+        Serial.print(batchEncoder.size());
+        Serial.print(F(", attempt "));
+        Serial.println(attempt);
+      }
+      applyTimeSync(lastAck, ackReceivedAt);
+      probeWindowMs = lastAck.probeWindowMs < DIAG_MAX_WINDOW_MS ? lastAck.probeWindowMs : DIAG_MAX_WINDOW_MS;
+      return true;
+    }
 
-  if (result == 0) {
     if (DEBUG_ESPNOW) {
-      Serial.println(F("[ESPNOW] Send initiated"));
+      Serial.print(F("[ESPNOW] No ACK, result "));
+      Serial.print(result);
+      Serial.print(F(", status "));
+      Serial.println(sendDone ? sendStatus : -1);
     }
-    sendFailureCount = 0;
-  } else {
-    Serial.print(F("[ERROR] ESP-NOW send failed: "));
-    Serial.println(result);
-    sendFailureCount++;
-    setStatusLED(LED_ERROR);
   }
+
+  return false;
 }
 
 /**
  * Add peer for ESP-NOW communication
  */
 void addPeer(uint8_t* macAddr) {
-  esp_now_add_peer(macAddr, ESP_NOW_ROLE_SLAVE, ESPNOW_CHANNEL, NULL, 0);
+  esp_now_add_peer(macAddr, ESP_NOW_ROLE_SLAVE, rtcState.channel, NULL, 0);
 
-  Serial.print(F("[ESPNOW] Added peer: "));
-  for (int i = 0; i < 6; i++) {
-    Serial.print(macAddr[i], HEX);
-    if (i < 5) Serial.print(":");
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[ESPNOW] Added peer: "));
+    for (int i = 0; i < 6; i++) {
+      Serial.print(macAddr[i], HEX);
+      if (i < 5) Serial.print(":");
+    }
+    Serial.println();
   }
-  Serial.println();
 }
 
 /**
  * ESP-NOW send callback
  */
-void onDataSent(uint8_t* mac_addr, uint8_t sendStatus) {
+void onDataSent(uint8_t* mac_addr, uint8_t status) {
+  sendStatus = status;
+  sendDone = true;
+
   if (DEBUG_ESPNOW) {
     Serial.print(F("[ESPNOW] Send status: "));
-    Serial.println(sendStatus == 0 ? F("Success") : F("Failed"));
+    Serial.println(status == 0 ? F("Success") : F("Failed"));
   }
 }
 
 /**
- * ESP-NOW receive callback (for future commands)
+ * ESP-NOW receive callback: ACK with time sync and slot assignment, or a
+ * diagnostics probe (kept for echoProbes())
  */
 void onDataReceived(uint8_t* mac_addr, uint8_t* data, uint8_t data_len) {
-  if (DEBUG_ESPNOW) {
-    Serial.print(F("[ESPNOW] Received "));
-    Serial.print(data_len);
-    Serial.println(F(" bytes"));
+  if (data_len >= 2 && data[1] == ESPNOW_MSG_PROBE) {
+    ProbePacket probe;
+    if (probeLength == 0 && memcmp(mac_addr, rtcState.centralMac, 6) == 0 &&
+        parseProbe(data, data_len, ESPNOW_MSG_PROBE, probe) && memcmp(probe.target, ownMac, 6) == 0) {
+      memcpy(probeFrame, data, data_len);
+      probeLength = data_len;
+    }
+    return;
   }
 
-  // Can be used for receiving commands from central node
+  AckPacket ack;
+  if (ackReceived || memcmp(mac_addr, rtcState.centralMac, 6) != 0 ||
+      !parseAck(data, data_len, ownMac, ack) || ack.sequence != rtcState.sequence) {
+    return;  // Not for us, or stale
+  }
+
+  lastAck = ack;
+  ackReceivedAt = nodeClock();
+  ackReceived = true;
 }
 
 /**
@@ -264,6 +678,8 @@ void onDataReceived(uint8_t* mac_addr, uint8_t* data, uint8_t data_len) {
 enum LEDStatus { LED_OK = 0, LED_WARNING = 1, LED_ERROR = 2 };
 
 void setStatusLED(LEDStatus status) {
+  if (warmWake) return;  // GPIO is not set up on fast wakes; no blink delays either
+
   // Simple LED blinking pattern
   switch (status) {
     case LED_OK:
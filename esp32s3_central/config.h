@@ -82,7 +82,7 @@
 // Update Intervals (milliseconds)
 // ============================================================================
 #define SENSOR_READ_INTERVAL 60000      // BME680: 60 seconds
-#define ESPNOW_POLL_INTERVAL 300000     // Remote nodes: 5 minutes
+#define TDMA_FRAME_MS 300000            // Remote nodes: transmit every 5 minutes
 #define WEATHER_API_INTERVAL 900000     // Weather API: 15 minutes
 #define DISPLAY_REFRESH_INTERVAL 1000   // Display: 1 second
 #define SD_LOG_INTERVAL 300000          // SD logging: 5 minutes
@@ -91,10 +91,109 @@
 // ============================================================================
 // Data Logging
 // ============================================================================
-#define LOG_FILE_NAME "weather.csv"
-#define LOG_FILE_MAX_SIZE 1048576  // 1MB - rotate when exceeded
+#define LOG_FORMAT_BINARY true       // Packed records with a schema header (log_format.h); false = CSV text
+#define LOG_DIR "/logs"              // Day partitions: LOG_DIR/YYYY/MM/DD.wxb (.csv) + DD.idx
+#define LOG_INDEX_SPACING 1024       // Data bytes per time index entry (range reads scan at most this much)
+#define LOG_COMPRESS_CLOSED_DAYS true // Rewrite each closed day as compressed blocks (DD.wxc, log_compress.h)
+#define LOG_EXPORT_FILE_NAME "/weather_export.csv"  // exportCSV() target for the training flow
+#define NODE_LOG_FILE_NAME "/nodes.csv"  // Every sample received from remote nodes
+#define HISTORY_DEFAULT_POINTS 200   // /api/history chart points (LTTB downsampled on the device)
+#define HISTORY_MAX_POINTS 1000      // 16 bytes of RAM each while a request is answered
+#define HISTORY_SLICE 256            // Summaries /api/history reads per response chunk (time in the async_tcp task)
 #define ENABLE_CSV_HEADER true
 
+// Write-behind: records queue in a RAM ring and a low-priority task writes them out.
+// The card shares the SPI bus with the displays, so writes are batched into whole chunks.
+#define LOG_RING_SIZE 65536              // Bytes, power of two (PSRAM)
+#define LOG_RING_SIZE_NO_PSRAM 8192      // Internal RAM fallback
+#define LOG_WRITE_CHUNK 4096             // SD write unit: 512 (one sector) or 4096 (a typical cluster)
+#define LOG_WRITE_CHUNK_MAX 4096
+#define LOG_FLUSH_MAX_DELAY_MS 300000    // Longest a record may wait in RAM (loss window on power cut)
+#define LOG_SYNC_INTERVAL_MS 600000      // Directory sync of files that grow by appending
+#define LOG_PREALLOCATE_BYTES 65536      // Binary log space kept allocated (0xFF) ahead of the data
+#define LOG_CHECKPOINT_BYTES 8192        // Binary log data between checkpoints (bounds the recovery scan)
+#define LOG_DRAIN_POLL_MS 1000           // Drain task wake-up without a full chunk
+#define LOG_DRAIN_TASK_PRIORITY 1        // Same as loop(): never starves the display
+#define LOG_DRAIN_TASK_CORE 0            // loop() runs on core 1
+#define LOG_DRAIN_TASK_STACK 6144
+
+// Retention (log_retention.h): a task below the drain task compresses closed days, thins out
+// old ones and deletes past the horizon, holding the card for one small slice at a time
+#define LOG_RETENTION_RAW_DAYS 365         // Days kept with every record; older ones keep only rollups (0 = all)
+#define LOG_RETENTION_HOURLY_DAYS 1825     // Days kept with hourly rollups; daily ones stay (0 = all)
+#define LOG_RETENTION_DAYS 3650            // Horizon: nothing older is kept (0 = no limit)
+#define LOG_SPACE_BUDGET_MB 0              // Most LOG_DIR may take, oldest data goes first past it (0 = no limit)
+#define LOG_SPACE_MIN_FREE_MB 256          // Card space always left free (same order of deletion)
+#define LOG_RETENTION_INTERVAL_MS 3600000  // Between passes (and one after each new day)
+#define LOG_RETENTION_SLICE_BYTES 4096     // Compaction data per slice
+#define LOG_RETENTION_SLICE_GAP_MS 50      // Card left free between slices
+#define LOG_RETENTION_MAX_YEARS 16         // Year directories one pass covers, oldest first
+#define LOG_RETENTION_TASK_PRIORITY 0      // Below the drain task: writes and readers go first
+#define LOG_RETENTION_TASK_STACK 4096
+
+// Flash spool (log_spool.h): with no card, or one that stops answering, records go to a
+// bounded ring of LittleFS files and are written back once the card is there again
+#define LOG_SPOOL_ENABLED true
+#define LOG_SPOOL_DIR "/spool"
+#define LOG_SPOOL_QUOTA_KB 1024            // Most flash it takes (~4 months of 5-minute weather records); oldest goes past it
+#define LOG_SPOOL_FREE_SHARE 50            // and at most this % of the free LittleFS space, left for wear leveling
+#define LOG_SPOOL_SEGMENT_BYTES 65536      // File size: the unit deleted past the quota
+#define LOG_SPOOL_PAGE_BYTES 4096          // Append unit (one flash erase block), RAM buffer
+#define LOG_SPOOL_MAX_DELAY_MS 900000      // Longest a record waits in RAM for its page to fill (loss window)
+#define LOG_SD_FAIL_LIMIT 3                // Failed card writes in a row before records go to the spool
+#define LOG_SD_RETRY_MS 30000              // Card probe interval while spooling
+#define LOG_SPOOL_BACKFILL_BYTES 16384     // Spool data written back per drain pass
+#define LOG_SPOOL_BACKFILL_GAP_MS 20       // Card left to readers between those passes
+
+// Time (UTC) for log timestamps; until NTP answers, time counts from LOG_FALLBACK_EPOCH at boot.
+// Nothing is logged until then: those records would land on that day's partition and retention
+// would delete them as expired. A station that never reaches an NTP server logs nothing.
+#define NTP_SERVER "pool.ntp.org"
+#define LOG_FALLBACK_EPOCH 1704067200  // 2024-01-01T00:00:00Z
+
+// ============================================================================
+// ML Prediction (ml_model.h)
+// ============================================================================
+// Two online models learn from the log: rain within ML_HORIZON_S (logistic
+// regression, SGD) and the temperature change over it (recursive least squares)
+#define ML_MODEL_FILE "/ml_model.bin"    // Coefficients on LittleFS
+#define ML_HORIZON_S 10800               // Predictions look 3 hours ahead
+#define ML_SAMPLE_SPACING_S 300          // Denser records are thinned out to about this
+#define ML_WINDOW_SAMPLES 128            // 3 h back + 3 h ahead at that spacing, with room for gaps
+#define ML_TIME_TOLERANCE_S 600          // A lookback or outcome further off skips the example
+#define ML_RAIN_HUMIDITY 95.0f           // Humidity that counts as rain (there is no rain gauge)
+#define ML_SGD_RATE 0.05f                // Logistic regression step, shrinking as examples accumulate
+#define ML_SGD_L2 0.0001f
+#define ML_RLS_FORGET 0.9999f            // RLS memory ~10000 examples (5 weeks of 5-minute records)
+#define ML_MIN_EXAMPLES 288              // A day of examples before the model replaces the rules
+#define ML_TRAIN_DAYS 90                 // Log retrained on, up to now
+#define ML_RETRAIN_INTERVAL_MS 86400000  // Retrain daily (and when there is no model yet)
+#define ML_READ_BUFFER 2048              // trainFromCSV() file reads
+#define ML_TRAIN_SLICE_MS 20             // Training work per loop() pass
+#define ML_COMPILED_MODEL true           // Use ml_model_int8.h (tools/wxtrain) until the station has trained its own
+#define ML_KERNEL_BENCH_RUNS 1000        // Inferences per kernel in the boot benchmark
+#define ML_KERNEL_CROSSCHECK 256         // Random inputs the SIMD kernel must match the scalar one on
+#define ML_EWMA_TAU_S 1800               // Live pressure, temperature and humidity averages (ml_features.h)
+// Readings older than these are stale for the predictor (ml_fusion.h)
+#define ML_FUSION_INDOOR_MAX_AGE_S 300        // 5 sensor reads
+#define ML_FUSION_EXTERIOR_MAX_AGE_S 900      // A few of the exterior node's batches
+#define ML_FUSION_OBSERVATION_MAX_AGE_S 3600  // 4 weather API fetches
+#define ML_FUSION_FORECAST_MAX_AGE_S 10800    // One forecast slot
+#define ML_FORECAST_RAIN_WEIGHT 0.5f          // Share of a fresh forecast in the rules' rain probability
+// Kalman nowcast of exterior temperature and pressure (ml_nowcast.h)
+#define ML_NOWCAST_HOURS 6                    // Hourly forecast steps
+#define ML_NOWCAST_WARMUP_S 10800             // Readings a channel needs before its forecast is shown
+#define ML_NOWCAST_MAX_AGE_S 3600             // ... and how recent the last one must be
+#define ML_NOWCAST_RESET_S 21600              // A longer gap in a channel's readings restarts its filter
+#define ML_NOWCAST_GATE 5.0f                  // Readings further off the prediction (standard deviations) are outliers
+#define ML_NOWCAST_REJECT_LIMIT 3             // ... unless this many in a row are: the level has jumped
+// int8 models swapped at runtime (ml_model_store.h)
+#define ML_MODEL_PARTITION "mlmodel"          // Data partition holding both slots, mapped in place (partitions.csv)
+#define ML_MODEL_SLOT_BYTES 32768             // Per slot: the largest model file
+#define ML_MODEL_SLOT_FILE "/ml_slot%u.wxq"   // Slots on LittleFS when there is no such partition
+#define ML_MODEL_SELECT_FILE "/ml_model.sel"  // Slot in use
+#define ML_MODEL_UPLOAD_TIMEOUT_MS 30000      // An upload idle this long is abandoned
+
 // ============================================================================
 // Weather API Configuration
 // ============================================================================
@@ -115,8 +214,21 @@
 // ============================================================================
 #define ESPNOW_CHANNEL 6
 #define ESPNOW_ENCRYPT false  // Set to true with PMK if needed
-#define ESPNOW_MAX_RETRIES 3
 #define ESPNOW_TIMEOUT 5000  // 5 seconds
+#define ESPNOW_SAMPLE_QUEUE_SIZE 128  // Decoded batch samples awaiting the main loop
+
+// TDMA: every ACK carries the central clock and the node's slot; slots are
+// spread evenly over TDMA_FRAME_MS (one per NODE_REGISTRY_CAPACITY)
+#define TDMA_GUARD_MS 2000      // Packets further than this from their slot start = slot miss
+#define TDMA_MIN_LEAD_MS 10000  // Shortest notice for a node's next slot
+
+// Link diagnostics (/api/nodes/diagnostics): after its batch, one node at a time
+// stays awake and echoes timestamped probes. Off by default - it costs node battery.
+#define ESPNOW_DIAG_ENABLED false
+#define DIAG_PROBES_PER_WAKE 10    // Probes per node wake, sent one at a time
+#define DIAG_PROBE_WINDOW_MS 250   // How long the node stays awake for them
+#define DIAG_PROBE_TIMEOUT_MS 25   // No echo within this = probe lost
+#define DIAG_PROBE_BYTES 64        // Frame size (batches are typically 60-120 bytes)
 
 // ============================================================================
 // Buffer Sizes
@@ -128,11 +128,11 @@ function handleSensorUpdate(data) {
         updateElement('temp-room2', formatTemperature(data.indoor_secondary.temperature));
         updateElement('humidity-room2', formatPercentage(data.indoor_secondary.humidity));
 
-        const status = data.indoor_secondary.rssi ? 'Online' : 'Offline';
+        const status = data.indoor_secondary.online ? 'Online' : 'Offline';
         updateElement('status-room2', status,
             status === 'Online' ? 'status-badge' : 'status-badge offline');
 
-        const minutesAgo = Math.floor((Date.now() - data.indoor_secondary.timestamp) / 60000);
+        const minutesAgo = Math.floor(data.indoor_secondary.age_ms / 60000);
         updateElement('update-room2', minutesAgo + ' min ago');
     }
 
@@ -4,130 +4,1932 @@
  */
 
 #include "data_logger.h"
+#include "spi_bus.h"
 #include "utils.h"
+#include "espnow_protocol.h"
+#include <esp_task_wdt.h>
+#include <esp_heap_caps.h>
+#include <LittleFS.h>
+#include <new>
+
+// Staging holds one chunk plus the record that completes it
+#define LOG_STAGING_SIZE (LOG_WRITE_CHUNK_MAX + LOG_CSV_LINE_MAX)
+
+// Source of the 0xFF fill written when preallocating
+static uint8_t erasedBlock[512];
+
+/**
+ * Open for in-place writes ("r+" needs the file to exist)
+ */
+static File openInPlace(const char* path) {
+  if (!SD.exists(path)) {
+    File created = SD.open(path, FILE_WRITE);
+    if (!created) return created;
+    created.close();
+  }
+  return SD.open(path, "r+");
+}
+
+/**
+ * Create every missing directory on the way to path's file
+ */
+static void makeParentDirs(const char* path) {
+  char dir[LOG_PARTITION_PATH_MAX];
+  for (const char* slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+    size_t length = slash - path;
+    if (length >= sizeof(dir)) return;
+    memcpy(dir, path, length);
+    dir[length] = '\0';
+    if (!SD.exists(dir)) SD.mkdir(dir);
+  }
+}
+
+/**
+ * Same path with another extension ("DD.wxb" -> "DD.idx")
+ */
+static void replaceExtension(const char* path, const char* ext, char* out, size_t cap) {
+  const char* dot = strrchr(path, '.');
+  size_t stem = dot ? (size_t)(dot - path) : strlen(path);
+  snprintf(out, cap, "%.*s.%s", (int)stem, path, ext);
+}
 
 DataLogger::DataLogger()
-  : ready(false), recordCount(0), fileSize(0), lastFlush(0) {}
+  : currentDay(0), indexNext(0), lastRecordTime(0), checkpointEnd(0), checkpointSequence(0), journalCorrupt(0),
+    encoder(nullptr), blockBuffer(nullptr), ready(false), recordCount(0), fileSize(0), ringBuffer(nullptr),
+    spoolPage(nullptr), cardState(CARD_OK), cardFailures(0), lastCardProbe(0), replayStart(0),
+    drainTask(nullptr), sdLock(nullptr), syncRequests(0), syncsDone(0), queued(0), dropped(0) {
+  for (uint8_t level = 0; level < LOG_ROLLUP_LEVELS; level++) {
+    rollups[level].begin(LOG_ROLLUP_EMPTY);
+    rollupDirty[level] = false;
+  }
+}
 
 bool DataLogger::begin() {
+  if (ready) return true;
+
+  // Flash spool for when the card is missing or fails (optional)
+  if (LOG_SPOOL_ENABLED) {
+    spoolPage = (uint8_t*)heap_caps_malloc(LOG_SPOOL_PAGE_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!spoolPage || !LittleFS.begin() ||
+        !spool.begin(LittleFS, LittleFS.totalBytes() - LittleFS.usedBytes(), spoolPage)) {
+      Serial.println(F("[WARNING] Flash spool unavailable - records are lost while the SD card is away"));
+    }
+  }
+
   // SD card is expected to be initialized before calling this
-  if (!SD.exists("/")) {
+  bool card = SD.exists("/");
+  if (!card && !spool.isReady()) {
     Serial.println(F("[ERROR] SD card not accessible"));
     return false;
   }
 
-  ready = openLogFile();
-  return ready;
-}
+  // Ring in PSRAM when fitted; staging buffers stay in internal (DMA-capable) RAM
+  size_t ringSize = LOG_RING_SIZE;
+  ringBuffer = psramFound() ? (uint8_t*)heap_caps_malloc(ringSize, MALLOC_CAP_SPIRAM) : nullptr;
+  stats.ringInPsram = ringBuffer != nullptr;
+  if (!ringBuffer) {
+    ringSize = LOG_RING_SIZE_NO_PSRAM;
+    ringBuffer = (uint8_t*)heap_caps_malloc(ringSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  if (!ringBuffer || !ring.begin(ringBuffer, ringSize)) {
+    Serial.println(F("[ERROR] Log ring allocation failed"));
+    return false;
+  }
 
-bool DataLogger::openLogFile() {
-  currentFileName = generateFileName(millis());
+  for (uint8_t i = 0; i < LOG_STREAM_COUNT; i++) {
+    streams[i].staging = (uint8_t*)heap_caps_malloc(LOG_STAGING_SIZE, MALLOC_CAP_DMA);
+    if (!streams[i].staging) {
+      Serial.println(F("[ERROR] Log staging allocation failed"));
+      return false;
+    }
+  }
+  memset(erasedBlock, 0xFF, sizeof(erasedBlock));
 
-  // Check if file exists
-  bool isNewFile = !SD.exists(currentFileName.c_str());
+  // Compaction is optional: without the memory, closed days stay as they are
+  if (LOG_FORMAT_BINARY && LOG_COMPRESS_CLOSED_DAYS) {
+    uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    void* memory = heap_caps_malloc(sizeof(LogBlockEncoder), caps);
+    blockBuffer = (uint8_t*)heap_caps_malloc(sizeof(LogBlockHeader) + LOG_BLOCK_MAX_BYTES, caps);
+    if (memory && blockBuffer) {
+      encoder = new (memory) LogBlockEncoder();
+    } else {
+      Serial.println(F("[WARNING] No memory for log compaction - closed days stay uncompressed"));
+      heap_caps_free(memory);
+      heap_caps_free(blockBuffer);
+      blockBuffer = nullptr;
+    }
+  }
 
-  // Open file in append mode
-  logFile = SD.open(currentFileName.c_str(), FILE_APPEND);
+  sdLock = xSemaphoreCreateMutex();
+  if (!sdLock) return false;
 
-  if (!logFile) {
-    Serial.print(F("[ERROR] Failed to open log file: "));
-    Serial.println(currentFileName);
+  // The weather partition opens with the first record, which decides its day
+  card = card && openStream(LOG_STREAM_NODES, NODE_LOG_FILE_NAME);
+  if (!card && !spool.isReady()) return false;
+
+  // Whatever an earlier outage left in the spool goes onto the card first
+  cardState = !card ? CARD_MISSING : !spool.empty() ? CARD_BACKFILL : CARD_OK;
+  lastCardProbe = millis();
+
+  if (xTaskCreatePinnedToCore(drainTaskMain, "sdlog", LOG_DRAIN_TASK_STACK, this,
+                              LOG_DRAIN_TASK_PRIORITY, &drainTask, LOG_DRAIN_TASK_CORE) != pdPASS) {
+    Serial.println(F("[ERROR] Log drain task creation failed"));
     return false;
   }
 
-  // Write header if new file
-  if (isNewFile && ENABLE_CSV_HEADER) {
-    writeHeader();
+  Serial.print(F("[OK] Write-behind log: "));
+  Serial.print(ringSize / 1024);
+  Serial.print(stats.ringInPsram ? F(" KB ring in PSRAM, ") : F(" KB ring in internal RAM, "));
+  Serial.print(flushPolicy.chunkSize);
+  Serial.println(F(" B writes"));
+  if (cardState == CARD_MISSING) {
+    Serial.println(F("[WARNING] No SD card - logging to the flash spool until one answers"));
+  }
+
+  ready = true;
+  return true;
+}
+
+bool DataLogger::openLogFile(uint32_t time) {
+  currentFileName = generateFileName(time);
+  makeParentDirs(currentFileName.c_str());
+
+  // Records for a day being compressed: it is not closed after all
+  if (compaction.day == time / LOG_SECONDS_PER_DAY) abandonCompaction();
+
+  // New partition: nothing checkpointed yet (checkBinaryLog() reads an existing one's)
+  checkpointEnd = weatherLogSchema().headerSize();
+  checkpointSequence = 0;
+  journalCorrupt = 0;
+
+  if (!openStream(LOG_STREAM_WEATHER, currentFileName.c_str())) {
+    return false;
+  }
+  if (LOG_FORMAT_BINARY && !openIndex()) {
+    Serial.println(F("[WARNING] Log index unavailable - range reads will scan"));
   }
+  currentDay = time / LOG_SECONDS_PER_DAY;
 
-  fileSize = logFile.size();
+  const LogStream& stream = streams[LOG_STREAM_WEATHER];
+  fileSize = stream.position + stream.staged;
   Serial.print(F("[OK] Log file opened: "));
   Serial.print(currentFileName);
   Serial.print(F(" Size: "));
-  Serial.println(fileSize);
+  Serial.print(fileSize);
+  Serial.print(F(" Allocated: "));
+  Serial.println(stream.allocated);
 
   return true;
 }
 
-bool DataLogger::writeRecord(const CSVRecord& record) {
-  if (!ready || !logFile) return false;
+bool DataLogger::openStream(LogStreamId id, const char* path) {
+  LogStream& stream = streams[id];
+
+  // Check if file exists
+  bool isNewFile = !SD.exists(path);
+
+  stream.file = openInPlace(path);
+  if (!stream.file) {
+    Serial.print(F("[ERROR] Failed to open log file: "));
+    Serial.println(path);
+    return false;
+  }
+
+  stream.allocated = stream.file.size();
+  stream.position = stream.allocated;
+  stream.staged = 0;
+  stream.onCard = 0;
+  stream.pendingRecords = 0;
+  stream.lastSync = millis();
+  stream.dirty = false;
+  stream.preallocate = id == LOG_STREAM_WEATHER && LOG_FORMAT_BINARY;
 
-  // Check if rotation needed
-  if (needsRotation()) {
-    logFile.close();
-    if (!openLogFile()) {
+  // Headers go through the staging buffer like any other data
+  if (isNewFile && id == LOG_STREAM_WEATHER && (LOG_FORMAT_BINARY || ENABLE_CSV_HEADER)) {
+    writeHeader(stream);
+  } else if (isNewFile && id == LOG_STREAM_NODES && ENABLE_CSV_HEADER) {
+    static const char header[] = "timestamp,node,mac,temperature,humidity,pressure,light\n";
+    memcpy(stream.staging, header, sizeof(header) - 1);
+    stream.staged = sizeof(header) - 1;
+  } else if (!isNewFile && stream.preallocate && !checkBinaryLog(stream)) {
+    stream.file.close();
+    return false;
+  }
+
+  // A text file can end in a line torn by a card failure or a reset: write
+  // over it from the end of the last whole line (a replay rewrites that line)
+  if (!isNewFile && !stream.preallocate && stream.position > 0) {
+    char tail[LOG_CSV_LINE_MAX];
+    uint32_t length = stream.position < sizeof(tail) ? stream.position : sizeof(tail);
+    if (stream.file.seek(stream.position - length) && (uint32_t)stream.file.read((uint8_t*)tail, length) == length) {
+      uint32_t end = length;
+      while (end > 0 && tail[end - 1] != '\n') end--;
+      if (end > 0) stream.position -= length - end;
+    }
+  }
+
+  // Writes start on a chunk boundary: reload the partial chunk the data ends in
+  size_t partial = stream.staged == 0 ? stream.position % flushPolicy.chunkSize : 0;
+  if (partial > 0) {
+    stream.position -= partial;
+    if (!stream.file.seek(stream.position) || (size_t)stream.file.read(stream.staging, partial) != partial) {
+      Serial.print(F("[ERROR] Failed to read log tail: "));
+      Serial.println(path);
+      stream.file.close();
       return false;
     }
+    stream.staged = partial;
+    stream.onCard = partial;
+  }
+
+  findNewestOnCard(id);
+  return true;
+}
+
+void DataLogger::closeStream(LogStream& stream) {
+  if (!stream.file) return;
+
+  if (stream.staged > stream.onCard) {
+    writeStaged(stream, stream.staged, true);
+  } else if (stream.dirty) {
+    syncStream(stream);
+  }
+
+  // Closed partitions reopen without a recovery scan
+  if (&stream == &streams[LOG_STREAM_WEATHER]) {
+    writeCheckpoint(stream, stream.position + stream.onCard);
+  }
+
+  stream.file.close();
+  stream.staged = 0;
+  stream.onCard = 0;
+  stream.pendingRecords = 0;
+
+  if (&stream == &streams[LOG_STREAM_WEATHER] && indexFile) {
+    indexFile.close();
+  }
+}
+
+bool DataLogger::writeRecord(const CSVRecord& record) {
+  if (!ready) return false;
+
+  const float values[WX_LOG_CHANNEL_COUNT] = {
+    record.temp_indoor, record.humidity_indoor, record.temp_outdoor, record.humidity_outdoor,
+    record.pressure, record.light, (float)record.iaq
+  };
+
+  // Queued packed in both formats: CSV mode prints it in the drain task,
+  // so both formats hold the same values and feed the same rollups
+  const LogSchema& schema = weatherLogSchema();
+  uint8_t packed[LOG_MAX_RECORD_SIZE];
+  schema.encode(record.timestamp, values, 0xFFFF, packed);
+
+  if (!enqueue(LOG_STREAM_WEATHER, packed, schema.recordSize())) {
+    return false;
   }
 
-  // Format CSV line
-  String line = record.timestamp + ",";
-  line += String(record.temp_indoor, 2) + ",";
-  line += String(record.humidity_indoor, 2) + ",";
-  line += String(record.temp_outdoor, 2) + ",";
-  line += String(record.humidity_outdoor, 2) + ",";
-  line += String(record.pressure, 2) + ",";
-  line += String(record.light, 2) + ",";
-  line += String(record.iaq);
-  line += "\n";
+  recordCount++;
+  return true;
+}
+
+bool DataLogger::writeNodeSample(const NodeSample& sample) {
+  if (!ready) return false;
 
-  // Write to file
-  size_t written = logFile.print(line);
+  char mac[18];
+  NodeRegistry::formatMac(sample.mac, mac);
 
-  if (written == line.length()) {
-    recordCount++;
-    fileSize += written;
+  const NodeReading& r = sample.reading;
+  const float values[WX_CHANNEL_COUNT] = {r.temperature, r.humidity, r.pressure, r.light};
 
-    // Flush every 10 records or every 5 minutes
-    if (recordCount % 10 == 0 || (millis() - lastFlush) > 300000) {
-      flush();
+  char line[160];
+  int len = snprintf(line, sizeof(line), "%s,%s,%s",
+                     getISO8601Timestamp(sample.timestamp).c_str(), sample.nodeType, mac);
+
+  // Channels the node does not measure are left empty
+  for (uint8_t ch = 0; ch < WX_CHANNEL_COUNT && len < (int)sizeof(line); ch++) {
+    if (r.channelMask & WX_MASK(ch)) {
+      len += snprintf(line + len, sizeof(line) - len, ",%.2f", values[ch]);
+    } else {
+      len += snprintf(line + len, sizeof(line) - len, ",");
     }
+  }
+  if (len >= (int)sizeof(line) - 1) {
+    return false;
+  }
+  line[len++] = '\n';
 
-    return true;
+  return enqueue(LOG_STREAM_NODES, line, len);
+}
+
+bool DataLogger::enqueue(LogStreamId stream, const void* data, size_t len) {
+  if (!ring.push(stream, data, len, millis())) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
   }
+  queued.fetch_add(1, std::memory_order_relaxed);
 
-  return false;
+  // Wake the drain task once a chunk is waiting; otherwise it polls every LOG_DRAIN_POLL_MS
+  if (flushPolicy.maxDelayMs == 0 || ring.used() >= flushPolicy.chunkSize) {
+    xTaskNotifyGive(drainTask);
+  }
+  return true;
 }
 
 void DataLogger::flush() {
-  if (!logFile) return;
+  if (!ready) return;
+
+  syncRequests.fetch_add(1);
+  xTaskNotifyGive(drainTask);
+}
 
-  logFile.flush();
-  lastFlush = millis();
+bool DataLogger::sync(uint32_t timeoutMs) {
+  if (!ready) return false;
 
-  Serial.print(F("[LOG] Flushed "));
-  Serial.print(recordCount);
-  Serial.print(F(" records, file size: "));
-  Serial.println(fileSize);
+  uint32_t target = syncRequests.fetch_add(1) + 1;
+  xTaskNotifyGive(drainTask);
+
+  unsigned long start = millis();
+  while ((int32_t)(syncsDone.load() - target) < 0) {
+    if (millis() - start > timeoutMs) return false;
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  return true;
 }
 
-bool DataLogger::needsRotation() {
-  // Rotate if file exceeds 1MB or if day has changed
-  if (fileSize > LOG_FILE_MAX_SIZE) {
-    Serial.println(F("[LOG] File size limit reached - rotating"));
-    return true;
+void DataLogger::setFlushPolicy(const LogFlushPolicy& policy) {
+  LogFlushPolicy clamped = policy;
+  clamped.chunkSize = policy.chunkSize > 512 ? LOG_WRITE_CHUNK_MAX : 512;
+
+  // Applied between drain passes, so a chunk is never cut by a size change
+  xSemaphoreTake(sdLock, portMAX_DELAY);
+  flushPolicy = clamped;
+  xSemaphoreGive(sdLock);
+}
+
+void DataLogger::getStats(LogWriterStats& out) const {
+  portENTER_CRITICAL(&statsLock);
+  out = stats;
+  portEXIT_CRITICAL(&statsLock);
+
+  out.ringCapacity = ring.capacity();
+  out.ringUsed = ring.used();
+  out.ringPeak = ring.peak();
+  out.recordsQueued = queued.load(std::memory_order_relaxed);
+  out.recordsDropped = dropped.load(std::memory_order_relaxed);
+}
+
+void DataLogger::lockCard() const {
+  xSemaphoreTake(sdLock, portMAX_DELAY);
+  spiBusLock();
+}
+
+void DataLogger::unlockCard() const {
+  spiBusUnlock();
+  xSemaphoreGive(sdLock);
+}
+
+void DataLogger::drainTaskMain(void* arg) {
+  DataLogger* logger = static_cast<DataLogger*>(arg);
+
+  for (;;) {
+    // A backfill goes on pass after pass, leaving the card to readers in between
+    bool backfilling = logger->cardState == CARD_BACKFILL;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(backfilling ? LOG_SPOOL_BACKFILL_GAP_MS : LOG_DRAIN_POLL_MS));
+
+    // The whole pass holds the card, and the bus: a display waits out one pass at most
+    logger->lockCard();
+    logger->drain();
+    logger->unlockCard();
+  }
+}
+
+void DataLogger::drain() {
+  // Requests made before this point are covered by this pass
+  uint32_t request = syncRequests.load();
+  bool syncAll = request != syncsDone.load();
+
+  // Card away: probe it now and then. Once back, the spool goes onto it before anything newer
+  if (cardState == CARD_MISSING) probeCard();
+  if (cardState == CARD_BACKFILL) backfill();
+
+  uint8_t record[LOG_CSV_LINE_MAX];
+  uint8_t id;
+  uint32_t stamp;
+  size_t len;
+
+  // While the spool is written back, newer records wait in the ring unless it fills up
+  bool take = cardState != CARD_BACKFILL || ring.used() > ring.capacity() / 2;
+  while (take && (len = ring.pop(id, stamp, record, sizeof(record))) > 0) {
+    if (id >= LOG_STREAM_COUNT) continue;
+
+    if (cardState == CARD_OK && drainRecord(id, record, len, stamp, false)) {
+      if (cardFailures >= LOG_SD_FAIL_LIMIT) cardLost();
+      continue;
+    }
+
+    // Card away, or its new partition would not open: to the spool, after what was staged
+    if (cardState == CARD_OK) cardLost();
+    if (cardState == CARD_OK || !spool.append(id, record, len)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
   }
 
-  // Check if new day
-  String newFileName = generateFileName(millis());
-  if (newFileName != currentFileName) {
-    Serial.println(F("[LOG] New day - rotating log file"));
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < LOG_STREAM_COUNT; i++) {
+    LogStream& stream = streams[i];
+    if (!stream.file) continue;
+
+    // Records that waited long enough go out as a partial chunk (rewritten when it fills)
+    bool due = stream.pendingRecords > 0 && now - stream.pendingSince >= flushPolicy.maxDelayMs;
+    if (due || (syncAll && stream.staged > stream.onCard)) {
+      writeStaged(stream, stream.staged, true);
+    } else if (stream.dirty && (syncAll || now - stream.lastSync >= flushPolicy.syncIntervalMs)) {
+      syncStream(stream);
+    }
+
+    // Idle: keep space preallocated ahead of the binary log, one chunk at a time
+    uint32_t end = stream.position + stream.staged;
+    uint32_t ahead = stream.preallocate ? preallocationTarget(end) - end : 0;
+    if (ahead > 0 && stream.allocated < end + ahead / 2) {
+      while (stream.preallocate && ring.used() == 0 && stream.allocated < end + ahead) {
+        preallocate(stream);
+      }
+    }
+  }
+
+  if (cardState == CARD_OK && cardFailures >= LOG_SD_FAIL_LIMIT) cardLost();
+
+  // Spooled records wait for a full page, within LOG_SPOOL_MAX_DELAY_MS
+  if (cardState != CARD_OK) spool.flush(syncAll ? 0 : LOG_SPOOL_MAX_DELAY_MS);
+
+  const LogStream& weather = streams[LOG_STREAM_WEATHER];
+  fileSize = weather.position + weather.staged;
+
+  portENTER_CRITICAL(&statsLock);
+  stats.preallocatedBytes = weather.allocated > fileSize ? weather.allocated - fileSize : 0;
+  stats.cardPresent = cardState != CARD_MISSING;
+  stats.backfilling = cardState == CARD_BACKFILL;
+  spool.getStats(stats.spool);
+  portEXIT_CRITICAL(&statsLock);
+
+  if (syncAll) {
+    if (cardState == CARD_OK) saveRollups();
+    syncsDone.store(request);
+    Serial.print(F("[LOG] Flushed "));
+    Serial.print(recordCount);
+    Serial.print(F(" records, file size: "));
+    Serial.println(fileSize);
+  }
+}
+
+bool DataLogger::drainRecord(uint8_t id, const uint8_t* record, size_t len, uint32_t stamp, bool replay) {
+  const uint8_t* data = record;
+  char line[LOG_CSV_LINE_MAX];
+
+  if (id == LOG_STREAM_WEATHER) {
+    if (len != weatherLogSchema().recordSize()) return true;
+
+    // New day (by record time): next partition, once the last one's records are on the card
+    uint32_t time = recordTime(record);
+    if (time / LOG_SECONDS_PER_DAY != currentDay) {
+      LogStream& last = streams[LOG_STREAM_WEATHER];
+      if (last.file && last.staged > last.onCard && !writeStaged(last, last.staged, true)) return false;
+      if (currentDay != 0) Serial.println(F("[LOG] New day - next log partition"));
+      closeStream(last);
+      if (!openLogFile(time)) return false;
+    }
+
+    // The periods a backfill starts in, as the card has them so far; then
+    // every record it replays counts in them, including one that a backfill
+    // cut short did write (not written twice)
+    if (replay && replayStart == 0) rebuildRollups(time);
+    if (replay && replayedBefore(LOG_STREAM_WEATHER, record, len)) {
+      rollupRecord(record);
+      portENTER_CRITICAL(&statsLock);
+      stats.replaySkipped++;
+      portEXIT_CRITICAL(&statsLock);
+      return true;
+    }
+    lastRecordTime = time;
+
+    const LogStream& weather = streams[LOG_STREAM_WEATHER];
+    if (indexFile) indexRecord(time, weather.position + weather.staged);
+    rollupRecord(record);
+
+    if (!LOG_FORMAT_BINARY) {
+      len = weatherLogSchema().formatCsv(record, line, sizeof(line));
+      if (len == 0) return true;
+      data = (const uint8_t*)line;
+    }
+  } else if (replay && replayedBefore((LogStreamId)id, record, len)) {
+    portENTER_CRITICAL(&statsLock);
+    stats.replaySkipped++;
+    portEXIT_CRITICAL(&statsLock);
     return true;
   }
+  stage((LogStreamId)id, data, len, stamp);
+  return true;
+}
+
+void DataLogger::cardLost() {
+  if (!spool.isReady()) return;  // Nowhere else to go: keep retrying the card
+  Serial.println(F("[ERROR] SD card stopped answering - logging to the flash spool"));
+
+  // What did not reach the card goes first, so the spool stays in order
+  spoolStaged(LOG_STREAM_WEATHER);
+  spoolStaged(LOG_STREAM_NODES);
+
+  if (compaction.day != 0) abandonCompaction();
+  if (indexFile) indexFile.close();
+  for (uint8_t i = 0; i < LOG_STREAM_COUNT; i++) {
+    LogStream& stream = streams[i];
+    stream.file.close();
+    stream.staged = 0;
+    stream.onCard = 0;
+    stream.position = 0;
+    stream.allocated = 0;
+    stream.pendingRecords = 0;
+    stream.dirty = false;
+  }
+  currentDay = 0;
+  cardFailures = 0;
+  cardState = CARD_MISSING;
+  lastCardProbe = millis();
+
+  portENTER_CRITICAL(&statsLock);
+  stats.cardLosses++;
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void DataLogger::spoolStaged(LogStreamId id) {
+  LogStream& stream = streams[id];
+  size_t at = stream.onCard;
+  uint32_t lost = 0;
+
+  if (id == LOG_STREAM_WEATHER && !LOG_FORMAT_BINARY) {
+    // CSV text cannot go back to packed records
+    lost = stream.pendingRecords;
+  } else if (id == LOG_STREAM_WEATHER) {
+    // Whole records: a chunk write may have cut the first one
+    const LogSchema& schema = weatherLogSchema();
+    const uint32_t size = schema.recordSize();
+    uint32_t offset = stream.position + at;
+    uint32_t start = schema.headerSize();
+    if (offset > start) start += (offset - start + size - 1) / size * size;
+    for (at = start - stream.position; at + size <= stream.staged; at += size) {
+      if (!spool.append(id | LOG_SPOOL_ROLLED_UP, stream.staging + at, size)) lost++;
+    }
+  } else {
+    // Whole lines: not the header of a new file, nor a line a chunk write cut
+    if (at == 0 && (stream.position > 0 || ENABLE_CSV_HEADER)) {
+      while (at < stream.staged && stream.staging[at++] != '\n') {}
+    }
+    for (size_t end = at; end < stream.staged; end++) {
+      if (stream.staging[end] != '\n') continue;
+      if (!spool.append(id, stream.staging + at, end + 1 - at)) lost++;
+      at = end + 1;
+    }
+  }
+
+  if (lost > 0) dropped.fetch_add(lost, std::memory_order_relaxed);
+}
+
+void DataLogger::probeCard() {
+  uint32_t now = millis();
+  if (now - lastCardProbe < LOG_SD_RETRY_MS) return;
+  lastCardProbe = now;
+
+  // Under lockCard() (drain pass): no display or touch transfer is under way
+  SD.end();
+  if (!SD.begin(SD_CS) || !SD.exists("/") || !openStream(LOG_STREAM_NODES, NODE_LOG_FILE_NAME)) return;
+
+  Serial.println(F("[OK] SD card answering - writing the flash spool back"));
+  cardFailures = 0;
+  replayStart = 0;
+  cardState = CARD_BACKFILL;
+}
+
+void DataLogger::backfill() {
+  uint8_t record[LOG_CSV_LINE_MAX];
+  uint8_t id;
+  size_t len;
+  size_t replayed = 0;
+
+  // The slice's rollups are kept aside, in case it has to be replayed again
+  LogRollup saved[LOG_ROLLUP_LEVELS];
+  portENTER_CRITICAL(&rollupLock);
+  memcpy(saved, rollups, sizeof(saved));
+  portEXIT_CRITICAL(&rollupLock);
+
+  uint32_t now = millis();
+  while (replayed < LOG_SPOOL_BACKFILL_BYTES && cardFailures == 0 && (len = spool.peek(id, record, sizeof(record))) > 0) {
+    uint8_t stream = id & ~LOG_SPOOL_ROLLED_UP;
+    if (stream < LOG_STREAM_COUNT && !drainRecord(stream, record, len, now, true)) {
+      cardFailures++;
+      break;
+    }
+    spool.consume();
+    replayed += sizeof(LogSpoolEntry) + len;
+  }
+
+  // On the card before the spool lets go of it
+  for (uint8_t i = 0; i < LOG_STREAM_COUNT; i++) {
+    LogStream& stream = streams[i];
+    if (stream.file && stream.staged > stream.onCard) writeStaged(stream, stream.staged, true);
+  }
+
+  if (cardFailures > 0) {
+    // The whole slice stays in the spool; what did reach the card is skipped next time
+    Serial.println(F("[ERROR] SD card failed during backfill - back to the flash spool"));
+    spool.rewind();
+    portENTER_CRITICAL(&rollupLock);
+    memcpy(rollups, saved, sizeof(saved));
+    portEXIT_CRITICAL(&rollupLock);
+    for (uint8_t i = 0; i < LOG_ROLLUP_LEVELS; i++) rollupDirty[i] = true;
+    for (uint8_t i = 0; i < LOG_STREAM_COUNT; i++) streams[i].staged = streams[i].onCard;
+    cardLost();
+    return;
+  }
+
+  spool.commit();
+  if (spool.empty()) {
+    LogSpoolStats written;
+    spool.getStats(written);
+    Serial.print(F("[OK] Flash spool written back: "));
+    Serial.print(written.recordsReplayed);
+    Serial.println(F(" records since boot"));
+    replayStart = 0;
+    cardState = CARD_OK;
+  }
+}
+
+void DataLogger::findNewestOnCard(LogStreamId id) {
+  LogStream& stream = streams[id];
+  uint32_t end = stream.position + stream.onCard;
+  stream.newestOnCard[0] = '\0';
+  stream.openedEnd = end;
+
+  if (id == LOG_STREAM_WEATHER && LOG_FORMAT_BINARY) {
+    // The recovery scan left the data ending on an intact record
+    const LogSchema& schema = weatherLogSchema();
+    const uint32_t size = schema.recordSize();
+    uint8_t record[LOG_MAX_RECORD_SIZE];
+    float values[LOG_MAX_CHANNELS];
+    uint16_t mask;
+    uint32_t time;
+    if (end >= schema.headerSize() + size && stream.file.seek(end - size) &&
+        (size_t)stream.file.read(record, size) == size && schema.decode(record, time, values, mask)) {
+      formatIsoTime(time, stream.newestOnCard);
+    }
+    return;
+  }
+
+  // Text: the timestamp the last line starts with (none if it is the header)
+  char tail[LOG_CSV_LINE_MAX];
+  uint32_t length = end < sizeof(tail) ? end : sizeof(tail);
+  if (length < 22 || !stream.file.seek(end - length) || (uint32_t)stream.file.read((uint8_t*)tail, length) != length) {
+    return;
+  }
+  uint32_t start = length - 1;
+  while (start > 0 && tail[start - 1] != '\n') start--;
+  if (length - start > 21 && tail[start + 4] == '-' && tail[start + 19] == 'Z' && tail[start + 20] == ',') {
+    memcpy(stream.newestOnCard, tail + start, 20);
+    stream.newestOnCard[20] = '\0';
+  }
+}
+
+bool DataLogger::replayedBefore(LogStreamId id, const uint8_t* record, size_t len) {
+  LogStream& stream = streams[id];
+  if (stream.newestOnCard[0] == '\0') return false;
+
+  char time[21];
+  if (id == LOG_STREAM_WEATHER) {
+    formatIsoTime(recordTime(record), time);
+  } else if (len > 20) {
+    memcpy(time, record, 20);
+    time[20] = '\0';
+  } else {
+    return false;
+  }
+
+  // One weather record per second
+  int order = strcmp(time, stream.newestOnCard);
+  if (order != 0 || id == LOG_STREAM_WEATHER) return order <= 0;
+
+  // Several nodes report within a second: only the same line is the same
+  // record. Windows overlap by a line, back from where the file ended
+  char window[LOG_CSV_LINE_MAX * 2];
+  uint32_t end = stream.openedEnd;
+  for (uint32_t back = 0; end > 0 && back < LOG_CSV_LINE_MAX * 16; back += LOG_CSV_LINE_MAX) {
+    uint32_t start = end > sizeof(window) ? end - sizeof(window) : 0;
+    size_t n = end - start;
+    if (!stream.file.seek(start) || (size_t)stream.file.read((uint8_t*)window, n) != n) return false;
+    for (size_t at = 0; at + len <= n; at++) {
+      if ((at == 0 ? start == 0 : window[at - 1] == '\n') && memcmp(window + at, record, len) == 0) return true;
+    }
 
+    // Lines further back are from earlier seconds
+    const char* first = (const char*)memchr(window, '\n', n);
+    size_t at = first ? first + 1 - window : n;
+    if (start == 0 || (at + 20 <= n && strncmp(window + at, time, 20) < 0)) return false;
+    end = start + LOG_CSV_LINE_MAX;
+  }
   return false;
 }
 
-void DataLogger::writeHeader() {
-  String header = "timestamp,temp_indoor,humidity_indoor,temp_outdoor,humidity_outdoor,pressure,light,iaq\n";
-  logFile.print(header);
+void DataLogger::stage(LogStreamId id, const uint8_t* data, size_t len, uint32_t stamp) {
+  LogStream& stream = streams[id];
+
+  // Only fills up when the card keeps failing: drop rather than overrun
+  if (stream.staged + len > LOG_STAGING_SIZE) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  memcpy(stream.staging + stream.staged, data, len);
+  stream.staged += len;
+  if (stream.pendingRecords++ == 0) stream.pendingSince = stamp;
+  stream.lastStamp = stamp;
+
+  // Write every complete chunk; the remainder starts the next one
+  size_t boundary = flushPolicy.chunkSize - stream.position % flushPolicy.chunkSize;
+  while (stream.staged >= boundary) {
+    if (!writeStaged(stream, boundary, false)) break;
+    boundary = flushPolicy.chunkSize;
+  }
+}
+
+bool DataLogger::writeStaged(LogStream& stream, size_t length, bool partial) {
+  bool grows = stream.position + length > stream.allocated;
+
+  unsigned long start = micros();
+  bool ok = stream.file.seek(stream.position) && stream.file.write(stream.staging, length) == length;
+  if (ok && partial) {
+    stream.file.flush();  // A partial sector stays in the FAT cache until synced
+    if (&stream == &streams[LOG_STREAM_WEATHER] && indexFile) indexFile.flush();
+  }
+  uint32_t elapsed = micros() - start;
+
+  // Rollups reach the card whenever the records they summarize do
+  if (ok && partial && &stream == &streams[LOG_STREAM_WEATHER]) saveRollups();
+
+  // Full chunk: every record in it except one cut at the end is on the card
+  size_t remainder = partial ? 0 : stream.staged - length;
+  uint32_t written = stream.pendingRecords - (remainder > 0 && stream.pendingRecords > 0 ? 1 : 0);
+  uint32_t latency = millis() - stream.pendingSince;
+
+  portENTER_CRITICAL(&statsLock);
+  stats.writes++;
+  stats.writeTimeUs += elapsed;
+  if (elapsed > stats.writeMaxUs) stats.writeMaxUs = elapsed;
+  if (!ok) {
+    stats.writeErrors++;
+  } else {
+    stats.bytesWritten += length;
+    stats.recordsWritten += written;
+    if (partial) {
+      stats.partialWrites++;
+      stats.syncs++;
+    }
+    if (written > 0) {
+      stats.latencySumMs += latency;
+      stats.latencyCount++;
+      if (latency > stats.latencyMaxMs) stats.latencyMaxMs = latency;
+    }
+  }
+  portEXIT_CRITICAL(&statsLock);
+
+  if (!ok) {
+    Serial.println(F("[ERROR] SD log write failed"));
+    cardFailures++;
+    return false;
+  }
+  cardFailures = 0;
+
+  if (stream.position + length > stream.allocated) {
+    stream.allocated = stream.position + length;
+  }
+
+  if (partial) {
+    // Stays staged: the next write of this chunk starts at the same offset
+    stream.onCard = length;
+    stream.pendingRecords = 0;
+    stream.dirty = false;
+    stream.lastSync = millis();
+    return true;
+  }
+
+  memmove(stream.staging, stream.staging + length, remainder);
+  stream.staged = remainder;
+  stream.onCard = 0;
+  stream.position += length;
+  stream.pendingRecords -= written;
+  if (stream.pendingRecords > 0) stream.pendingSince = stream.lastStamp;
+
+  // Writes into preallocated space do not change the directory entry
+  if (grows) stream.dirty = true;
+
+  // Bounds the recovery scan after a power loss
+  if (&stream == &streams[LOG_STREAM_WEATHER] && stream.position - checkpointEnd >= LOG_CHECKPOINT_BYTES) {
+    writeCheckpoint(stream, stream.position);
+  }
+  return true;
+}
+
+void DataLogger::syncStream(LogStream& stream) {
+  unsigned long start = micros();
+  stream.file.flush();
+  if (&stream == &streams[LOG_STREAM_WEATHER] && indexFile) indexFile.flush();
+  uint32_t elapsed = micros() - start;
+
+  if (&stream == &streams[LOG_STREAM_WEATHER]) saveRollups();
+
+  stream.dirty = false;
+  stream.lastSync = millis();
+
+  portENTER_CRITICAL(&statsLock);
+  stats.syncs++;
+  stats.writeTimeUs += elapsed;
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void DataLogger::writeCheckpoint(LogStream& stream, uint32_t dataEnd) {
+  if (!LOG_FORMAT_BINARY) return;
+
+  // A chunk boundary usually cuts a record: vouch only for whole ones
+  const LogSchema& schema = weatherLogSchema();
+  dataEnd -= (dataEnd - schema.headerSize()) % schema.recordSize();
+  if (dataEnd <= checkpointEnd) return;
+
+  LogCheckpoint checkpoint;
+  checkpoint.sequence = checkpointSequence + 1;
+  checkpoint.dataEnd = dataEnd;
+  checkpoint.corrupt = journalCorrupt;
+  sealCheckpoint(checkpoint);
+
+  // The data must be on the card before a checkpoint vouches for it; the
+  // slots alternate, so a torn checkpoint leaves the previous one intact
+  unsigned long start = micros();
+  stream.file.flush();
+  bool ok = stream.file.seek(schema.checkpointOffset(checkpoint.sequence % LOG_CHECKPOINT_SLOTS)) &&
+            stream.file.write((const uint8_t*)&checkpoint, sizeof(checkpoint)) == sizeof(checkpoint);
+  stream.file.flush();
+  uint32_t elapsed = micros() - start;
+
+  portENTER_CRITICAL(&statsLock);
+  stats.writes++;
+  stats.writeTimeUs += elapsed;
+  if (ok) {
+    stats.checkpoints++;
+    stats.bytesWritten += sizeof(checkpoint);
+  } else {
+    stats.writeErrors++;
+  }
+  portEXIT_CRITICAL(&statsLock);
+
+  if (ok) {
+    checkpointSequence = checkpoint.sequence;
+    checkpointEnd = dataEnd;
+  }
+}
+
+uint32_t DataLogger::preallocationTarget(uint32_t end) {
+  uint32_t target = end + LOG_PREALLOCATE_BYTES;
+
+  // A partition only lives for a day: past the first hour, reserve no more
+  // than the day is on course to fill, so closed partitions waste little
+  uint32_t elapsed = lastRecordTime % LOG_SECONDS_PER_DAY;
+  uint32_t projected = elapsed >= 3600
+    ? (uint32_t)((uint64_t)end * LOG_SECONDS_PER_DAY / elapsed) + flushPolicy.chunkSize
+    : end + flushPolicy.chunkSize;
+
+  return projected < target ? projected : target;
+}
+
+void DataLogger::preallocate(LogStream& stream) {
+  // Keep the end of the file chunk-aligned
+  size_t length = flushPolicy.chunkSize - stream.allocated % flushPolicy.chunkSize;
+
+  bool ok = stream.file.seek(stream.allocated);
+  for (size_t done = 0; ok && done < length; done += sizeof(erasedBlock)) {
+    size_t n = length - done < sizeof(erasedBlock) ? length - done : sizeof(erasedBlock);
+    ok = stream.file.write(erasedBlock, n) == n;
+  }
+
+  if (!ok) {
+    // Most likely a full card: carry on appending without
+    Serial.println(F("[WARNING] Log preallocation failed - appending instead"));
+    stream.preallocate = false;
+    portENTER_CRITICAL(&statsLock);
+    stats.writeErrors++;
+    portEXIT_CRITICAL(&statsLock);
+    return;
+  }
+
+  // Commit the new size once here instead of after data writes
+  stream.file.flush();
+  stream.allocated += length;
+}
+
+uint32_t DataLogger::recordTime(const uint8_t* record) {
+  return record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t)record[3] << 24);
+}
+
+bool DataLogger::openIndex() {
+  char path[LOG_PARTITION_PATH_MAX];
+  replaceExtension(currentFileName.c_str(), "idx", path, sizeof(path));
+
+  // Rebuilt on every open: the index is derived data and may lag the log
+  // after a power loss. Cheap: one record read per LOG_INDEX_SPACING bytes.
+  indexFile = SD.open(path, FILE_WRITE);
+  if (!indexFile) return false;
+
+  const LogSchema& schema = weatherLogSchema();
+  LogIndexHeader header = {LOG_INDEX_MAGIC, LOG_INDEX_VERSION, sizeof(LogIndexEntry),
+                           LOG_INDEX_SPACING, (uint32_t)schema.headerSize()};
+  indexFile.write((const uint8_t*)&header, sizeof(header));
+  indexNext = 0;
+
+  LogStream& stream = streams[LOG_STREAM_WEATHER];
+  uint32_t dataEnd = stream.position + stream.staged;
+  uint32_t recordSize = schema.recordSize();
+
+  uint8_t record[LOG_MAX_RECORD_SIZE];
+  float values[LOG_MAX_CHANNELS];
+  uint16_t mask;
+
+  for (uint32_t boundary = header.dataStart; boundary < dataEnd; boundary = header.dataStart + indexNext * LOG_INDEX_SPACING) {
+    // First intact record starting at or after the boundary
+    uint32_t index = (boundary - header.dataStart + recordSize - 1) / recordSize;
+    uint32_t offset = header.dataStart + index * recordSize;
+    uint32_t time = 0;
+    bool found = false;
+    for (; offset < dataEnd && !found; offset += recordSize) {
+      if (!stream.file.seek(offset) || (size_t)stream.file.read(record, recordSize) != recordSize) break;
+      found = schema.decode(record, time, values, mask);
+    }
+    if (!found) break;
+    indexRecord(time, offset - recordSize);
+  }
+
+  indexFile.flush();
+  return true;
+}
+
+void DataLogger::indexRecord(uint32_t time, uint32_t offset) {
+  const uint32_t dataStart = weatherLogSchema().headerSize();
+
+  // Entry i: first record at or after dataStart + i * spacing (slot i of the file)
+  while (offset >= dataStart + indexNext * LOG_INDEX_SPACING) {
+    LogIndexEntry entry = {time, offset};
+    if (!indexFile.seek(sizeof(LogIndexHeader) + indexNext * sizeof(entry)) ||
+        indexFile.write((const uint8_t*)&entry, sizeof(entry)) != sizeof(entry)) {
+      return;
+    }
+    indexNext++;
+  }
+}
+
+void DataLogger::rollupRecord(const uint8_t* record) {
+  uint32_t time;
+  uint16_t mask;
+  float values[LOG_MAX_CHANNELS];
+  if (!weatherLogSchema().decode(record, time, values, mask)) return;
+
+  for (uint8_t i = 0; i < LOG_ROLLUP_LEVELS; i++) {
+    LogRollupLevel level = (LogRollupLevel)i;
+    uint32_t start = time - time % rollupPeriod(level);
+
+    if (rollups[i].start != start) {
+      // Moved on (or first record since boot): store the old period, and
+      // carry on from whatever the new one's slot already holds
+      if (rollupDirty[i]) writeRollup(level, rollups[i]);
+      LogRollup next;
+      if (cardState == CARD_BACKFILL && replayStart != 0 && start > replayStart) {
+        // Only replayed records belong here; a backfill cut short may have left a slot
+        next.begin(start);
+      } else {
+        loadRollup(level, start, next);
+      }
+      portENTER_CRITICAL(&rollupLock);
+      rollups[i] = next;
+      portEXIT_CRITICAL(&rollupLock);
+    }
+
+    portENTER_CRITICAL(&rollupLock);
+    rollups[i].add(values, mask);
+    portEXIT_CRITICAL(&rollupLock);
+    rollupDirty[i] = true;
+  }
+}
+
+void DataLogger::rebuildRollups(uint32_t time) {
+  LogRollup rebuilt[LOG_ROLLUP_LEVELS];
+  for (uint8_t i = 0; i < LOG_ROLLUP_LEVELS; i++) {
+    rebuilt[i].begin(time - time % rollupPeriod((LogRollupLevel)i));
+  }
+
+  // The partition of time is open: its records before time, as on the card
+  LogStream& stream = streams[LOG_STREAM_WEATHER];
+  const LogSchema& schema = weatherLogSchema();
+  const uint32_t recordSize = schema.recordSize();
+  uint8_t buffer[512 + LOG_MAX_RECORD_SIZE];
+  size_t have = 0;
+  uint32_t offset = schema.headerSize();
+  float values[LOG_MAX_CHANNELS];
+  uint16_t mask;
+  uint32_t recordTime;
+
+  while (LOG_FORMAT_BINARY && offset < stream.openedEnd && stream.file.seek(offset)) {
+    uint32_t want = stream.openedEnd - offset < 512 ? stream.openedEnd - offset : 512;
+    int n = stream.file.read(buffer + have, want);
+    if (n <= 0) break;
+    offset += n;
+    have += n;
+
+    size_t used = 0;
+    for (; used + recordSize <= have; used += recordSize) {
+      if (!schema.decode(buffer + used, recordTime, values, mask) || recordTime >= time) continue;
+      for (uint8_t i = 0; i < LOG_ROLLUP_LEVELS; i++) {
+        if (recordTime >= rebuilt[i].start) rebuilt[i].add(values, mask);
+      }
+    }
+    memmove(buffer, buffer + used, have - used);
+    have -= used;
+  }
+
+  for (uint8_t i = 0; i < LOG_ROLLUP_LEVELS; i++) {
+    // An earlier period still in RAM has all its records on the card
+    if (rollupDirty[i] && rollups[i].start < rebuilt[i].start) writeRollup((LogRollupLevel)i, rollups[i]);
+    rollupDirty[i] = true;
+  }
+  portENTER_CRITICAL(&rollupLock);
+  memcpy(rollups, rebuilt, sizeof(rebuilt));
+  portEXIT_CRITICAL(&rollupLock);
+  replayStart = time;
+}
+
+void DataLogger::saveRollups() {
+  for (uint8_t i = 0; i < LOG_ROLLUP_LEVELS; i++) {
+    if (rollupDirty[i] && writeRollup((LogRollupLevel)i, rollups[i])) {
+      rollupDirty[i] = false;
+    }
+  }
+}
+
+bool DataLogger::writeRollup(LogRollupLevel level, const LogRollup& rollup) {
+  char path[LOG_PARTITION_PATH_MAX];
+  if (formatRollupPath(LOG_DIR, level, rollup.start, path, sizeof(path)) == 0) return false;
+  makeParentDirs(path);
+
+  unsigned long start = micros();
+  File file = openInPlace(path);
+  if (!file) return false;
+
+  // New file, or one written for another layout: start it over
+  LogRollupHeader header;
+  uint32_t size = file.size();
+  bool ok = true;
+  if (size < sizeof(header) || file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+      !checkRollupHeader(header, level, rollup.start)) {
+    file.close();
+    SD.remove(path);
+    file = openInPlace(path);
+    makeRollupHeader(level, rollup.start, header);
+    ok = file && file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    size = sizeof(header);
+  }
+
+  // Periods without records in between read as unwritten
+  uint32_t offset = rollupSlotOffset(level, rollup.start);
+  ok = ok && file.seek(size);
+  while (ok && size < offset) {
+    size_t n = offset - size < sizeof(erasedBlock) ? offset - size : sizeof(erasedBlock);
+    ok = file.write(erasedBlock, n) == n;
+    size += n;
+  }
+  ok = ok && file.seek(offset) && file.write((const uint8_t*)&rollup, sizeof(rollup)) == sizeof(rollup);
+  if (file) file.close();
+  uint32_t elapsed = micros() - start;
+
+  portENTER_CRITICAL(&statsLock);
+  stats.writes++;
+  stats.writeTimeUs += elapsed;
+  if (ok) {
+    stats.bytesWritten += sizeof(rollup);
+  } else {
+    stats.writeErrors++;
+  }
+  portEXIT_CRITICAL(&statsLock);
+
+  if (!ok) {
+    Serial.print(F("[ERROR] Rollup write failed: "));
+    Serial.println(path);
+  }
+  return ok;
+}
+
+void DataLogger::loadRollup(LogRollupLevel level, uint32_t start, LogRollup& out) {
+  out.begin(start);
+
+  char path[LOG_PARTITION_PATH_MAX];
+  if (formatRollupPath(LOG_DIR, level, start, path, sizeof(path)) == 0 || !SD.exists(path)) return;
+
+  File file = SD.open(path, FILE_READ);
+  if (!file) return;
+
+  LogRollupHeader header;
+  LogRollup stored;
+  if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+      checkRollupHeader(header, level, start) &&
+      file.seek(rollupSlotOffset(level, start)) &&
+      file.read((uint8_t*)&stored, sizeof(stored)) == sizeof(stored) && stored.start == start) {
+    out = stored;
+  }
+  file.close();
+}
+
+void DataLogger::writeHeader(LogStream& stream) {
+  const LogSchema& schema = weatherLogSchema();
+
+  if (LOG_FORMAT_BINARY) {
+    stream.staged += schema.writeHeader(stream.staging + stream.staged, LOG_STAGING_SIZE - stream.staged, getUnixTime());
+    Serial.println(F("[LOG] Binary log header written"));
+    return;
+  }
+
+  stream.staged += schema.formatCsvHeader((char*)stream.staging + stream.staged, LOG_STAGING_SIZE - stream.staged);
   Serial.println(F("[LOG] CSV header written"));
 }
 
-String DataLogger::generateFileName(unsigned long timestamp) {
-  // Format: /logs/weather_YYYY_MM_DD.csv
-  // For simplicity, using a generic name for now
-  // TODO: Implement proper date extraction from RTC
+bool DataLogger::checkBinaryLog(LogStream& stream) {
+  const LogSchema& schema = weatherLogSchema();
+  uint8_t header[LOG_MAX_HEADER_SIZE];
+
+  size_t length = stream.file.seek(0) ? stream.file.read(header, sizeof(header)) : 0;
+
+  LogSchema stored;
+  if (!stored.parse(header, length) || !stored.sameLayout(schema)) {
+    // Written by another firmware version: keep it aside, start a new log
+    Serial.println(F("[LOG] Binary log schema changed - moving old log aside"));
+    stream.file.close();
+    String oldName = currentFileName + ".old";
+    SD.remove(oldName.c_str());
+    SD.rename(currentFileName.c_str(), oldName.c_str());
+    stream.file = openInPlace(currentFileName.c_str());
+    if (!stream.file) return false;
+    stream.allocated = 0;
+    stream.position = 0;
+    writeHeader(stream);
+    return true;
+  }
+
+  // Everything before the newest checkpoint was checked when it was
+  // written: only what follows is scanned, so recovery time does not grow
+  // with the partition
+  unsigned long start = micros();
+  const uint32_t recordSize = stored.recordSize();
+  uint32_t offset = stored.headerSize();
+  LogCheckpoint checkpoint;
+  if (stored.latestCheckpoint(header, length, checkpoint) && checkpoint.dataEnd >= offset &&
+      checkpoint.dataEnd <= stream.allocated && (checkpoint.dataEnd - offset) % recordSize == 0) {
+    offset = checkpoint.dataEnd;
+    checkpointSequence = checkpoint.sequence;
+    journalCorrupt = checkpoint.corrupt;
+  }
+  checkpointEnd = offset;
+
+  // Up to the unwritten (preallocated) space: records that fail their check
+  // are counted and left to be skipped by readers, except a run of them
+  // right before the unwritten space, which is a write torn by a power loss
+  uint32_t end = offset;        // Just past the last intact record
+  uint32_t scanEnd = offset;    // Just past the last written record
+  uint32_t scanned = 0;
+  uint32_t corrupt = 0;
+  uint32_t failedRun = 0;
+  uint8_t buffer[512 + LOG_MAX_RECORD_SIZE];
+  size_t have = 0;
+  bool done = !stream.file.seek(offset);
+  float values[LOG_MAX_CHANNELS];
+  uint16_t mask;
+  uint32_t time;
+
+  while (!done) {
+    int n = stream.file.read(buffer + have, 512);
+    if (n <= 0) break;
+    have += n;
+
+    size_t used = 0;
+    for (; used + recordSize <= have; used += recordSize) {
+      const uint8_t* record = buffer + used;
+      if (stored.isUnwritten(record)) {
+        done = true;
+        break;
+      }
+      scanned++;
+      scanEnd += recordSize;
+      if (stored.decode(record, time, values, mask)) {
+        corrupt += failedRun;
+        failedRun = 0;
+        end = scanEnd;
+      } else {
+        failedRun++;
+      }
+    }
+
+    memmove(buffer, buffer + used, have - used);
+    have -= used;
+  }
+  journalCorrupt += corrupt;
+
+  // Erase the torn tail so new records start on clean space
+  if (scanEnd > end && stream.file.seek(end)) {
+    for (uint32_t erased = end; erased < scanEnd;) {
+      size_t n = scanEnd - erased < sizeof(erasedBlock) ? scanEnd - erased : sizeof(erasedBlock);
+      if (stream.file.write(erasedBlock, n) != n) break;
+      erased += n;
+    }
+    stream.file.flush();
+  }
+  stream.position = end;
+  uint32_t elapsed = micros() - start;
+
+  portENTER_CRITICAL(&statsLock);
+  stats.recoveryUs = elapsed;
+  stats.recoveryScanned = scanned;
+  stats.corruptFound += corrupt;
+  stats.tornRecords += failedRun;
+  portEXIT_CRITICAL(&statsLock);
+
+  if (corrupt > 0 || failedRun > 0) {
+    Serial.print(F("[LOG] Recovery: "));
+    Serial.print(corrupt);
+    Serial.print(F(" corrupt records skipped, "));
+    Serial.print(failedRun);
+    Serial.println(F(" torn records erased"));
+  }
+  return true;
+}
+
+long DataLogger::readRange(uint32_t from, uint32_t to, LogRecordCallback callback, void* context) {
+  if (!ready || !LOG_FORMAT_BINARY) return -1;
+
+  // Nothing is older than the fallback clock or newer than now: bounds the days to visit
+  if (from < LOG_FALLBACK_EPOCH) from = LOG_FALLBACK_EPOCH;
+  uint32_t now = getUnixTime();
+  if (to > now) to = now;
+
+  long total = 0;
+  bool stop = false;
+  char monthDir[LOG_PARTITION_PATH_MAX] = "";
+  bool monthExists = false;
+
+  for (uint32_t day = from / LOG_SECONDS_PER_DAY; from <= to && day <= to / LOG_SECONDS_PER_DAY && !stop; day++) {
+    char path[LOG_PARTITION_PATH_MAX];
+    formatPartitionPath(LOG_DIR, day * LOG_SECONDS_PER_DAY, "wxb", path, sizeof(path));
+
+    // A closed day is compressed; records filed after that (clock set
+    // back) start a new DD.wxb next to it
+    char packed[LOG_PARTITION_PATH_MAX];
+    replaceExtension(path, "wxc", packed, sizeof(packed));
+
+    // One directory check per month rather than one file check per day
+    bool hasPacked = false, hasPath = false;
+    lockCard();
+    size_t dirLength = strrchr(path, '/') - path;
+    if (strncmp(monthDir, path, dirLength) != 0 || monthDir[dirLength] != '\0') {
+      memcpy(monthDir, path, dirLength);
+      monthDir[dirLength] = '\0';
+      monthExists = SD.exists(monthDir);
+    }
+    if (monthExists) {
+      hasPacked = SD.exists(packed);
+      hasPath = SD.exists(path);
+    }
+    unlockCard();
+
+    // Each holds the card for one read at a time: the callbacks run with it free
+    if (hasPacked) {
+      long n = readBlocks(packed, from, to, callback, context, stop);
+      if (n > 0) total += n;
+    }
+    if (!stop && hasPath) {
+      long n = readPartition(path, from, to, callback, context, stop);
+      if (n > 0) total += n;
+    }
+  }
+
+  return total;
+}
+
+long DataLogger::readPartition(const char* path, uint32_t from, uint32_t to,
+                               LogRecordCallback callback, void* context, bool& stop) {
+  lockCard();
+  File data = SD.open(path, FILE_READ);
+  if (!data) {
+    unlockCard();
+    return -1;
+  }
+
+  uint8_t header[LOG_MAX_HEADER_SIZE];
+  LogSchema schema;
+  if (!schema.parse(header, data.read(header, sizeof(header)))) {
+    data.close();
+    unlockCard();
+    return -1;
+  }
+
+  // Start at the last index entry older than from (O(log n) seeks)
+  char indexPath[LOG_PARTITION_PATH_MAX];
+  replaceExtension(path, "idx", indexPath, sizeof(indexPath));
+  uint32_t offset = schema.headerSize();
+  File index = SD.open(indexPath, FILE_READ);
+  if (index) {
+    offset = seekIndex(index, schema.headerSize(), from);
+    index.close();
+  }
+  data.close();
+  unlockCard();
+
+  // Sector-sized reads; a record cut at the end of one is completed by the next.
+  // The file is opened again for each, so the card is free while the callback
+  // formats what it got (a download, a history query), and a partition the
+  // drain task appends to or retention rewrites meanwhile is never read through
+  // a stale handle.
+  uint8_t buffer[512 + LOG_MAX_RECORD_SIZE];
+  const size_t recordSize = schema.recordSize();
+  size_t have = 0;
+  long count = 0;
+  uint32_t corrupt = 0;
+  bool done = false;
+  float values[LOG_MAX_CHANNELS];
+
+  while (!done) {
+    int n = -1;
+    lockCard();
+    data = SD.open(path, FILE_READ);
+    if (data && data.seek(offset)) n = data.read(buffer + have, 512);
+    data.close();
+    unlockCard();
+    if (n <= 0) break;
+    offset += n;
+    have += n;
+
+    size_t used = 0;
+    for (; used + recordSize <= have; used += recordSize) {
+      const uint8_t* record = buffer + used;
+      uint32_t time;
+      uint16_t mask;
+      if (schema.isUnwritten(record)) {
+        done = true;  // Preallocated space: end of the data
+        break;
+      }
+      if (!schema.decode(record, time, values, mask)) {
+        corrupt++;  // Failed its check: never handed on (e.g. into training data)
+        continue;
+      }
+      if (time < from) continue;
+      if (time > to) {
+        done = true;
+        break;
+      }
+      count++;
+      if (!callback(schema, record, time, context)) {
+        stop = true;
+        done = true;
+        break;
+      }
+    }
+
+    memmove(buffer, buffer + used, have - used);
+    have -= used;
+  }
+
+  if (corrupt > 0) {
+    portENTER_CRITICAL(&statsLock);
+    stats.corruptSkipped += corrupt;
+    portEXIT_CRITICAL(&statsLock);
+  }
+  return count;
+}
+
+long DataLogger::readBlocks(const char* path, uint32_t from, uint32_t to,
+                            LogRecordCallback callback, void* context, bool& stop) {
+  lockCard();
+  File data = SD.open(path, FILE_READ);
+  if (!data) {
+    unlockCard();
+    return -1;
+  }
+
+  uint8_t header[LOG_MAX_HEADER_SIZE];
+  LogSchema schema;
+  bool blocks = schema.parse(header, data.read(header, sizeof(header))) && (schema.getFlags() & LOG_FLAG_BLOCKS);
+  data.close();
+  unlockCard();
+  if (!blocks) return -1;
+
+  uint8_t payload[LOG_BLOCK_MAX_BYTES];
+  uint8_t record[LOG_MAX_RECORD_SIZE];
+  LogBlockReader reader;
+  uint32_t offset = schema.headerSize();
+  long count = 0;
+  uint32_t corrupt = 0;
+  bool done = false;
+
+  // One block per hold of the card (opened again each time, as in readPartition())
+  while (!done) {
+    LogBlockHeader block;
+    int status = -1;                  // -1 end or unreadable, 0 skipped, 1 payload read
+    lockCard();
+    data = SD.open(path, FILE_READ);
+    if (data && data.seek(offset) && data.read((uint8_t*)&block, sizeof(block)) == sizeof(block)) {
+      if (!checkBlockHeader(block)) {
+        corrupt++;  // Nothing says where the next block starts
+      } else if (block.firstTime > to) {
+        // Past the range: done
+      } else if (block.lastTime < from) {
+        status = 0;  // Whole blocks before the range are skipped unread
+      } else {
+        status = data.read(payload, block.length) == block.length ? 1 : 0;
+        if (status == 0) corrupt += block.records;
+      }
+    }
+    data.close();
+    unlockCard();
+    if (status < 0) break;
+    offset += sizeof(block) + block.length;
+    if (status == 0) continue;
+
+    if (!reader.begin(schema, block, payload)) {
+      corrupt += block.records;
+      continue;
+    }
+
+    uint32_t time;
+    while (reader.next(record, time)) {
+      if (time < from) continue;
+      if (time > to) {
+        done = true;
+        break;
+      }
+      count++;
+      if (!callback(schema, record, time, context)) {
+        stop = true;
+        done = true;
+        break;
+      }
+    }
+    if (reader.failed()) corrupt++;
+  }
+
+  if (corrupt > 0) {
+    portENTER_CRITICAL(&statsLock);
+    stats.corruptSkipped += corrupt;
+    portEXIT_CRITICAL(&statsLock);
+  }
+  return count;
+}
+
+int DataLogger::compactSlice(uint32_t day) {
+  if (!encoder || day == currentDay) {
+    abandonCompaction();
+    return -1;
+  }
+
+  char path[LOG_PARTITION_PATH_MAX], packed[LOG_PARTITION_PATH_MAX], temp[LOG_PARTITION_PATH_MAX];
+  formatPartitionPath(LOG_DIR, day * LOG_SECONDS_PER_DAY, "wxb", path, sizeof(path));
+  replaceExtension(path, "wxc", packed, sizeof(packed));
+  replaceExtension(path, "wxt", temp, sizeof(temp));
+
+  unsigned long start = micros();
+  Compaction& job = compaction;
+  if (job.day != day) {
+    abandonCompaction();
+
+    // Left by a power loss: complete once DD.wxb is gone, else start over
+    if (SD.exists(temp)) {
+      if (!SD.exists(path)) {
+        SD.remove(packed);
+        return SD.rename(temp, packed) ? 0 : -1;
+      }
+      SD.remove(temp);
+    }
+    if (!SD.exists(path)) return 0;
+
+    if (!startCompaction(day, path, packed, temp)) {
+      abandonCompaction();
+      Serial.print(F("[ERROR] Log compaction failed: "));
+      Serial.println(path);
+      return -1;
+    }
+    job.busyUs = micros() - start;
+    return 1;
+  }
+
+  // Blocks are independent: an earlier DD.wxc's are copied over as they are
+  bool ok = true;
+  bool finished = false;
+  size_t budget = LOG_RETENTION_SLICE_BYTES;
+  while (ok && job.previous && budget > 0) {
+    int n = job.previous.read(blockBuffer, budget < LOG_BLOCK_MAX_BYTES ? budget : LOG_BLOCK_MAX_BYTES);
+    if (n <= 0) {
+      job.previous.close();
+      break;
+    }
+    ok = job.out.write(blockBuffer, n) == (size_t)n;
+    budget -= n;
+  }
+
+  // Then the records (failed ones dropped) through the encoder, stopping at
+  // the preallocated space. Reads are whole records, so only the end of the
+  // file leaves a part of one.
+  const LogSchema& schema = job.schema;
+  const size_t recordSize = schema.recordSize();
+  uint8_t buffer[512];
+  const size_t span = sizeof(buffer) / recordSize * recordSize;
+  float values[LOG_MAX_CHANNELS];
+  uint32_t time;
+  uint16_t mask;
+
+  while (ok && !job.previous && !finished && budget > 0) {
+    int n = job.data.read(buffer, span);
+    finished = n < (int)span;
+    if (n < 0) n = 0;
+    budget = (size_t)n < budget ? budget - n : 0;
+
+    for (size_t used = 0; used + recordSize <= (size_t)n; used += recordSize) {
+      const uint8_t* record = buffer + used;
+      if (schema.isUnwritten(record)) {
+        finished = true;
+        break;
+      }
+      job.dataEnd += recordSize;
+      if (!schema.decode(record, time, values, mask)) {
+        job.corrupt++;
+        continue;
+      }
+      if (encoder->full()) {
+        size_t length = encoder->emit(blockBuffer, sizeof(LogBlockHeader) + LOG_BLOCK_MAX_BYTES);
+        if (job.out.write(blockBuffer, length) != length) {
+          ok = false;
+          break;
+        }
+      }
+      encoder->add(record);
+    }
+  }
+  while (ok && finished && encoder->pending() > 0) {
+    size_t length = encoder->emit(blockBuffer, sizeof(LogBlockHeader) + LOG_BLOCK_MAX_BYTES);
+    ok = job.out.write(blockBuffer, length) == length;
+  }
+  job.busyUs += micros() - start;
+
+  if (!ok) {
+    abandonCompaction();
+    Serial.print(F("[ERROR] Log compaction failed: "));
+    Serial.println(path);
+    return -1;
+  }
+  if (!finished) return 1;
+
+  job.data.close();
+  job.out.flush();
+  uint32_t packedSize = job.out.size();
+  job.out.close();
+
+  // Removing DD.wxb commits the rewrite
+  char indexPath[LOG_PARTITION_PATH_MAX];
+  replaceExtension(path, "idx", indexPath, sizeof(indexPath));
+  SD.remove(path);
+  SD.remove(indexPath);
+  SD.remove(packed);
+  SD.rename(temp, packed);
+  job.day = 0;
+  uint32_t elapsed = job.busyUs + (micros() - start);
+
+  portENTER_CRITICAL(&statsLock);
+  stats.compactedPartitions++;
+  stats.compactedBytesIn += job.dataEnd;
+  stats.compactedBytesOut += packedSize - job.previousSize;
+  stats.compactUs = elapsed;
+  stats.corruptSkipped += job.corrupt;
+  portEXIT_CRITICAL(&statsLock);
+
+  Serial.print(F("[LOG] Compressed "));
+  Serial.print(path);
+  Serial.print(F(": "));
+  Serial.print(job.dataEnd);
+  Serial.print(F(" -> "));
+  Serial.print(packedSize);
+  Serial.print(F(" bytes, "));
+  Serial.print(elapsed / 1000);
+  Serial.println(F(" ms of card time"));
+  return 0;
+}
+
+bool DataLogger::startCompaction(uint32_t day, const char* path, const char* packed, const char* temp) {
+  Compaction& job = compaction;
+  job.day = day;
+  job.corrupt = 0;
+  job.previousSize = 0;
+
+  job.data = SD.open(path, FILE_READ);
+  if (!job.data) return false;
+
+  uint8_t header[LOG_MAX_HEADER_SIZE];
+  size_t headerLength = job.data.read(header, sizeof(header));
+  if (!job.schema.parse(header, headerLength) || (job.schema.getFlags() & LOG_FLAG_BLOCKS)) {
+    return false;
+  }
+  job.dataEnd = job.schema.headerSize();
+  if (!job.data.seek(job.dataEnd)) return false;
+
+  job.out = SD.open(temp, FILE_WRITE);
+  if (!job.out) return false;
+  encoder->begin(job.schema);
+
+  // Appending to an earlier DD.wxc: its header and blocks go first, as they are
+  job.previous = SD.open(packed, FILE_READ);
+  if (job.previous) {
+    job.previousSize = job.previous.size();
+    uint8_t previousHeader[LOG_MAX_HEADER_SIZE];
+    LogSchema previousSchema;
+    return previousSchema.parse(previousHeader, job.previous.read(previousHeader, sizeof(previousHeader))) &&
+           previousSchema.sameLayout(job.schema) && job.previous.seek(0);
+  }
+
+  LogFileHeader fileHeader;
+  memcpy(&fileHeader, header, sizeof(fileHeader));
+  size_t n = job.schema.writeHeader(header, sizeof(header), fileHeader.created, LOG_FLAG_BLOCKS);
+  return job.out.write(header, n) == n;
+}
+
+void DataLogger::abandonCompaction() {
+  Compaction& job = compaction;
+  if (job.day == 0) return;
+
+  job.data.close();
+  job.out.close();
+  job.previous.close();
+
+  char path[LOG_PARTITION_PATH_MAX], temp[LOG_PARTITION_PATH_MAX];
+  formatPartitionPath(LOG_DIR, job.day * LOG_SECONDS_PER_DAY, "wxb", path, sizeof(path));
+  replaceExtension(path, "wxt", temp, sizeof(temp));
+  SD.remove(temp);
+  job.day = 0;
+}
+
+uint32_t DataLogger::seekIndex(File& index, uint32_t dataStart, uint32_t time) {
+  LogIndexHeader header;
+  if (index.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+      header.magic != LOG_INDEX_MAGIC || header.version != LOG_INDEX_VERSION ||
+      header.entrySize != sizeof(LogIndexEntry) || header.dataStart != dataStart) {
+    return dataStart;
+  }
+
+  // Last entry with entry.time < time: every record before it is older
+  uint32_t low = 0;
+  uint32_t high = (index.size() - sizeof(header)) / sizeof(LogIndexEntry);
+  uint32_t offset = dataStart;
+
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    LogIndexEntry entry;
+    if (!index.seek(sizeof(header) + mid * sizeof(entry)) ||
+        index.read((uint8_t*)&entry, sizeof(entry)) != sizeof(entry)) {
+      break;
+    }
+    if (entry.time < time) {
+      offset = entry.offset;
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return offset;
+}
+
+long DataLogger::readFile(const char* path, uint32_t offset, uint8_t* buffer, size_t length, uint32_t& size) {
+  if (!ready) return -1;
+
+  long result = -1;
+  lockCard();
+  File file = SD.open(path, FILE_READ);
+  if (file && !file.isDirectory()) {
+    size = file.size();
+    result = 0;
+    if (length > 0 && offset < size && file.seek(offset)) {
+      int n = file.read(buffer, length);
+      result = n > 0 ? n : 0;
+    }
+  }
+  file.close();
+  unlockCard();
+  return result;
+}
+
+/**
+ * exportCSV() state for its readRange() callback
+ */
+struct CsvExport {
+  const DataLogger* logger;
+  File* out;
+  bool headerWritten;
+  bool failed;
+  long records;
+};
+
+bool DataLogger::exportRecord(const LogSchema& schema, const uint8_t* record, uint32_t time, void* context) {
+  CsvExport& job = *static_cast<CsvExport*>(context);
+  char line[LOG_CSV_LINE_MAX];
+
+  // readRange() calls back with the card free: each write takes it
+  job.logger->lockCard();
+  if (!job.headerWritten) {
+    size_t n = schema.formatCsvHeader(line, sizeof(line));
+    job.headerWritten = true;
+    if (job.out->write((const uint8_t*)line, n) != n) job.failed = true;
+  }
+
+  size_t n = schema.formatCsv(record, line, sizeof(line));
+  if (n == 0 || job.out->write((const uint8_t*)line, n) != n) job.failed = true;
+  job.logger->unlockCard();
+
+  // Large exports take longer than the watchdog timeout
+  if (++job.records % 256 == 0) esp_task_wdt_reset();
+  return !job.failed;
+}
+
+long DataLogger::exportCSV(uint32_t from, uint32_t to, const char* csvPath) {
+  if (!ready) return -1;
+
+  // Everything queued so far goes to the card first
+  sync();
+
+  lockCard();
+  File out = SD.open(csvPath, FILE_WRITE);
+  unlockCard();
+  if (!out) {
+    Serial.print(F("[ERROR] Cannot create CSV export: "));
+    Serial.println(csvPath);
+    return -1;
+  }
+
+  CsvExport job = {this, &out, false, false, 0};
+  long count = readRange(from, to, exportRecord, &job);
+  lockCard();
+  out.close();
+  unlockCard();
+
+  if (count < 0 || job.failed) {
+    Serial.println(F("[ERROR] CSV export failed"));
+    return -1;
+  }
+
+  Serial.print(F("[LOG] Exported "));
+  Serial.print(count);
+  Serial.print(F(" records to "));
+  Serial.println(csvPath);
+  return count;
+}
+
+bool DataLogger::getCurrentRollup(LogRollupLevel level, LogRollup& out) const {
+  if (level >= LOG_ROLLUP_LEVELS) return false;
+
+  portENTER_CRITICAL(&rollupLock);
+  out = rollups[level];
+  portEXIT_CRITICAL(&rollupLock);
+  return out.start != LOG_ROLLUP_EMPTY;
+}
+
+long DataLogger::readRollups(LogRollupLevel level, uint32_t from, uint32_t to,
+                             LogRollupCallback callback, void* context) {
+  if (!ready || level >= LOG_ROLLUP_LEVELS) return -1;
+
+  if (from < LOG_FALLBACK_EPOCH) from = LOG_FALLBACK_EPOCH;
+  uint32_t now = getUnixTime();
+  if (to > now) to = now;
+
+  const uint32_t period = rollupPeriod(level);
+  from -= from % period;
+
+  LogRollup current;
+  bool haveCurrent = getCurrentRollup(level, current);
+
+  long total = 0;
+  bool stop = false;
+
+  // One file per month (hourly) or year (daily)
+  for (uint32_t first = from; first <= to && !stop; first = rollupFileEnd(level, first)) {
+    uint32_t last = rollupFileEnd(level, first) - period;
+    if (last > to) last = to;
+
+    lockCard();
+    total += readRollupFile(level, first, last, haveCurrent ? &current : nullptr, callback, context, stop);
+    unlockCard();
+  }
+
+  return total;
+}
+
+long DataLogger::readRollupFile(LogRollupLevel level, uint32_t first, uint32_t last, const LogRollup* current,
+                                LogRollupCallback callback, void* context, bool& stop) {
+  char path[LOG_PARTITION_PATH_MAX];
+  File file;
+  if (formatRollupPath(LOG_DIR, level, first, path, sizeof(path)) > 0 && SD.exists(path)) {
+    file = SD.open(path, FILE_READ);
+  }
+
+  LogRollupHeader header;
+  if (file && (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+               !checkRollupHeader(header, level, first) || !file.seek(rollupSlotOffset(level, first)))) {
+    file.close();
+  }
+
+  // Slots are consecutive: read a few at a time
+  LogRollup batch[4];
+  size_t batched = 0;
+  size_t next = 0;
+  long count = 0;
+  const uint32_t period = rollupPeriod(level);
+
+  for (uint32_t start = first; start <= last && !stop; start += period) {
+    if (next == batched && file) {
+      int n = file.read((uint8_t*)batch, sizeof(batch));
+      batched = n > 0 ? n / sizeof(LogRollup) : 0;
+      next = 0;
+      if (batched < 4) file.close();  // End of the file
+    }
+    const LogRollup* rollup = next < batched ? &batch[next++] : nullptr;
+
+    // The slot of the period in progress may lag: RAM has it exactly
+    if (current && current->start == start) rollup = current;
+    if (!rollup || rollup->start != start || rollup->empty()) continue;
+
+    count++;
+    if (!callback(*rollup, context)) stop = true;
+  }
+
+  if (file) file.close();
+  return count;
+}
+
+/**
+ * readSummary() over records: each passed on as a one-reading rollup
+ */
+struct RecordSummary {
+  LogRollupCallback callback;
+  void* context;
+};
+
+static bool summarizeRecord(const LogSchema& schema, const uint8_t* record, uint32_t time, void* context) {
+  RecordSummary& job = *static_cast<RecordSummary*>(context);
+  float values[LOG_MAX_CHANNELS];
+  uint16_t mask;
+  if (!schema.decode(record, time, values, mask)) return true;
+
+  LogRollup rollup;
+  rollup.begin(time);
+  rollup.add(values, mask);
+  return job.callback(rollup, job.context);
+}
+
+long DataLogger::readSummary(uint32_t from, uint32_t to, uint32_t points, LogRollupCallback callback, void* context) {
+  if (!ready) return -1;
+  if (to < from) return 0;
+
+  long resolution = summaryResolution(from, to, points);
+  return readSummaryAt(resolution, from, to, callback, context) < 0 ? -1 : resolution;
+}
+
+long DataLogger::summaryResolution(uint32_t from, uint32_t to, uint32_t points) const {
+  // Coarsest level with at least points periods in the range
+  uint32_t span = to > from ? to - from : 0;
+  for (int level = LOG_ROLLUP_LEVELS - 1; level >= 0; level--) {
+    uint32_t period = rollupPeriod((LogRollupLevel)level);
+    if (span / period >= points) return period;
+  }
+  return 0;
+}
+
+long DataLogger::readSummaryAt(long resolution, uint32_t from, uint32_t to, LogRollupCallback callback, void* context) {
+  if (!ready) return -1;
+  if (to < from) return 0;
+
+  for (uint8_t level = 0; level < LOG_ROLLUP_LEVELS; level++) {
+    if ((long)rollupPeriod((LogRollupLevel)level) == resolution) {
+      return readRollups((LogRollupLevel)level, from, to, callback, context);
+    }
+  }
+
+  RecordSummary job = {callback, context};
+  return readRange(from, to, summarizeRecord, &job);
+}
 
-  return String("/weather.csv");
+String DataLogger::generateFileName(uint32_t time) {
+  char path[LOG_PARTITION_PATH_MAX];
+  formatPartitionPath(LOG_DIR, time, LOG_FORMAT_BINARY ? "wxb" : "csv", path, sizeof(path));
+  return String(path);
 }
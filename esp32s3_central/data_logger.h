@@ -1,6 +1,40 @@
 /**
  * @file data_logger.h
  * @brief SD card data logging for ML training
+ *
+ * Write-behind: writeRecord() and writeNodeSample() only format the record
+ * and push it into a lock-free ring (PSRAM when present), so callers never
+ * wait for the card. A low-priority task drains the ring into one staging
+ * buffer per file and writes whole LogFlushPolicy::chunkSize pieces at
+ * chunk-aligned file offsets. The binary weather log keeps space
+ * preallocated ahead of its data, so those writes do not grow the file.
+ * The card shares its SPI bus with the displays and touch, which loop()
+ * drives on the other core: card access from the tasks holds the bus lock
+ * (spi_bus.h) along with the card's own.
+ *
+ * The weather log is split into day partitions, LOG_DIR/YYYY/MM/DD.wxb (by
+ * record time, UTC), each with a sparse DD.idx time index: a range read
+ * opens only the days it covers and binary-searches the index for its
+ * starting offset. Binary records carry a CRC and commit byte, and the
+ * partition header checkpoints how far the data has been checked: reopening
+ * after a power loss scans only the records past the last checkpoint.
+ *
+ * Once a day is closed, its partition is rewritten as compressed blocks
+ * (DD.wxc, log_compress.h) by LogRetention (log_retention.h), a slice at a
+ * time. Readers take either form.
+ *
+ * As records are drained they also update hourly and daily rollups
+ * (log_rollup.h). The periods in progress are kept in RAM and written to
+ * their slots whenever the log itself is flushed, so views over days or
+ * months read one summary per period instead of every record.
+ *
+ * Without a card at boot, or after LOG_SD_FAIL_LIMIT failed writes in a
+ * row, records go to a flash spool instead (log_spool.h). The card is
+ * probed every LOG_SD_RETRY_MS; when it answers, the spool is replayed
+ * onto it through the same path before anything newer, then logging
+ * carries on as before. A replay cut short by another failure or a reset
+ * starts again from its last commit and skips what is on the card already. Callers see no difference, except that range and
+ * rollup reads only cover what has reached the card.
  */
 
 #ifndef DATA_LOGGER_H
@@ -8,19 +42,109 @@
 
 #include <Arduino.h>
 #include <SD.h>
+#include <atomic>
 #include "config.h"
+#include "node_registry.h"
+#include "log_format.h"
+#include "log_ring.h"
+#include "log_rollup.h"
+#include "log_compress.h"
+#include "log_spool.h"
 
 /**
- * CSV record structure for logging
+ * Called by DataLogger::readRange() for each record; return false to stop
+ */
+typedef bool (*LogRecordCallback)(const LogSchema& schema, const uint8_t* record, uint32_t time, void* context);
+
+/**
+ * Called by DataLogger::readRollups() / readSummary() for each period; return false to stop
+ */
+typedef bool (*LogRollupCallback)(const LogRollup& rollup, void* context);
+
+/**
+ * Files fed through the ring
+ */
+enum LogStreamId : uint8_t {
+  LOG_STREAM_WEATHER,   // Weather log (binary or CSV)
+  LOG_STREAM_NODES,     // Per-node sample CSV
+  LOG_STREAM_COUNT
+};
+
+/**
+ * When queued records reach the card: durability vs. SD bus time
+ */
+struct LogFlushPolicy {
+  uint16_t chunkSize = LOG_WRITE_CHUNK;          // Write unit, 512 or 4096; writes end on a multiple of it
+  uint32_t maxDelayMs = LOG_FLUSH_MAX_DELAY_MS;  // Longest a record may wait in RAM (0 = write every record)
+  uint32_t syncIntervalMs = LOG_SYNC_INTERVAL_MS;  // FAT / directory sync of files that grow by appending
+};
+
+/**
+ * Write-behind statistics
+ */
+struct LogWriterStats {
+  uint32_t ringCapacity = 0;
+  uint32_t ringUsed = 0;           // Bytes queued now
+  uint32_t ringPeak = 0;
+  bool ringInPsram = false;
+  uint32_t recordsQueued = 0;
+  uint32_t recordsDropped = 0;     // Ring full
+  uint32_t recordsWritten = 0;     // Reached the card
+  uint64_t bytesWritten = 0;       // Including rewrites of partial chunks
+  uint32_t writes = 0;
+  uint32_t partialWrites = 0;      // Forced by maxDelayMs / flush()
+  uint32_t syncs = 0;
+  uint32_t writeErrors = 0;
+  uint64_t writeTimeUs = 0;        // Total time spent in SD writes and syncs
+  uint32_t writeMaxUs = 0;
+  uint32_t latencyMaxMs = 0;       // Enqueue to on card, oldest record of each write
+  uint32_t latencySumMs = 0;
+  uint32_t latencyCount = 0;
+  uint32_t preallocatedBytes = 0;  // Binary log space reserved ahead of the data
+  uint32_t checkpoints = 0;        // Journal checkpoints written
+  uint32_t recoveryUs = 0;         // Last partition reopen: tail scan time
+  uint32_t recoveryScanned = 0;    // and records it checked
+  uint32_t corruptFound = 0;       // Failed records found by recovery scans (left in place)
+  uint32_t tornRecords = 0;        // Torn records at the end of the data, erased
+  uint32_t corruptSkipped = 0;     // Failed records skipped by readers
+  uint32_t compactedPartitions = 0;  // Closed days rewritten as compressed blocks
+  uint64_t compactedBytesIn = 0;   // Their .wxb data
+  uint64_t compactedBytesOut = 0;  // and the .wxc files that replaced it
+  uint32_t compactUs = 0;          // Card time of the last rewrite (all its slices)
+  bool cardPresent = true;         // false while records go to the flash spool
+  bool backfilling = false;        // Spooled records being written to the card
+  uint32_t cardLosses = 0;         // Times the card stopped answering
+  uint32_t replaySkipped = 0;      // Spooled records the card already had (a backfill cut short)
+  LogSpoolStats spool;
+
+  /**
+   * Size reduction of the compressed partitions (0 = none yet)
+   */
+  float compressionRatio() const {
+    return compactedBytesOut ? (float)compactedBytesIn / compactedBytesOut : 0.0f;
+  }
+
+  uint32_t latencyMeanMs() const { return latencyCount ? latencySumMs / latencyCount : 0; }
+
+  /**
+   * SD write throughput while writing (KB/s)
+   */
+  float throughputKBps() const {
+    return writeTimeUs ? (float)bytesWritten * 1000.0f / 1024.0f / writeTimeUs : 0.0f;
+  }
+};
+
+/**
+ * Weather record for logging (NAN = not measured, left empty / marked missing)
  */
 struct CSVRecord {
-  String timestamp;        // ISO 8601 format
-  float temp_indoor = 0;
-  float humidity_indoor = 0;
-  float temp_outdoor = 0;
-  float humidity_outdoor = 0;
-  float pressure = 0;
-  float light = 0;
+  uint32_t timestamp = 0;  // Unix time (UTC)
+  float temp_indoor = NAN;
+  float humidity_indoor = NAN;
+  float temp_outdoor = NAN;
+  float humidity_outdoor = NAN;
+  float pressure = NAN;
+  float light = NAN;
   uint8_t iaq = 0;
 };
 
@@ -28,6 +152,8 @@ struct CSVRecord {
  * Manages SD card data logging
  */
 class DataLogger {
+  friend class LogRetention;          // Maintenance slices under lockCard()
+
 public:
   DataLogger();
 
@@ -37,22 +163,102 @@ public:
   bool begin();
 
   /**
-   * Write a CSV record to SD card
+   * Write a weather record to SD card (packed binary or CSV, see LOG_FORMAT_BINARY)
    */
   bool writeRecord(const CSVRecord& record);
 
   /**
-   * Flush data to SD card
+   * Visit the binary log's records with from <= time <= to, in order
+   * (what is on the card: call sync() first to include queued records).
+   * The card is held for each 512-byte read or compressed block, not while
+   * callback runs, so a slow callback does not hold up the drain task
+   * @return records passed to callback, -1 if not available
+   */
+  long readRange(uint32_t from, uint32_t to, LogRecordCallback callback, void* context);
+
+  /**
+   * Read part of a file on the card (downloads), opened and closed under
+   * the card lock so a partition is never seen halfway through a rewrite
+   * @param size set to the file's size
+   * @return bytes read (0 at or past the end), -1 if there is no such file
+   */
+  long readFile(const char* path, uint32_t offset, uint8_t* buffer, size_t length, uint32_t& size);
+
+  /**
+   * Write the binary log's records in [from, to] to one CSV file
+   * (for the training flow; queued records are flushed first)
+   * @return records written, -1 on error
+   */
+  long exportCSV(uint32_t from = 0, uint32_t to = UINT32_MAX, const char* csvPath = LOG_EXPORT_FILE_NAME);
+
+  /**
+   * Visit the level's summaries of the periods overlapping [from, to], in
+   * order; periods in progress come from RAM, so they are always current
+   * @return summaries passed to callback, -1 if not available
+   */
+  long readRollups(LogRollupLevel level, uint32_t from, uint32_t to, LogRollupCallback callback, void* context);
+
+  /**
+   * Visit [from, to] at the coarsest resolution that still gives at least
+   * points values: daily rollups, hourly rollups, or else the records
+   * themselves (each passed as a one-reading rollup)
+   * @return seconds per summary (0 = records), -1 if not available
+   */
+  long readSummary(uint32_t from, uint32_t to, uint32_t points, LogRollupCallback callback, void* context);
+
+  /**
+   * Seconds per summary that readSummary() picks for [from, to] and points
+   * @return 86400, 3600 or 0 (records)
+   */
+  long summaryResolution(uint32_t from, uint32_t to, uint32_t points) const;
+
+  /**
+   * readSummary() at a resolution from summaryResolution(), so a range can be
+   * read in slices that all come from the same level
+   * @return summaries passed to callback, -1 if not available
+   */
+  long readSummaryAt(long resolution, uint32_t from, uint32_t to, LogRollupCallback callback, void* context);
+
+  /**
+   * Copy of the level's period in progress
+   * @return false if no record has reached a period yet
+   */
+  bool getCurrentRollup(LogRollupLevel level, LogRollup& out) const;
+
+  /**
+   * Append one remote node sample to the per-node log
+   */
+  bool writeNodeSample(const NodeSample& sample);
+
+  /**
+   * Ask the drain task to write out and sync everything queued (returns at once)
    */
   void flush();
 
   /**
-   * Get total records logged
+   * Flush and wait until the ring is empty and all files are synced
+   * @return false on timeout
+   */
+  bool sync(uint32_t timeoutMs = 5000);
+
+  /**
+   * Change the flush policy (chunkSize is clamped to 512 or LOG_WRITE_CHUNK_MAX)
+   */
+  void setFlushPolicy(const LogFlushPolicy& policy);
+  LogFlushPolicy getFlushPolicy() const { return flushPolicy; }
+
+  /**
+   * Copy of the write-behind statistics
+   */
+  void getStats(LogWriterStats& out) const;
+
+  /**
+   * Get total weather records queued for the log
    */
   unsigned long getRecordCount() const { return recordCount; }
 
   /**
-   * Get current file size
+   * Get size of the current weather partition's data (excluding preallocated space)
    */
   unsigned long getFileSize() const { return fileSize; }
 
@@ -61,33 +267,316 @@ public:
    */
   bool isReady() const { return ready; }
 
+  /**
+   * Check if records are reaching the card (not the flash spool)
+   */
+  bool cardReady() const { return ready && cardState == CARD_OK; }
+
 private:
-  File logFile;
+  /**
+   * One log file and its staging buffer (owned by the drain task)
+   */
+  struct LogStream {
+    File file;
+    uint8_t* staging = nullptr;   // Bytes from position on; internal RAM
+    size_t staged = 0;
+    size_t onCard = 0;            // Leading staged bytes already written (partial chunk)
+    uint32_t position = 0;        // File offset of staging[0]
+    uint32_t allocated = 0;       // File size; beyond the data when preallocated
+    uint32_t pendingSince = 0;    // Enqueue time of the oldest record not on the card
+    uint32_t pendingRecords = 0;
+    uint32_t lastStamp = 0;       // Enqueue time of the newest staged record
+    uint32_t lastSync = 0;
+    bool preallocate = false;
+    bool dirty = false;           // Written since the last sync
+    char newestOnCard[21] = "";   // Timestamp of the last record when the file was opened ("" = none)
+    uint32_t openedEnd = 0;       // and the data end then
+  };
+
+  /**
+   * Where drained records go
+   */
+  enum CardState : uint8_t {
+    CARD_OK,
+    CARD_MISSING,                 // To the spool; the card is probed every LOG_SD_RETRY_MS
+    CARD_BACKFILL,                // Card back: the spool is replayed onto it before the ring
+  };
+
+  LogStream streams[LOG_STREAM_COUNT];
   String currentFileName;
+  uint32_t currentDay;                // Day (since 1970) of the open weather partition, 0 = none
+  File indexFile;                     // Its sidecar index
+  uint32_t indexNext;                 // Next index slot to fill
+  uint32_t lastRecordTime;            // Of the newest weather record staged
+  uint32_t checkpointEnd;             // Data end of the partition's newest checkpoint
+  uint32_t checkpointSequence;        // Its sequence number (0 = none yet)
+  uint32_t journalCorrupt;            // Failed records before checkpointEnd
+
+  /**
+   * Closed day being rewritten by compactSlice()
+   */
+  struct Compaction {
+    uint32_t day = 0;             // 0 = none
+    File data;                    // DD.wxb, read up to dataEnd
+    File out;                     // DD.wxt
+    File previous;                // Earlier DD.wxc, copied to the front first
+    LogSchema schema;
+    uint32_t dataEnd = 0;
+    uint32_t previousSize = 0;
+    uint32_t corrupt = 0;
+    uint32_t busyUs = 0;          // Card time of its slices so far
+  };
+
+  Compaction compaction;
+  LogBlockEncoder* encoder;           // Compaction buffers (PSRAM when fitted)
+  uint8_t* blockBuffer;
+  LogRollup rollups[LOG_ROLLUP_LEVELS];  // Periods in progress (drain task writes, under rollupLock)
+  bool rollupDirty[LOG_ROLLUP_LEVELS];   // Changed since last written to its slot
+  mutable portMUX_TYPE rollupLock = portMUX_INITIALIZER_UNLOCKED;
   bool ready;
-  unsigned long recordCount;
-  unsigned long fileSize;
-  unsigned long lastFlush;
+  volatile unsigned long recordCount;
+  volatile unsigned long fileSize;
+
+  LogRing ring;
+  uint8_t* ringBuffer;
+  LogSpool spool;
+  uint8_t* spoolPage;
+  volatile uint8_t cardState;         // CardState (drain task writes)
+  uint32_t cardFailures;              // Failed card writes in a row
+  uint32_t lastCardProbe;
+  uint32_t replayStart;               // First weather record of this backfill (0 = none yet): later periods start empty
+  TaskHandle_t drainTask;
+  SemaphoreHandle_t sdLock;           // Drain task vs. range / rollup readers (card I/O: lockCard())
+  LogFlushPolicy flushPolicy;
+  std::atomic<uint32_t> syncRequests;  // flush() / sync() calls
+  std::atomic<uint32_t> syncsDone;     // Requests the drain task has completed
+  std::atomic<uint32_t> queued;       // Producer-side counters
+  std::atomic<uint32_t> dropped;
+  LogWriterStats stats;               // Drain-side counters, under statsLock
+  mutable portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+  /**
+   * Hold the card: sdLock, then the SPI bus it shares with the displays
+   * and touch (spi_bus.h). All card I/O from running tasks goes between
+   * these two calls
+   */
+  void lockCard() const;
+  void unlockCard() const;
+
+  /**
+   * Queue one record for a stream (any task)
+   */
+  bool enqueue(LogStreamId stream, const void* data, size_t len);
+
+  /**
+   * Drain task body: wait for work, drain, repeat
+   */
+  static void drainTaskMain(void* arg);
+
+  /**
+   * Move queued records into the staging buffers and write what is due
+   */
+  void drain();
+
+  /**
+   * Partition, index, roll up and stage one record from the ring or the spool
+   * @param replay from the spool: a record the card already has is rolled up but not staged again
+   * @return false if the day's partition could not be closed or opened (nothing done)
+   */
+  bool drainRecord(uint8_t id, const uint8_t* record, size_t len, uint32_t stamp, bool replay);
+
+  /**
+   * Give up on the card: records staged and not on it go to the spool
+   * first, then the files are dropped
+   */
+  void cardLost();
+
+  /**
+   * Spool a stream's whole records that are staged and not on the card
+   */
+  void spoolStaged(LogStreamId id);
+
+  /**
+   * Try the card again (every LOG_SD_RETRY_MS); start the backfill if it answers
+   */
+  void probeCard();
+
+  /**
+   * Replay up to LOG_SPOOL_BACKFILL_BYTES of the spool onto the card and
+   * write it out: committed in the spool if it got there, replayed again if not
+   */
+  void backfill();
+
+  /**
+   * Note a stream's newest record on the card as its file opens: where a
+   * backfill cut short by a card failure or a reset had got to
+   */
+  void findNewestOnCard(LogStreamId id);
+
+  /**
+   * A spooled record at or before that point, already on the card
+   */
+  bool replayedBefore(LogStreamId id, const uint8_t* record, size_t len);
+
+  /**
+   * Append one record to a stream's staging buffer, writing full chunks
+   */
+  void stage(LogStreamId id, const uint8_t* data, size_t len, uint32_t stamp);
+
+  /**
+   * Write staged bytes at the stream position (full chunk, or the partial
+   * chunk that stays staged for the next write)
+   */
+  bool writeStaged(LogStream& stream, size_t length, bool partial);
+
+  /**
+   * Commit a stream's file size / directory entry
+   */
+  void syncStream(LogStream& stream);
+
+  /**
+   * Flush the weather partition's data and record dataEnd in its next checkpoint slot
+   */
+  void writeCheckpoint(LogStream& stream, uint32_t dataEnd);
+
+  /**
+   * File size to preallocate the binary log to, for data ending at end
+   */
+  uint32_t preallocationTarget(uint32_t end);
+
+  /**
+   * Extend the binary log's preallocated space by one chunk
+   */
+  void preallocate(LogStream& stream);
+
+  /**
+   * Open a stream's file for in-place writing and load its partial last chunk
+   */
+  bool openStream(LogStreamId id, const char* path);
+
+  /**
+   * Write out and close a stream's file
+   */
+  void closeStream(LogStream& stream);
+
+  /**
+   * Create or open the weather partition for the day of time
+   */
+  bool openLogFile(uint32_t time);
+
+  /**
+   * Unix time of a packed weather record
+   */
+  uint32_t recordTime(const uint8_t* record);
+
+  /**
+   * Add a drained weather record to the periods in progress, storing and
+   * replacing any period it has moved past
+   */
+  void rollupRecord(const uint8_t* record);
+
+  /**
+   * Start a backfill's rollups at its first weather record: the periods
+   * holding time, from the records of the open partition before it
+   */
+  void rebuildRollups(uint32_t time);
+
+  /**
+   * Write the periods in progress that changed to their slots
+   */
+  void saveRollups();
+
+  /**
+   * Write one summary to its slot (creating the file, and filling skipped
+   * slots as unwritten)
+   */
+  bool writeRollup(LogRollupLevel level, const LogRollup& rollup);
+
+  /**
+   * Summary stored for the period at start, or an empty one
+   */
+  void loadRollup(LogRollupLevel level, uint32_t start, LogRollup& out);
+
+  /**
+   * readRollups() for the periods first..last of one file
+   * @param current period in progress (replaces its slot), nullptr if none
+   * @param stop set when the callback asked to stop
+   */
+  long readRollupFile(LogRollupLevel level, uint32_t first, uint32_t last, const LogRollup* current,
+                      LogRollupCallback callback, void* context, bool& stop);
+
+  /**
+   * Open the current partition's index, rebuilt from the data on the card
+   */
+  bool openIndex();
+
+  /**
+   * Add index entries for a record about to be staged at offset
+   */
+  void indexRecord(uint32_t time, uint32_t offset);
+
+  /**
+   * Offset to start reading a partition at for records at or after time
+   * (binary search of its index; dataStart without a usable index)
+   */
+  uint32_t seekIndex(File& index, uint32_t dataStart, uint32_t time);
+
+  /**
+   * readRange() for one partition
+   * @param stop set when the callback asked to stop
+   */
+  long readPartition(const char* path, uint32_t from, uint32_t to,
+                     LogRecordCallback callback, void* context, bool& stop);
+
+  /**
+   * readRange() for one compressed partition: blocks outside [from, to]
+   * are skipped by their headers
+   */
+  long readBlocks(const char* path, uint32_t from, uint32_t to,
+                  LogRecordCallback callback, void* context, bool& stop);
+
+  /**
+   * exportCSV()'s readRange() callback: one CSV line to the export file
+   */
+  static bool exportRecord(const LogSchema& schema, const uint8_t* record, uint32_t time, void* context);
+
+  /**
+   * Rewrite a closed day's DD.wxb as DD.wxc (appending to one already
+   * there), about LOG_RETENTION_SLICE_BYTES per call: call under lockCard()
+   * with the same day until it stops returning 1. Written as DD.wxt, which
+   * becomes DD.wxc once DD.wxb is removed, so a power loss at any point
+   * leaves one complete copy.
+   * @return 1 = more to do, 0 = done, -1 = failed or abandoned (DD.wxb is kept)
+   */
+  int compactSlice(uint32_t day);
+
+  /**
+   * Open the files of a rewrite and write the head of DD.wxt
+   */
+  bool startCompaction(uint32_t day, const char* path, const char* packed, const char* temp);
 
   /**
-   * Create or open log file for today
+   * Drop the rewrite in progress and its DD.wxt (its day was reopened, or it failed)
    */
-  bool openLogFile();
+  void abandonCompaction();
 
   /**
-   * Check if current file needs rotation (> 1MB or new day)
+   * Stage the CSV header, or the binary schema header, of a new weather log
    */
-  bool needsRotation();
+  void writeHeader(LogStream& stream);
 
   /**
-   * Write CSV header
+   * Existing binary log: check its schema, then recover from its newest
+   * checkpoint: scan the records after it to the unwritten space, count
+   * the ones that fail their check and erase a torn tail
+   * @return false if the file cannot be written to
    */
-  void writeHeader();
+  bool checkBinaryLog(LogStream& stream);
 
   /**
-   * Generate filename based on date
+   * Partition path for the day of time (LOG_DIR/YYYY/MM/DD.wxb or .csv)
    */
-  String generateFileName(unsigned long timestamp);
+  String generateFileName(uint32_t time);
 };
 
 #endif // DATA_LOGGER_H
@@ -4,6 +4,7 @@
  */
 
 #include "display_manager.h"
+#include "spi_bus.h"
 #include <TFT_eSPI.h>
 
 // Create 3 TFT instances for each display
@@ -11,6 +12,8 @@ TFT_eSPI tft1 = TFT_eSPI();
 TFT_eSPI tft2 = TFT_eSPI();
 TFT_eSPI tft3 = TFT_eSPI();
 
+static const uint8_t displayCs[] = {DISPLAY_1_CS, DISPLAY_2_CS, DISPLAY_3_CS};
+
 DisplayManager::DisplayManager()
   : currentDisplay(0), initialized(false), backlightBrightness(200) {
   tft[0] = &tft1;
@@ -26,12 +29,20 @@ bool DisplayManager::begin() {
   // Initialize backlight first
   initBacklight();
 
+  // All deselected: a display's CS only goes low while it is drawn to
+  for (uint8_t i = 0; i < 3; i++) {
+    pinMode(displayCs[i], OUTPUT);
+    digitalWrite(displayCs[i], HIGH);
+  }
+
   // Initialize each display with its CS pin
   for (int i = 0; i < 3; i++) {
     selectDisplay(i);
+    beginDraw();
     tft[i]->init();
     tft[i]->setRotation(DISPLAY_ROTATION);
     tft[i]->fillScreen(TFT_BLACK);
+    endDraw();
     delay(100);
   }
 
@@ -45,26 +56,24 @@ bool DisplayManager::begin() {
 
 void DisplayManager::selectDisplay(uint8_t displayNum) {
   if (displayNum > 2) return;
-
-  // Deselect all displays
-  digitalWrite(DISPLAY_1_CS, HIGH);
-  digitalWrite(DISPLAY_2_CS, HIGH);
-  digitalWrite(DISPLAY_3_CS, HIGH);
-
-  // Select requested display
   currentDisplay = displayNum;
-  switch (displayNum) {
-    case 0: digitalWrite(DISPLAY_1_CS, LOW); break;
-    case 1: digitalWrite(DISPLAY_2_CS, LOW); break;
-    case 2: digitalWrite(DISPLAY_3_CS, LOW); break;
-  }
+}
+
+void DisplayManager::beginDraw() {
+  spiBusLock();
+  digitalWrite(displayCs[currentDisplay], LOW);
+}
 
-  delayMicroseconds(10);  // CS setup time
+void DisplayManager::endDraw() {
+  digitalWrite(displayCs[currentDisplay], HIGH);
+  spiBusUnlock();
 }
 
 void DisplayManager::clear(uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->fillScreen(color);
+  endDraw();
 }
 
 void DisplayManager::clearAll(uint16_t color) {
@@ -91,52 +100,72 @@ void DisplayManager::setCursor(int16_t x, int16_t y) {
 
 void DisplayManager::print(const char* str) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->print(str);
+  endDraw();
 }
 
 void DisplayManager::print(const String& str) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->print(str);
+  endDraw();
 }
 
 void DisplayManager::print(float val, uint8_t decimals) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->print(val, decimals);
+  endDraw();
 }
 
 void DisplayManager::print(int val) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->print(val);
+  endDraw();
 }
 
 void DisplayManager::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->drawLine(x0, y0, x1, y1, color);
+  endDraw();
 }
 
 void DisplayManager::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->fillRect(x, y, w, h, color);
+  endDraw();
 }
 
 void DisplayManager::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->drawRect(x, y, w, h, color);
+  endDraw();
 }
 
 void DisplayManager::drawCircle(int16_t x, int16_t y, int16_t r, uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->drawCircle(x, y, r, color);
+  endDraw();
 }
 
 void DisplayManager::fillCircle(int16_t x, int16_t y, int16_t r, uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->fillCircle(x, y, r, color);
+  endDraw();
 }
 
 void DisplayManager::drawPixel(int16_t x, int16_t y, uint16_t color) {
   if (!initialized || tft[currentDisplay] == nullptr) return;
+  beginDraw();
   tft[currentDisplay]->drawPixel(x, y, color);
+  endDraw();
 }
 
 void DisplayManager::setBacklight(uint8_t brightness) {
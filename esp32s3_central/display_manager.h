@@ -28,7 +28,8 @@ public:
   bool begin();
 
   /**
-   * Select a display (0, 1, or 2)
+   * Select the display (0, 1, or 2) the next calls draw on. Its CS is only
+   * driven low, with the SPI bus lock held, while one of them runs
    */
   void selectDisplay(uint8_t displayNum);
 
@@ -130,6 +131,13 @@ private:
    * Initialize backlight PWM
    */
   void initBacklight();
+
+  /**
+   * Take the shared SPI bus (spi_bus.h) and select the current display,
+   * around each drawing call; endDraw() deselects it and gives the bus back
+   */
+  void beginDraw();
+  void endDraw();
 };
 
 #endif // DISPLAY_MANAGER_H
@@ -31,6 +31,7 @@
 #include "touch_handler.h"
 #include "ui_screens.h"
 #include "data_logger.h"
+#include "log_retention.h"
 #include "ml_predictor.h"
 #include "utils.h"
 
@@ -44,6 +45,7 @@ WeatherAPI weatherAPI;
 TouchHandler touchHandler;
 UIScreens uiScreens;
 DataLogger dataLogger;
+LogRetention logRetention;
 MLPredictor mlPredictor;
 
 // ============================================================================
@@ -51,11 +53,11 @@ MLPredictor mlPredictor;
 // ============================================================================
 struct SystemState {
   unsigned long lastSensorRead = 0;
-  unsigned long lastESPNowPoll = 0;
   unsigned long lastWeatherAPI = 0;
   unsigned long lastDisplayRefresh = 0;
   unsigned long lastSDLog = 0;
   unsigned long lastMLPredict = 0;
+  unsigned long lastMLSample = 0;  // Reading time last fed to the predictor
 
   bool wifiConnected = false;
   bool sensorReady = false;
@@ -70,18 +72,6 @@ struct SystemState {
   bool needsRedraw = true;
 } systemState;
 
-// Remote sensor data
-struct RemoteSensorData {
-  float temp_interior = 0;
-  float humidity_interior = 0;
-  float temp_exterior = 0;
-  float humidity_exterior = 0;
-  float pressure_exterior = 0;
-  float light_exterior = 0;
-  unsigned long last_update_interior = 0;
-  unsigned long last_update_exterior = 0;
-} remoteSensorData;
-
 // Weather data from APIs
 struct WeatherData {
   float currentTemp = 0;
@@ -168,10 +158,18 @@ void setup() {
   if (SD.begin(SD_CS)) {
     systemState.sdCardReady = true;
     Serial.println(F("[OK] SD card initialized"));
-    dataLogger.begin();
   } else {
     Serial.println(F("[WARNING] SD card not available"));
   }
+  // Without the card, records go to flash until it is inserted
+  if (dataLogger.begin()) {
+    logRetention.begin(dataLogger);
+  }
+
+  // Stored model; it is retrained from the log in loop()
+  if (ENABLE_ML_PREDICTIONS) {
+    mlPredictor.begin(&dataLogger);
+  }
 
   // Initialize WiFi (non-blocking)
   if (ENABLE_WIFI) {
@@ -235,14 +233,12 @@ void loop() {
     systemState.lastSensorRead = now;
   }
 
-  // Poll remote nodes (ESP-NOW)
-  if (now - systemState.lastESPNowPoll >= ESPNOW_POLL_INTERVAL) {
-    if (systemState.espnowReady) {
-      espnowReceiver.requestUpdate();
-      remoteSensorData.last_update_interior = espnowReceiver.getLastInteriorUpdate();
-      remoteSensorData.last_update_exterior = espnowReceiver.getLastExteriorUpdate();
-    }
-    systemState.lastESPNowPoll = now;
+  // Drain batched samples from remote nodes into the node time series
+  drainRemoteSamples();
+
+  // Link diagnostics: expire unanswered probes, send the next one
+  if (systemState.espnowReady) {
+    espnowReceiver.update();
   }
 
   // Fetch weather from APIs
@@ -256,14 +252,29 @@ void loop() {
   // Update ML prediction
   if (now - systemState.lastMLPredict >= ML_PREDICT_INTERVAL) {
     if (ENABLE_ML_PREDICTIONS) {
-      mlPredictor.update(sensorManager.getLastData());
+      mlPredictor.update();
     }
     systemState.lastMLPredict = now;
   }
 
+  // A model uploaded (or rolled back to) through the web server goes live here, between predictions
+  if (ENABLE_ML_PREDICTIONS) {
+    mlPredictor.applyModelSwitch();
+  }
+
+  // Retrain on the log, a slice per pass so the loop keeps its pace
+  // (starting once NTP has set the clock: until then "the last days" are unknown)
+  if (ENABLE_ML_PREDICTIONS && dataLogger.cardReady()) {
+    if (mlPredictor.retrainDue() && isClockSet()) {
+      uint32_t until = getUnixTime();
+      mlPredictor.trainFromLog(until - ML_TRAIN_DAYS * 86400UL, until);
+    }
+    mlPredictor.trainStep();
+  }
+
   // Log data to SD card
   if (now - systemState.lastSDLog >= SD_LOG_INTERVAL) {
-    if (systemState.sdCardReady && ENABLE_SD_LOGGING) {
+    if (dataLogger.isReady() && ENABLE_SD_LOGGING) {
       logDataToSD();
       systemState.lastSDLog = now;
     }
@@ -307,6 +318,8 @@ void initWiFi() {
         Serial.println(WiFi.localIP());
         // Initialize weather API once WiFi is ready
         weatherAPI.setAPIKeys(OPENWEATHERMAP_API_KEY, TOMORROW_IO_API_KEY);
+        // UTC clock for log timestamps (SNTP runs in the background)
+        configTime(0, 0, NTP_SERVER);
         break;
       case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
         systemState.wifiConnected = false;
@@ -340,6 +353,12 @@ void readLocalSensors() {
     Serial.print(F(" hPa, IAQ: "));
     Serial.println(data.iaq);
   }
+
+  // Every reading feeds the predictor's trends; a failed one repeats the last and is skipped
+  if (ENABLE_ML_PREDICTIONS && data.pressure > 0 && data.timestamp != systemState.lastMLSample) {
+    mlPredictor.sample(data, getUptimeSeconds());
+    systemState.lastMLSample = data.timestamp;
+  }
 }
 
 /**
@@ -367,32 +386,95 @@ void fetchWeatherData() {
       Serial.print(F("°C, "));
       Serial.println(weatherData.description);
     }
+
+    MLSourceReading observed;
+    observed.time = getUptimeSeconds();
+    observed.temperature = weather.temp;
+    observed.humidity = weather.humidity;
+    observed.pressure = weather.pressure > 0 ? weather.pressure : NAN;
+    mlPredictor.observeSource(ML_INPUT_OBSERVATION, observed);
   } else {
     Serial.println(F("[WARNING] Weather API fetch failed"));
   }
+
+  if (weatherAPI.fetchForecast(LATITUDE, LONGITUDE)) {
+    ForecastDay* days = weatherAPI.getForecast();
+    for (int i = 0; i < 5; i++) {
+      weatherData.forecastTemp[i] = days[i].tempMax;
+      weatherData.forecastCondition[i] = days[i].weatherCode;
+      weatherData.forecastRain[i] = days[i].rainProbability;
+    }
+
+    // The next slot, for the predictor (stale once ML_FUSION_FORECAST_MAX_AGE_S old)
+    ForecastSlot slot = weatherAPI.getNextSlot();
+    if (slot.valid) {
+      MLSourceReading forecast;
+      forecast.time = getUptimeSeconds();
+      forecast.temperature = slot.temp;
+      forecast.humidity = slot.humidity;
+      forecast.rainProbability = slot.rainProbability;
+      mlPredictor.observeSource(ML_INPUT_FORECAST, forecast);
+    }
+  } else {
+    Serial.println(F("[WARNING] Forecast fetch failed"));
+  }
 }
 
 /**
  * Log data to SD card in CSV format
  */
 void logDataToSD() {
-  if (!systemState.sdCardReady) return;
+  if (!dataLogger.isReady()) return;
 
   SensorData localData = sensorManager.getLastData();
 
   CSVRecord record;
-  record.timestamp = getISO8601Timestamp();
+  record.timestamp = getUnixTime();
   record.temp_indoor = localData.temperature;
   record.humidity_indoor = localData.humidity;
   record.pressure = localData.pressure;
   record.iaq = localData.iaq;
-  record.temp_outdoor = remoteSensorData.temp_exterior;
-  record.humidity_outdoor = remoteSensorData.humidity_exterior;
-  record.light = remoteSensorData.light_exterior;
 
-  if (dataLogger.writeRecord(record)) {
+  // Only channels the exterior node measures, while it is online; the rest stay NAN (not logged)
+  NodeEntry exterior;
+  if (espnowReceiver.getNodeByType("exterior", exterior) && exterior.isOnline(millis())) {
+    uint8_t mask = exterior.latest.channelMask;
+    if (mask & WX_MASK(WX_CH_TEMPERATURE)) record.temp_outdoor = exterior.latest.temperature;
+    if (mask & WX_MASK(WX_CH_HUMIDITY)) record.humidity_outdoor = exterior.latest.humidity;
+    if (mask & WX_MASK(WX_CH_LIGHT)) record.light = exterior.latest.light;
+  }
+
+  // Not before NTP has set the clock (see LOG_FALLBACK_EPOCH)
+  if (isClockSet() && dataLogger.writeRecord(record)) {
     if (DEBUG_SENSORS) Serial.println(F("[LOG] Data logged to SD"));
   }
+
+  // Same record the model trains on, for its features
+  mlPredictor.observe(record);
+}
+
+/**
+ * Log every sample unpacked from remote node batches
+ */
+void drainRemoteSamples() {
+  NodeSample sample;
+  while (espnowReceiver.popSample(sample)) {
+    if (dataLogger.isReady() && ENABLE_SD_LOGGING && isClockSet()) {
+      dataLogger.writeNodeSample(sample);
+    }
+
+    // The exterior node's channels, at the time each sample was taken
+    if (ENABLE_ML_PREDICTIONS && strcmp(sample.nodeType, "exterior") == 0) {
+      const NodeReading& r = sample.reading;
+      MLSourceReading exterior;
+      exterior.time = getUptimeSeconds(sample.timestamp);
+      if (r.channelMask & WX_MASK(WX_CH_TEMPERATURE)) exterior.temperature = r.temperature;
+      if (r.channelMask & WX_MASK(WX_CH_HUMIDITY)) exterior.humidity = r.humidity;
+      if (r.channelMask & WX_MASK(WX_CH_PRESSURE)) exterior.pressure = r.pressure;
+      if (r.channelMask & WX_MASK(WX_CH_LIGHT)) exterior.light = r.light;
+      mlPredictor.observeSource(ML_INPUT_EXTERIOR, exterior);
+    }
+  }
 }
 
 /**
@@ -406,13 +488,16 @@ void updateDisplay() {
     case 0:  // Home/Main screen
       uiScreens.drawMainScreen(
         sensorManager.getLastData(),
-        remoteSensorData,
+        espnowReceiver,
         weatherData
       );
       break;
-    case 1:  // Weather forecast
-      uiScreens.drawForecastScreen(weatherData);
+    case 1: {  // Weather forecast and the station's nowcast
+      MLNowcast nowcast;
+      mlPredictor.getNowcast(nowcast);
+      uiScreens.drawForecastScreen(weatherData, nowcast);
       break;
+    }
     case 2:  // Heart rate (when active)
       if (ENABLE_HEART_RATE) {
         HeartRateData hrData = sensorManager.getHeartRateData();
@@ -0,0 +1,382 @@
+/**
+ * @file espnow_protocol.h
+ * @brief ESP-NOW wire format shared by the central node and the ESP-01S nodes
+ *
+ * Each sketch folder carries an identical copy of this file (Arduino sketches
+ * cannot include headers from sibling folders). Keep the copies in sync.
+ *
+ * A batch packet carries every sample a node took since its last transmit:
+ *
+ *   BatchHeader | sample 0 | sample 1 | ... | sample N-1
+ *
+ * Each sample is a run of zigzag varints:
+ *   dt      - sample 0: age relative to header.sentAt, then delta to previous
+ *             sample (units of ESPNOW_TIME_UNIT_MS)
+ *   values  - one per bit set in header.channelMask, delta to the previous
+ *             sample's fixed-point value (sample 0: delta to 0)
+ *
+ * The central answers every valid batch with a broadcast AckPacket that
+ * carries its clock (time sync) and the node's TDMA slot: the node's
+ * transmit period is one frame, split into equally spaced slots. A batch
+ * without an ACK is retransmitted with the same sequence number (the
+ * central drops duplicates); header.firstSample numbers every sample a node
+ * takes, so gaps measure end-to-end loss.
+ *
+ * Link diagnostics: an ACK with probeWindowMs > 0 asks the node to stay
+ * awake after its batch. The node announces itself with a ready echo
+ * (probeId 0), the central then sends ProbePackets one at a time and the
+ * node returns each one unchanged except for msgType = ESPNOW_MSG_ECHO.
+ *
+ * Header-only and free of Arduino dependencies so it builds on both cores
+ * and on the host.
+ */
+
+#ifndef ESPNOW_PROTOCOL_H
+#define ESPNOW_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ESPNOW_PROTOCOL_VERSION 6
+#define ESPNOW_MAX_PAYLOAD 250           // ESP-NOW hard limit per frame
+#define ESPNOW_BATCH_MAX_SAMPLES 48      // Upper bound per packet (decoder sanity limit)
+#define ESPNOW_TIME_UNIT_MS 100          // Timestamp resolution on the wire
+#define ESPNOW_NODE_TYPE_LEN 16
+
+// Message types (first bytes after version)
+#define ESPNOW_MSG_BATCH 0x01
+#define ESPNOW_MSG_ACK 0x02
+#define ESPNOW_MSG_PROBE 0x03            // Central -> node, diagnostics only
+#define ESPNOW_MSG_ECHO 0x04             // Node -> central, probe returned as is
+
+// BatchHeader.flags
+#define BATCH_FLAG_IN_SLOT 0x01          // Sent on the node's scheduled slot wake
+
+// Channels carried in a batch (bit index = value index)
+#define WX_CH_TEMPERATURE 0   // centi-degC
+#define WX_CH_HUMIDITY 1      // centi-%RH
+#define WX_CH_PRESSURE 2      // Pa (hPa * 100)
+#define WX_CH_LIGHT 3         // deci-lux
+#define WX_CHANNEL_COUNT 4
+
+#define WX_MASK(ch) (1u << (ch))
+
+/**
+ * One sample in fixed-point form (node side: timestamp = millis())
+ */
+struct WxSample {
+  uint32_t timestamp = 0;               // ms
+  int32_t values[WX_CHANNEL_COUNT] = {0};
+};
+
+/**
+ * Batch packet header (packed, identical layout on ESP8266 and ESP32)
+ */
+struct __attribute__((packed)) BatchHeader {
+  uint8_t version;
+  uint8_t msgType;
+  uint8_t nodeId;
+  uint8_t sampleCount;
+  char nodeType[ESPNOW_NODE_TYPE_LEN];  // "interior", "exterior", room name
+  uint32_t sequence;                    // Per-packet counter, for loss accounting
+  uint32_t sentAt;                      // Node ms clock when the packet was built
+  uint8_t channelMask;                  // WX_MASK() bits present in every sample
+  uint8_t flags;                        // BATCH_FLAG_*
+  uint16_t sendWakeMs;                  // Wake-to-sleep time of the node's last transmit cycle
+  uint16_t readWakeMs;                  // Wake-to-sleep time of its last read-only cycle
+  uint32_t firstSample;                 // Node-wide number of sample 0 (never reused)
+  uint8_t attempt;                      // 0 = first transmission, then retry count
+};
+
+/**
+ * Acknowledgement + time sync + slot assignment (central -> node, broadcast)
+ */
+struct __attribute__((packed)) AckPacket {
+  uint8_t version;
+  uint8_t msgType;
+  uint8_t slot;                         // Slot assigned to the node
+  uint8_t slotCount;                    // Slots per frame
+  uint8_t target[6];                    // Node this ACK is for (ACKs are broadcast)
+  uint32_t sequence;                    // Batch sequence acknowledged
+  uint32_t centralTime;                 // Central ms clock when the ACK was built
+  uint32_t frameMs;                     // Frame length = node transmit period
+  uint32_t nextSlotMs;                  // From centralTime to the start of the node's next slot
+  uint16_t probeWindowMs;               // Stay awake this long echoing probes, 0 = sleep now
+};
+
+/**
+ * Round-trip probe (central -> node) and its echo (node -> central).
+ * Frames may be longer than the struct: the padding is echoed too, so
+ * probes can match the size of real batches.
+ */
+struct __attribute__((packed)) ProbePacket {
+  uint8_t version;
+  uint8_t msgType;                      // ESPNOW_MSG_PROBE or ESPNOW_MSG_ECHO
+  uint16_t probeId;                     // 0 = node is ready for probes (echo only)
+  uint8_t remaining;                    // Probes still to come after this one
+  uint8_t target[6];                    // Node being probed
+  uint32_t sentAtUs;                    // Central us clock when the probe was sent
+};
+
+/**
+ * Validate an ACK and check that it is addressed to mac
+ */
+inline bool parseAck(const uint8_t* data, size_t len, const uint8_t* mac, AckPacket& ack) {
+  if (len != sizeof(AckPacket)) return false;
+  memcpy(&ack, data, sizeof(ack));
+  return ack.version == ESPNOW_PROTOCOL_VERSION && ack.msgType == ESPNOW_MSG_ACK &&
+         ack.frameMs > 0 && memcmp(ack.target, mac, 6) == 0;
+}
+
+/**
+ * Validate a probe or echo frame of the given msgType
+ */
+inline bool parseProbe(const uint8_t* data, size_t len, uint8_t msgType, ProbePacket& probe) {
+  if (len < sizeof(ProbePacket) || len > ESPNOW_MAX_PAYLOAD) return false;
+  memcpy(&probe, data, sizeof(probe));
+  return probe.version == ESPNOW_PROTOCOL_VERSION && probe.msgType == msgType;
+}
+
+// Scaling between float sensor readings and wire values
+inline int32_t wxToFixed(uint8_t channel, float value) {
+  static const float scale[WX_CHANNEL_COUNT] = {100.0f, 100.0f, 100.0f, 10.0f};
+  float scaled = value * scale[channel];
+  return (int32_t)(scaled + (scaled >= 0 ? 0.5f : -0.5f));
+}
+
+inline float wxFromFixed(uint8_t channel, int32_t value) {
+  static const float scale[WX_CHANNEL_COUNT] = {100.0f, 100.0f, 100.0f, 10.0f};
+  return value / scale[channel];
+}
+
+// ============================================================================
+// Varint helpers
+// ============================================================================
+
+inline uint32_t zigzagEncode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+inline size_t varintSize(uint32_t v) {
+  size_t n = 1;
+  while (v >= 0x80) { v >>= 7; n++; }
+  return n;
+}
+
+inline size_t varintWrite(uint32_t v, uint8_t* out) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+/**
+ * @return bytes consumed, 0 on truncated/overlong input
+ */
+inline size_t varintRead(const uint8_t* in, size_t avail, uint32_t& v) {
+  v = 0;
+  for (size_t i = 0; i < avail && i < 5; i++) {
+    v |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+    if ((in[i] & 0x80) == 0) return i + 1;
+  }
+  return 0;
+}
+
+// ============================================================================
+// Encoder (remote nodes)
+// ============================================================================
+
+/**
+ * Builds one batch packet, appending samples until the next one would not fit
+ */
+class BatchEncoder {
+public:
+  void begin(uint8_t nodeId, const char* nodeType, uint32_t sequence,
+             uint32_t sentAt, uint8_t channelMask) {
+    memset(&header, 0, sizeof(header));
+    header.version = ESPNOW_PROTOCOL_VERSION;
+    header.msgType = ESPNOW_MSG_BATCH;
+    header.nodeId = nodeId;
+    // Zeroed above, so the last byte stays the terminator
+    size_t typeLen = strlen(nodeType);
+    memcpy(header.nodeType, nodeType, typeLen < sizeof(header.nodeType) - 1 ? typeLen : sizeof(header.nodeType) - 1);
+    header.sequence = sequence;
+    header.sentAt = sentAt;
+    header.channelMask = channelMask;
+    length = sizeof(BatchHeader);
+    lastTimestamp = sentAt;
+    memset(lastValues, 0, sizeof(lastValues));
+  }
+
+  /**
+   * Append a sample (samples must be added oldest first)
+   * @return false if the packet is full; the sample was not added
+   */
+  bool add(const WxSample& sample) {
+    if (header.sampleCount >= ESPNOW_BATCH_MAX_SAMPLES) return false;
+
+    // Sample 0 is stored as age before sentAt, later ones as forward deltas
+    uint32_t dt = (header.sampleCount == 0)
+                    ? (header.sentAt - sample.timestamp) / ESPNOW_TIME_UNIT_MS
+                    : (sample.timestamp - lastTimestamp) / ESPNOW_TIME_UNIT_MS;
+
+    uint8_t tmp[5 * (WX_CHANNEL_COUNT + 1)];
+    size_t n = varintWrite(dt, tmp);
+    for (uint8_t ch = 0; ch < WX_CHANNEL_COUNT; ch++) {
+      if (!(header.channelMask & WX_MASK(ch))) continue;
+      n += varintWrite(zigzagEncode(sample.values[ch] - lastValues[ch]), tmp + n);
+    }
+
+    if (length + n > ESPNOW_MAX_PAYLOAD) return false;
+
+    memcpy(buffer + length, tmp, n);
+    length += n;
+    header.sampleCount++;
+
+    // Keep timestamps on the wire grid so the decoder reproduces them exactly
+    lastTimestamp = (header.sampleCount == 1)
+                      ? header.sentAt - dt * ESPNOW_TIME_UNIT_MS
+                      : lastTimestamp + dt * ESPNOW_TIME_UNIT_MS;
+    memcpy(lastValues, sample.values, sizeof(lastValues));
+    return true;
+  }
+
+  void setFlags(uint8_t flags) { header.flags = flags; }
+
+  /**
+   * Number the samples (firstSample) and mark retransmissions (attempt > 0)
+   */
+  void setDelivery(uint32_t firstSample, uint8_t attempt) {
+    header.firstSample = firstSample;
+    header.attempt = attempt;
+  }
+
+  /**
+   * Report the node's measured awake windows (0 = unknown)
+   */
+  void setWakeTimes(uint16_t sendWakeMs, uint16_t readWakeMs) {
+    header.sendWakeMs = sendWakeMs;
+    header.readWakeMs = readWakeMs;
+  }
+
+  uint8_t sampleCount() const { return header.sampleCount; }
+
+  /**
+   * Finalized packet bytes (valid until the next begin())
+   */
+  const uint8_t* data() {
+    memcpy(buffer, &header, sizeof(header));
+    return buffer;
+  }
+
+  size_t size() const { return length; }
+
+private:
+  BatchHeader header;
+  uint8_t buffer[ESPNOW_MAX_PAYLOAD];
+  size_t length = 0;
+  uint32_t lastTimestamp = 0;
+  int32_t lastValues[WX_CHANNEL_COUNT];
+};
+
+// ============================================================================
+// Decoder (central node)
+// ============================================================================
+
+/**
+ * Streams samples out of a batch packet without copying or allocating.
+ * Timestamps come out on the sender's clock (same base as header.sentAt).
+ */
+class BatchDecoder {
+public:
+  /**
+   * Validate the header
+   * @return false if the packet is not a well-formed batch
+   */
+  bool begin(const uint8_t* packet, size_t len) {
+    data = packet;
+    length = len;
+    error = false;
+    if (len < sizeof(BatchHeader)) return false;
+
+    memcpy(&header, packet, sizeof(header));
+    header.nodeType[ESPNOW_NODE_TYPE_LEN - 1] = '\0';
+
+    if (header.version != ESPNOW_PROTOCOL_VERSION || header.msgType != ESPNOW_MSG_BATCH) return false;
+    if (header.sampleCount == 0 || header.sampleCount > ESPNOW_BATCH_MAX_SAMPLES) return false;
+    if (header.channelMask == 0 || (header.channelMask >> WX_CHANNEL_COUNT) != 0) return false;
+
+    offset = sizeof(BatchHeader);
+    decoded = 0;
+    lastTimestamp = header.sentAt;
+    memset(lastValues, 0, sizeof(lastValues));
+    return true;
+  }
+
+  /**
+   * Decode the next sample
+   * @return false when done or on malformed data (check failed())
+   */
+  bool next(WxSample& sample) {
+    if (decoded >= header.sampleCount) return false;
+
+    uint32_t raw;
+    size_t n = varintRead(data + offset, length - offset, raw);
+    if (n == 0) return fail();
+    offset += n;
+
+    sample.timestamp = (decoded == 0) ? header.sentAt - raw * ESPNOW_TIME_UNIT_MS
+                                      : lastTimestamp + raw * ESPNOW_TIME_UNIT_MS;
+
+    for (uint8_t ch = 0; ch < WX_CHANNEL_COUNT; ch++) {
+      if (!(header.channelMask & WX_MASK(ch))) {
+        sample.values[ch] = 0;
+        continue;
+      }
+      n = varintRead(data + offset, length - offset, raw);
+      if (n == 0) return fail();
+      offset += n;
+      sample.values[ch] = lastValues[ch] + zigzagDecode(raw);
+    }
+
+    lastTimestamp = sample.timestamp;
+    memcpy(lastValues, sample.values, sizeof(lastValues));
+    decoded++;
+    return true;
+  }
+
+  /**
+   * True once all samples were decoded and no bytes are left over
+   */
+  bool complete() const { return !error && decoded == header.sampleCount && offset == length; }
+
+  bool failed() const { return error; }
+
+  const BatchHeader& getHeader() const { return header; }
+
+private:
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  size_t offset = 0;
+  uint8_t decoded = 0;
+  bool error = false;
+  BatchHeader header;
+  uint32_t lastTimestamp = 0;
+  int32_t lastValues[WX_CHANNEL_COUNT];
+
+  bool fail() {
+    error = true;
+    decoded = header.sampleCount;  // Stop further next() calls
+    return false;
+  }
+};
+
+#endif // ESPNOW_PROTOCOL_H
@@ -5,10 +5,18 @@
 
 #include "espnow_receiver.h"
 
+static_assert(NODE_REGISTRY_CAPACITY <= 255, "AckPacket.slotCount is a uint8_t");
+static_assert(DIAG_PROBE_BYTES <= ESPNOW_MAX_PAYLOAD, "probes must fit one ESP-NOW frame");
+static_assert(DIAG_PROBES_PER_WAKE <= 255, "ProbePacket.remaining is a uint8_t");
+
 // Static instance for callback
 static ESPNowReceiver* espnowInstance = nullptr;
 
-ESPNowReceiver::ESPNowReceiver() {
+// ACKs are broadcast so nodes never need to be registered as peers
+static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+ESPNowReceiver::ESPNowReceiver()
+  : schedule(TDMA_FRAME_MS, NODE_REGISTRY_CAPACITY, TDMA_GUARD_MS, TDMA_MIN_LEAD_MS) {
   espnowInstance = this;
 }
 
@@ -25,6 +33,16 @@ bool ESPNowReceiver::begin() {
   // Register callbacks
   esp_now_register_recv_cb(onDataReceive);
   esp_now_register_send_cb(onDataSent);
+  addPeer(broadcastMac);
+
+#if ESP_IDF_VERSION_MAJOR < 5
+  // Capture RSSI of incoming ESP-NOW action frames (management frames only)
+  wifi_promiscuous_filter_t filter = {};
+  filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+  esp_wifi_set_promiscuous_filter(&filter);
+  esp_wifi_set_promiscuous_rx_cb(onPromiscuousRx);
+  esp_wifi_set_promiscuous(true);
+#endif
 
   Serial.println(F("[OK] ESP-NOW initialized"));
   return true;
@@ -48,65 +66,398 @@ void ESPNowReceiver::addPeer(const uint8_t* macAddr) {
   }
 }
 
-void ESPNowReceiver::requestUpdate() {
-  // Send request to all peers
-  uint8_t request[] = {0xAA, 0x55};  // Simple handshake pattern
+size_t ESPNowReceiver::getNodeCount() const {
+  portENTER_CRITICAL(&registryLock);
+  size_t count = registry.size();
+  portEXIT_CRITICAL(&registryLock);
+  return count;
+}
+
+bool ESPNowReceiver::getNode(size_t index, NodeEntry& out) const {
+  bool found = false;
+
+  portENTER_CRITICAL(&registryLock);
+  if (index < registry.size()) {
+    out = registry.at(index);
+    found = true;
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  return found;
+}
+
+bool ESPNowReceiver::getNodeByType(const char* nodeType, NodeEntry& out) const {
+  bool found = false;
+
+  portENTER_CRITICAL(&registryLock);
+  const NodeEntry* entry = registry.findByType(nodeType);
+  if (entry != nullptr) {
+    out = *entry;
+    found = true;
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  return found;
+}
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+void ESPNowReceiver::onDataReceive(const esp_now_recv_info_t* info, const uint8_t* data, int len) {
+  if (espnowInstance == nullptr) return;
+  espnowInstance->handlePacket(info->src_addr, data, len, (int8_t)info->rx_ctrl->rssi);
+}
+#else
+// Last ESP-NOW frame seen by the promiscuous hook (source MAC + RSSI)
+static volatile int8_t promiscuousRssi = 0;
+static uint8_t promiscuousMac[6] = {0};
 
-  uint8_t interiorMac[] = ESPNOW_MAC_INTERIOR;
-  uint8_t exteriorMac[] = ESPNOW_MAC_EXTERIOR;
+void ESPNowReceiver::onPromiscuousRx(void* buf, wifi_promiscuous_pkt_type_t type) {
+  if (type != WIFI_PKT_MGMT) return;
 
-  esp_now_send(interiorMac, request, sizeof(request));
-  esp_now_send(exteriorMac, request, sizeof(request));
+  const wifi_promiscuous_pkt_t* pkt = (const wifi_promiscuous_pkt_t*)buf;
+  const uint8_t* frame = pkt->payload;
+
+  // Action frame (subtype 0xD0), vendor-specific category 127 = ESP-NOW
+  if (pkt->rx_ctrl.sig_len < 25 || frame[0] != 0xD0 || frame[24] != 0x7F) return;
+
+  memcpy(promiscuousMac, frame + 10, 6);  // addr2 = transmitter
+  promiscuousRssi = (int8_t)pkt->rx_ctrl.rssi;
 }
 
 void ESPNowReceiver::onDataReceive(const uint8_t* mac, const uint8_t* data, int len) {
   if (espnowInstance == nullptr) return;
 
-  // CRITICAL: Validate packet size BEFORE memcpy
-  if (len != sizeof(ESPNowData)) {
-    Serial.print(F("[ERROR] Invalid ESP-NOW packet size: "));
+  // The promiscuous hook runs just before this callback for the same frame
+  int8_t rssi = (memcmp(promiscuousMac, mac, 6) == 0) ? promiscuousRssi : 0;
+  espnowInstance->handlePacket(mac, data, len, rssi);
+}
+#endif
+
+/**
+ * Convert a wire sample to float readings
+ */
+static NodeReading toReading(const WxSample& sample, uint8_t channelMask) {
+  NodeReading reading;
+  reading.temperature = wxFromFixed(WX_CH_TEMPERATURE, sample.values[WX_CH_TEMPERATURE]);
+  reading.humidity = wxFromFixed(WX_CH_HUMIDITY, sample.values[WX_CH_HUMIDITY]);
+  reading.pressure = wxFromFixed(WX_CH_PRESSURE, sample.values[WX_CH_PRESSURE]);
+  reading.light = wxFromFixed(WX_CH_LIGHT, sample.values[WX_CH_LIGHT]);
+  reading.remoteTimestamp = sample.timestamp;
+  reading.channelMask = channelMask;
+  return reading;
+}
+
+void ESPNowReceiver::handlePacket(const uint8_t* mac, const uint8_t* data, int len, int8_t rssi) {
+  if (len >= 2 && data[1] == ESPNOW_MSG_ECHO) {
+    handleEcho(mac, data, len, rssi);
+    return;
+  }
+
+  BatchDecoder decoder;
+  WxSample sample;
+
+  // Pass 1: validate the whole packet before touching any state
+  bool valid = len > 0 && decoder.begin(data, len);
+  if (valid) {
+    while (decoder.next(sample)) {}
+    valid = decoder.complete();
+  }
+
+  if (!valid) {
+    rejectedCount++;
+    Serial.print(F("[ERROR] Invalid ESP-NOW packet, "));
     Serial.print(len);
-    Serial.print(F(" (expected "));
-    Serial.print(sizeof(ESPNowData));
-    Serial.println(F(")"));
+    Serial.println(F(" bytes"));
     return;  // Reject invalid packet
   }
 
-  ESPNowData receivedData;
-  memcpy(&receivedData, data, len);
+  // Pass 1 left the newest sample of the batch in sample: that one goes to the registry
+  const BatchHeader& header = decoder.getHeader();
+  uint32_t now = millis();
+  NodeReading reading = toReading(sample, header.channelMask);
 
-  // Ensure null-terminated strings to prevent buffer overrun in strcmp()
-  receivedData.nodeType[sizeof(receivedData.nodeType) - 1] = '\0';
+  portENTER_CRITICAL(&registryLock);
 
-  // Determine which node sent data
-  if (strcmp(receivedData.nodeType, "interior") == 0) {
-    espnowInstance->lastInteriorData = receivedData;
-    espnowInstance->lastInteriorUpdate = millis();
+  // A retransmission whose first copy already got through (our ACK was lost):
+  // acknowledge again, but do not queue or count the samples twice
+  NodeEntry* previous = registry.find(mac);
+  if (previous != nullptr && previous->packetCount > 0 && header.sequence == previous->lastSequence) {
+    previous->duplicateCount++;
+    previous->lastSeen = now;
+    uint8_t slot = previous->slot;
+    uint16_t window = grantProbeWindow(mac, slot, now);
+    portEXIT_CRITICAL(&registryLock);
+    sendAck(mac, header.sequence, slot, window);
+    return;
+  }
+  uint32_t previousSeen = previous ? previous->lastSeen : 0;
+  bool known = previous != nullptr;
+
+  // Registry keeps the newest sample of the batch. A node it has no room for
+  // gets no ACK and none of its samples are queued, so its retransmissions
+  // cannot queue the same batch again.
+  NodeEntry* entry = registry.update(mac, header.nodeType, reading, header.sequence,
+                                     rssi, now, header.sampleCount, header.firstSample);
+  uint8_t slot = 0;
+  uint16_t window = 0;
+  if (entry != nullptr) {
+    // Pass 2: queue every sample, timestamped on the central clock
+    decoder.begin(data, len);
+    while (decoder.next(sample)) {
+      if (sampleCount == ESPNOW_SAMPLE_QUEUE_SIZE) {
+        // Queue full: overwrite the oldest sample
+        sampleHead = (sampleHead + 1) % ESPNOW_SAMPLE_QUEUE_SIZE;
+        sampleCount--;
+        droppedSamples++;
+      }
 
-    if (DEBUG_ESPNOW) {
-      Serial.print(F("[ESPNOW] Interior: T="));
-      Serial.print(receivedData.temperature);
-      Serial.print(F("°C H="));
-      Serial.print(receivedData.humidity);
-      Serial.println(F("%"));
+      NodeSample& queued = sampleQueue[(sampleHead + sampleCount) % ESPNOW_SAMPLE_QUEUE_SIZE];
+      memcpy(queued.mac, mac, 6);
+      memcpy(queued.nodeType, header.nodeType, NODE_TYPE_MAX_LEN);
+      queued.timestamp = now - (header.sentAt - sample.timestamp);
+      queued.reading = toReading(sample, header.channelMask);
+      sampleCount++;
     }
-  } else if (strcmp(receivedData.nodeType, "exterior") == 0) {
-    espnowInstance->lastExteriorData = receivedData;
-    espnowInstance->lastExteriorUpdate = millis();
-
-    if (DEBUG_ESPNOW) {
-      Serial.print(F("[ESPNOW] Exterior: T="));
-      Serial.print(receivedData.temperature);
-      Serial.print(F("°C H="));
-      Serial.print(receivedData.humidity);
-      Serial.print(F("% P="));
-      Serial.print(receivedData.pressure);
-      Serial.println(F(" hPa"));
+
+    entry->sendWakeMs = header.sendWakeMs;
+    entry->readWakeMs = header.readWakeMs;
+    if (header.attempt > 0) entry->retryCount++;
+    entry->slotErrorMs = schedule.slotError(entry->slot, now);
+    slot = entry->slot;
+
+    // Only transmits the node scheduled on its slot count towards misses
+    if (header.flags & BATCH_FLAG_IN_SLOT) {
+      if (!schedule.inSlot(entry->slot, now)) {
+        entry->slotMisses++;
+      }
+      // Whole frames without any packet are missed slots too
+      uint32_t frames = known ? (now - previousSeen + schedule.frameMs() / 2) / schedule.frameMs() : 0;
+      if (frames > 1) {
+        entry->slotMisses += frames - 1;
+      }
     }
-  } else {
-    Serial.print(F("[ERROR] Unknown node type: "));
-    Serial.println(receivedData.nodeType);
+
+    window = grantProbeWindow(mac, slot, now);
   }
+  portEXIT_CRITICAL(&registryLock);
+
+  if (entry == nullptr) {
+    rejectedCount++;
+    Serial.println(F("[ERROR] Node registry full - node not tracked"));
+    return;
+  }
+
+  sendAck(mac, header.sequence, slot, window);
+
+  if (DEBUG_ESPNOW) {
+    Serial.print(F("[ESPNOW] "));
+    Serial.print(header.nodeType);
+    Serial.print(F(": "));
+    Serial.print(header.sampleCount);
+    Serial.print(F(" samples, T="));
+    Serial.print(reading.temperature);
+    Serial.print(F("°C H="));
+    Serial.print(reading.humidity);
+    Serial.print(F("% RSSI="));
+    Serial.println(rssi);
+  }
+}
+
+void ESPNowReceiver::sendAck(const uint8_t* mac, uint32_t sequence, uint8_t slot, uint16_t probeWindowMs) {
+  AckPacket ack = {};
+  ack.version = ESPNOW_PROTOCOL_VERSION;
+  ack.msgType = ESPNOW_MSG_ACK;
+  ack.slot = slot;
+  ack.slotCount = (uint8_t)schedule.slotCount();
+  memcpy(ack.target, mac, 6);
+  ack.sequence = sequence;
+  ack.centralTime = millis();
+  ack.frameMs = schedule.frameMs();
+  ack.nextSlotMs = schedule.untilSlot(slot, ack.centralTime);
+  ack.probeWindowMs = probeWindowMs;
+
+  // Sent from the RX callback: the node only listens for a few ms after its batch
+  esp_err_t result = esp_now_send(broadcastMac, (const uint8_t*)&ack, sizeof(ack));
+  if (result != ESP_OK && DEBUG_ESPNOW) {
+    Serial.print(F("[ESPNOW] ACK send failed: "));
+    Serial.println(result);
+  }
+}
+
+// ============================================================================
+// Link diagnostics
+// ============================================================================
+
+void ESPNowReceiver::handleEcho(const uint8_t* mac, const uint8_t* data, int len, int8_t rssi) {
+  ProbePacket echo;
+  if (!parseProbe(data, len, ESPNOW_MSG_ECHO, echo) || memcmp(echo.target, mac, 6) != 0) {
+    rejectedCount++;
+    return;
+  }
+
+  uint32_t nowUs = micros();
+  uint32_t now = millis();
+  ProbePacket packet;
+  bool send = false;
+
+  portENTER_CRITICAL(&registryLock);
+  if (probe.state != PROBE_IDLE && memcmp(probe.mac, mac, 6) == 0) {
+    LinkStats& stats = linkStats[probe.node];
+
+    if (echo.probeId == 0) {
+      // Node is awake and listening: its window starts now
+      if (probe.state == PROBE_GRANTED) {
+        probe.state = PROBE_ACTIVE;
+        probe.startMs = now;
+        send = nextProbe(packet, now);
+      }
+    } else if (probe.state == PROBE_ACTIVE && echo.probeId == probe.pendingId) {
+      uint32_t rttUs = nowUs - echo.sentAtUs;
+      if (rttUs < DIAG_PROBE_TIMEOUT_MS * 1000UL) {
+        stats.recordEcho(rttUs, rssi);
+      } else {
+        stats.lateEchoes++;
+        stats.recordLost(probe.pendingBand);
+      }
+      probe.pendingId = 0;
+
+      NodeEntry* entry = registry.find(mac);
+      if (entry != nullptr && rssi != 0) entry->rssi = rssi;
+
+      // Next probe right away: one in flight at a time
+      send = nextProbe(packet, now);
+    } else {
+      stats.lateEchoes++;  // Already timed out in update()
+    }
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  if (send) sendProbe(packet);
+}
+
+uint16_t ESPNowReceiver::grantProbeWindow(const uint8_t* mac, uint8_t node, uint32_t now) {
+  if (!diagEnabled) return 0;
+
+  // A retransmitted batch (our ACK was lost) gets the same grant again
+  bool sameNode = memcmp(probe.mac, mac, 6) == 0;
+  if (probe.state == PROBE_ACTIVE || (probe.state == PROBE_GRANTED && !sameNode)) {
+    return 0;
+  }
+
+  probe = ProbeSession();
+  probe.state = PROBE_GRANTED;
+  memcpy(probe.mac, mac, 6);
+  probe.node = node;
+  probe.startMs = now;
+  return DIAG_PROBE_WINDOW_MS;
+}
+
+bool ESPNowReceiver::nextProbe(ProbePacket& packet, uint32_t now) {
+  if (probe.state == PROBE_GRANTED) {
+    if (now - probe.startMs > DIAG_PROBE_WINDOW_MS) {
+      probe.state = PROBE_IDLE;  // Ready echo never arrived
+    }
+    return false;
+  }
+  if (probe.state != PROBE_ACTIVE) return false;
+
+  LinkStats& stats = linkStats[probe.node];
+
+  if (probe.pendingId != 0) {
+    if (micros() - probe.pendingSentUs < DIAG_PROBE_TIMEOUT_MS * 1000UL) {
+      return false;  // Still waiting for the echo
+    }
+    stats.recordLost(probe.pendingBand);
+    probe.pendingId = 0;
+  }
+
+  // The node goes back to sleep DIAG_PROBE_WINDOW_MS after it got ready:
+  // stop while a whole timeout still fits, so no probe is sent into a closed window
+  if (probe.sent >= DIAG_PROBES_PER_WAKE ||
+      now - probe.startMs + 2 * DIAG_PROBE_TIMEOUT_MS > DIAG_PROBE_WINDOW_MS) {
+    probe.state = PROBE_IDLE;
+    return false;
+  }
+
+  const NodeEntry* entry = registry.find(probe.mac);
+  probe.pendingBand = stats.recordSent(entry != nullptr ? entry->rssi : 0);
+  probe.pendingId = nextProbeId++;
+  if (nextProbeId == 0) nextProbeId = 1;  // 0 is the ready echo
+  probe.pendingSentUs = micros();
+  probe.sent++;
+
+  memset(&packet, 0, sizeof(packet));
+  packet.version = ESPNOW_PROTOCOL_VERSION;
+  packet.msgType = ESPNOW_MSG_PROBE;
+  packet.probeId = probe.pendingId;
+  packet.remaining = DIAG_PROBES_PER_WAKE - probe.sent;
+  memcpy(packet.target, probe.mac, 6);
+  packet.sentAtUs = probe.pendingSentUs;
+  return true;
+}
+
+void ESPNowReceiver::sendProbe(const ProbePacket& packet) {
+  uint8_t frame[DIAG_PROBE_BYTES > sizeof(ProbePacket) ? DIAG_PROBE_BYTES : sizeof(ProbePacket)] = {0};
+  memcpy(frame, &packet, sizeof(packet));
+
+  // Broadcast like the ACK: no MAC-layer retries, so losses are the raw link's
+  esp_err_t result = esp_now_send(broadcastMac, frame, sizeof(frame));
+  if (result != ESP_OK && DEBUG_ESPNOW) {
+    Serial.print(F("[ESPNOW] Probe send failed: "));
+    Serial.println(result);
+  }
+}
+
+void ESPNowReceiver::update() {
+  ProbePacket packet;
+
+  portENTER_CRITICAL(&registryLock);
+  bool send = nextProbe(packet, millis());
+  portEXIT_CRITICAL(&registryLock);
+
+  if (send) sendProbe(packet);
+}
+
+void ESPNowReceiver::setDiagnostics(bool enabled) {
+  portENTER_CRITICAL(&registryLock);
+  diagEnabled = enabled;
+  if (!enabled) probe.state = PROBE_IDLE;
+  portEXIT_CRITICAL(&registryLock);
+}
+
+void ESPNowReceiver::resetDiagnostics() {
+  portENTER_CRITICAL(&registryLock);
+  for (size_t i = 0; i < NODE_REGISTRY_CAPACITY; i++) {
+    linkStats[i] = LinkStats();
+  }
+  portEXIT_CRITICAL(&registryLock);
+}
+
+bool ESPNowReceiver::getLinkStats(size_t index, LinkStats& out) const {
+  bool found = false;
+
+  portENTER_CRITICAL(&registryLock);
+  if (index < registry.size()) {
+    out = linkStats[registry.at(index).slot];
+    found = true;
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  return found;
+}
+
+bool ESPNowReceiver::popSample(NodeSample& out) {
+  bool found = false;
+
+  portENTER_CRITICAL(&registryLock);
+  if (sampleCount > 0) {
+    out = sampleQueue[sampleHead];
+    sampleHead = (sampleHead + 1) % ESPNOW_SAMPLE_QUEUE_SIZE;
+    sampleCount--;
+    found = true;
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  return found;
 }
 
 void ESPNowReceiver::onDataSent(const uint8_t* mac_addr, esp_now_send_status_t status) {
@@ -7,27 +7,19 @@
 #define ESPNOW_RECEIVER_H
 
 #include <Arduino.h>
+#include <esp_idf_version.h>
 #include <esp_now.h>
+#include <esp_wifi.h>
 #include <WiFi.h>
+#include "config.h"
+#include "node_registry.h"
+#include "espnow_protocol.h"
+#include "tdma_schedule.h"
+#include "link_diagnostics.h"
 
 /**
- * Data structure for ESP-NOW communication
- * Max 250 bytes per packet
- */
-#define ESPNOW_PACKET_SIZE sizeof(ESPNowData)
-
-typedef struct {
-  char nodeType[16];      // "interior" or "exterior"
-  float temperature = 0;
-  float humidity = 0;
-  float pressure = 0;
-  float light = 0;
-  int32_t rssi = 0;
-  unsigned long timestamp = 0;
-} ESPNowData;
-
-/**
- * Manages ESP-NOW reception from remote nodes
+ * Manages ESP-NOW reception from remote nodes and acts as their time master:
+ * every valid batch is answered with an ACK carrying time sync and a TDMA slot
  */
 class ESPNowReceiver {
 public:
@@ -45,55 +37,144 @@ public:
   void addPeer(const uint8_t* macAddr);
 
   /**
-   * Request data update from remote nodes
+   * Number of nodes seen so far
    */
-  void requestUpdate();
+  size_t getNodeCount() const;
 
   /**
-   * Get last received interior node data
+   * Copy of node at index 0..getNodeCount()-1 (safe against the RX callback)
+   * @return false if index is out of range
    */
-  ESPNowData getInteriorData() const { return lastInteriorData; }
+  bool getNode(size_t index, NodeEntry& out) const;
 
   /**
-   * Get last received exterior node data
+   * Copy of the first node reporting the given type (e.g. "exterior")
+   * @return false if no such node has reported yet
    */
-  ESPNowData getExteriorData() const { return lastExteriorData; }
+  bool getNodeByType(const char* nodeType, NodeEntry& out) const;
 
   /**
-   * Get timestamp of last interior update
+   * Pop the oldest decoded sample (all samples of every batch, in arrival order)
+   * @return false if the queue is empty
    */
-  unsigned long getLastInteriorUpdate() const { return lastInteriorUpdate; }
+  bool popSample(NodeSample& out);
 
   /**
-   * Get timestamp of last exterior update
+   * Packets rejected (malformed, wrong version, registry full)
    */
-  unsigned long getLastExteriorUpdate() const { return lastExteriorUpdate; }
+  uint32_t getRejectedCount() const { return rejectedCount; }
 
   /**
-   * Check if interior node is online
+   * Samples dropped because the main loop did not drain the queue in time
    */
-  bool isInteriorOnline() {
-    return (millis() - lastInteriorUpdate) < 600000;  // 10 min timeout
-  }
+  uint32_t getDroppedSampleCount() const { return droppedSamples; }
+
+  const TdmaSchedule& getSchedule() const { return schedule; }
 
   /**
-   * Check if exterior node is online
+   * Drive link diagnostics (probe timeouts); call from loop()
    */
-  bool isExteriorOnline() {
-    return (millis() - lastExteriorUpdate) < 600000;
-  }
+  void update();
+
+  /**
+   * Turn link diagnostics on or off (nodes get a probe window with their next ACK)
+   */
+  void setDiagnostics(bool enabled);
+  bool isDiagnosticsEnabled() const { return diagEnabled; }
+
+  /**
+   * Clear the probe statistics of every node
+   */
+  void resetDiagnostics();
+
+  /**
+   * Copy of the probe statistics of node index 0..getNodeCount()-1
+   * @return false if index is out of range
+   */
+  bool getLinkStats(size_t index, LinkStats& out) const;
 
 private:
-  ESPNowData lastInteriorData;
-  ESPNowData lastExteriorData;
-  unsigned long lastInteriorUpdate = 0;
-  unsigned long lastExteriorUpdate = 0;
+  NodeRegistry registry;
+  TdmaSchedule schedule;
+  mutable portMUX_TYPE registryLock = portMUX_INITIALIZER_UNLOCKED;
+  volatile uint32_t rejectedCount = 0;
+
+  // Decoded samples waiting for the main loop (guarded by registryLock)
+  NodeSample sampleQueue[ESPNOW_SAMPLE_QUEUE_SIZE];
+  size_t sampleHead = 0;
+  size_t sampleCount = 0;
+  volatile uint32_t droppedSamples = 0;
+
+  // Link diagnostics: one probe session at a time (guarded by registryLock)
+  enum ProbeState : uint8_t { PROBE_IDLE, PROBE_GRANTED, PROBE_ACTIVE };
+
+  struct ProbeSession {
+    ProbeState state = PROBE_IDLE;
+    uint8_t mac[6] = {0};
+    uint8_t node = 0;           // Index into linkStats (the node's TDMA slot)
+    uint8_t sent = 0;
+    uint16_t pendingId = 0;     // Probe awaiting its echo, 0 = none
+    int8_t pendingBand = -1;    // RSSI band it was sent in
+    uint32_t pendingSentUs = 0;
+    uint32_t startMs = 0;       // Window granted (GRANTED) or node ready (ACTIVE)
+  };
+
+  volatile bool diagEnabled = ESPNOW_DIAG_ENABLED;
+  ProbeSession probe;
+  uint16_t nextProbeId = 1;
+  LinkStats linkStats[NODE_REGISTRY_CAPACITY];
 
   /**
    * Callback for received ESP-NOW data
    */
+#if ESP_IDF_VERSION_MAJOR >= 5
+  static void onDataReceive(const esp_now_recv_info_t* info, const uint8_t* data, int len);
+#else
   static void onDataReceive(const uint8_t* mac, const uint8_t* data, int len);
 
+  /**
+   * Promiscuous RX hook used only to capture the RSSI of ESP-NOW frames
+   * (IDF 4.x receive callbacks do not carry rx_ctrl)
+   */
+  static void onPromiscuousRx(void* buf, wifi_promiscuous_pkt_type_t type);
+#endif
+
+  /**
+   * Decode a batch packet, queue its samples and update the registry
+   * (probe echoes are handed to handleEcho())
+   */
+  void handlePacket(const uint8_t* mac, const uint8_t* data, int len, int8_t rssi);
+
+  /**
+   * Record a probe echo, or start probing on the node's ready echo
+   */
+  void handleEcho(const uint8_t* mac, const uint8_t* data, int len, int8_t rssi);
+
+  /**
+   * Broadcast the ACK / time sync / slot assignment for a received batch
+   * @param probeWindowMs non-zero keeps the node awake for probes
+   */
+  void sendAck(const uint8_t* mac, uint32_t sequence, uint8_t slot, uint16_t probeWindowMs = 0);
+
+  /**
+   * Grant the node a probe window if diagnostics are on and no session is running
+   * (caller holds registryLock)
+   * @return window for the ACK, 0 = none
+   */
+  uint16_t grantProbeWindow(const uint8_t* mac, uint8_t node, uint32_t now);
+
+  /**
+   * Fill the next probe of the running session, or end the session
+   * (caller holds registryLock)
+   * @return false if nothing is to be sent
+   */
+  bool nextProbe(ProbePacket& packet, uint32_t now);
+
+  /**
+   * Send a probe filled by nextProbe(), padded to DIAG_PROBE_BYTES
+   */
+  void sendProbe(const ProbePacket& packet);
+
   /**
    * Callback for sent ESP-NOW data
    */
@@ -0,0 +1,72 @@
+/**
+ * @file link_diagnostics.cpp
+ * @brief Link statistics implementation
+ */
+
+#include "link_diagnostics.h"
+
+/**
+ * Band index for an RSSI, clamped to the outer bands
+ */
+static int8_t rssiBand(int8_t rssi) {
+  int band = (rssi - DIAG_RSSI_FLOOR) / DIAG_RSSI_BAND_DB;
+  if (rssi < DIAG_RSSI_FLOOR || band < 0) band = 0;
+  if (band >= DIAG_RSSI_BANDS) band = DIAG_RSSI_BANDS - 1;
+  return (int8_t)band;
+}
+
+int8_t LinkStats::recordSent(int8_t rssi) {
+  probesSent++;
+  if (rssi == 0) return -1;
+
+  int8_t band = rssiBand(rssi);
+  bandSent[band]++;
+  return band;
+}
+
+void LinkStats::recordEcho(uint32_t rttUs, int8_t rssi) {
+  size_t bucket = 0;
+  while (bucket < DIAG_RTT_BUCKETS - 1 && rttUs >= bucketLimitUs(bucket)) {
+    bucket++;
+  }
+  rttHistogram[bucket]++;
+
+  if (echoes == 0 || rttUs < rttMinUs) rttMinUs = rttUs;
+  if (rttUs > rttMaxUs) rttMaxUs = rttUs;
+  rttSumUs += rttUs;
+  echoes++;
+
+  if (rssi != 0) lastRssi = rssi;
+}
+
+void LinkStats::recordLost(int8_t band) {
+  if (band >= 0 && band < DIAG_RSSI_BANDS) {
+    bandLost[band]++;
+  }
+}
+
+uint32_t LinkStats::rttPercentileUs(float fraction) const {
+  if (echoes == 0) return 0;
+
+  float rank = fraction * echoes;
+  uint32_t below = 0;
+
+  for (size_t b = 0; b < DIAG_RTT_BUCKETS; b++) {
+    if (rttHistogram[b] == 0) continue;
+
+    if (below + rttHistogram[b] >= rank) {
+      // Interpolate inside the bucket, clamped to what was actually measured
+      uint32_t low = b == 0 ? 0 : bucketLimitUs(b - 1);
+      uint32_t high = b == DIAG_RTT_BUCKETS - 1 ? rttMaxUs : bucketLimitUs(b);
+      if (low < rttMinUs) low = rttMinUs;
+      if (high > rttMaxUs) high = rttMaxUs;
+      if (high < low) high = low;
+
+      float within = (rank - below) / rttHistogram[b];
+      return low + (uint32_t)(within * (high - low));
+    }
+    below += rttHistogram[b];
+  }
+
+  return rttMaxUs;
+}
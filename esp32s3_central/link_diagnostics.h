@@ -0,0 +1,92 @@
+/**
+ * @file link_diagnostics.h
+ * @brief Per-node round-trip time and loss statistics from on-air probes
+ *
+ * Fixed-size counters only (no samples are kept), so a node's statistics
+ * can be updated from the ESP-NOW receive callback and copied out under the
+ * registry lock. RTTs go into a log-linear histogram (each power of two
+ * split into DIAG_RTT_SUB_BUCKETS, so percentiles are good to ~12%); loss is
+ * also split by the RSSI band the link was in when each probe was sent.
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef LINK_DIAGNOSTICS_H
+#define LINK_DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DIAG_RTT_FIRST_US 250        // First octave is [0, 250 us), then [250, 500), [500, 1000)...
+#define DIAG_RTT_SUB_BUCKETS 4       // Linear buckets per octave
+#define DIAG_RTT_BUCKETS 32          // 8 octaves = up to 32 ms, the last bucket also holds the rest
+#define DIAG_RSSI_BANDS 8            // Band b covers DIAG_RSSI_FLOOR + b * DIAG_RSSI_BAND_DB and up
+#define DIAG_RSSI_FLOOR -95
+#define DIAG_RSSI_BAND_DB 5
+
+/**
+ * Probe statistics for one node
+ */
+struct LinkStats {
+  uint32_t probesSent = 0;
+  uint32_t echoes = 0;                 // Probes answered within the timeout
+  uint32_t lateEchoes = 0;             // Answered after the timeout (counted as lost)
+  uint32_t rttMinUs = 0;
+  uint32_t rttMaxUs = 0;
+  uint64_t rttSumUs = 0;
+  uint32_t rttHistogram[DIAG_RTT_BUCKETS] = {0};
+  uint32_t bandSent[DIAG_RSSI_BANDS] = {0};
+  uint32_t bandLost[DIAG_RSSI_BANDS] = {0};
+  int8_t lastRssi = 0;                 // dBm of the last echo, 0 = none yet
+
+  /**
+   * Count a probe sent while the link was at rssi (0 = unknown)
+   * @return RSSI band to pass to recordLost(), -1 if unknown
+   */
+  int8_t recordSent(int8_t rssi);
+
+  /**
+   * Count an answered probe
+   */
+  void recordEcho(uint32_t rttUs, int8_t rssi);
+
+  /**
+   * Count an unanswered probe (band from recordSent())
+   */
+  void recordLost(int8_t band);
+
+  uint32_t lost() const { return probesSent - echoes; }
+
+  /**
+   * Fraction of probes without a timely echo (0.0 - 1.0)
+   */
+  float lossRatio() const {
+    return probesSent ? (float)lost() / probesSent : 0.0f;
+  }
+
+  uint32_t rttMeanUs() const {
+    return echoes ? (uint32_t)(rttSumUs / echoes) : 0;
+  }
+
+  /**
+   * RTT percentile estimated from the histogram (linear within a bucket)
+   * @param fraction 0.0 - 1.0
+   */
+  uint32_t rttPercentileUs(float fraction) const;
+
+  /**
+   * Upper RTT bound of bucket b (the last bucket is open-ended)
+   */
+  static uint32_t bucketLimitUs(size_t bucket) {
+    size_t octave = bucket / DIAG_RTT_SUB_BUCKETS;
+    uint32_t base = octave == 0 ? 0 : (uint32_t)DIAG_RTT_FIRST_US << (octave - 1);
+    uint32_t width = octave == 0 ? DIAG_RTT_FIRST_US : base;
+    return base + width * (bucket % DIAG_RTT_SUB_BUCKETS + 1) / DIAG_RTT_SUB_BUCKETS;
+  }
+
+  /**
+   * Lowest RSSI of band b
+   */
+  static int bandFloor(size_t band) { return DIAG_RSSI_FLOOR + (int)band * DIAG_RSSI_BAND_DB; }
+};
+
+#endif // LINK_DIAGNOSTICS_H
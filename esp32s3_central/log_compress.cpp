@@ -0,0 +1,492 @@
+/**
+ * @file log_compress.cpp
+ * @brief Compressed block encoding implementation
+ */
+
+#include "log_compress.h"
+#include <string.h>
+
+static_assert(sizeof(LogBlockHeader) == 16, "LogBlockHeader layout is part of the file format");
+
+// ============================================================================
+// Bit-level helpers
+// ============================================================================
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint8_t bitWidth(uint64_t value) {
+  uint8_t width = 0;
+  while (value) {
+    width++;
+    value >>= 1;
+  }
+  return width;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static size_t varintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static size_t putVarint(uint8_t* out, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+static bool getVarint(const uint8_t* in, size_t length, size_t& position, uint64_t& value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 64 && position < length; shift += 7) {
+    uint8_t byte = in[position++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+/**
+ * Delta-of-delta time codes: prefix, then a zigzag value of `bits` bits
+ * (a regular logging interval costs one bit per record)
+ */
+struct TimeCode {
+  uint8_t prefix;
+  uint8_t prefixBits;
+  uint8_t bits;
+};
+
+static const TimeCode TIME_CODES[] = {
+  {0x0, 1, 0},
+  {0x2, 2, 7},
+  {0x6, 3, 12},
+  {0xE, 4, 20},
+  {0xF, 4, 40},
+};
+static const uint8_t TIME_CODE_COUNT = sizeof(TIME_CODES) / sizeof(TIME_CODES[0]);
+
+static const TimeCode& timeCode(int64_t change) {
+  if (change == 0) return TIME_CODES[0];
+  uint64_t symbol = zigzag(change);
+  for (uint8_t i = 1; i < TIME_CODE_COUNT - 1; i++) {
+    if (symbol < (1ull << TIME_CODES[i].bits)) return TIME_CODES[i];
+  }
+  return TIME_CODES[TIME_CODE_COUNT - 1];
+}
+
+/**
+ * MSB-first bit stream into a fixed buffer
+ */
+struct BitWriter {
+  uint8_t* out;
+  size_t cap;
+  size_t position;
+  uint64_t bits;
+  uint8_t bitCount;
+
+  BitWriter(uint8_t* buffer, size_t size) : out(buffer), cap(size), position(0), bits(0), bitCount(0) {}
+
+  void put(uint64_t value, uint8_t n) {
+    while (n > 0) {
+      uint8_t take = n > 32 ? 32 : n;
+      n -= take;
+      bits = (bits << take) | ((value >> n) & ((1ull << take) - 1));
+      bitCount += take;
+      while (bitCount >= 8) {
+        bitCount -= 8;
+        if (position < cap) out[position] = (uint8_t)(bits >> bitCount);
+        position++;
+      }
+    }
+  }
+
+  size_t finish() {
+    if (bitCount > 0) put(0, 8 - bitCount);
+    return position;
+  }
+};
+
+bool checkBlockHeader(const LogBlockHeader& header) {
+  return header.magic == LOG_BLOCK_MAGIC && header.records > 0 && header.records <= LOG_BLOCK_RECORDS &&
+         header.length > 0 && header.length <= LOG_BLOCK_MAX_BYTES;
+}
+
+static uint8_t blockCrc(const LogBlockHeader& header, const uint8_t* payload) {
+  LogBlockHeader copy = header;
+  copy.crc = 0;
+  return logCrc8(payload, header.length, logCrc8((const uint8_t*)&copy, sizeof(copy)));
+}
+
+// ============================================================================
+// LogBlockEncoder
+// ============================================================================
+
+void LogBlockEncoder::begin(const LogSchema& recordSchema) {
+  schema = recordSchema;
+  count = 0;
+  capacity = sizeof(records) / schema.recordSize();
+  if (capacity > LOG_BLOCK_RECORDS) capacity = LOG_BLOCK_RECORDS;
+}
+
+bool LogBlockEncoder::add(const uint8_t* record) {
+  if (full()) return false;
+  memcpy(records + count * schema.recordSize(), record, schema.recordSize());
+  count++;
+  return true;
+}
+
+size_t LogBlockEncoder::plan(size_t n, ChannelPlan* plans) const {
+  const uint8_t channelCount = schema.channelCount();
+
+  // Per channel and order (change, change of change): range, common divisor, zeros
+  struct Stats {
+    int64_t low;
+    int64_t high;
+    uint64_t divisor;
+    uint32_t values;
+    uint32_t nonzero;
+  };
+  Stats stats[LOG_MAX_CHANNELS][2];
+  int64_t previous[LOG_MAX_CHANNELS];
+  int64_t change[LOG_MAX_CHANNELS];
+  int32_t base[LOG_MAX_CHANNELS];
+  memset(stats, 0, sizeof(stats));
+  memset(base, 0, sizeof(base));
+
+  size_t streamBits = 0;
+  uint32_t lastTime = 0;
+  int64_t interval = 0;
+  uint16_t lastMask = 0;
+  uint16_t seen = 0;
+  size_t fitted = 0;
+
+  for (size_t k = 0; k < n; k++) {
+    uint32_t time;
+    uint16_t mask;
+    int32_t raw[LOG_MAX_CHANNELS];
+    schema.decodeRaw(records + k * schema.recordSize(), time, raw, mask);
+
+    if (k == 0) {
+      streamBits += channelCount;
+    } else {
+      int64_t gap = (int64_t)time - lastTime;
+      const TimeCode& code = timeCode(gap - interval);
+      streamBits += code.prefixBits + code.bits;
+      streamBits += mask == lastMask ? 1 : 1 + channelCount;
+      interval = gap;
+    }
+    lastTime = time;
+    lastMask = mask;
+
+    for (uint8_t ch = 0; ch < channelCount; ch++) {
+      if (!(mask & (1u << ch))) continue;
+      if (!(seen & (1u << ch))) {
+        seen |= 1u << ch;
+        previous[ch] = raw[ch];
+        change[ch] = 0;
+        base[ch] = raw[ch];
+        continue;
+      }
+
+      int64_t delta = raw[ch] - previous[ch];
+      int64_t symbols[2] = {delta, delta - change[ch]};
+      previous[ch] = raw[ch];
+      change[ch] = delta;
+
+      for (uint8_t order = 0; order < 2; order++) {
+        Stats& s = stats[ch][order];
+        int64_t e = symbols[order];
+        if (e < s.low) s.low = e;
+        if (e > s.high) s.high = e;
+        s.divisor = gcd(s.divisor, (uint64_t)(e < 0 ? -e : e));
+        s.values++;
+        if (e != 0) s.nonzero++;
+      }
+    }
+
+    // Cheapest coding of each channel for the records so far
+    ChannelPlan candidate[LOG_MAX_CHANNELS];
+    size_t bytes = 0;
+    size_t bits = streamBits;
+    for (uint8_t ch = 0; ch < channelCount; ch++) {
+      ChannelPlan& p = candidate[ch];
+      p.base = base[ch];
+      p.width = 0;
+      p.secondOrder = false;
+      p.zeroFlag = false;
+      p.divisor = 1;
+      size_t best = SIZE_MAX;
+
+      for (uint8_t order = 0; order < 2; order++) {
+        const Stats& s = stats[ch][order];
+        uint64_t divisor = s.divisor > 1 && s.divisor <= UINT32_MAX ? s.divisor : 1;
+        uint64_t high = zigzag(s.high / (int64_t)divisor);
+        uint64_t low = zigzag(s.low / (int64_t)divisor);
+        uint8_t width = bitWidth(high > low ? high : low);
+        size_t plain = (size_t)s.values * width;
+        size_t flagged = width ? s.values + (size_t)s.nonzero * width : 0;
+        size_t cost = flagged < plain ? flagged : plain;
+        if (cost < best) {
+          best = cost;
+          p.width = width;
+          p.secondOrder = order == 1;
+          p.zeroFlag = flagged < plain;
+          p.divisor = width ? (uint32_t)divisor : 1;
+        }
+      }
+
+      bits += best;
+      bytes += 1 + varintSize(zigzag(p.base)) + varintSize(p.divisor);
+    }
+    bytes += (bits + 7) / 8;
+
+    // Block size only grows with more records: stop at the first that does not fit
+    if (bytes > LOG_BLOCK_MAX_BYTES && k > 0) break;
+    memcpy(plans, candidate, channelCount * sizeof(ChannelPlan));
+    fitted = k + 1;
+  }
+
+  return fitted;
+}
+
+size_t LogBlockEncoder::emit(uint8_t* out, size_t cap) {
+  if (count == 0 || cap < sizeof(LogBlockHeader) + LOG_BLOCK_MAX_BYTES) return 0;
+
+  // Longest run of the oldest records that fits one block
+  ChannelPlan plans[LOG_MAX_CHANNELS];
+  size_t n = plan(count, plans);
+
+  const uint8_t channelCount = schema.channelCount();
+  uint8_t* payload = out + sizeof(LogBlockHeader);
+  size_t length = 0;
+  for (uint8_t ch = 0; ch < channelCount; ch++) {
+    const ChannelPlan& p = plans[ch];
+    payload[length++] = p.width | (p.secondOrder ? 0x40 : 0) | (p.zeroFlag ? 0x80 : 0);
+    length += putVarint(payload + length, zigzag(p.base));
+    length += putVarint(payload + length, p.divisor);
+  }
+
+  BitWriter stream(payload + length, LOG_BLOCK_MAX_BYTES - length);
+  int64_t previous[LOG_MAX_CHANNELS];
+  int64_t change[LOG_MAX_CHANNELS];
+  bool seen[LOG_MAX_CHANNELS];
+  memset(seen, 0, sizeof(seen));
+  uint32_t firstTime = 0, lastTime = 0;
+  int64_t interval = 0;
+  uint16_t lastMask = 0;
+
+  for (size_t k = 0; k < n; k++) {
+    uint32_t time;
+    uint16_t mask;
+    int32_t raw[LOG_MAX_CHANNELS];
+    schema.decodeRaw(records + k * schema.recordSize(), time, raw, mask);
+
+    if (k == 0) {
+      firstTime = time;
+      stream.put(mask, channelCount);
+    } else {
+      int64_t gap = (int64_t)time - lastTime;
+      int64_t dod = gap - interval;
+      const TimeCode& code = timeCode(dod);
+      stream.put(code.prefix, code.prefixBits);
+      if (code.bits) stream.put(zigzag(dod), code.bits);
+      interval = gap;
+
+      if (mask == lastMask) {
+        stream.put(0, 1);
+      } else {
+        stream.put(1, 1);
+        stream.put(mask, channelCount);
+      }
+    }
+    lastTime = time;
+    lastMask = mask;
+
+    for (uint8_t ch = 0; ch < channelCount; ch++) {
+      if (!(mask & (1u << ch))) continue;
+      const ChannelPlan& p = plans[ch];
+      if (!seen[ch]) {
+        seen[ch] = true;
+        previous[ch] = raw[ch];
+        change[ch] = 0;
+        continue;
+      }
+
+      int64_t delta = raw[ch] - previous[ch];
+      int64_t e = p.secondOrder ? delta - change[ch] : delta;
+      previous[ch] = raw[ch];
+      change[ch] = delta;
+      if (p.width == 0) continue;
+
+      if (p.zeroFlag) {
+        stream.put(e != 0, 1);
+        if (e == 0) continue;
+      }
+      stream.put(zigzag(e / (int64_t)p.divisor), p.width);
+    }
+  }
+  length += stream.finish();
+
+  LogBlockHeader header;
+  header.magic = LOG_BLOCK_MAGIC;
+  header.records = (uint16_t)n;
+  header.length = (uint16_t)length;
+  header.reserved = 0;
+  header.firstTime = firstTime;
+  header.lastTime = lastTime;
+  header.crc = blockCrc(header, payload);
+  memcpy(out, &header, sizeof(header));
+
+  count -= n;
+  memmove(records, records + n * schema.recordSize(), count * schema.recordSize());
+  return sizeof(header) + length;
+}
+
+// ============================================================================
+// LogBlockReader
+// ============================================================================
+
+bool LogBlockReader::begin(const LogSchema& schema, const LogBlockHeader& header, const uint8_t* payload) {
+  this->schema = &schema;
+  this->payload = payload;
+  length = header.length;
+  damaged = true;
+
+  if (!checkBlockHeader(header) || blockCrc(header, payload) != header.crc) return false;
+
+  position = 0;
+  for (uint8_t ch = 0; ch < schema.channelCount(); ch++) {
+    if (position >= length) return false;
+    ChannelState& c = channels[ch];
+    uint8_t descriptor = payload[position++];
+    uint64_t base, divisor;
+    if (!getVarint(payload, length, position, base) || !getVarint(payload, length, position, divisor)) {
+      return false;
+    }
+    c.width = descriptor & 0x3F;
+    c.secondOrder = descriptor & 0x40;
+    c.zeroFlag = descriptor & 0x80;
+    if (c.width > 40 || divisor == 0 || divisor > UINT32_MAX) return false;
+    c.divisor = (uint32_t)divisor;
+    c.value = unzigzag(base);
+    c.delta = 0;
+    c.seen = false;
+  }
+
+  bits = 0;
+  bitCount = 0;
+  records = header.records;
+  decoded = 0;
+  time = header.firstTime;
+  lastTime = header.lastTime;
+  interval = 0;
+  mask = 0;
+  damaged = false;
+  return true;
+}
+
+bool LogBlockReader::readBits(uint8_t n, uint64_t& value) {
+  while (bitCount < n) {
+    if (position >= length) return false;
+    bits = (bits << 8) | payload[position++];
+    bitCount += 8;
+  }
+  bitCount -= n;
+  value = n ? (bits >> bitCount) & ((1ull << n) - 1) : 0;
+  return true;
+}
+
+bool LogBlockReader::readSigned(uint8_t n, int64_t& value) {
+  uint64_t symbol;
+  if (!readBits(n, symbol)) return false;
+  value = unzigzag(symbol);
+  return true;
+}
+
+bool LogBlockReader::next(uint8_t* record, uint32_t& recordTime) {
+  if (damaged || decoded >= records) return false;
+
+  const uint8_t channelCount = schema->channelCount();
+  uint64_t field;
+
+  if (decoded == 0) {
+    if (!readBits(channelCount, field)) return fail();
+    mask = (uint16_t)field;
+  } else {
+    // Prefix: up to four 1 bits select the code
+    uint8_t code = 0;
+    while (code < TIME_CODE_COUNT - 1) {
+      if (!readBits(1, field)) return fail();
+      if (!field) break;
+      code++;
+    }
+    int64_t dod = 0;
+    if (TIME_CODES[code].bits && !readSigned(TIME_CODES[code].bits, dod)) return fail();
+    interval += dod;
+    time += (uint32_t)interval;
+
+    if (!readBits(1, field)) return fail();
+    if (field) {
+      if (!readBits(channelCount, field)) return fail();
+      mask = (uint16_t)field;
+    }
+  }
+
+  int32_t raw[LOG_MAX_CHANNELS];
+  for (uint8_t ch = 0; ch < channelCount; ch++) {
+    raw[ch] = 0;
+    if (!(mask & (1u << ch))) continue;
+    ChannelState& c = channels[ch];
+
+    if (!c.seen) {
+      c.seen = true;
+    } else {
+      int64_t e = 0;
+      bool changed = c.width > 0;
+      if (changed && c.zeroFlag) {
+        if (!readBits(1, field)) return fail();
+        changed = field;
+      }
+      if (changed && !readSigned(c.width, e)) return fail();
+      e *= c.divisor;
+
+      if (c.secondOrder) {
+        c.delta += e;
+        c.value += c.delta;
+      } else {
+        c.value += e;
+      }
+    }
+
+    if (c.value < INT32_MIN || c.value > INT32_MAX) return fail();
+    raw[ch] = (int32_t)c.value;
+  }
+
+  // The last record must land on the time the header promises
+  if (++decoded == records && time != lastTime) return fail();
+
+  schema->encodeRaw(time, raw, mask, record);
+  recordTime = time;
+  return true;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file log_compress.h
+ * @brief Compressed block encoding of the weather log (.wxc)
+ *
+ * Closed day partitions are rewritten as independent blocks of up to
+ * LOG_BLOCK_RECORDS records:
+ *
+ *   LogFileHeader (flags LOG_FLAG_BLOCKS) | LogChannel[] | LogCheckpoint[2] | block | block | ...
+ *   block = LogBlockHeader | channel descriptors | bit stream
+ *
+ * The header keeps the .wxb schema, so a block decodes back to the exact
+ * packed records it was built from. Each block header carries its time
+ * range and length: range reads skip whole blocks with one seek.
+ *
+ * Inside a block (bits MSB first):
+ * - time: the first is in the header, then delta-of-delta codes
+ *   ('0' = same interval as before, '10' + 7 bits, '110' + 12 bits,
+ *   '1110' + 20 bits, '1111' + 40 bits, zigzag)
+ * - valid mask: all channels for the first record, then '0' = unchanged
+ *   or '1' + the mask
+ * - each present value: the change from that channel's previous value
+ *   (order 1) or from its previous change (order 2), divided by the
+ *   block's common divisor, zigzag, in a fixed width; with the zero flag
+ *   a '0' bit stands for no change
+ *
+ * The encoder picks order, divisor, width and zero flag per channel and
+ * block from the records themselves (a descriptor byte, the first value
+ * and the divisor as varints). Slowly changing fixed-point sensor values
+ * take a few bits each instead of 2-4 bytes.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef LOG_COMPRESS_H
+#define LOG_COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "log_format.h"
+
+#define LOG_BLOCK_MAGIC 0x4257         // "WB"
+#define LOG_BLOCK_RECORDS 256          // Most records per block
+#define LOG_BLOCK_MAX_BYTES 1024       // Most bytes after the block header (a reader's buffer)
+#define LOG_BLOCK_BUFFER 6144          // Encoder's queue of packed records (292 weather records)
+
+/**
+ * Block header (packed, 16 bytes)
+ */
+struct __attribute__((packed)) LogBlockHeader {
+  uint16_t magic;
+  uint16_t records;
+  uint16_t length;                      // Bytes that follow the header
+  uint8_t reserved;
+  uint8_t crc;                          // CRC-8 of the header (crc = 0) and the payload
+  uint32_t firstTime;
+  uint32_t lastTime;
+};
+
+/**
+ * True if a block header is plausible (checked before its payload is read)
+ */
+bool checkBlockHeader(const LogBlockHeader& header);
+
+/**
+ * Builds blocks from packed records of one schema. Records are queued
+ * (up to LOG_BLOCK_RECORDS, fixed buffer) and emit() writes as many of
+ * the oldest as fit one block.
+ */
+class LogBlockEncoder {
+public:
+  LogBlockEncoder() : count(0), capacity(0) {}
+
+  /**
+   * Start on records of this schema (drops anything queued)
+   */
+  void begin(const LogSchema& schema);
+
+  /**
+   * Queue a record that passed schema.decode()
+   * @return false if the queue is full (emit() first)
+   */
+  bool add(const uint8_t* record);
+
+  size_t pending() const { return count; }
+  bool full() const { return count >= capacity; }
+
+  /**
+   * Encode the oldest queued records into out (header + payload) and
+   * drop them from the queue
+   * @param cap at least sizeof(LogBlockHeader) + LOG_BLOCK_MAX_BYTES
+   * @return bytes written, 0 if nothing is queued
+   */
+  size_t emit(uint8_t* out, size_t cap);
+
+private:
+  /**
+   * How one channel is coded in a block
+   */
+  struct ChannelPlan {
+    uint8_t width;                      // Bits per nonzero symbol (0 = the value never changes)
+    bool secondOrder;
+    bool zeroFlag;
+    int32_t base;                       // First present value
+    uint32_t divisor;
+  };
+
+  LogSchema schema;
+  uint8_t records[LOG_BLOCK_BUFFER];
+  size_t count;
+  size_t capacity;
+
+  /**
+   * Pick each channel's coding for the longest run of the first n queued
+   * records that fits LOG_BLOCK_MAX_BYTES (at least one)
+   * @return records covered
+   */
+  size_t plan(size_t n, ChannelPlan* plans) const;
+};
+
+/**
+ * Decodes one block back into packed records, without allocation
+ */
+class LogBlockReader {
+public:
+  LogBlockReader() : schema(nullptr), payload(nullptr), length(0) {}
+
+  /**
+   * Start on a block whose payload was read after its header
+   * @return false if the CRC or the descriptors do not check out
+   */
+  bool begin(const LogSchema& schema, const LogBlockHeader& header, const uint8_t* payload);
+
+  /**
+   * Next record, re-packed as schema.encode() wrote it
+   * @return false after the last record, or if the block is damaged
+   */
+  bool next(uint8_t* record, uint32_t& time);
+
+  /**
+   * True if next() stopped on damage rather than the end of the block
+   */
+  bool failed() const { return damaged; }
+
+private:
+  struct ChannelState {
+    uint8_t width;
+    bool secondOrder;
+    bool zeroFlag;
+    bool seen;
+    uint32_t divisor;
+    int64_t value;
+    int64_t delta;
+  };
+
+  const LogSchema* schema;
+  const uint8_t* payload;
+  size_t length;
+  size_t position;                      // Next payload byte to load
+  uint64_t bits;                        // Loaded, not yet consumed (low bitCount bits)
+  uint8_t bitCount;
+  uint16_t records;
+  uint16_t decoded;
+  uint32_t lastTime;
+  uint32_t time;
+  int64_t interval;
+  uint16_t mask;
+  bool damaged;
+  ChannelState channels[LOG_MAX_CHANNELS];
+
+  bool fail() {
+    damaged = true;
+    return false;
+  }
+  bool readBits(uint8_t n, uint64_t& value);
+  bool readSigned(uint8_t n, int64_t& value);
+};
+
+#endif // LOG_COMPRESS_H
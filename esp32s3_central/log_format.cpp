@@ -0,0 +1,444 @@
+/**
+ * @file log_format.cpp
+ * @brief Binary log format implementation
+ */
+
+#include "log_format.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+static_assert(sizeof(LogFileHeader) == 20, "LogFileHeader layout is part of the file format");
+static_assert(sizeof(LogChannel) == 32, "LogChannel layout is part of the file format");
+static_assert(sizeof(LogCheckpoint) == 16, "LogCheckpoint layout is part of the file format");
+
+// ============================================================================
+// Little-endian helpers (the format does not depend on the host byte order)
+// ============================================================================
+
+static void putLe(uint8_t* out, uint32_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static uint32_t getLe(const uint8_t* in, size_t bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    value |= (uint32_t)in[i] << (8 * i);
+  }
+  return value;
+}
+
+// ============================================================================
+// LogSchema
+// ============================================================================
+
+uint8_t logCrc8(const uint8_t* data, size_t length, uint8_t crc) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+
+  return crc;
+}
+
+void sealCheckpoint(LogCheckpoint& checkpoint) {
+  memset(checkpoint.reserved, 0, sizeof(checkpoint.reserved));
+  checkpoint.crc = logCrc8((const uint8_t*)&checkpoint, sizeof(checkpoint) - 1);
+}
+
+bool checkCheckpoint(const LogCheckpoint& checkpoint) {
+  return checkpoint.sequence != 0xFFFFFFFF &&
+         checkpoint.crc == logCrc8((const uint8_t*)&checkpoint, sizeof(checkpoint) - 1);
+}
+
+LogSchema::LogSchema() : count(0), size(LOG_RECORD_PREFIX), journaled(true), flags(0) {
+  memset(channels, 0, sizeof(channels));
+  memset(offsets, 0, sizeof(offsets));
+}
+
+size_t LogSchema::typeSize(uint8_t type) {
+  switch (type) {
+    case LOG_TYPE_U8: return 1;
+    case LOG_TYPE_I16: return 2;
+    case LOG_TYPE_U16: return 2;
+    case LOG_TYPE_I32: return 4;
+    default: return 0;
+  }
+}
+
+bool LogSchema::addChannel(const char* name, LogValueType type, float scale, float offset, uint8_t decimals) {
+  if (count >= LOG_MAX_CHANNELS || typeSize(type) == 0 || scale == 0) return false;
+
+  LogChannel& channel = channels[count];
+  memset(&channel, 0, sizeof(channel));
+  strncpy(channel.name, name, LOG_CHANNEL_NAME_LEN - 1);
+  channel.type = type;
+  channel.decimals = decimals;
+  channel.scale = scale;
+  channel.offset = offset;
+
+  offsets[count] = size;
+  size += typeSize(type);
+  count++;
+  return true;
+}
+
+bool LogSchema::parse(const uint8_t* data, size_t len) {
+  if (len < sizeof(LogFileHeader)) return false;
+
+  LogFileHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != LOG_MAGIC || header.version < 1 || header.version > LOG_FORMAT_VERSION ||
+      header.channelCount > LOG_MAX_CHANNELS || len < header.headerSize) {
+    return false;
+  }
+
+  *this = LogSchema();
+  journaled = header.version >= 2;
+  flags = header.flags;
+  for (uint8_t i = 0; i < header.channelCount; i++) {
+    LogChannel channel;
+    memcpy(&channel, data + sizeof(LogFileHeader) + i * sizeof(LogChannel), sizeof(channel));
+    channel.name[LOG_CHANNEL_NAME_LEN - 1] = '\0';
+    if (!addChannel(channel.name, (LogValueType)channel.type, channel.scale, channel.offset, channel.decimals)) {
+      return false;
+    }
+  }
+
+  return recordSize() == header.recordSize && headerSize() == header.headerSize;
+}
+
+bool LogSchema::latestCheckpoint(const uint8_t* header, size_t len, LogCheckpoint& out) const {
+  if (!journaled || len < headerSize()) return false;
+
+  bool found = false;
+  for (uint8_t slot = 0; slot < LOG_CHECKPOINT_SLOTS; slot++) {
+    LogCheckpoint checkpoint;
+    memcpy(&checkpoint, header + checkpointOffset(slot), sizeof(checkpoint));
+    if (checkCheckpoint(checkpoint) && checkpoint.sequence % LOG_CHECKPOINT_SLOTS == slot &&
+        (!found || checkpoint.sequence > out.sequence)) {
+      out = checkpoint;
+      found = true;
+    }
+  }
+  return found;
+}
+
+size_t LogSchema::writeHeader(uint8_t* out, size_t cap, uint32_t created, uint8_t fileFlags) const {
+  if (cap < headerSize()) return 0;
+
+  LogFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = LOG_MAGIC;
+  header.version = journaled ? LOG_FORMAT_VERSION : 1;
+  header.headerSize = headerSize();
+  header.recordSize = recordSize();
+  header.channelCount = count;
+  header.flags = fileFlags;
+  header.created = created;
+
+  memcpy(out, &header, sizeof(header));
+  memcpy(out + sizeof(header), channels, count * sizeof(LogChannel));
+
+  // Checkpoint slots start unwritten
+  if (journaled) memset(out + checkpointOffset(0), 0xFF, LOG_CHECKPOINT_SLOTS * sizeof(LogCheckpoint));
+  return headerSize();
+}
+
+int LogSchema::find(const char* name) const {
+  for (uint8_t i = 0; i < count; i++) {
+    if (strncmp(channels[i].name, name, LOG_CHANNEL_NAME_LEN) == 0) return i;
+  }
+  return -1;
+}
+
+bool LogSchema::sameLayout(const LogSchema& other) const {
+  if (count != other.count || journaled != other.journaled) return false;
+  for (uint8_t i = 0; i < count; i++) {
+    if (channels[i].type != other.channels[i].type || channels[i].scale != other.channels[i].scale ||
+        channels[i].offset != other.channels[i].offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void LogSchema::encode(uint32_t time, const float* values, uint16_t validMask, uint8_t* out) const {
+  int32_t raw[LOG_MAX_CHANNELS];
+
+  for (uint8_t i = 0; i < count; i++) {
+    const LogChannel& channel = channels[i];
+    raw[i] = 0;
+
+    if ((validMask & (1u << i)) && !isnan(values[i])) {
+      float scaled = (values[i] - channel.offset) / channel.scale;
+      float low, high;
+      switch (channel.type) {
+        case LOG_TYPE_U8: low = 0; high = 255; break;
+        case LOG_TYPE_I16: low = -32768; high = 32767; break;
+        case LOG_TYPE_U16: low = 0; high = 65535; break;
+        default: low = -2147483520.0f; high = 2147483520.0f; break;  // Largest floats inside int32
+      }
+      if (scaled < low) scaled = low;
+      if (scaled > high) scaled = high;
+      raw[i] = (int32_t)lroundf(scaled);
+    } else {
+      validMask &= ~(1u << i);
+    }
+  }
+
+  encodeRaw(time, raw, validMask, out);
+}
+
+void LogSchema::encodeRaw(uint32_t time, const int32_t* raw, uint16_t validMask, uint8_t* out) const {
+  putLe(out, time, 4);
+  putLe(out + 4, validMask & ((1u << count) - 1), 2);
+
+  for (uint8_t i = 0; i < count; i++) {
+    putLe(out + offsets[i], (validMask & (1u << i)) ? (uint32_t)raw[i] : 0, typeSize(channels[i].type));
+  }
+
+  // Commit byte last: a write cut short leaves it unset
+  if (journaled) {
+    out[size] = logCrc8(out, size);
+    out[size + 1] = LOG_RECORD_COMMIT;
+  }
+}
+
+bool LogSchema::decode(const uint8_t* record, uint32_t& time, float* values, uint16_t& validMask) const {
+  int32_t raw[LOG_MAX_CHANNELS];
+  if (!decodeRaw(record, time, raw, validMask)) return false;
+
+  for (uint8_t i = 0; i < count; i++) {
+    values[i] = (validMask & (1u << i)) ? raw[i] * channels[i].scale + channels[i].offset : NAN;
+  }
+  return true;
+}
+
+bool LogSchema::decodeRaw(const uint8_t* record, uint32_t& time, int32_t* raw, uint16_t& validMask) const {
+  if (journaled && (record[size + 1] != LOG_RECORD_COMMIT || record[size] != logCrc8(record, size))) {
+    return false;
+  }
+
+  time = getLe(record, 4);
+  validMask = (uint16_t)getLe(record + 4, 2);
+
+  // Bits beyond the channel count only appear in torn records or 0xFF padding
+  if (time == 0xFFFFFFFF || (validMask & ~((1u << count) - 1)) != 0) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t bits = getLe(record + offsets[i], typeSize(channels[i].type));
+    switch (channels[i].type) {
+      case LOG_TYPE_I16: raw[i] = (int16_t)bits; break;
+      default: raw[i] = (int32_t)bits; break;
+    }
+  }
+
+  return true;
+}
+
+bool LogSchema::isUnwritten(const uint8_t* record) const {
+  for (size_t i = 0; i < recordSize(); i++) {
+    if (record[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+size_t LogSchema::formatCsvHeader(char* out, size_t cap) const {
+  int len = snprintf(out, cap, "timestamp");
+  for (uint8_t i = 0; i < count && len > 0 && (size_t)len < cap; i++) {
+    len += snprintf(out + len, cap - len, ",%s", channels[i].name);
+  }
+  if (len <= 0 || (size_t)len + 1 >= cap) return 0;
+
+  out[len++] = '\n';
+  out[len] = '\0';
+  return len;
+}
+
+size_t LogSchema::formatCsv(const uint8_t* record, char* out, size_t cap) const {
+  uint32_t time;
+  uint16_t validMask;
+  float values[LOG_MAX_CHANNELS];
+  if (cap < 22 || !decode(record, time, values, validMask)) return 0;
+
+  formatIsoTime(time, out);
+  size_t len = 20;
+
+  for (uint8_t i = 0; i < count; i++) {
+    int n = (validMask & (1u << i))
+              ? snprintf(out + len, cap - len, ",%.*f", channels[i].decimals, values[i])
+              : snprintf(out + len, cap - len, ",");
+    if (n < 0 || len + n >= cap) return 0;
+    len += n;
+  }
+  if (len + 1 >= cap) return 0;
+
+  out[len++] = '\n';
+  out[len] = '\0';
+  return len;
+}
+
+// ============================================================================
+// LogCsvConverter
+// ============================================================================
+
+void LogCsvConverter::begin() {
+  schema = LogSchema();
+  state = STATE_HEADER;
+  buffered = 0;
+  needed = sizeof(LogFileHeader);
+  records = 0;
+  skipped = 0;
+}
+
+size_t LogCsvConverter::convert(const uint8_t* in, size_t len, char* out, size_t cap, size_t& produced) {
+  size_t consumed = 0;
+  produced = 0;
+
+  if (state == STATE_END) return len;
+
+  while (state != STATE_FAILED) {
+    if (state == STATE_CSV_HEADER) {
+      size_t n = schema.formatCsvHeader(out + produced, cap - produced);
+      if (n == 0) break;  // No room yet
+      produced += n;
+      state = STATE_RECORDS;
+      continue;
+    }
+
+    // Only complete a record when its CSV line is sure to fit
+    if (state == STATE_RECORDS && buffered + (len - consumed) >= needed &&
+        cap - produced < LOG_CSV_LINE_MAX) {
+      break;
+    }
+
+    size_t take = needed - buffered;
+    if (take > len - consumed) take = len - consumed;
+    memcpy(buffer + buffered, in + consumed, take);
+    buffered += take;
+    consumed += take;
+    if (buffered < needed) break;  // Input exhausted mid-item
+
+    if (state == STATE_HEADER) {
+      if (needed == sizeof(LogFileHeader)) {
+        // Fixed part read: now we know how long the channel table is
+        LogFileHeader header;
+        memcpy(&header, buffer, sizeof(header));
+        if (header.magic != LOG_MAGIC || header.headerSize < sizeof(header) || header.headerSize > sizeof(buffer)) {
+          state = STATE_FAILED;
+          break;
+        }
+        needed = header.headerSize;
+        continue;
+      }
+      if (!schema.parse(buffer, buffered) || (schema.getFlags() & LOG_FLAG_BLOCKS)) {
+        state = STATE_FAILED;  // Compressed files are read with LogBlockReader
+        break;
+      }
+      state = STATE_CSV_HEADER;
+      needed = schema.recordSize();
+    } else if (schema.isUnwritten(buffer)) {
+      state = STATE_END;
+      return len;
+    } else {
+      size_t n = schema.formatCsv(buffer, out + produced, cap - produced);
+      if (n > 0) {
+        produced += n;
+        records++;
+      } else {
+        skipped++;
+      }
+    }
+    buffered = 0;
+  }
+
+  return consumed;
+}
+
+// ============================================================================
+// Weather log schema
+// ============================================================================
+
+/**
+ * Fixed point sized to each sensor's range and resolution
+ * (21-byte records with their CRC instead of ~60-70 bytes of CSV text)
+ */
+static LogSchema buildWeatherSchema() {
+  LogSchema schema;
+  schema.addChannel("temp_indoor", LOG_TYPE_I16, 0.01f, 0.0f, 2);
+  schema.addChannel("humidity_indoor", LOG_TYPE_U16, 0.01f, 0.0f, 2);
+  schema.addChannel("temp_outdoor", LOG_TYPE_I16, 0.01f, 0.0f, 2);
+  schema.addChannel("humidity_outdoor", LOG_TYPE_U16, 0.01f, 0.0f, 2);
+  schema.addChannel("pressure", LOG_TYPE_U16, 0.01f, 500.0f, 2);  // 500.00 - 1155.35 hPa
+  schema.addChannel("light", LOG_TYPE_U16, 1.0f, 0.0f, 0);        // BH1750 range, 1 lux
+  schema.addChannel("iaq", LOG_TYPE_U8, 1.0f, 0.0f, 0);
+  return schema;
+}
+
+const LogSchema& weatherLogSchema() {
+  static const LogSchema schema = buildWeatherSchema();
+  return schema;
+}
+
+// ============================================================================
+// Calendar (proleptic Gregorian, UTC)
+// ============================================================================
+
+int32_t daysFromCivil(int32_t year, uint32_t month, uint32_t day) {
+  year -= month <= 2;
+  const int32_t era = (year >= 0 ? year : year - 399) / 400;
+  const uint32_t yoe = (uint32_t)(year - era * 400);
+  const uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+void civilFromDays(int32_t days, int32_t& year, uint32_t& month, uint32_t& day) {
+  days += 719468;
+  const int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  const uint32_t doe = (uint32_t)(days - era * 146097);
+  const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const uint32_t mp = (5 * doy + 2) / 153;
+  day = doy - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = (int32_t)yoe + era * 400 + (month <= 2);
+}
+
+size_t formatPartitionPath(const char* dir, uint32_t time, const char* ext, char* out, size_t cap) {
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays((int32_t)(time / LOG_SECONDS_PER_DAY), year, month, day);
+
+  int n = snprintf(out, cap, "%s/%04d/%02u/%02u.%s", dir, (int)year, (unsigned)month, (unsigned)day, ext);
+  return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+void formatIsoTime(uint32_t time, char* out) {
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays((int32_t)(time / 86400), year, month, day);
+  uint32_t seconds = time % 86400;
+
+  snprintf(out, 21, "%04d-%02u-%02uT%02u:%02u:%02uZ", (int)year, (unsigned)month, (unsigned)day,
+           (unsigned)(seconds / 3600), (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60));
+}
+
+bool parseIsoTime(const char* text, uint32_t& time) {
+  int year, month, day, hour, minute, second;
+  if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6 ||
+      year < 1970 || month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour > 23 || minute > 59 || second > 60) {
+    return false;
+  }
+
+  time = (uint32_t)daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  return true;
+}
@@ -0,0 +1,342 @@
+/**
+ * @file log_format.h
+ * @brief Packed binary log format (.wxb) and its streaming CSV conversion
+ *
+ * A log file is a header that carries its own schema, followed by
+ * fixed-size records:
+ *
+ *   LogFileHeader | LogChannel[channelCount] | LogCheckpoint[2] | record 0 | record 1 | ...
+ *
+ * A record is a uint32 unix time, a uint16 valid mask (bit c set = channel
+ * c present), then each channel's raw value in schema order, all
+ * little-endian. Readers need nothing but the header: value = raw * scale
+ * + offset, printed with the channel's decimals.
+ *
+ * Journaling (version 2): each record ends with a CRC-8 of its payload and
+ * a commit byte, the last byte written, so a record torn by a power loss
+ * or damaged later fails decode() and is skipped. The two checkpoint slots
+ * are written alternately and record how far the data had been verified;
+ * recovery only scans what follows the newest valid one. Version 1 files
+ * (no trailer, no checkpoints) are still read.
+ *
+ * Space after the last record may be preallocated (filled with 0xFF): the
+ * first all-0xFF record marks the end of the data.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_MAGIC 0x474C5857          // "WXLG"
+#define LOG_FORMAT_VERSION 2           // Journaled; version 1 is read only
+#define LOG_MAX_CHANNELS 16           // valid mask is a uint16_t
+#define LOG_CHANNEL_NAME_LEN 20
+#define LOG_RECORD_PREFIX 6           // time + valid mask
+#define LOG_RECORD_TRAILER 2          // CRC-8 + commit byte (version 2)
+#define LOG_RECORD_COMMIT 0xA5
+#define LOG_CHECKPOINT_SLOTS 2
+#define LOG_MAX_RECORD_SIZE (LOG_RECORD_PREFIX + LOG_MAX_CHANNELS * 4 + LOG_RECORD_TRAILER)
+#define LOG_CSV_LINE_MAX (32 + LOG_MAX_CHANNELS * 16)
+#define LOG_FLAG_BLOCKS 0x01          // LogFileHeader.flags: compressed blocks follow (log_compress.h)
+
+#define LOG_INDEX_MAGIC 0x58495857    // "WXIX"
+#define LOG_INDEX_VERSION 1
+#define LOG_PARTITION_PATH_MAX 32     // "/logs/YYYY/MM/DD.ext"
+#define LOG_SECONDS_PER_DAY 86400
+
+/**
+ * Storage type of one channel
+ */
+enum LogValueType : uint8_t {
+  LOG_TYPE_U8 = 1,
+  LOG_TYPE_I16 = 2,
+  LOG_TYPE_U16 = 3,
+  LOG_TYPE_I32 = 4
+};
+
+/**
+ * File header (packed, followed by channelCount LogChannel entries)
+ */
+struct __attribute__((packed)) LogFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;                  // Header + channel table = offset of record 0
+  uint16_t recordSize;
+  uint8_t channelCount;
+  uint8_t flags;
+  uint32_t created;                     // Unix time the file was started
+  uint8_t reserved[4];
+};
+
+/**
+ * Schema entry for one channel (packed, 32 bytes)
+ */
+struct __attribute__((packed)) LogChannel {
+  char name[LOG_CHANNEL_NAME_LEN];      // CSV column name
+  uint8_t type;                         // LogValueType
+  uint8_t decimals;                     // Digits after the point in CSV
+  uint8_t reserved[2];
+  float scale;                          // value = raw * scale + offset
+  float offset;
+};
+
+/**
+ * Recovery checkpoint (packed, 16 bytes): every record before dataEnd was
+ * on the card and checked when it was written
+ */
+struct __attribute__((packed)) LogCheckpoint {
+  uint32_t sequence;                    // Higher wins; slot = sequence % LOG_CHECKPOINT_SLOTS
+  uint32_t dataEnd;                     // File offset just past the verified records
+  uint32_t corrupt;                     // Records before dataEnd that failed their check
+  uint8_t reserved[3];
+  uint8_t crc;                          // CRC-8 of the bytes above
+};
+
+#define LOG_MAX_HEADER_SIZE \
+  (sizeof(LogFileHeader) + LOG_MAX_CHANNELS * sizeof(LogChannel) + LOG_CHECKPOINT_SLOTS * sizeof(LogCheckpoint))
+
+/**
+ * Sidecar index of a log partition (DD.idx next to DD.wxb): this header,
+ * then entry i for the first record starting at or after
+ * dataStart + i * spacing. Entry i always sits at slot i, so a rewrite after
+ * a restart lands on the same place.
+ */
+struct __attribute__((packed)) LogIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entrySize;
+  uint32_t spacing;                     // Data bytes per entry
+  uint32_t dataStart;                   // Offset of record 0 (= log header size)
+};
+
+struct __attribute__((packed)) LogIndexEntry {
+  uint32_t time;
+  uint32_t offset;
+};
+
+/**
+ * Channel layout of a log file: encodes, decodes and formats records
+ */
+class LogSchema {
+public:
+  LogSchema();
+
+  /**
+   * Append a channel (firmware side, before the first record)
+   * @return false if the schema is full
+   */
+  bool addChannel(const char* name, LogValueType type, float scale, float offset, uint8_t decimals);
+
+  /**
+   * Load the schema from a file header
+   * @return false if data is not a complete, supported header
+   */
+  bool parse(const uint8_t* data, size_t len);
+
+  /**
+   * Serialize header + channel table
+   * @param fileFlags LOG_FLAG_* describing what follows the header
+   * @return bytes written, 0 if cap is too small
+   */
+  size_t writeHeader(uint8_t* out, size_t cap, uint32_t created, uint8_t fileFlags = 0) const;
+
+  /**
+   * Flags of the header read by parse()
+   */
+  uint8_t getFlags() const { return flags; }
+
+  size_t headerSize() const {
+    return sizeof(LogFileHeader) + count * sizeof(LogChannel) + (journaled ? LOG_CHECKPOINT_SLOTS * sizeof(LogCheckpoint) : 0);
+  }
+  size_t recordSize() const { return size + (journaled ? LOG_RECORD_TRAILER : 0); }
+  uint8_t channelCount() const { return count; }
+
+  /**
+   * Records carry a CRC and commit byte, the header checkpoints (version 2)
+   */
+  bool isJournaled() const { return journaled; }
+
+  /**
+   * File offset of a checkpoint slot (journaled schemas)
+   */
+  size_t checkpointOffset(uint8_t slot) const {
+    return sizeof(LogFileHeader) + count * sizeof(LogChannel) + slot * sizeof(LogCheckpoint);
+  }
+
+  /**
+   * Newest valid checkpoint in a header read by parse()
+   * @return false if there is none (never written, or both torn)
+   */
+  bool latestCheckpoint(const uint8_t* header, size_t len, LogCheckpoint& out) const;
+  const LogChannel& channel(uint8_t index) const { return channels[index]; }
+
+  /**
+   * Index of the channel with this name, -1 if absent
+   */
+  int find(const char* name) const;
+
+  /**
+   * True if records written with other can be read with this schema
+   */
+  bool sameLayout(const LogSchema& other) const;
+
+  /**
+   * Pack one record; channels not in validMask (or NaN) are stored as 0
+   * and read back as missing. Values are rounded and clamped to the type.
+   */
+  void encode(uint32_t time, const float* values, uint16_t validMask, uint8_t* out) const;
+
+  /**
+   * Unpack one record (values[] holds channelCount() entries)
+   * @return false if the record fails its CRC / commit check, or is not
+   *         plausible (torn or padding)
+   */
+  bool decode(const uint8_t* record, uint32_t& time, float* values, uint16_t& validMask) const;
+
+  /**
+   * Same as encode() / decode() with the stored integers (no scaling):
+   * raw must already be in range for each channel's type
+   */
+  void encodeRaw(uint32_t time, const int32_t* raw, uint16_t validMask, uint8_t* out) const;
+  bool decodeRaw(const uint8_t* record, uint32_t& time, int32_t* raw, uint16_t& validMask) const;
+
+  /**
+   * True if the record is preallocated space (all 0xFF), i.e. past the data
+   */
+  bool isUnwritten(const uint8_t* record) const;
+
+  /**
+   * CSV header line ("timestamp,<name>,...\n")
+   * @return length, 0 if cap is too small
+   */
+  size_t formatCsvHeader(char* out, size_t cap) const;
+
+  /**
+   * CSV line for one record; missing channels are left empty
+   * @return length, 0 if the record is invalid or cap too small
+   */
+  size_t formatCsv(const uint8_t* record, char* out, size_t cap) const;
+
+private:
+  LogChannel channels[LOG_MAX_CHANNELS];
+  uint16_t offsets[LOG_MAX_CHANNELS];   // Byte offset of each channel in a record
+  uint8_t count;
+  uint16_t size;                        // Payload: prefix + channels, before the trailer
+  bool journaled;
+  uint8_t flags;
+
+  static size_t typeSize(uint8_t type);
+};
+
+/**
+ * Streaming .wxb -> CSV conversion with no allocation: push file bytes in
+ * chunks of any size, get CSV text out (header line first)
+ */
+class LogCsvConverter {
+public:
+  LogCsvConverter() { begin(); }
+
+  /**
+   * Start a new file
+   */
+  void begin();
+
+  /**
+   * Consume input and produce CSV. Stops early when out has no room for
+   * another line; call again with the unconsumed rest.
+   * @param produced set to the CSV bytes written to out
+   * @return input bytes consumed
+   */
+  size_t convert(const uint8_t* in, size_t len, char* out, size_t cap, size_t& produced);
+
+  /**
+   * Header was not a valid log header; everything after it is ignored
+   */
+  bool failed() const { return state == STATE_FAILED; }
+
+  /**
+   * Reached preallocated space; the rest of the input is consumed silently
+   */
+  bool finished() const { return state == STATE_END; }
+
+  uint32_t getRecordCount() const { return records; }
+
+  /**
+   * Records skipped as invalid (failed CRC / commit check, torn writes)
+   */
+  uint32_t getSkippedCount() const { return skipped; }
+
+  const LogSchema& getSchema() const { return schema; }
+
+private:
+  enum State : uint8_t { STATE_HEADER, STATE_CSV_HEADER, STATE_RECORDS, STATE_END, STATE_FAILED };
+
+  LogSchema schema;
+  State state;
+  uint8_t buffer[LOG_MAX_HEADER_SIZE];
+  size_t buffered;
+  size_t needed;
+  uint32_t records;
+  uint32_t skipped;
+};
+
+/**
+ * Weather record channels, in record order (append only: the order is the
+ * binary layout and the CSV column order)
+ */
+enum WeatherChannel : uint8_t {
+  WX_LOG_TEMP_INDOOR,
+  WX_LOG_HUMIDITY_INDOOR,
+  WX_LOG_TEMP_OUTDOOR,
+  WX_LOG_HUMIDITY_OUTDOOR,
+  WX_LOG_PRESSURE,
+  WX_LOG_LIGHT,
+  WX_LOG_IAQ,
+  WX_LOG_CHANNEL_COUNT
+};
+
+/**
+ * Schema of the weather log written by DataLogger
+ */
+const LogSchema& weatherLogSchema();
+
+/**
+ * Fill in a checkpoint's CRC, and check it
+ */
+void sealCheckpoint(LogCheckpoint& checkpoint);
+bool checkCheckpoint(const LogCheckpoint& checkpoint);
+
+/**
+ * CRC-8 (polynomial 0x07, as crc8() in utils.h) of records and checkpoints;
+ * pass the previous result as crc to continue over more data
+ */
+uint8_t logCrc8(const uint8_t* data, size_t length, uint8_t crc = 0);
+
+/**
+ * Day partition holding time: "<dir>/YYYY/MM/DD.<ext>"
+ * @return length, 0 if cap is too small
+ */
+size_t formatPartitionPath(const char* dir, uint32_t time, const char* ext, char* out, size_t cap);
+
+/**
+ * Format unix time as "YYYY-MM-DDTHH:MM:SSZ" (out must hold 21 bytes)
+ */
+void formatIsoTime(uint32_t time, char* out);
+
+/**
+ * Parse "YYYY-MM-DDTHH:MM:SS[Z]" (UTC)
+ * @return false on malformed input
+ */
+bool parseIsoTime(const char* text, uint32_t& time);
+
+/**
+ * Days since 1970-01-01 for a civil date, and back
+ */
+int32_t daysFromCivil(int32_t year, uint32_t month, uint32_t day);
+void civilFromDays(int32_t days, int32_t& year, uint32_t& month, uint32_t& day);
+
+#endif // LOG_FORMAT_H
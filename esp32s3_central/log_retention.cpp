@@ -0,0 +1,564 @@
+/**
+ * @file log_retention.cpp
+ * @brief Weather log retention implementation
+ */
+
+#include "log_retention.h"
+#include "log_rollup.h"
+#include "utils.h"
+#include <ctype.h>
+
+#define BYTES_PER_MB (1024ULL * 1024ULL)
+
+// What a day has on the card
+enum : uint8_t {
+  DAY_RAW = 0x01,      // DD.wxb
+  DAY_CSV = 0x02,      // DD.csv
+  DAY_PACKED = 0x04,   // DD.wxc
+  DAY_TEMP = 0x08,     // DD.wxt (compaction cut short)
+  DAY_INDEX = 0x10,    // DD.idx
+};
+
+static const struct {
+  uint8_t kind;
+  const char* ext;
+} dayFileKinds[] = {{DAY_RAW, "wxb"}, {DAY_CSV, "csv"}, {DAY_PACKED, "wxc"}, {DAY_TEMP, "wxt"}, {DAY_INDEX, "idx"}};
+
+/**
+ * Last path component (File::name() is the full path on older cores)
+ */
+static const char* baseName(const char* name) {
+  const char* slash = strrchr(name, '/');
+  return slash ? slash + 1 : name;
+}
+
+/**
+ * Day of month and kind of a partition file name ("15.wxb"), 0 if it is not one
+ */
+static uint8_t dayFileKind(const char* name, uint8_t& dayOfMonth) {
+  if (!isdigit((unsigned char)name[0]) || !isdigit((unsigned char)name[1]) || name[2] != '.') return 0;
+  dayOfMonth = (name[0] - '0') * 10 + (name[1] - '0');
+  if (dayOfMonth < 1 || dayOfMonth > 31) return 0;
+
+  for (const auto& kind : dayFileKinds) {
+    if (strcmp(name + 3, kind.ext) == 0) return kind.kind;
+  }
+  return 0;
+}
+
+/**
+ * Number of up to 4 digits, -1 if name is anything else
+ */
+static int parseNumber(const char* name, size_t digits) {
+  int value = 0;
+  for (size_t i = 0; i < digits; i++) {
+    if (!isdigit((unsigned char)name[i])) return -1;
+    value = value * 10 + (name[i] - '0');
+  }
+  return name[digits] == '\0' ? value : -1;
+}
+
+/**
+ * First month from `from` on present in mask, 13 = none
+ */
+static uint8_t nextMonth(uint16_t mask, uint8_t from) {
+  while (from <= 12 && !(mask & (1u << (from - 1)))) from++;
+  return from;
+}
+
+LogRetention::LogRetention()
+  : logger(nullptr), task(nullptr), requested(false), phase(PHASE_IDLE), passStart(0), lastPass(0), lastDay(0),
+    today(0), yearCount(0), yearCursor(0), monthCursor(0), dayCursor(0), compacting(false),
+    shedRaw(0), shedHourly(0), shedDaily(0), reclaimed(0), deleted(0), compressed(0),
+    backlogCleared(0), backlogClearedBytes(0), rawDeleted(0), oldestKept(0) {
+  memset(&listing, 0, sizeof(listing));
+}
+
+bool LogRetention::begin(DataLogger& dataLogger) {
+  if (task) return true;
+  if (!dataLogger.isReady()) return false;
+  logger = &dataLogger;
+
+  // First pass right away: picks up days closed while the station was off
+  requested = true;
+  if (xTaskCreatePinnedToCore(taskMain, "sdkeep", LOG_RETENTION_TASK_STACK, this,
+                              LOG_RETENTION_TASK_PRIORITY, &task, LOG_DRAIN_TASK_CORE) != pdPASS) {
+    Serial.println(F("[ERROR] Log retention task creation failed"));
+    task = nullptr;
+    return false;
+  }
+
+  Serial.print(F("[OK] Log retention: records "));
+  Serial.print(policy.rawDays);
+  Serial.print(F(" days, hourly rollups "));
+  Serial.print(policy.hourlyDays);
+  Serial.print(F(" days, horizon "));
+  Serial.print(policy.horizonDays);
+  Serial.println(F(" days"));
+  return true;
+}
+
+void LogRetention::trigger() {
+  requested = true;
+  if (task) xTaskNotifyGive(task);
+}
+
+void LogRetention::setPolicy(const LogRetentionPolicy& newPolicy) {
+  portENTER_CRITICAL(&lock);
+  policy = newPolicy;
+  portEXIT_CRITICAL(&lock);
+}
+
+LogRetentionPolicy LogRetention::getPolicy() const {
+  portENTER_CRITICAL(&lock);
+  LogRetentionPolicy out = policy;
+  portEXIT_CRITICAL(&lock);
+  return out;
+}
+
+void LogRetention::getStats(LogRetentionStats& out) const {
+  portENTER_CRITICAL(&lock);
+  out = stats;
+  portEXIT_CRITICAL(&lock);
+}
+
+void LogRetention::taskMain(void* arg) {
+  LogRetention* retention = static_cast<LogRetention*>(arg);
+
+  for (;;) {
+    bool idle = retention->phase == PHASE_IDLE;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idle ? LOG_DRAIN_POLL_MS : LOG_RETENTION_SLICE_GAP_MS));
+    retention->run();
+  }
+}
+
+void LogRetention::run() {
+  // Nothing to keep in shape while records go to the flash spool
+  if (!logger->cardReady()) return;
+
+  if (phase == PHASE_IDLE) {
+    // A pass every LOG_RETENTION_INTERVAL_MS, and one as soon as a day closes
+    uint32_t now = millis();
+    uint32_t day = logger->currentDay;
+    if (lastDay == 0) lastDay = day;
+    if (!requested && now - lastPass < LOG_RETENTION_INTERVAL_MS && day == lastDay) return;
+
+    requested = false;
+    lastPass = now;
+    lastDay = day;
+    passStart = now;
+    uint32_t clockDay = getUnixTime() / LOG_SECONDS_PER_DAY;
+    today = clockDay > day ? clockDay : day;
+    reclaimed = 0;
+    deleted = 0;
+    compressed = 0;
+    backlogCleared = 0;
+    backlogClearedBytes = 0;
+    rawDeleted = 0;
+    oldestKept = 0;
+
+    portENTER_CRITICAL(&lock);
+    active = policy;
+    stats.running = true;
+    portEXIT_CRITICAL(&lock);
+    phase = PHASE_START;
+  }
+
+  logger->lockCard();
+  unsigned long start = micros();
+  bool more = step();
+  uint32_t held = micros() - start;
+  logger->unlockCard();
+
+  portENTER_CRITICAL(&lock);
+  stats.slices++;
+  if (held > stats.sliceMaxUs) stats.sliceMaxUs = held;
+  portEXIT_CRITICAL(&lock);
+
+  if (!more) finishPass();
+}
+
+bool LogRetention::step() {
+  switch (phase) {
+    case PHASE_START:
+      return stepStart();
+    case PHASE_SURVEY:
+      return stepSurvey();
+    case PHASE_ACT:
+      return stepAct();
+    default:
+      return false;
+  }
+}
+
+bool LogRetention::stepStart() {
+  survey = LogRetentionStats();
+  shedRaw = shedHourly = shedDaily = 0;
+  yearCount = 0;
+  yearCursor = 0;
+  monthCursor = 0;
+  dayCursor = 0;
+
+  survey.cardBytes = SD.totalBytes();
+  uint64_t used = SD.usedBytes();
+  survey.freeBytes = survey.cardBytes > used ? survey.cardBytes - used : 0;
+
+  // Year directories, oldest first (a pass covers the oldest LOG_RETENTION_MAX_YEARS)
+  File root = SD.open(LOG_DIR);
+  if (!root || !root.isDirectory()) return false;
+  for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+    int year = entry.isDirectory() ? parseNumber(baseName(entry.name()), 4) : -1;
+    entry.close();
+    if (year < 1970) continue;
+
+    uint8_t at = yearCount;
+    while (at > 0 && years[at - 1] > year) at--;
+    if (at >= LOG_RETENTION_MAX_YEARS) continue;
+    uint8_t last = yearCount < LOG_RETENTION_MAX_YEARS ? yearCount : LOG_RETENTION_MAX_YEARS - 1;
+    memmove(&years[at + 1], &years[at], (last - at) * sizeof(years[0]));
+    years[at] = year;
+    if (yearCount < LOG_RETENTION_MAX_YEARS) yearCount++;
+  }
+  root.close();
+
+  phase = PHASE_SURVEY;
+  return true;
+}
+
+bool LogRetention::stepSurvey() {
+  if (yearCursor >= yearCount) {
+    plan();
+    yearCursor = 0;
+    monthCursor = 0;
+    dayCursor = 0;
+    phase = PHASE_ACT;
+    return true;
+  }
+
+  int32_t year = years[yearCursor];
+  uint32_t yearStart = daysFromCivil(year, 1, 1);
+  uint32_t yearEnd = daysFromCivil(year + 1, 1, 1);
+  uint32_t current = logger->currentDay;
+
+  if (monthCursor == 0) {
+    listYear(year, months[yearCursor], dailyBytes[yearCursor]);
+    survey.logBytes += dailyBytes[yearCursor];
+    if (today >= yearEnd && !(current >= yearStart && current < yearEnd)) shedDaily += dailyBytes[yearCursor];
+    monthCursor = nextMonth(months[yearCursor], 1);
+    return true;
+  }
+  if (monthCursor > 12) {
+    yearCursor++;
+    monthCursor = 0;
+    return true;
+  }
+
+  uint32_t month = monthCursor;
+  monthCursor = nextMonth(months[yearCursor], monthCursor + 1);
+  if (!listMonth(year, month)) return true;
+
+  uint32_t monthStart = daysFromCivil(year, month, 1);
+  uint32_t monthEnd = month == 12 ? yearEnd : daysFromCivil(year, month + 1, 1);
+  survey.logBytes += listing.hourlyBytes;
+  if (today >= monthEnd && !(current >= monthStart && current < monthEnd)) shedHourly += listing.hourlyBytes;
+
+  for (uint8_t dom = 1; dom <= 31; dom++) {
+    uint8_t files = listing.files[dom];
+    if (files == 0) continue;
+    uint32_t day = monthStart + dom - 1;
+    bool closed = day < today && day != current;
+
+    survey.logBytes += listing.bytes[dom];
+    if (files & (DAY_RAW | DAY_CSV | DAY_PACKED)) {
+      survey.rawDays++;
+      if (survey.oldestRawDay == 0) survey.oldestRawDay = day * LOG_SECONDS_PER_DAY;
+    }
+    if (closed) shedRaw += listing.bytes[dom];
+    if (closed && logger->encoder && (files & (DAY_RAW | DAY_TEMP))) {
+      survey.backlogDays++;
+      survey.backlogBytes += listing.bytes[dom];
+    }
+  }
+  return true;
+}
+
+void LogRetention::plan() {
+  // Past the budget, or short of free space: whichever asks for more
+  uint64_t over = 0;
+  uint64_t budget = (uint64_t)active.budgetMB * BYTES_PER_MB;
+  uint64_t minFree = (uint64_t)active.minFreeMB * BYTES_PER_MB;
+  if (budget > 0 && survey.logBytes > budget) over = survey.logBytes - budget;
+  if (survey.cardBytes > 0 && survey.freeBytes < minFree && minFree - survey.freeBytes > over) {
+    over = minFree - survey.freeBytes;
+  }
+  survey.overBytes = over;
+
+  // The survey summed what each tier may lose; records go first, then hourly, then daily rollups
+  shedRaw = over < shedRaw ? over : shedRaw;
+  over -= shedRaw;
+  shedHourly = over < shedHourly ? over : shedHourly;
+  over -= shedHourly;
+  shedDaily = over < shedDaily ? over : shedDaily;
+
+  if (survey.overBytes > 0) {
+    Serial.print(F("[LOG] Retention: "));
+    Serial.print((uint32_t)(survey.overBytes / 1024));
+    Serial.println(F(" KB over the space limits - oldest data goes first"));
+  }
+
+  portENTER_CRITICAL(&lock);
+  stats.cardBytes = survey.cardBytes;
+  stats.freeBytes = survey.freeBytes;
+  stats.logBytes = survey.logBytes;
+  stats.rawDays = survey.rawDays;
+  stats.oldestRawDay = survey.oldestRawDay;
+  stats.backlogDays = survey.backlogDays;
+  stats.backlogBytes = survey.backlogBytes;
+  stats.overBytes = survey.overBytes;
+  portEXIT_CRITICAL(&lock);
+}
+
+bool LogRetention::stepAct() {
+  // Listings and days with nothing to do cost no slice of their own
+  while (yearCursor < yearCount) {
+    int32_t year = years[yearCursor];
+
+    if (monthCursor == 0) {
+      monthCursor = nextMonth(months[yearCursor], 1);
+      dayCursor = 0;
+      continue;
+    }
+    if (monthCursor > 12) {
+      actOnYear(yearCursor);
+      yearCursor++;
+      monthCursor = 0;
+      return true;
+    }
+    if (dayCursor == 0) {
+      dayCursor = 1;
+      if (!listMonth(year, monthCursor)) dayCursor = 32;
+      return true;
+    }
+
+    for (; dayCursor <= 31; dayCursor++) {
+      if (listing.files[dayCursor] == 0) continue;
+      uint8_t before = listing.files[dayCursor];
+      if (!actOnDay(year, monthCursor, dayCursor)) return true;
+      if (oldestKept == 0 && (listing.files[dayCursor] & (DAY_RAW | DAY_CSV | DAY_PACKED))) {
+        oldestKept = daysFromCivil(year, monthCursor, dayCursor);
+      }
+      if (listing.files[dayCursor] != before) {
+        dayCursor++;
+        return true;
+      }
+    }
+
+    actOnMonth(year, monthCursor);
+    monthCursor = nextMonth(months[yearCursor], monthCursor + 1);
+    dayCursor = 0;
+    return true;
+  }
+  return false;
+}
+
+bool LogRetention::actOnDay(int32_t year, uint32_t month, uint8_t dayOfMonth) {
+  uint32_t day = daysFromCivil(year, month, dayOfMonth);
+  if (day >= today || day == logger->currentDay) return true;
+
+  uint8_t files = listing.files[dayOfMonth];
+  bool backlog = logger->encoder && (files & (DAY_RAW | DAY_TEMP));
+  uint32_t rawFrom = keepFrom(active.rawDays);
+  uint32_t horizon = keepFrom(active.horizonDays);
+  if (horizon > rawFrom) rawFrom = horizon;
+
+  // Past its age, or the oldest data while over the limits: the records go, rollups stay
+  if (day < rawFrom || shedRaw > 0) {
+    if (compacting) {
+      logger->abandonCompaction();
+      compacting = false;
+    }
+    bool removed = false;
+    for (const auto& kind : dayFileKinds) {
+      if (!(files & kind.kind)) continue;
+      char path[LOG_PARTITION_PATH_MAX];
+      formatPartitionPath(LOG_DIR, day * LOG_SECONDS_PER_DAY, kind.ext, path, sizeof(path));
+      removed |= removeFile(path);
+    }
+    if (removed) reclaimed += listing.bytes[dayOfMonth];
+    if (files & (DAY_RAW | DAY_CSV | DAY_PACKED)) rawDeleted++;
+    if (backlog) {
+      backlogCleared++;
+      backlogClearedBytes += listing.bytes[dayOfMonth];
+    }
+    shedRaw -= shedRaw < listing.bytes[dayOfMonth] ? shedRaw : listing.bytes[dayOfMonth];
+    listing.files[dayOfMonth] = 0;
+    listing.bytes[dayOfMonth] = 0;
+    return true;
+  }
+
+  // Closed and still raw (or a rewrite cut short): compress, a slice at a time
+  if (!backlog) return true;
+
+  int state = logger->compactSlice(day);
+  compacting = state == 1;
+  if (compacting) return false;
+  if (state < 0) {
+    listing.files[dayOfMonth] &= ~(DAY_RAW | DAY_TEMP);
+    return true;
+  }
+
+  char packed[LOG_PARTITION_PATH_MAX];
+  formatPartitionPath(LOG_DIR, day * LOG_SECONDS_PER_DAY, "wxc", packed, sizeof(packed));
+  File file = SD.open(packed, FILE_READ);
+  uint32_t after = file ? file.size() : 0;
+  file.close();
+
+  if (listing.bytes[dayOfMonth] > after) reclaimed += listing.bytes[dayOfMonth] - after;
+  compressed++;
+  backlogCleared++;
+  backlogClearedBytes += listing.bytes[dayOfMonth];
+  listing.files[dayOfMonth] = DAY_PACKED;
+  listing.bytes[dayOfMonth] = after;
+  return true;
+}
+
+void LogRetention::actOnMonth(int32_t year, uint32_t month) {
+  uint32_t first = daysFromCivil(year, month, 1);
+  uint32_t next = month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, month + 1, 1);
+  uint32_t current = logger->currentDay;
+  if (today < next || (current >= first && current < next)) return;
+
+  if (listing.hasHourly) {
+    uint32_t from = keepFrom(active.hourlyDays);
+    uint32_t horizon = keepFrom(active.horizonDays);
+    if (horizon > from) from = horizon;
+
+    if (next <= from || shedHourly > 0) {
+      char path[LOG_PARTITION_PATH_MAX];
+      formatRollupPath(LOG_DIR, LOG_ROLLUP_HOUR, first * LOG_SECONDS_PER_DAY, path, sizeof(path));
+      if (removeFile(path)) reclaimed += listing.hourlyBytes;
+      shedHourly -= shedHourly < listing.hourlyBytes ? shedHourly : listing.hourlyBytes;
+      listing.hasHourly = false;
+    }
+  }
+
+  // Nothing left in it: drop the directory
+  if (listing.hasHourly) return;
+  for (uint8_t dom = 1; dom <= 31; dom++) {
+    if (listing.files[dom] != 0) return;
+  }
+  char dir[LOG_PARTITION_PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s/%04d/%02u", LOG_DIR, (int)year, (unsigned)month);
+  if (SD.rmdir(dir)) months[yearCursor] &= ~(1u << (month - 1));
+}
+
+void LogRetention::actOnYear(uint8_t index) {
+  int32_t year = years[index];
+  uint32_t first = daysFromCivil(year, 1, 1);
+  uint32_t next = daysFromCivil(year + 1, 1, 1);
+  uint32_t current = logger->currentDay;
+  if (today < next || (current >= first && current < next)) return;
+
+  if (dailyBytes[index] > 0 && (next <= keepFrom(active.horizonDays) || shedDaily > 0)) {
+    char path[LOG_PARTITION_PATH_MAX];
+    formatRollupPath(LOG_DIR, LOG_ROLLUP_DAY, first * LOG_SECONDS_PER_DAY, path, sizeof(path));
+    if (removeFile(path)) reclaimed += dailyBytes[index];
+    shedDaily -= shedDaily < dailyBytes[index] ? shedDaily : dailyBytes[index];
+    dailyBytes[index] = 0;
+  }
+
+  if (months[index] == 0 && dailyBytes[index] == 0) {
+    char dir[LOG_PARTITION_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/%04d", LOG_DIR, (int)year);
+    SD.rmdir(dir);
+  }
+}
+
+void LogRetention::finishPass() {
+  phase = PHASE_IDLE;
+  uint32_t elapsed = millis() - passStart;
+
+  portENTER_CRITICAL(&lock);
+  stats.running = false;
+  stats.passes++;
+  stats.passMs = elapsed;
+  stats.bytesReclaimed += reclaimed;
+  stats.filesDeleted += deleted;
+  stats.daysCompressed += compressed;
+  stats.backlogDays -= stats.backlogDays < backlogCleared ? stats.backlogDays : backlogCleared;
+  stats.backlogBytes -= stats.backlogBytes < backlogClearedBytes ? stats.backlogBytes : backlogClearedBytes;
+  stats.logBytes -= stats.logBytes < reclaimed ? stats.logBytes : reclaimed;
+  stats.rawDays -= stats.rawDays < rawDeleted ? stats.rawDays : rawDeleted;
+  stats.oldestRawDay = oldestKept * LOG_SECONDS_PER_DAY;
+  stats.freeBytes += reclaimed;
+  portEXIT_CRITICAL(&lock);
+
+  if (reclaimed == 0 && compressed == 0) return;
+  Serial.print(F("[LOG] Retention pass: "));
+  Serial.print(compressed);
+  Serial.print(F(" days compressed, "));
+  Serial.print(deleted);
+  Serial.print(F(" files deleted, "));
+  Serial.print((uint32_t)(reclaimed / 1024));
+  Serial.print(F(" KB reclaimed in "));
+  Serial.print(elapsed);
+  Serial.println(F(" ms"));
+}
+
+bool LogRetention::listYear(int32_t year, uint16_t& monthMask, uint32_t& dailySize) {
+  monthMask = 0;
+  dailySize = 0;
+
+  char path[LOG_PARTITION_PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%04d", LOG_DIR, (int)year);
+  File dir = SD.open(path);
+  if (!dir || !dir.isDirectory()) return false;
+
+  for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+    const char* name = baseName(entry.name());
+    if (entry.isDirectory()) {
+      int month = parseNumber(name, 2);
+      if (month >= 1 && month <= 12) monthMask |= 1u << (month - 1);
+    } else if (strcmp(name, "daily.wxr") == 0) {
+      dailySize = entry.size();
+    }
+    entry.close();
+  }
+  dir.close();
+  return true;
+}
+
+bool LogRetention::listMonth(int32_t year, uint32_t month) {
+  memset(&listing, 0, sizeof(listing));
+
+  char path[LOG_PARTITION_PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%04d/%02u", LOG_DIR, (int)year, (unsigned)month);
+  File dir = SD.open(path);
+  if (!dir || !dir.isDirectory()) return false;
+
+  for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+    const char* name = baseName(entry.name());
+    uint8_t dayOfMonth;
+    uint8_t kind = entry.isDirectory() ? 0 : dayFileKind(name, dayOfMonth);
+    if (kind != 0) {
+      listing.files[dayOfMonth] |= kind;
+      listing.bytes[dayOfMonth] += entry.size();
+    } else if (strcmp(name, "hourly.wxr") == 0) {
+      listing.hasHourly = true;
+      listing.hourlyBytes = entry.size();
+    }
+    entry.close();
+  }
+  dir.close();
+  return true;
+}
+
+bool LogRetention::removeFile(const char* path) {
+  if (!SD.remove(path)) return false;
+  deleted++;
+  return true;
+}
+
+uint32_t LogRetention::keepFrom(uint16_t days) const {
+  return days > 0 && today + 1 > days ? today + 1 - days : 0;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file log_retention.h
+ * @brief Lifecycle of the weather log on the SD card
+ *
+ * A task below the drain task keeps LOG_DIR within its limits. It holds
+ * the card (DataLogger::lockCard(), with the SPI bus) for one small slice
+ * at a time - one directory listing, one day's files, or
+ * LOG_RETENTION_SLICE_BYTES of a compaction - and leaves it free for
+ * LOG_RETENTION_SLICE_GAP_MS between slices, so records keep draining,
+ * readers are answered and the displays are drawn meanwhile.
+ *
+ * Each pass first surveys the tree (card space, sizes, closed days still
+ * uncompressed), then walks it oldest first:
+ * - closed days are rewritten as compressed blocks (DD.wxc)
+ * - days older than rawDays lose their records and keep their rollups
+ * - hourly rollups older than hourlyDays go; daily ones stay
+ * - nothing older than horizonDays is kept
+ * - past the space budget, or below the card's minimum free space, the
+ *   oldest records go first, then the oldest hourly and daily rollups
+ * The day, month and year being logged are never deleted.
+ */
+
+#ifndef LOG_RETENTION_H
+#define LOG_RETENTION_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "data_logger.h"
+
+/**
+ * What is kept, by age and by space
+ */
+struct LogRetentionPolicy {
+  uint16_t rawDays = LOG_RETENTION_RAW_DAYS;        // Days kept with every record (0 = all)
+  uint16_t hourlyDays = LOG_RETENTION_HOURLY_DAYS;  // Days kept with hourly rollups (0 = all)
+  uint16_t horizonDays = LOG_RETENTION_DAYS;        // Nothing older is kept (0 = no limit)
+  uint32_t budgetMB = LOG_SPACE_BUDGET_MB;          // Most LOG_DIR may take (0 = no limit)
+  uint32_t minFreeMB = LOG_SPACE_MIN_FREE_MB;       // Card space always left free
+};
+
+/**
+ * Retention statistics (space figures are from the last survey)
+ */
+struct LogRetentionStats {
+  uint64_t cardBytes = 0;
+  uint64_t freeBytes = 0;
+  uint64_t logBytes = 0;           // Everything under LOG_DIR
+  uint32_t rawDays = 0;            // Days with records
+  uint32_t oldestRawDay = 0;       // Unix time of the oldest, 0 = none
+  uint32_t backlogDays = 0;        // Closed days not compressed yet
+  uint64_t backlogBytes = 0;
+  uint64_t overBytes = 0;          // Past the budget / minimum free space at the survey
+  uint64_t bytesReclaimed = 0;     // Deleted or saved by compaction, since boot
+  uint32_t filesDeleted = 0;
+  uint32_t daysCompressed = 0;
+  uint32_t passes = 0;
+  uint32_t passMs = 0;             // Duration of the last complete pass
+  uint32_t slices = 0;
+  uint32_t sliceMaxUs = 0;         // Longest hold of the card
+  bool running = false;            // Pass in progress
+};
+
+/**
+ * Background compaction and deletion of old weather log data
+ */
+class LogRetention {
+public:
+  LogRetention();
+
+  /**
+   * Start the task (after DataLogger::begin())
+   */
+  bool begin(DataLogger& logger);
+
+  /**
+   * Start a pass now, unless one is running (returns at once)
+   */
+  void trigger();
+
+  /**
+   * Change the policy (used from the next pass)
+   */
+  void setPolicy(const LogRetentionPolicy& policy);
+  LogRetentionPolicy getPolicy() const;
+
+  /**
+   * Copy of the statistics
+   */
+  void getStats(LogRetentionStats& out) const;
+
+private:
+  enum Phase : uint8_t {
+    PHASE_IDLE,
+    PHASE_START,     // Card space and year directories
+    PHASE_SURVEY,    // One year or month directory per slice
+    PHASE_ACT,       // One listing, day, rollup file or compaction slice per slice
+  };
+
+  /**
+   * One month directory
+   */
+  struct MonthListing {
+    uint8_t files[32];             // DAY_* flags by day of month
+    uint32_t bytes[32];            // All of the day's files
+    uint32_t hourlyBytes;          // hourly.wxr, 0 = none
+    bool hasHourly;
+  };
+
+  DataLogger* logger;
+  TaskHandle_t task;
+  LogRetentionPolicy policy;
+  LogRetentionStats stats;
+  mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;  // policy and stats
+  volatile bool requested;
+
+  // Pass state (retention task only)
+  Phase phase;
+  uint32_t passStart;
+  uint32_t lastPass;               // millis() at the last pass start
+  uint32_t lastDay;                // Logger's day at the last pass start
+  uint32_t today;
+  LogRetentionPolicy active;       // Policy of this pass
+  uint16_t years[LOG_RETENTION_MAX_YEARS];
+  uint16_t months[LOG_RETENTION_MAX_YEARS];       // Bit m - 1 = month m exists
+  uint32_t dailyBytes[LOG_RETENTION_MAX_YEARS];   // daily.wxr, 0 = none
+  uint8_t yearCount;
+  uint8_t yearCursor;
+  uint8_t monthCursor;             // 0 = the year directory itself
+  uint8_t dayCursor;               // 0 = month not listed yet
+  bool compacting;
+  MonthListing listing;
+  LogRetentionStats survey;        // Totals being gathered
+  uint64_t shedRaw;                // Bytes still to free from each tier (the survey sums what each may lose)
+  uint64_t shedHourly;
+  uint64_t shedDaily;
+  uint64_t reclaimed;              // This pass
+  uint32_t deleted;
+  uint32_t compressed;
+  uint32_t backlogCleared;         // Backlog days compressed or deleted
+  uint64_t backlogClearedBytes;
+  uint32_t rawDeleted;             // Days whose records were deleted
+  uint32_t oldestKept;             // First day the walk left records in, 0 = none yet
+
+  static void taskMain(void* arg);
+
+  /**
+   * Start a pass when one is due, then run one slice under the card lock
+   */
+  void run();
+
+  /**
+   * One slice of the pass in progress
+   * @return false when the pass is over
+   */
+  bool step();
+
+  bool stepStart();
+  bool stepSurvey();
+  bool stepAct();
+
+  /**
+   * Act on the current day of the listed month
+   * @return false while its compaction has slices left
+   */
+  bool actOnDay(int32_t year, uint32_t month, uint8_t dayOfMonth);
+
+  /**
+   * Act on the listed month's hourly rollups, then drop the directory if empty
+   */
+  void actOnMonth(int32_t year, uint32_t month);
+
+  /**
+   * Act on the year's daily rollups, then drop the directory if empty
+   */
+  void actOnYear(uint8_t index);
+
+  /**
+   * Plan the space to free per tier from the survey
+   */
+  void plan();
+
+  void finishPass();
+
+  /**
+   * Read a year directory: months present and daily.wxr
+   */
+  bool listYear(int32_t year, uint16_t& monthMask, uint32_t& dailySize);
+
+  /**
+   * Read a month directory into listing
+   */
+  bool listMonth(int32_t year, uint32_t month);
+
+  /**
+   * Delete a file, counting it
+   */
+  bool removeFile(const char* path);
+
+  /**
+   * Oldest day the policy keeps for a tier (days since 1970, 0 = all)
+   */
+  uint32_t keepFrom(uint16_t days) const;
+};
+
+#endif // LOG_RETENTION_H
@@ -0,0 +1,94 @@
+/**
+ * @file log_ring.cpp
+ * @brief Lock-free log ring implementation
+ */
+
+#include "log_ring.h"
+#include <string.h>
+
+LogRing::LogRing() : data(nullptr), size(0), head(0), tail(0), peakUsed(0) {}
+
+bool LogRing::begin(uint8_t* buffer, size_t capacity) {
+  if (!buffer || capacity < 64 || (capacity & (capacity - 1)) != 0) return false;
+
+  data = buffer;
+  size = capacity;
+  memset(data, 0, size);
+  head.store(0, std::memory_order_relaxed);
+  tail.store(0, std::memory_order_relaxed);
+  peakUsed.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+bool LogRing::push(uint8_t stream, const void* payload, size_t len, uint32_t stamp) {
+  if (!data || len == 0 || len > maxRecord()) return false;
+
+  const uint32_t total = entrySize(len);
+
+  // Reserve [start, start + total); the consumer only frees space, so a
+  // failed check cannot turn into an overrun
+  uint32_t start = head.load(std::memory_order_relaxed);
+  uint32_t used;
+  do {
+    used = start + total - tail.load(std::memory_order_acquire);
+    if (used > size) return false;
+  } while (!head.compare_exchange_weak(start, start + total,
+                                       std::memory_order_acquire, std::memory_order_relaxed));
+
+  uint32_t peak = peakUsed.load(std::memory_order_relaxed);
+  while (used > peak && !peakUsed.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+  }
+
+  copyIn(start + 4, &stamp, 4);
+  copyIn(start + LOG_RING_ENTRY_HEADER, payload, len);
+
+  // Publish: header word last (padding bytes are already zero)
+  uint32_t header = (uint32_t)len | ((uint32_t)stream << 16) | ((uint32_t)LOG_RING_COMMITTED << 24);
+  __atomic_store_n((uint32_t*)(data + (start & (size - 1))), header, __ATOMIC_RELEASE);
+  return true;
+}
+
+size_t LogRing::pop(uint8_t& stream, uint32_t& stamp, uint8_t* out, size_t cap) {
+  if (!data) return 0;
+
+  uint32_t start = tail.load(std::memory_order_relaxed);
+  if (start == head.load(std::memory_order_acquire)) return 0;
+
+  uint32_t header = __atomic_load_n((uint32_t*)(data + (start & (size - 1))), __ATOMIC_ACQUIRE);
+  if (!((header >> 24) & LOG_RING_COMMITTED)) return 0;  // Producer still copying
+
+  size_t len = header & 0xFFFF;
+  stream = (header >> 16) & 0xFF;
+  copyOut(start + 4, &stamp, 4);
+
+  // A record too large for out is dropped rather than blocking the ring
+  size_t taken = len <= cap ? len : 0;
+  if (taken) copyOut(start + LOG_RING_ENTRY_HEADER, out, len);
+
+  // Zero the entry so its space reads as unpublished when reused
+  const uint32_t total = entrySize(len);
+  clear(start, total);
+  tail.store(start + total, std::memory_order_release);
+  return taken;
+}
+
+void LogRing::copyIn(uint32_t position, const void* src, size_t len) {
+  size_t offset = position & (size - 1);
+  size_t first = len < size - offset ? len : size - offset;
+  memcpy(data + offset, src, first);
+  memcpy(data, (const uint8_t*)src + first, len - first);
+}
+
+void LogRing::copyOut(uint32_t position, void* dst, size_t len) const {
+  size_t offset = position & (size - 1);
+  size_t first = len < size - offset ? len : size - offset;
+  memcpy(dst, data + offset, first);
+  memcpy((uint8_t*)dst + first, data, len - first);
+}
+
+void LogRing::clear(uint32_t position, size_t len) {
+  size_t offset = position & (size - 1);
+  size_t first = len < size - offset ? len : size - offset;
+  memset(data + offset, 0, first);
+  memset(data, 0, len - first);
+}
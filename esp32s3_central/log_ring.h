@@ -0,0 +1,93 @@
+/**
+ * @file log_ring.h
+ * @brief Lock-free multi-producer / single-consumer ring of log records
+ *
+ * Producers reserve space with one compare-and-swap on the head, copy their
+ * record in and publish it by storing its header word last. The single
+ * consumer (the SD drain task) takes records in reservation order, stopping
+ * at the first one still being written. Nothing blocks: a full ring makes
+ * push() fail and the record is counted as dropped.
+ *
+ * Entry layout, 4-byte aligned so a header word never wraps:
+ *
+ *   header (length:16 | stream:8 | LOG_RING_COMMITTED) | stamp | payload, padded
+ *
+ * The consumer zeroes what it takes, so an unpublished header always reads
+ * 0. Only the head/tail counters are atomics (in internal RAM); the buffer
+ * itself may live in PSRAM since it is only read and written with plain
+ * loads and stores.
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define LOG_RING_COMMITTED 0x80      // Header flag: entry is complete
+#define LOG_RING_ENTRY_HEADER 8      // Header word + stamp
+
+/**
+ * Byte ring of variable-length records tagged with a stream id
+ */
+class LogRing {
+public:
+  LogRing();
+
+  /**
+   * Use buffer (capacity: power of two, at least 64 bytes); the ring starts empty
+   * @return false if capacity is unusable
+   */
+  bool begin(uint8_t* buffer, size_t capacity);
+
+  /**
+   * Append a record (any task)
+   * @param stamp caller's enqueue time, handed back by pop()
+   * @return false if the ring is full or len is too large (record dropped)
+   */
+  bool push(uint8_t stream, const void* data, size_t len, uint32_t stamp);
+
+  /**
+   * Take the oldest complete record (drain task only)
+   * @param out receives the payload; cap must hold the largest record pushed
+   * @return payload length, 0 if the ring is empty or the oldest record is
+   *         still being written
+   */
+  size_t pop(uint8_t& stream, uint32_t& stamp, uint8_t* out, size_t cap);
+
+  /**
+   * Bytes reserved (records waiting plus ones being written)
+   */
+  size_t used() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return size; }
+
+  /**
+   * Highest used() seen since begin()
+   */
+  size_t peak() const { return peakUsed.load(std::memory_order_relaxed); }
+
+  /**
+   * Largest payload push() accepts
+   */
+  size_t maxRecord() const { return size / 4; }
+
+  static size_t entrySize(size_t len) { return LOG_RING_ENTRY_HEADER + ((len + 3) & ~(size_t)3); }
+
+private:
+  uint8_t* data;
+  size_t size;
+  std::atomic<uint32_t> head;        // Next byte to reserve (free-running)
+  std::atomic<uint32_t> tail;        // Next byte to consume (free-running)
+  std::atomic<uint32_t> peakUsed;
+
+  void copyIn(uint32_t position, const void* src, size_t len);
+  void copyOut(uint32_t position, void* dst, size_t len) const;
+  void clear(uint32_t position, size_t len);
+};
+
+#endif // LOG_RING_H
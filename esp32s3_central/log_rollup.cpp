@@ -0,0 +1,96 @@
+/**
+ * @file log_rollup.cpp
+ * @brief Weather log rollup implementation
+ */
+
+#include "log_rollup.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+void LogRollup::begin(uint32_t periodStart) {
+  start = periodStart;
+  for (uint8_t ch = 0; ch < WX_LOG_CHANNEL_COUNT; ch++) {
+    min[ch] = NAN;
+    max[ch] = NAN;
+    mean[ch] = NAN;
+    count[ch] = 0;
+  }
+}
+
+void LogRollup::add(const float* values, uint16_t mask) {
+  for (uint8_t ch = 0; ch < WX_LOG_CHANNEL_COUNT; ch++) {
+    float v = values[ch];
+    if (!(mask & (1u << ch)) || isnan(v) || count[ch] == UINT16_MAX) continue;
+
+    // Running mean: the stored mean and count are enough to carry on after a restart
+    if (count[ch]++ == 0) {
+      min[ch] = max[ch] = mean[ch] = v;
+      continue;
+    }
+    if (v < min[ch]) min[ch] = v;
+    if (v > max[ch]) max[ch] = v;
+    mean[ch] += (v - mean[ch]) / count[ch];
+  }
+}
+
+bool LogRollup::empty() const {
+  for (uint8_t ch = 0; ch < WX_LOG_CHANNEL_COUNT; ch++) {
+    if (count[ch] != 0) return false;
+  }
+  return true;
+}
+
+uint32_t rollupPeriod(LogRollupLevel level) {
+  return level == LOG_ROLLUP_HOUR ? 3600 : LOG_SECONDS_PER_DAY;
+}
+
+uint32_t rollupFileStart(LogRollupLevel level, uint32_t time) {
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays((int32_t)(time / LOG_SECONDS_PER_DAY), year, month, day);
+  return (uint32_t)daysFromCivil(year, level == LOG_ROLLUP_HOUR ? month : 1, 1) * LOG_SECONDS_PER_DAY;
+}
+
+uint32_t rollupFileEnd(LogRollupLevel level, uint32_t time) {
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays((int32_t)(time / LOG_SECONDS_PER_DAY), year, month, day);
+  if (level == LOG_ROLLUP_DAY || month == 12) {
+    return (uint32_t)daysFromCivil(year + 1, 1, 1) * LOG_SECONDS_PER_DAY;
+  }
+  return (uint32_t)daysFromCivil(year, month + 1, 1) * LOG_SECONDS_PER_DAY;
+}
+
+size_t formatRollupPath(const char* dir, LogRollupLevel level, uint32_t time, char* out, size_t cap) {
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays((int32_t)(time / LOG_SECONDS_PER_DAY), year, month, day);
+
+  int n = level == LOG_ROLLUP_HOUR
+    ? snprintf(out, cap, "%s/%04d/%02u/hourly.wxr", dir, (int)year, (unsigned)month)
+    : snprintf(out, cap, "%s/%04d/daily.wxr", dir, (int)year);
+  return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+void makeRollupHeader(LogRollupLevel level, uint32_t time, LogRollupHeader& header) {
+  memset(&header, 0, sizeof(header));
+  header.magic = LOG_ROLLUP_MAGIC;
+  header.version = LOG_ROLLUP_VERSION;
+  header.recordSize = sizeof(LogRollup);
+  header.channelCount = WX_LOG_CHANNEL_COUNT;
+  header.level = level;
+  header.period = rollupPeriod(level);
+  header.firstSlot = rollupFileStart(level, time);
+}
+
+bool checkRollupHeader(const LogRollupHeader& header, LogRollupLevel level, uint32_t time) {
+  LogRollupHeader expected;
+  makeRollupHeader(level, time, expected);
+  return memcmp(&header, &expected, sizeof(header)) == 0;
+}
+
+uint32_t rollupSlotOffset(LogRollupLevel level, uint32_t time) {
+  uint32_t slot = (time - rollupFileStart(level, time)) / rollupPeriod(level);
+  return sizeof(LogRollupHeader) + slot * sizeof(LogRollup);
+}
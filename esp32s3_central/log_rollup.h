@@ -0,0 +1,113 @@
+/**
+ * @file log_rollup.h
+ * @brief Hourly and daily summaries (min/max/mean/count per channel) of the weather log
+ *
+ * Each level lives in small slot-addressed files next to the day partitions:
+ *
+ *   LOG_DIR/YYYY/MM/hourly.wxr   one slot per hour of the month
+ *   LOG_DIR/YYYY/daily.wxr       one slot per day of the year
+ *
+ *   LogRollupHeader | slot 0 | slot 1 | ...
+ *
+ * Slot i covers firstSlot + i * period, so a period is read or rewritten
+ * with one seek. Slots never filled read as all 0xFF (or are past the end
+ * of the file).
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef LOG_ROLLUP_H
+#define LOG_ROLLUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "log_format.h"
+
+#define LOG_ROLLUP_MAGIC 0x55525857   // "WXRU"
+#define LOG_ROLLUP_VERSION 1
+#define LOG_ROLLUP_EMPTY 0xFFFFFFFF   // start of a slot never written
+
+/**
+ * Summary levels, finest first
+ */
+enum LogRollupLevel : uint8_t {
+  LOG_ROLLUP_HOUR,
+  LOG_ROLLUP_DAY,
+  LOG_ROLLUP_LEVELS
+};
+
+/**
+ * Rollup file header (packed)
+ */
+struct __attribute__((packed)) LogRollupHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;                  // sizeof(LogRollup)
+  uint8_t channelCount;                 // WX_LOG_CHANNEL_COUNT
+  uint8_t level;                        // LogRollupLevel
+  uint16_t reserved;
+  uint32_t period;                      // Seconds per slot
+  uint32_t firstSlot;                   // Start of slot 0 (first of the month / year)
+};
+
+/**
+ * Summary of one period, one entry per weather channel (packed, floats
+ * kept 4-byte aligned). A channel with count 0 had no readings.
+ */
+struct __attribute__((packed)) LogRollup {
+  uint32_t start;                       // Period start (unix, UTC)
+  float min[WX_LOG_CHANNEL_COUNT];
+  float max[WX_LOG_CHANNEL_COUNT];
+  float mean[WX_LOG_CHANNEL_COUNT];
+  uint16_t count[WX_LOG_CHANNEL_COUNT];
+
+  /**
+   * Start an empty period
+   */
+  void begin(uint32_t periodStart);
+
+  /**
+   * Add one record's values (channels outside mask, or NaN, are skipped)
+   */
+  void add(const float* values, uint16_t mask);
+
+  /**
+   * True if no channel has a reading
+   */
+  bool empty() const;
+};
+
+/**
+ * Seconds per period of a level
+ */
+uint32_t rollupPeriod(LogRollupLevel level);
+
+/**
+ * Start of the file holding time's period (first of its month / year)
+ * and of the next file
+ */
+uint32_t rollupFileStart(LogRollupLevel level, uint32_t time);
+uint32_t rollupFileEnd(LogRollupLevel level, uint32_t time);
+
+/**
+ * File holding time's period: "<dir>/YYYY/MM/hourly.wxr" or "<dir>/YYYY/daily.wxr"
+ * @return length, 0 if cap is too small
+ */
+size_t formatRollupPath(const char* dir, LogRollupLevel level, uint32_t time, char* out, size_t cap);
+
+/**
+ * Header of a new rollup file for time's period
+ */
+void makeRollupHeader(LogRollupLevel level, uint32_t time, LogRollupHeader& header);
+
+/**
+ * True if header was written for this level, file and record layout
+ */
+bool checkRollupHeader(const LogRollupHeader& header, LogRollupLevel level, uint32_t time);
+
+/**
+ * File offset of time's slot
+ */
+uint32_t rollupSlotOffset(LogRollupLevel level, uint32_t time);
+
+#endif // LOG_ROLLUP_H
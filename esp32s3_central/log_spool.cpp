@@ -0,0 +1,356 @@
+/**
+ * @file log_spool.cpp
+ * @brief Flash spool implementation
+ */
+
+#include "log_spool.h"
+#include "log_format.h"
+
+#define LOG_SPOOL_READ_FILE LOG_SPOOL_DIR "/read"
+#define LOG_SPOOL_PATH_MAX 32
+
+/**
+ * Stored replay position
+ */
+struct __attribute__((packed)) LogSpoolPosition {
+  uint32_t segment;
+  uint32_t offset;
+  uint8_t crc;                          // CRC-8 of the bytes above
+};
+
+/**
+ * Last path component (File::name() is the full path on older cores)
+ */
+static const char* baseName(const char* name) {
+  const char* slash = strrchr(name, '/');
+  return slash ? slash + 1 : name;
+}
+
+static uint8_t entryCrc(const LogSpoolEntry& entry, const uint8_t* payload) {
+  uint8_t crc = logCrc8(&entry.stream, sizeof(entry.stream) + sizeof(entry.length));
+  return logCrc8(payload, entry.length, crc);
+}
+
+LogSpool::LogSpool()
+  : fs(nullptr), page(nullptr), pageUsed(0), pageWritten(0), pageSince(0), first(0), last(0), lastSize(0),
+    lastSealed(false), segmentsMax(0), readSegment(0), readOffset(0), commitSegment(0), commitOffset(0),
+    peekLength(0), unread(0), consumedRecords(0), readerSegment(0) {}
+
+void LogSpool::segmentPath(uint32_t segment, char* out, size_t cap) {
+  snprintf(out, cap, "%s/%08lu.seg", LOG_SPOOL_DIR, (unsigned long)segment);
+}
+
+bool LogSpool::begin(FS& filesystem, uint64_t freeBytes, uint8_t* buffer) {
+  if (!buffer) return false;
+  if (!filesystem.exists(LOG_SPOOL_DIR) && !filesystem.mkdir(LOG_SPOOL_DIR)) return false;
+
+  // Segments left by an earlier outage
+  File dir = filesystem.open(LOG_SPOOL_DIR);
+  if (!dir || !dir.isDirectory()) return false;
+  uint64_t spooled = 0;
+  for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+    char* end;
+    unsigned long segment = strtoul(baseName(entry.name()), &end, 10);
+    if (!entry.isDirectory() && segment > 0 && strcmp(end, ".seg") == 0) {
+      if (first == 0 || segment < first) first = segment;
+      if (segment > last) {
+        last = segment;
+        lastSize = entry.size();
+      }
+      spooled += entry.size();
+    }
+    entry.close();
+  }
+  dir.close();
+
+  fs = &filesystem;
+  page = buffer;
+
+  // Whole segments, within a share of the free flash (the spool's own files count as free)
+  uint64_t quota = (uint64_t)LOG_SPOOL_QUOTA_KB * 1024;
+  uint64_t share = (freeBytes + spooled) * LOG_SPOOL_FREE_SHARE / 100;
+  if (share < quota) quota = share;
+  segmentsMax = quota / LOG_SPOOL_SEGMENT_BYTES > 0 ? quota / LOG_SPOOL_SEGMENT_BYTES : 1;
+  stats.quotaBytes = (uint32_t)segmentsMax * LOG_SPOOL_SEGMENT_BYTES;
+
+  // Replay resumes where it had got to
+  if (first != 0) {
+    readSegment = first;
+    LogSpoolPosition position;
+    File file = fs->open(LOG_SPOOL_READ_FILE, FILE_READ);
+    if (file && file.read((uint8_t*)&position, sizeof(position)) == sizeof(position) &&
+        position.crc == logCrc8((const uint8_t*)&position, sizeof(position) - 1) &&
+        position.segment >= first && position.segment <= last) {
+      readSegment = position.segment;
+      readOffset = position.offset;
+    }
+    file.close();
+  }
+  commitSegment = readSegment;
+  commitOffset = readOffset;
+  recount();
+
+  if (unread > 0) {
+    Serial.print(F("[LOG] Flash spool holds "));
+    Serial.print(unread);
+    Serial.println(F(" bytes from an earlier outage"));
+  }
+  return true;
+}
+
+bool LogSpool::append(uint8_t stream, const uint8_t* data, size_t len) {
+  size_t size = sizeof(LogSpoolEntry) + len;
+  if (!fs || size > LOG_SPOOL_PAGE_BYTES) return false;
+
+  // Page full: out to flash in one append
+  if (pageUsed + size > LOG_SPOOL_PAGE_BYTES) {
+    if (!writePage()) return false;
+    pageUsed = 0;
+    pageWritten = 0;
+  }
+
+  LogSpoolEntry entry;
+  entry.magic = LOG_SPOOL_MAGIC;
+  entry.stream = stream;
+  entry.length = len;
+  entry.crc = entryCrc(entry, data);
+  memcpy(page + pageUsed, &entry, sizeof(entry));
+  memcpy(page + pageUsed + sizeof(entry), data, len);
+
+  if (pageUsed == pageWritten) pageSince = millis();
+  pageUsed += size;
+  unread += size;
+  stats.recordsSpooled++;
+  return true;
+}
+
+bool LogSpool::flush(uint32_t maxDelayMs) {
+  if (!fs || pageUsed == pageWritten) return true;
+  if (maxDelayMs > 0 && millis() - pageSince < maxDelayMs) return true;
+  return writePage();
+}
+
+bool LogSpool::writePage() {
+  size_t length = pageUsed - pageWritten;
+  if (length == 0) return true;
+
+  // A page never spans two segments
+  if (first == 0 || lastSealed || (pageWritten == 0 && lastSize + LOG_SPOOL_PAGE_BYTES > LOG_SPOOL_SEGMENT_BYTES)) {
+    startSegment();
+  }
+
+  char path[LOG_SPOOL_PATH_MAX];
+  segmentPath(last, path, sizeof(path));
+  if (readerSegment == last) closeReader();  // Reopened to see the new end
+
+  unsigned long start = micros();
+  File file = fs->open(path, FILE_APPEND);
+  bool ok = file && file.write(page + pageWritten, length) == length;
+  file.close();
+  uint32_t elapsed = micros() - start;
+
+  stats.appends++;
+  if (elapsed > stats.appendMaxUs) stats.appendMaxUs = elapsed;
+  if (!ok) {
+    // Whatever part of it went out is left at the end of this segment, and the page goes to the next
+    stats.writeErrors++;
+    lastSealed = true;
+    uint32_t size = segmentSize(last);
+    if (size > lastSize) unread += size - lastSize;  // Skipped by replay as damage
+    lastSize = size;
+    return false;
+  }
+
+  pageWritten = pageUsed;
+  lastSize += length;
+  stats.flashBytesWritten += length;
+  return true;
+}
+
+void LogSpool::startSegment() {
+  while (first != 0 && segmentCount() >= segmentsMax) dropOldest();
+
+  last++;
+  lastSize = 0;
+  lastSealed = false;
+  if (first == 0) {
+    first = last;
+    readSegment = commitSegment = last;
+    readOffset = commitOffset = 0;
+  }
+}
+
+void LogSpool::dropOldest() {
+  uint32_t dropped = first;
+  uint32_t size = segmentSize(dropped);
+  if (readerSegment == dropped) closeReader();
+
+  char path[LOG_SPOOL_PATH_MAX];
+  segmentPath(dropped, path, sizeof(path));
+  fs->remove(path);
+  first = dropped == last ? 0 : dropped + 1;
+  stats.segmentsDropped++;
+
+  // Replay moves on to the next segment
+  if (readSegment <= dropped) {
+    uint32_t done = readSegment == dropped ? readOffset : 0;
+    stats.bytesDropped += size > done ? size - done : 0;
+    readSegment = first;
+    readOffset = 0;
+    peekLength = 0;
+  }
+  if (commitSegment <= dropped) {
+    commitSegment = first;
+    commitOffset = 0;
+  }
+  recount();
+}
+
+size_t LogSpool::peek(uint8_t& stream, uint8_t* out, size_t cap) {
+  peekLength = 0;
+
+  while (unread > 0) {
+    // Caught up with the page in RAM: it is read like the rest once in flash
+    if (first == 0) {
+      if (pageUsed > pageWritten && writePage()) continue;
+      return 0;
+    }
+
+    uint32_t size = segmentSize(readSegment);
+    if (readOffset >= size) {
+      if (readSegment < last) {
+        readSegment++;
+        readOffset = 0;
+        continue;
+      }
+      if (pageUsed > pageWritten && writePage()) continue;
+      return 0;
+    }
+
+    LogSpoolEntry entry;
+    bool ok = openReader() && reader.seek(readOffset) &&
+              reader.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry) &&
+              entry.magic == LOG_SPOOL_MAGIC && entry.length <= cap &&
+              readOffset + sizeof(entry) + entry.length <= size &&
+              reader.read(out, entry.length) == entry.length && entry.crc == entryCrc(entry, out);
+    if (!ok) {
+      // Nothing after a damaged entry can be framed: skip the rest of the segment
+      uint32_t rest = size - readOffset;
+      unread -= rest < unread ? rest : unread;
+      readOffset = size;
+      stats.corruptSkipped++;
+      continue;
+    }
+
+    stream = entry.stream;
+    peekLength = sizeof(entry) + entry.length;
+    return entry.length;
+  }
+  return 0;
+}
+
+void LogSpool::consume() {
+  if (peekLength == 0) return;
+  readOffset += peekLength;
+  unread -= peekLength < unread ? peekLength : unread;
+  peekLength = 0;
+  consumedRecords++;
+  stats.recordsReplayed++;
+}
+
+void LogSpool::commit() {
+  if (!fs) return;
+  char path[LOG_SPOOL_PATH_MAX];
+
+  if (unread == 0) {
+    // All on the card: start afresh
+    closeReader();
+    for (uint32_t segment = first; first != 0 && segment <= last; segment++) {
+      segmentPath(segment, path, sizeof(path));
+      fs->remove(path);
+    }
+    fs->remove(LOG_SPOOL_READ_FILE);
+    first = 0;
+    lastSize = 0;
+    pageUsed = 0;
+    pageWritten = 0;
+    readSegment = 0;
+    readOffset = 0;
+  } else {
+    // Segments replayed to the end go
+    while (first != 0 && first < readSegment) {
+      if (readerSegment == first) closeReader();
+      segmentPath(first, path, sizeof(path));
+      fs->remove(path);
+      first++;
+    }
+
+    LogSpoolPosition position;
+    position.segment = readSegment;
+    position.offset = readOffset;
+    position.crc = logCrc8((const uint8_t*)&position, sizeof(position) - 1);
+    File file = fs->open(LOG_SPOOL_READ_FILE, FILE_WRITE);
+    if (!file || file.write((const uint8_t*)&position, sizeof(position)) != sizeof(position)) {
+      stats.writeErrors++;  // Replay after a reboot starts from the oldest segment again
+    }
+    file.close();
+  }
+
+  commitSegment = readSegment;
+  commitOffset = readOffset;
+  consumedRecords = 0;
+}
+
+void LogSpool::rewind() {
+  uint32_t replayed = consumedRecords;
+  readSegment = commitSegment;
+  readOffset = commitOffset;
+  peekLength = 0;
+  recount();
+  stats.recordsReplayed -= replayed < stats.recordsReplayed ? replayed : stats.recordsReplayed;
+}
+
+void LogSpool::recount() {
+  unread = pageUsed - pageWritten;
+  for (uint32_t segment = readSegment; first != 0 && segment != 0 && segment <= last; segment++) {
+    uint32_t size = segmentSize(segment);
+    uint32_t done = segment == readSegment ? readOffset : 0;
+    unread += size > done ? size - done : 0;
+  }
+  consumedRecords = 0;
+}
+
+uint32_t LogSpool::segmentSize(uint32_t segment) {
+  if (segment == last && !lastSealed) return lastSize;
+  if (segment == readerSegment && reader) return reader.size();
+
+  char path[LOG_SPOOL_PATH_MAX];
+  segmentPath(segment, path, sizeof(path));
+  File file = fs->open(path, FILE_READ);
+  uint32_t size = file ? file.size() : 0;
+  file.close();
+  return size;
+}
+
+bool LogSpool::openReader() {
+  if (reader && readerSegment == readSegment) return true;
+  closeReader();
+
+  char path[LOG_SPOOL_PATH_MAX];
+  segmentPath(readSegment, path, sizeof(path));
+  reader = fs->open(path, FILE_READ);
+  if (!reader) return false;
+  readerSegment = readSegment;
+  return true;
+}
+
+void LogSpool::closeReader() {
+  if (reader) reader.close();
+  readerSegment = 0;
+}
+
+void LogSpool::getStats(LogSpoolStats& out) const {
+  out = stats;
+  out.pendingBytes = unread;
+  out.segments = segmentCount();
+}
@@ -0,0 +1,173 @@
+/**
+ * @file log_spool.h
+ * @brief Flash spool of log records while the SD card is missing or failing
+ *
+ * When the card cannot be written, DataLogger puts the records it would
+ * have staged into a bounded ring of segment files on LittleFS, and
+ * replays them through its normal drain path once the card answers again
+ * (partitions, index and rollups as if the card had never been away):
+ *
+ *   LOG_SPOOL_DIR/00000001.seg, 00000002.seg, ...   entries, oldest segment first
+ *   LOG_SPOOL_DIR/read                               replay position (segment, offset)
+ *   entry = LogSpoolEntry | payload
+ *
+ * Flash wears by erase block, so records collect in a RAM page and are
+ * appended one page (LOG_SPOOL_PAGE_BYTES) at a time, or when the oldest
+ * has waited LOG_SPOOL_MAX_DELAY_MS; a page never spans two segments.
+ * The quota is a whole number of segments, capped at a share of the free
+ * flash so LittleFS keeps spare blocks to spread wear over; past it the
+ * oldest segment is deleted. Segments outlive a reboot: whatever was not
+ * replayed before it is replayed after.
+ */
+
+#ifndef LOG_SPOOL_H
+#define LOG_SPOOL_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+
+#define LOG_SPOOL_MAGIC 0xA5
+#define LOG_SPOOL_ROLLED_UP 0x80       // Stream flag: already in the rollups (staged before the card failed)
+
+/**
+ * Entry header (packed, 5 bytes)
+ */
+struct __attribute__((packed)) LogSpoolEntry {
+  uint8_t magic;
+  uint8_t stream;                       // LogStreamId, possibly | LOG_SPOOL_ROLLED_UP
+  uint16_t length;                      // Payload bytes
+  uint8_t crc;                          // CRC-8 of stream, length and payload
+};
+
+/**
+ * Spool statistics (since boot, except quota and pending)
+ */
+struct LogSpoolStats {
+  uint32_t quotaBytes = 0;
+  uint32_t pendingBytes = 0;            // Spooled, not replayed yet (flash and RAM page)
+  uint16_t segments = 0;
+  uint32_t recordsSpooled = 0;
+  uint32_t recordsReplayed = 0;
+  uint32_t segmentsDropped = 0;         // Oldest segments deleted past the quota
+  uint64_t bytesDropped = 0;
+  uint64_t flashBytesWritten = 0;
+  uint32_t appends = 0;                 // Flash writes; each programs at most one block partly filled before
+  uint32_t appendMaxUs = 0;
+  uint32_t writeErrors = 0;
+  uint32_t corruptSkipped = 0;          // Segment tails dropped by replay
+};
+
+/**
+ * Bounded ring of log records in flash (used by the drain task only)
+ */
+class LogSpool {
+public:
+  LogSpool();
+
+  /**
+   * Pick up segments left by an earlier outage and size the quota
+   * @param freeBytes free space on fs now
+   * @param page LOG_SPOOL_PAGE_BYTES of RAM for the page being filled
+   */
+  bool begin(FS& fs, uint64_t freeBytes, uint8_t* page);
+
+  bool isReady() const { return fs != nullptr; }
+
+  /**
+   * True when every record has been replayed
+   */
+  bool empty() const { return unread == 0; }
+
+  /**
+   * Add one record (it reaches flash with its page)
+   * @return false if it is too large or the page could not be written
+   */
+  bool append(uint8_t stream, const uint8_t* data, size_t len);
+
+  /**
+   * Write the page out if its oldest record has waited maxDelayMs (0 = now)
+   */
+  bool flush(uint32_t maxDelayMs = 0);
+
+  /**
+   * Oldest record not replayed yet (replay that catches up with the page
+   * writes it out first)
+   * @param out cap must hold the largest record appended
+   * @return payload length, 0 if there is none
+   */
+  size_t peek(uint8_t& stream, uint8_t* out, size_t cap);
+
+  /**
+   * Done with the record peek() returned
+   */
+  void consume();
+
+  /**
+   * The records consumed so far are on the card: store the replay position
+   * and delete the segments replayed
+   */
+  void commit();
+
+  /**
+   * Back to the last commit() (the card failed before they were written)
+   */
+  void rewind();
+
+  void getStats(LogSpoolStats& out) const;
+
+private:
+  FS* fs;
+  uint8_t* page;
+  size_t pageUsed;
+  size_t pageWritten;                   // Leading bytes already appended to the newest segment
+  uint32_t pageSince;                   // millis() of the oldest record not in flash
+  uint32_t first;                       // Oldest segment (0 = none)
+  uint32_t last;                        // Newest segment
+  uint32_t lastSize;                    // Its bytes in flash
+  bool lastSealed;                      // A failed append left it with a torn end: start another
+  uint16_t segmentsMax;
+  uint32_t readSegment;                 // Next entry to replay
+  uint32_t readOffset;
+  uint32_t commitSegment;               // Position at the last commit()
+  uint32_t commitOffset;
+  uint32_t peekLength;                  // Entry peek() returned (0 = none)
+  uint32_t unread;                      // Bytes of entries not consumed
+  uint32_t consumedRecords;             // Since the last commit()
+  File reader;
+  uint32_t readerSegment;               // Segment reader has open (0 = none)
+  LogSpoolStats stats;
+
+  /**
+   * Append the page's bytes not in flash yet to the newest segment
+   */
+  bool writePage();
+
+  /**
+   * Start a new newest segment, deleting the oldest past the quota
+   */
+  void startSegment();
+
+  /**
+   * Delete the oldest segment
+   */
+  void dropOldest();
+
+  /**
+   * Bytes in a segment's file (0 if there is none)
+   */
+  uint32_t segmentSize(uint32_t segment);
+
+  uint16_t segmentCount() const { return first ? last - first + 1 : 0; }
+
+  /**
+   * Recompute unread from the replay position
+   */
+  void recount();
+
+  bool openReader();
+  void closeReader();
+  static void segmentPath(uint32_t segment, char* out, size_t cap);
+};
+
+#endif // LOG_SPOOL_H
@@ -0,0 +1,128 @@
+/**
+ * @file lttb.cpp
+ * @brief Streaming LTTB implementation
+ */
+
+#include "lttb.h"
+#include <math.h>
+
+LttbSampler::LttbSampler(HistoryPoint* out, size_t points, uint32_t from, uint32_t to)
+  : out(out), capacity(points), written(0), from(from), span(to > from ? to - from : 1),
+    bucketCount(points > 2 ? points - 2 : 1), inputs(0), selected(), last(),
+    current(&slots[0]), next(&slots[1]) {
+  for (Bucket& bucket : slots) {
+    bucket.count = 0;
+    bucket.total = 0;
+  }
+}
+
+uint32_t LttbSampler::bucketOf(uint32_t time) const {
+  if (time <= from) return 0;
+  uint32_t index = (uint32_t)((uint64_t)(time - from) * bucketCount / span);
+  return index < bucketCount ? index : bucketCount - 1;
+}
+
+void LttbSampler::add(const HistoryPoint& point) {
+  inputs++;
+  last = point;
+
+  // The first point is always kept
+  if (written == 0) {
+    emit(point);
+    return;
+  }
+
+  uint32_t index = bucketOf(point.time);
+  if (current->total == 0) {
+    current->index = index;
+    push(*current, point);
+  } else if (index <= current->index) {
+    push(*current, point);
+  } else if (next->total == 0 || index == next->index) {
+    next->index = index;
+    push(*next, point);
+  } else {
+    // Next bucket is complete: its mean is the third corner for current
+    resolve(next->sumTime / next->total, next->sumValue / next->total);
+    next->index = index;
+    push(*next, point);
+  }
+}
+
+size_t LttbSampler::finish() {
+  if (inputs < 2) return written;
+
+  // The last point is kept as is: take it out of its bucket (it was added
+  // last, so it is the bucket's last candidate), and it becomes the third
+  // corner of the final bucket
+  Bucket& tail = next->total > 0 ? *next : *current;
+  double lastTime = (double)last.time - from;
+  tail.count--;
+  tail.total--;
+  tail.sumTime -= lastTime;
+  tail.sumValue -= last.value;
+
+  if (next->total > 0) {
+    resolve(next->sumTime / next->total, next->sumValue / next->total);
+  }
+  if (current->total > 0) {
+    resolve(lastTime, last.value);
+  }
+  emit(last);
+  return written;
+}
+
+void LttbSampler::push(Bucket& bucket, const HistoryPoint& point) {
+  bucket.sumTime += (double)point.time - from;
+  bucket.sumValue += point.value;
+  bucket.total++;
+
+  // Full: of each pair keep the point further from the bucket mean, so the
+  // excursions LTTB would pick survive
+  if (bucket.count == LTTB_BUCKET_MAX) {
+    float mean = (float)(bucket.sumValue / bucket.total);
+    size_t kept = 0;
+    for (size_t i = 0; i + 1 < bucket.count; i += 2) {
+      const HistoryPoint& a = bucket.points[i];
+      const HistoryPoint& b = bucket.points[i + 1];
+      bucket.points[kept++] = fabsf(a.value - mean) >= fabsf(b.value - mean) ? a : b;
+    }
+    bucket.count = kept;
+  }
+  bucket.points[bucket.count++] = point;
+}
+
+void LttbSampler::resolve(double cornerTime, double cornerValue) {
+  const double aTime = (double)selected.time - from;
+  const double aValue = selected.value;
+
+  // Largest triangle (selected, candidate, corner)
+  const HistoryPoint* best = nullptr;
+  double bestArea = -1.0;
+  for (size_t i = 0; i < current->count; i++) {
+    const HistoryPoint& candidate = current->points[i];
+    double area = fabs((aTime - cornerTime) * ((double)candidate.value - aValue) -
+                       (aTime - ((double)candidate.time - from)) * (cornerValue - aValue));
+    if (area > bestArea) {
+      bestArea = area;
+      best = &candidate;
+    }
+  }
+  if (best) emit(*best);
+
+  // Next becomes current; the old current is reused for the bucket after
+  Bucket* done = current;
+  current = next;
+  next = done;
+  next->count = 0;
+  next->total = 0;
+  next->sumTime = 0;
+  next->sumValue = 0;
+}
+
+void LttbSampler::emit(const HistoryPoint& point) {
+  if (written < capacity) {
+    out[written++] = point;
+    selected = point;
+  }
+}
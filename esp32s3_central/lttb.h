@@ -0,0 +1,102 @@
+/**
+ * @file lttb.h
+ * @brief Streaming Largest-Triangle-Three-Buckets downsampling for history charts
+ *
+ * Points arrive in time order (from DataLogger::readSummary()) and are
+ * reduced to at most `points` outputs without storing the series: the
+ * range [from, to] is split into points - 2 equal time buckets, and each
+ * bucket keeps the point that spans the largest triangle with the previous
+ * pick and the mean of the next bucket. The first and last points are
+ * always kept. Only two buckets of candidates are held at a time.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef LTTB_H
+#define LTTB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LTTB_BUCKET_MAX 64   // Candidates kept per bucket; more are thinned to the outliers
+
+/**
+ * One chart point: value is what LTTB picks on, min/max ride along
+ */
+struct HistoryPoint {
+  uint32_t time;
+  float value;
+  float min;
+  float max;
+};
+
+/**
+ * Downsamples one series into a caller-provided array
+ */
+class LttbSampler {
+public:
+  /**
+   * @param out receives up to points entries (points >= 3)
+   * @param from, to time range the buckets divide
+   */
+  LttbSampler(HistoryPoint* out, size_t points, uint32_t from, uint32_t to);
+
+  /**
+   * Add the next point (time order)
+   */
+  void add(const HistoryPoint& point);
+
+  /**
+   * Pick the remaining buckets and the last point
+   * @return points written to out
+   */
+  size_t finish();
+
+  /**
+   * Points in out so far: a bucket's pick is written once the bucket after
+   * it is complete, so out can be sent while the series is still read
+   */
+  size_t getOutputCount() const { return written; }
+
+  /**
+   * Points passed to add()
+   */
+  uint32_t getInputCount() const { return inputs; }
+
+private:
+  /**
+   * Candidates of one bucket, plus the sums for its mean
+   */
+  struct Bucket {
+    HistoryPoint points[LTTB_BUCKET_MAX];
+    size_t count;
+    uint32_t index;          // Bucket number in the range
+    double sumTime;          // Relative to the range start
+    double sumValue;
+    uint32_t total;          // Points added, including thinned ones
+  };
+
+  HistoryPoint* out;
+  size_t capacity;
+  size_t written;
+  uint32_t from;
+  uint32_t span;
+  uint32_t bucketCount;
+  uint32_t inputs;
+  HistoryPoint selected;     // Last point written (the triangle's first corner)
+  HistoryPoint last;         // Newest point seen
+  Bucket slots[2];
+  Bucket* current;           // Bucket being decided
+  Bucket* next;              // Bucket after it, still filling
+
+  uint32_t bucketOf(uint32_t time) const;
+  void push(Bucket& bucket, const HistoryPoint& point);
+  void emit(const HistoryPoint& point);
+
+  /**
+   * Write current's best point given the third corner, then move next into current
+   */
+  void resolve(double cornerTime, double cornerValue);
+};
+
+#endif // LTTB_H
@@ -0,0 +1,210 @@
+/**
+ * @file ml_features.cpp
+ * @brief Live features: rolling windows and averages
+ */
+
+#include "ml_features.h"
+#include <math.h>
+#include <string.h>
+
+// Spans the rules use, at about ML_ROLLING_CAPACITY - 4 points each
+#define ML_PRESSURE_SHORT_S 3600
+#define ML_PRESSURE_LONG_S 10800
+#define ML_TEMP_TREND_S 1800
+#define ML_HUMIDITY_MEAN_S 43200
+#define ML_POINTS_PER_SPAN (ML_ROLLING_CAPACITY - 4)
+
+// ============================================================================
+// MLRollingWindow
+// ============================================================================
+
+MLRollingWindow::MLRollingWindow(uint32_t spanS, uint32_t spacingS) : span(spanS), spacing(spacingS) {
+  clear();
+}
+
+void MLRollingWindow::clear() {
+  head = 0;
+  count = 0;
+  timeOrigin = 0;
+  valueOrigin = 0;
+  sumT = sumV = sumTT = sumTV = 0;
+  changes = 0;
+}
+
+void MLRollingWindow::accumulate(const Point& p, float sign) {
+  float t = (float)(p.time - timeOrigin) / 3600.0f;
+  float v = p.value - valueOrigin;
+  sumT += sign * t;
+  sumV += sign * v;
+  sumTT += sign * t * t;
+  sumTV += sign * t * v;
+}
+
+void MLRollingWindow::rebuild() {
+  sumT = sumV = sumTT = sumTV = 0;
+  changes = 0;
+  if (count == 0) return;
+  timeOrigin = at(count - 1).time;
+  valueOrigin = at(count - 1).value;
+  for (uint16_t age = 0; age < count; age++) accumulate(at(age), 1.0f);
+}
+
+void MLRollingWindow::add(uint32_t time, float value) {
+  if (count > 0 && time - at(0).time < spacing) {
+    // Same point: move its mean
+    Point& p = at(0);
+    accumulate(p, -1.0f);
+    p.samples++;
+    p.time += (time - p.time) / p.samples;
+    p.value += (value - p.value) / p.samples;
+    accumulate(p, 1.0f);
+  } else {
+    if (count == ML_ROLLING_CAPACITY) {
+      accumulate(at(count - 1), -1.0f);
+      count--;
+    }
+    if (count == 0) {
+      timeOrigin = time;
+      valueOrigin = value;
+    }
+    Point& p = points[head];
+    p.time = time;
+    p.value = value;
+    p.samples = 1;
+    head = (head + 1) % ML_ROLLING_CAPACITY;
+    count++;
+    accumulate(p, 1.0f);
+  }
+
+  // Expire: amortized O(1), each point leaves once
+  while (count > 1 && time - at(count - 1).time > span) {
+    accumulate(at(count - 1), -1.0f);
+    count--;
+    changes++;
+  }
+
+  if (++changes >= ML_ROLLING_CAPACITY) rebuild();
+}
+
+uint32_t MLRollingWindow::coverage() const {
+  return count > 1 ? at(0).time - at(count - 1).time : 0;
+}
+
+float MLRollingWindow::mean() const {
+  return count > 0 ? valueOrigin + sumV / count : 0.0f;
+}
+
+float MLRollingWindow::slopePerHour() const {
+  if (count < 2) return 0.0f;
+  float n = (float)count;
+  float denominator = n * sumTT - sumT * sumT;
+  if (denominator <= 1e-9f) return 0.0f;
+  return (n * sumTV - sumT * sumV) / denominator;
+}
+
+// ============================================================================
+// MLEwma
+// ============================================================================
+
+void MLEwma::add(uint32_t time, float value) {
+  if (!started) {
+    average = value;
+    started = true;
+  } else {
+    float weight = 1.0f - expf(-(float)(time - last) / tau);
+    average += weight * (value - average);
+  }
+  last = time;
+}
+
+// ============================================================================
+// MLFeatureStore
+// ============================================================================
+
+MLFeatureStore::MLFeatureStore()
+  : pressure1h(ML_PRESSURE_SHORT_S, ML_PRESSURE_SHORT_S / ML_POINTS_PER_SPAN),
+    pressure3h(ML_PRESSURE_LONG_S, ML_PRESSURE_LONG_S / ML_POINTS_PER_SPAN),
+    temperature30m(ML_TEMP_TREND_S, ML_TEMP_TREND_S / ML_POINTS_PER_SPAN),
+    humidity12h(ML_HUMIDITY_MEAN_S, ML_HUMIDITY_MEAN_S / ML_POINTS_PER_SPAN),
+    pressureAverage(ML_EWMA_TAU_S), temperatureAverage(ML_EWMA_TAU_S), humidityAverage(ML_EWMA_TAU_S),
+    newest(0), samples(0) {
+  memset(sources, 0, sizeof(sources));
+}
+
+void MLFeatureStore::clear() {
+  pressure1h.clear();
+  pressure3h.clear();
+  temperature30m.clear();
+  humidity12h.clear();
+  pressureAverage.clear();
+  temperatureAverage.clear();
+  humidityAverage.clear();
+  memset(sources, 0, sizeof(sources));
+  newest = 0;
+  samples = 0;
+}
+
+void MLFeatureStore::add(uint32_t time, float pressure, float temperature, float humidity) {
+  const float values[ML_STORE_CHANNELS] = {pressure, temperature, humidity};
+  add(time, values, sources);
+}
+
+void MLFeatureStore::add(uint32_t time, const float* values, const uint8_t* from) {
+  if (time < newest) clear();  // The clock went back: start over
+  newest = time;
+  samples++;
+
+  for (uint8_t c = 0; c < ML_STORE_CHANNELS; c++) {
+    if (isnan(values[c]) || from[c] == sources[c]) continue;
+    sources[c] = from[c];
+    switch (c) {
+      case ML_STORE_PRESSURE:
+        pressure1h.clear();
+        pressure3h.clear();
+        pressureAverage.clear();
+        break;
+      case ML_STORE_TEMPERATURE:
+        temperature30m.clear();
+        temperatureAverage.clear();
+        break;
+      default:
+        humidity12h.clear();
+        humidityAverage.clear();
+        break;
+    }
+  }
+
+  float pressure = values[ML_STORE_PRESSURE];
+  float temperature = values[ML_STORE_TEMPERATURE];
+  float humidity = values[ML_STORE_HUMIDITY];
+  if (!isnan(pressure)) {
+    pressure1h.add(time, pressure);
+    pressure3h.add(time, pressure);
+    pressureAverage.add(time, pressure);
+  }
+  if (!isnan(temperature)) {
+    temperature30m.add(time, temperature);
+    temperatureAverage.add(time, temperature);
+  }
+  if (!isnan(humidity)) {
+    humidity12h.add(time, humidity);
+    humidityAverage.add(time, humidity);
+  }
+}
+
+void MLFeatureStore::read(MLLiveFeatures& out) const {
+  out.time = newest;
+  out.samples = samples;
+  out.ready = (pressure1h.ready(newest) ? ML_LIVE_PRESSURE_1H : 0) |
+              (pressure3h.ready(newest) ? ML_LIVE_PRESSURE_3H : 0) |
+              (temperature30m.ready(newest) ? ML_LIVE_TEMP_30MIN : 0) |
+              (humidity12h.ready(newest) ? ML_LIVE_HUMIDITY_12H : 0);
+  out.pressure = pressureAverage.value();
+  out.pressureTrend1h = pressure1h.slopePerHour();
+  out.pressureTrend3h = pressure3h.slopePerHour();
+  out.temperature = temperatureAverage.value();
+  out.temperatureTrend = temperature30m.slopePerHour();
+  out.humidity = humidityAverage.value();
+  out.humidityMean = humidity12h.mean();
+  memcpy(out.sources, sources, sizeof(sources));
+}
@@ -0,0 +1,214 @@
+/**
+ * @file ml_features.h
+ * @brief Live features for MLPredictor, updated on every sensor read
+ *
+ * MLPredictor predicts once per ML_PREDICT_INTERVAL, but its rules look at
+ * trends over 30 minutes to 12 hours. The store is fed on every sensor
+ * read instead, each sample in O(1), and keeps what the rules need as
+ * running sums, so reading the features costs the same whenever a
+ * prediction runs:
+ *
+ * - MLRollingWindow: timestamped samples over a span, with sums of t, v,
+ *   t^2 and t*v for the mean and the least-squares slope. Samples closer
+ *   than its spacing are averaged into one point, so a window holds its
+ *   span at ML_ROLLING_CAPACITY points whatever the read interval.
+ * - MLEwma: exponential average with a time constant, for irregular
+ *   sampling (the weight follows the time since the last sample).
+ *
+ * Times are seconds on any monotonic clock (MLPredictor passes uptime);
+ * a sample older than the newest one restarts the store.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef ML_FEATURES_H
+#define ML_FEATURES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+#define ML_ROLLING_CAPACITY 64          // Points per window (span / spacing must fit)
+
+/**
+ * Mean and least-squares slope over the last span seconds
+ */
+class MLRollingWindow {
+public:
+  /**
+   * @param spanS samples older than this (behind the newest) leave
+   * @param spacingS a sample this close to the newest point is averaged into it
+   */
+  MLRollingWindow(uint32_t spanS, uint32_t spacingS);
+
+  void clear();
+
+  /**
+   * Add a sample (time >= the newest's) and expire the old ones
+   */
+  void add(uint32_t time, float value);
+
+  uint16_t size() const { return count; }
+
+  /**
+   * Seconds between the oldest and the newest point
+   */
+  uint32_t coverage() const;
+
+  /**
+   * True if the window covers at least 3/4 of its span and its newest
+   * point is no more than 1/4 of it older than now
+   */
+  bool ready(uint32_t now) const {
+    return count > 0 && coverage() * 4 >= span * 3 && (now - newestTime()) * 4 <= span;
+  }
+
+  float mean() const;
+
+  /**
+   * Least-squares slope, per hour (0 with fewer than 2 points)
+   */
+  float slopePerHour() const;
+
+  uint32_t newestTime() const { return count > 0 ? at(0).time : 0; }
+
+private:
+  struct Point {
+    uint32_t time;                      // Mean time of the samples in it
+    float value;                        // Their mean
+    uint16_t samples;
+  };
+
+  Point points[ML_ROLLING_CAPACITY];
+  uint16_t head;                        // Next slot written
+  uint16_t count;
+  uint32_t span;
+  uint32_t spacing;
+
+  // Sums over the points, of t in hours after timeOrigin and v minus
+  // valueOrigin: small numbers keep float sums exact enough. Rebuilt from
+  // the points every ML_ROLLING_CAPACITY changes so rounding cannot build up.
+  uint32_t timeOrigin;
+  float valueOrigin;
+  float sumT, sumV, sumTT, sumTV;
+  uint16_t changes;
+
+  const Point& at(uint16_t age) const {  // 0 = newest
+    return points[(head + ML_ROLLING_CAPACITY - 1 - age) % ML_ROLLING_CAPACITY];
+  }
+  Point& at(uint16_t age) {
+    return points[(head + ML_ROLLING_CAPACITY - 1 - age) % ML_ROLLING_CAPACITY];
+  }
+
+  void accumulate(const Point& p, float sign);
+  void rebuild();
+};
+
+/**
+ * Exponentially weighted moving average over irregular samples
+ */
+class MLEwma {
+public:
+  explicit MLEwma(uint32_t tauS) : tau((float)tauS) { clear(); }
+
+  void clear() {
+    last = 0;
+    average = 0;
+    started = false;
+  }
+
+  /**
+   * Weight of the new sample: 1 - exp(-dt / tau)
+   */
+  void add(uint32_t time, float value);
+
+  bool ready() const { return started; }
+  float value() const { return average; }
+
+private:
+  float tau;
+  uint32_t last;
+  float average;
+  bool started;
+};
+
+/**
+ * Channels the store is fed, each from one source at a time
+ */
+enum MLStoreChannel : uint8_t {
+  ML_STORE_PRESSURE,
+  ML_STORE_TEMPERATURE,
+  ML_STORE_HUMIDITY,
+  ML_STORE_CHANNELS
+};
+
+/**
+ * What the live features are ready for (enough history)
+ */
+enum MLLiveReady : uint8_t {
+  ML_LIVE_PRESSURE_1H = 1 << 0,
+  ML_LIVE_PRESSURE_3H = 1 << 1,
+  ML_LIVE_TEMP_30MIN = 1 << 2,
+  ML_LIVE_HUMIDITY_12H = 1 << 3
+};
+
+/**
+ * Snapshot of the features, read in O(1)
+ */
+struct MLLiveFeatures {
+  uint32_t time = 0;                    // Newest sample (store clock)
+  uint32_t samples = 0;                 // Added since the store started
+  uint8_t ready = 0;                    // MLLiveReady bits
+  float pressure = 0;                   // hPa, EWMA
+  float pressureTrend1h = 0;            // hPa/h, least squares over 1 h
+  float pressureTrend3h = 0;            // and over 3 h
+  float temperature = 0;                // °C, EWMA
+  float temperatureTrend = 0;           // °C/h over 30 min
+  float humidity = 0;                   // %, EWMA
+  float humidityMean = 0;               // % over 12 h (what it covers so far)
+  uint8_t sources[ML_STORE_CHANNELS] = {};  // Where each channel's readings come from (caller's ids)
+
+  bool has(MLLiveReady bit) const { return (ready & bit) != 0; }
+};
+
+/**
+ * The windows and averages MLPredictor's rules read
+ */
+class MLFeatureStore {
+public:
+  MLFeatureStore();
+
+  void clear();
+
+  /**
+   * Add one reading (any value may be NaN: that channel skips it)
+   * @param values ML_STORE_CHANNELS of them
+   * @param sources where each comes from: a channel whose source changes
+   *        starts over, so an offset between two sensors is not a trend
+   */
+  void add(uint32_t time, const float* values, const uint8_t* sources);
+
+  /**
+   * Add one reading from a single source per channel
+   */
+  void add(uint32_t time, float pressure, float temperature, float humidity);
+
+  /**
+   * Current features, O(1)
+   */
+  void read(MLLiveFeatures& out) const;
+
+private:
+  MLRollingWindow pressure1h;
+  MLRollingWindow pressure3h;
+  MLRollingWindow temperature30m;
+  MLRollingWindow humidity12h;
+  MLEwma pressureAverage;
+  MLEwma temperatureAverage;
+  MLEwma humidityAverage;
+  uint8_t sources[ML_STORE_CHANNELS];
+  uint32_t newest;
+  uint32_t samples;
+};
+
+#endif // ML_FEATURES_H
@@ -0,0 +1,108 @@
+/**
+ * @file ml_fusion.cpp
+ * @brief Fused predictor inputs
+ */
+
+#include "ml_fusion.h"
+#include <string.h>
+
+/**
+ * Where each fused field comes from
+ */
+struct MLFusedSlot {
+  MLInputSource source;
+  float MLSourceReading::*member;
+};
+
+static const MLFusedSlot FUSED_SLOTS[ML_FUSED_COUNT] = {
+  {ML_INPUT_INDOOR, &MLSourceReading::temperature},
+  {ML_INPUT_INDOOR, &MLSourceReading::humidity},
+  {ML_INPUT_INDOOR, &MLSourceReading::pressure},
+  {ML_INPUT_EXTERIOR, &MLSourceReading::temperature},
+  {ML_INPUT_EXTERIOR, &MLSourceReading::humidity},
+  {ML_INPUT_EXTERIOR, &MLSourceReading::pressure},
+  {ML_INPUT_EXTERIOR, &MLSourceReading::light},
+  {ML_INPUT_OBSERVATION, &MLSourceReading::temperature},
+  {ML_INPUT_OBSERVATION, &MLSourceReading::humidity},
+  {ML_INPUT_OBSERVATION, &MLSourceReading::pressure},
+  {ML_INPUT_FORECAST, &MLSourceReading::temperature},
+  {ML_INPUT_FORECAST, &MLSourceReading::humidity},
+  {ML_INPUT_FORECAST, &MLSourceReading::rainProbability},
+};
+
+/**
+ * Store channels: fused fields in order of preference
+ */
+static const MLFusedField CHANNEL_FIELDS[ML_STORE_CHANNELS][3] = {
+  {ML_FUSED_INDOOR_PRESSURE, ML_FUSED_EXTERIOR_PRESSURE, ML_FUSED_OBSERVED_PRESSURE},
+  {ML_FUSED_EXTERIOR_TEMP, ML_FUSED_OBSERVED_TEMP, ML_FUSED_INDOOR_TEMP},
+  {ML_FUSED_EXTERIOR_HUMIDITY, ML_FUSED_OBSERVED_HUMIDITY, ML_FUSED_INDOOR_HUMIDITY},
+};
+
+MLFusion::MLFusion() {
+  clear();
+}
+
+void MLFusion::clear() {
+  for (uint8_t s = 0; s < ML_INPUT_COUNT; s++) {
+    readings[s] = MLSourceReading();
+    received[s] = false;
+  }
+}
+
+void MLFusion::update(MLInputSource source, const MLSourceReading& reading) {
+  if (source >= ML_INPUT_COUNT) return;
+  if (received[source] && reading.time < readings[source].time) return;  // Out of order
+  readings[source] = reading;
+  received[source] = true;
+}
+
+uint32_t MLFusion::maxAge(MLInputSource source) {
+  switch (source) {
+    case ML_INPUT_INDOOR: return ML_FUSION_INDOOR_MAX_AGE_S;
+    case ML_INPUT_EXTERIOR: return ML_FUSION_EXTERIOR_MAX_AGE_S;
+    case ML_INPUT_OBSERVATION: return ML_FUSION_OBSERVATION_MAX_AGE_S;
+    default: return ML_FUSION_FORECAST_MAX_AGE_S;
+  }
+}
+
+void MLFusion::fuse(uint32_t now, MLFusedFeatures& out) const {
+  out.time = now;
+  out.present = 0;
+  out.stale = 0;
+
+  uint32_t staleSources = 0;
+  for (uint8_t s = 0; s < ML_INPUT_COUNT; s++) {
+    if (!received[s]) {
+      out.age[s] = ML_AGE_UNKNOWN;
+      continue;
+    }
+    // A reading stamped after now (clocks of different sources) counts as fresh
+    out.age[s] = now > readings[s].time ? now - readings[s].time : 0;
+    if (out.age[s] > maxAge((MLInputSource)s)) staleSources |= 1u << s;
+  }
+
+  for (uint8_t f = 0; f < ML_FUSED_COUNT; f++) {
+    const MLFusedSlot& slot = FUSED_SLOTS[f];
+    float value = received[slot.source] ? readings[slot.source].*slot.member : NAN;
+    if (isnan(value)) {
+      out.values[f] = 0;
+      continue;
+    }
+    out.values[f] = value;
+    out.present |= ML_FUSED_BIT(f);
+    if (staleSources & (1u << slot.source)) out.stale |= ML_FUSED_BIT(f);
+  }
+
+  for (uint8_t c = 0; c < ML_STORE_CHANNELS; c++) {
+    out.channels[c] = NAN;
+    out.channelSource[c] = ML_INPUT_NONE;
+    for (MLFusedField field : CHANNEL_FIELDS[c]) {
+      if (out.usable(field)) {
+        out.channels[c] = out.values[field];
+        out.channelSource[c] = FUSED_SLOTS[field].source;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,132 @@
+/**
+ * @file ml_fusion.h
+ * @brief Fused predictor inputs from every source the station has
+ *
+ * Four sources report at their own pace:
+ * - indoor: the BME680 (every SENSOR_READ_INTERVAL)
+ * - exterior: the exterior node's AHT20 / BMP280 / BH1750 (ESP-NOW batches)
+ * - observation: OpenWeatherMap's current weather (every WEATHER_API_INTERVAL)
+ * - forecast: OpenWeatherMap's next 3-hour forecast slot
+ *
+ * Each source keeps its newest reading and the time it was measured. fuse()
+ * aligns them to one time: every field holds its source's newest value,
+ * with a present bit (the source has measured it) and a stale bit (that
+ * reading is older than the source's ML_FUSION_*_MAX_AGE_S), and every
+ * source its age. Consumers decide on the masks, not on zeros standing in
+ * for missing data.
+ *
+ * fuse() also picks one value per channel for MLFeatureStore, from the
+ * first fresh source in a fixed order (pressure: indoor, exterior,
+ * observation; temperature and humidity: exterior, observation, indoor),
+ * and reports which source that was.
+ *
+ * Times are seconds on the same monotonic clock as MLFeatureStore.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef ML_FUSION_H
+#define ML_FUSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "config.h"
+#include "ml_features.h"
+
+/**
+ * Where a reading came from
+ */
+enum MLInputSource : uint8_t {
+  ML_INPUT_INDOOR,
+  ML_INPUT_EXTERIOR,
+  ML_INPUT_OBSERVATION,
+  ML_INPUT_FORECAST,
+  ML_INPUT_COUNT,
+  ML_INPUT_NONE = 0xFF
+};
+
+/**
+ * One source's reading (NaN = not measured)
+ */
+struct MLSourceReading {
+  uint32_t time = 0;                    // When it was measured
+  float temperature = NAN;              // °C
+  float humidity = NAN;                 // %
+  float pressure = NAN;                 // hPa
+  float light = NAN;                    // lux
+  float rainProbability = NAN;          // 0..1 (forecast)
+};
+
+/**
+ * Fields of the fused vector
+ */
+enum MLFusedField : uint8_t {
+  ML_FUSED_INDOOR_TEMP,
+  ML_FUSED_INDOOR_HUMIDITY,
+  ML_FUSED_INDOOR_PRESSURE,
+  ML_FUSED_EXTERIOR_TEMP,
+  ML_FUSED_EXTERIOR_HUMIDITY,
+  ML_FUSED_EXTERIOR_PRESSURE,
+  ML_FUSED_EXTERIOR_LIGHT,
+  ML_FUSED_OBSERVED_TEMP,
+  ML_FUSED_OBSERVED_HUMIDITY,
+  ML_FUSED_OBSERVED_PRESSURE,
+  ML_FUSED_FORECAST_TEMP,
+  ML_FUSED_FORECAST_HUMIDITY,
+  ML_FUSED_FORECAST_RAIN,
+  ML_FUSED_COUNT
+};
+
+#define ML_FUSED_BIT(field) (1ul << (field))
+#define ML_AGE_UNKNOWN 0xFFFFFFFFul
+
+/**
+ * Every source aligned to one time
+ */
+struct MLFusedFeatures {
+  uint32_t time = 0;
+  float values[ML_FUSED_COUNT] = {};    // Newest value per field (0 if not present)
+  uint32_t present = 0;                 // ML_FUSED_BIT()s with a measured value
+  uint32_t stale = 0;                   // ... whose reading is too old
+  uint32_t age[ML_INPUT_COUNT] = {};    // Seconds since each source's reading, ML_AGE_UNKNOWN if none
+
+  // One value per store channel, from the first fresh source (ML_INPUT_NONE: no fresh source)
+  float channels[ML_STORE_CHANNELS] = {};
+  uint8_t channelSource[ML_STORE_CHANNELS] = {ML_INPUT_NONE, ML_INPUT_NONE, ML_INPUT_NONE};
+
+  bool usable(MLFusedField field) const {
+    return (present & ML_FUSED_BIT(field)) && !(stale & ML_FUSED_BIT(field));
+  }
+};
+
+/**
+ * Newest reading per source
+ */
+class MLFusion {
+public:
+  MLFusion();
+
+  void clear();
+
+  /**
+   * Replace a source's reading, O(1); an older reading than the one kept is ignored
+   */
+  void update(MLInputSource source, const MLSourceReading& reading);
+
+  /**
+   * Assemble the fused vector as of now
+   */
+  void fuse(uint32_t now, MLFusedFeatures& out) const;
+
+  /**
+   * Oldest reading a source may have and still count (seconds)
+   */
+  static uint32_t maxAge(MLInputSource source);
+
+private:
+  MLSourceReading readings[ML_INPUT_COUNT];
+  bool received[ML_INPUT_COUNT];
+};
+
+#endif // ML_FUSION_H
@@ -0,0 +1,271 @@
+/**
+ * @file ml_model.cpp
+ * @brief Online models behind MLPredictor
+ */
+
+#include "ml_model.h"
+#include "log_format.h"
+#include <math.h>
+#include <string.h>
+
+#define ML_HUMIDITY_MEAN_TAU_S 21600.0f  // EWMA time constant (MLPredictor averaged its 12 h history)
+#define ML_COVARIANCE_PRIOR 100.0f      // RLS starts with P = prior * I (weights free to move)
+#define ML_COVARIANCE_MAX 10000.0f      // No forgetting along an input that stopped varying
+
+bool mlSampleFrom(uint32_t time, float pressure, float tempOutdoor, float humidityOutdoor,
+                  float tempIndoor, float humidityIndoor, MLSample& out) {
+  if (!isfinite(pressure) || pressure <= 0) return false;
+
+  if (isfinite(tempOutdoor) && isfinite(humidityOutdoor)) {
+    out.temperature = tempOutdoor;
+    out.humidity = humidityOutdoor;
+  } else if (isfinite(tempIndoor) && isfinite(humidityIndoor)) {
+    out.temperature = tempIndoor;
+    out.humidity = humidityIndoor;
+  } else {
+    return false;
+  }
+  out.time = time;
+  out.pressure = pressure;
+  out.humidityMean = out.humidity;
+  return true;
+}
+
+// ============================================================================
+// Feature window
+// ============================================================================
+
+MLFeatureWindow::MLFeatureWindow() {
+  clear();
+}
+
+void MLFeatureWindow::clear() {
+  head = 0;
+  count = 0;
+  pending = 0;
+}
+
+bool MLFeatureWindow::add(const MLSample& sample) {
+  MLSample entry = sample;
+
+  if (count > 0) {
+    const MLSample& newest = at(0);
+    // Thinned to about the spacing (a logging interval jitters by a second or two)
+    if (sample.time <= newest.time || sample.time - newest.time < ML_SAMPLE_SPACING_S * 3 / 4) return false;
+
+    // Humidity mean: exponential in time, so gaps weigh what they should
+    float dt = (float)(sample.time - newest.time);
+    float alpha = 1.0f - expf(-dt / ML_HUMIDITY_MEAN_TAU_S);
+    entry.humidityMean = newest.humidityMean + alpha * (sample.humidity - newest.humidityMean);
+  } else {
+    entry.humidityMean = sample.humidity;
+  }
+
+  samples[head] = entry;
+  head = (head + 1) % ML_WINDOW_SAMPLES;
+  if (count < ML_WINDOW_SAMPLES) count++;
+  if (pending < count) pending++;
+  return true;
+}
+
+int MLFeatureWindow::findBefore(uint16_t age, uint32_t seconds) const {
+  uint32_t time = at(age).time;
+  if (time < seconds) return -1;
+  uint32_t target = time - seconds;
+
+  int best = -1;
+  uint32_t bestDistance = ML_TIME_TOLERANCE_S + 1;
+  for (uint16_t older = age + 1; older < count; older++) {
+    uint32_t t = at(older).time;
+    uint32_t distance = t > target ? t - target : target - t;
+    if (distance < bestDistance) {
+      best = older;
+      bestDistance = distance;
+    }
+    if (t + ML_TIME_TOLERANCE_S < target) break;  // Only further off from here
+  }
+  return best;
+}
+
+bool MLFeatureWindow::featuresAt(uint16_t age, float* features) const {
+  int hourAgo = findBefore(age, 3600);
+  int hoursAgo = findBefore(age, 3 * 3600);
+  int halfHourAgo = findBefore(age, 1800);
+  if (hourAgo < 0 || hoursAgo < 0 || halfHourAgo < 0) return false;
+
+  const MLSample& now = at(age);
+  float hour = (float)(now.time % 86400) * (2.0f * (float)M_PI / 86400.0f);
+
+  features[ML_BIAS] = 1.0f;
+  features[ML_PRESSURE_1H] = (now.pressure - at(hourAgo).pressure) / 2.0f;
+  features[ML_PRESSURE_3H] = (now.pressure - at(hoursAgo).pressure) / 4.0f;
+  features[ML_TEMP_30MIN] = (now.temperature - at(halfHourAgo).temperature) / 2.0f;
+  features[ML_HUMIDITY] = (now.humidity - 70.0f) / 30.0f;
+  features[ML_HUMIDITY_MEAN] = (now.humidityMean - 70.0f) / 30.0f;
+  features[ML_PRESSURE_LEVEL] = (now.pressure - 1013.0f) / 20.0f;
+  features[ML_HOUR_SIN] = sinf(hour);
+  features[ML_HOUR_COS] = cosf(hour);
+  return true;
+}
+
+bool MLFeatureWindow::latest(float* features) const {
+  return count > 0 && featuresAt(0, features);
+}
+
+bool MLFeatureWindow::nextExample(float* features, bool& rain, float& tempChange) {
+  while (pending > 0) {
+    uint16_t age = pending - 1;
+    const MLSample& then = at(age);
+    uint32_t target = then.time + ML_HORIZON_S;
+    if (at(0).time < target) return false;  // Its outcome is still to come
+    pending--;
+
+    // Outcome: the sample closest to the horizon, and the wettest one up to it
+    int outcome = -1;
+    uint32_t bestDistance = ML_TIME_TOLERANCE_S + 1;
+    float wettest = then.humidity;
+    for (int later = age - 1; later >= 0; later--) {
+      const MLSample& sample = at(later);
+      uint32_t distance = sample.time > target ? sample.time - target : target - sample.time;
+      if (distance < bestDistance) {
+        outcome = later;
+        bestDistance = distance;
+      }
+      if (sample.time <= target && sample.humidity > wettest) wettest = sample.humidity;
+      if (sample.time > target + ML_TIME_TOLERANCE_S) break;
+    }
+    if (outcome < 0 || !featuresAt(age, features)) continue;  // Gap in the log
+
+    rain = wettest >= ML_RAIN_HUMIDITY;
+    tempChange = at(outcome).temperature - then.temperature;
+    return true;
+  }
+  return false;
+}
+
+// ============================================================================
+// Models
+// ============================================================================
+
+MLOnlineModel::MLOnlineModel() {
+  reset();
+}
+
+void MLOnlineModel::reset() {
+  memset(rainWeights, 0, sizeof(rainWeights));
+  memset(tempWeights, 0, sizeof(tempWeights));
+  memset(covariance, 0, sizeof(covariance));
+  for (uint8_t i = 0; i < ML_FEATURE_COUNT; i++) covariance[i][i] = ML_COVARIANCE_PRIOR;
+  score = MLModelScore();
+}
+
+static float dot(const float* a, const float* b) {
+  float sum = 0;
+  for (uint8_t i = 0; i < ML_FEATURE_COUNT; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+float MLOnlineModel::rainProbability(const float* features) const {
+  float z = dot(rainWeights, features);
+  if (z > 30) z = 30;
+  if (z < -30) z = -30;
+  return 1.0f / (1.0f + expf(-z));
+}
+
+float MLOnlineModel::temperatureChange(const float* features) const {
+  return dot(tempWeights, features);
+}
+
+void MLOnlineModel::train(const float* x, bool rain, float tempChange) {
+  // Scored first: running means of the errors
+  float p = rainProbability(x);
+  float y = rain ? 1.0f : 0.0f;
+  float predicted = temperatureChange(x);
+  float error = tempChange - predicted;
+  uint32_t n = ++score.examples;
+  if (rain) score.rainExamples++;
+  score.brier += ((p - y) * (p - y) - score.brier) / n;
+  score.tempMae += (fabsf(error) - score.tempMae) / n;
+
+  // Rain: one SGD step on the log loss, smaller as examples accumulate
+  float rate = ML_SGD_RATE / sqrtf(1.0f + (float)n / ML_MIN_EXAMPLES);
+  for (uint8_t i = 0; i < ML_FEATURE_COUNT; i++) {
+    float decay = i == ML_BIAS ? 0.0f : ML_SGD_L2 * rainWeights[i];
+    rainWeights[i] += rate * ((y - p) * x[i] - decay);
+  }
+
+  // Temperature: RLS with exponential forgetting
+  float px[ML_FEATURE_COUNT];
+  float largest = 0;
+  for (uint8_t i = 0; i < ML_FEATURE_COUNT; i++) {
+    px[i] = dot(covariance[i], x);
+    if (covariance[i][i] > largest) largest = covariance[i][i];
+  }
+  float forget = largest < ML_COVARIANCE_MAX ? ML_RLS_FORGET : 1.0f;
+  float denominator = forget + dot(x, px);
+  if (denominator <= 0) return;
+
+  for (uint8_t i = 0; i < ML_FEATURE_COUNT; i++) {
+    tempWeights[i] += px[i] / denominator * error;
+  }
+  for (uint8_t i = 0; i < ML_FEATURE_COUNT; i++) {
+    for (uint8_t j = i; j < ML_FEATURE_COUNT; j++) {
+      float value = (covariance[i][j] - px[i] * px[j] / denominator) / forget;
+      covariance[i][j] = value;
+      covariance[j][i] = value;  // Kept exactly symmetric
+    }
+  }
+}
+
+size_t MLOnlineModel::storedSize() {
+  return sizeof(MLModelHeader) + sizeof(rainWeights) + sizeof(tempWeights) + sizeof(covariance) +
+         sizeof(MLModelScore);
+}
+
+size_t MLOnlineModel::store(uint8_t* out, size_t cap, uint32_t trainedFrom, uint32_t trainedTo) const {
+  size_t size = storedSize();
+  if (cap < size) return 0;
+
+  uint8_t* p = out + sizeof(MLModelHeader);
+  memcpy(p, rainWeights, sizeof(rainWeights));
+  p += sizeof(rainWeights);
+  memcpy(p, tempWeights, sizeof(tempWeights));
+  p += sizeof(tempWeights);
+  memcpy(p, covariance, sizeof(covariance));
+  p += sizeof(covariance);
+  memcpy(p, &score, sizeof(score));
+
+  MLModelHeader header;
+  header.magic = ML_MODEL_MAGIC;
+  header.version = ML_MODEL_VERSION;
+  header.featureCount = ML_FEATURE_COUNT;
+  header.crc = logCrc8(out + sizeof(header), size - sizeof(header));
+  header.horizon = ML_HORIZON_S;
+  header.trainedFrom = trainedFrom;
+  header.trainedTo = trainedTo;
+  memcpy(out, &header, sizeof(header));
+  return size;
+}
+
+bool MLOnlineModel::restore(const uint8_t* data, size_t len, uint32_t& trainedFrom, uint32_t& trainedTo) {
+  MLModelHeader header;
+  if (len != storedSize()) return false;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != ML_MODEL_MAGIC || header.version != ML_MODEL_VERSION ||
+      header.featureCount != ML_FEATURE_COUNT || header.horizon != ML_HORIZON_S ||
+      header.crc != logCrc8(data + sizeof(header), len - sizeof(header))) {
+    return false;
+  }
+
+  const uint8_t* p = data + sizeof(header);
+  memcpy(rainWeights, p, sizeof(rainWeights));
+  p += sizeof(rainWeights);
+  memcpy(tempWeights, p, sizeof(tempWeights));
+  p += sizeof(tempWeights);
+  memcpy(covariance, p, sizeof(covariance));
+  p += sizeof(covariance);
+  memcpy(&score, p, sizeof(score));
+  trainedFrom = header.trainedFrom;
+  trainedTo = header.trainedTo;
+  return true;
+}
@@ -0,0 +1,192 @@
+/**
+ * @file ml_model.h
+ * @brief Online models behind MLPredictor: features, outcomes and streaming fits
+ *
+ * Records go through an MLFeatureWindow one at a time, both when training
+ * on the log and when predicting from live readings, so the model always
+ * sees features computed the same way. The window keeps ML_HORIZON_S of
+ * samples on each side of the one being trained on: the past for its
+ * features (MLPredictor's pressure, temperature and humidity trends), the
+ * future for its outcomes.
+ *
+ * Each example updates two models in O(features^2), without keeping any:
+ * - rain within ML_HORIZON_S: logistic regression by SGD
+ * - temperature change over ML_HORIZON_S: recursive least squares
+ * Both are scored on each example before learning from it (prequential),
+ * which gives an honest running error without a held-out set.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef ML_MODEL_H
+#define ML_MODEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+#define ML_MODEL_MAGIC 0x4C4D5857     // "WXML"
+#define ML_MODEL_VERSION 1
+
+/**
+ * Model inputs, all scaled to about -1..1
+ */
+enum MLFeature : uint8_t {
+  ML_BIAS,
+  ML_PRESSURE_1H,       // Pressure change over the last hour (MLPredictor's pressure trend)
+  ML_PRESSURE_3H,       // and over three hours
+  ML_TEMP_30MIN,        // Temperature change over 30 minutes (its temperature trend)
+  ML_HUMIDITY,
+  ML_HUMIDITY_MEAN,     // Humidity averaged over hours (EWMA)
+  ML_PRESSURE_LEVEL,    // Pressure against 1013 hPa
+  ML_HOUR_SIN,          // Time of day (UTC), for the daily temperature cycle
+  ML_HOUR_COS,
+  ML_FEATURE_COUNT
+};
+
+/**
+ * One reading of the channels the models use
+ */
+struct MLSample {
+  uint32_t time;                        // Unix time (UTC)
+  float pressure;                       // hPa
+  float temperature;                    // °C
+  float humidity;                       // %
+  float humidityMean;                   // EWMA up to this sample
+};
+
+/**
+ * Pick a record's channels: outdoor temperature and humidity when it has
+ * both, the station's own otherwise (any channel may be NaN)
+ * @return false if the record cannot be used
+ */
+bool mlSampleFrom(uint32_t time, float pressure, float tempOutdoor, float humidityOutdoor,
+                  float tempIndoor, float humidityIndoor, MLSample& out);
+
+/**
+ * Recent samples, thinned to ML_SAMPLE_SPACING_S
+ */
+class MLFeatureWindow {
+public:
+  MLFeatureWindow();
+
+  void clear();
+
+  /**
+   * Add the newest sample (its humidityMean is filled in)
+   * @return false if it was thinned out or is older than the newest
+   */
+  bool add(const MLSample& sample);
+
+  /**
+   * Features of the newest sample
+   * @return false if there is not enough history around it
+   */
+  bool latest(float* features) const;
+
+  /**
+   * Next sample that is ML_HORIZON_S old, with what happened after it
+   * (call after each add() until it returns false)
+   * @param rain humidity reached ML_RAIN_HUMIDITY within the horizon
+   * @param tempChange temperature at the horizon minus temperature then
+   */
+  bool nextExample(float* features, bool& rain, float& tempChange);
+
+  uint16_t size() const { return count; }
+
+  /**
+   * Time of the newest sample, 0 if there is none
+   */
+  uint32_t newestTime() const { return count > 0 ? at(0).time : 0; }
+
+private:
+  MLSample samples[ML_WINDOW_SAMPLES];
+  uint16_t head;                        // Next slot written
+  uint16_t count;
+  uint16_t pending;                     // Newest samples not yet trained on (the oldest of them is next)
+
+  const MLSample& at(uint16_t age) const {  // 0 = newest
+    return samples[(head + ML_WINDOW_SAMPLES - 1 - age) % ML_WINDOW_SAMPLES];
+  }
+
+  /**
+   * Age of the sample closest to seconds before the one at age (within
+   * ML_TIME_TOLERANCE_S), -1 if there is none
+   */
+  int findBefore(uint16_t age, uint32_t seconds) const;
+
+  bool featuresAt(uint16_t age, float* features) const;
+};
+
+/**
+ * Prequential scores: each example is predicted before it is learned from
+ */
+struct MLModelScore {
+  uint32_t examples = 0;
+  uint32_t rainExamples = 0;            // Outcomes with rain
+  float brier = 0;                      // Mean squared error of the rain probability
+  float tempMae = 0;                    // Mean absolute error of the temperature change (°C)
+};
+
+/**
+ * The two models, stored as one blob (LittleFS file, see MLPredictor)
+ */
+class MLOnlineModel {
+public:
+  MLOnlineModel();
+
+  /**
+   * Untrained: zero weights, RLS covariance at its prior
+   */
+  void reset();
+
+  /**
+   * Chance of rain within the horizon (0..1)
+   */
+  float rainProbability(const float* features) const;
+
+  /**
+   * Expected temperature change over the horizon (°C)
+   */
+  float temperatureChange(const float* features) const;
+
+  /**
+   * Score, then learn from one example
+   */
+  void train(const float* features, bool rain, float tempChange);
+
+  bool isTrained() const { return score.examples >= ML_MIN_EXAMPLES; }
+  const MLModelScore& getScore() const { return score; }
+
+  /**
+   * Serialized size, and the blob itself (with a CRC)
+   */
+  static size_t storedSize();
+  size_t store(uint8_t* out, size_t cap, uint32_t trainedFrom, uint32_t trainedTo) const;
+
+  /**
+   * @return false if the blob is not a model of this build's features
+   */
+  bool restore(const uint8_t* data, size_t len, uint32_t& trainedFrom, uint32_t& trainedTo);
+
+private:
+  float rainWeights[ML_FEATURE_COUNT];
+  float tempWeights[ML_FEATURE_COUNT];
+  float covariance[ML_FEATURE_COUNT][ML_FEATURE_COUNT];  // RLS inverse correlation (kept to continue training)
+  MLModelScore score;
+};
+
+/**
+ * Stored model header (packed)
+ */
+struct __attribute__((packed)) MLModelHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t featureCount;
+  uint8_t crc;                          // CRC-8 of everything after the header
+  uint32_t horizon;                     // ML_HORIZON_S it was trained for
+  uint32_t trainedFrom;                 // Log time range it was trained on
+  uint32_t trainedTo;
+};
+
+#endif // ML_MODEL_H
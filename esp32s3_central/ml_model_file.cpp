@@ -0,0 +1,242 @@
+/**
+ * @file ml_model_file.cpp
+ * @brief int8 model files: CRC-32, parsing in place, writing
+ */
+
+#include "ml_model_file.h"
+#include "ml_model.h"
+#include <string.h>
+
+#define ML_MODEL_FILE_CRC_START (offsetof(MLModelFileHeader, crc) + sizeof(uint32_t))
+#define ML_MODEL_FILE_ERASED 0xFFFFFFFF  // Magic of an erased flash slot
+
+static_assert(sizeof(MLModelFileHeader) == 40 && sizeof(MLModelFileLayer) == 16,
+              "model file records must keep their size: bump ML_MODEL_FILE_VERSION");
+
+const char* mlModelFileStatusName(MLModelFileStatus status) {
+  switch (status) {
+    case ML_MODEL_FILE_OK: return "ok";
+    case ML_MODEL_FILE_EMPTY: return "empty";
+    case ML_MODEL_FILE_TRUNCATED: return "truncated";
+    case ML_MODEL_FILE_BAD_MAGIC: return "not a model file";
+    case ML_MODEL_FILE_NEWER_SCHEMA: return "newer schema";
+    case ML_MODEL_FILE_BAD_CRC: return "checksum mismatch";
+    case ML_MODEL_FILE_OTHER_FEATURES: return "other features or horizon";
+    case ML_MODEL_FILE_BAD_LAYOUT: return "bad layout";
+    case ML_MODEL_FILE_CHECK_FAILED: return "check vectors differ";
+    case ML_MODEL_FILE_TOO_LARGE: return "too large";
+    case ML_MODEL_FILE_IO_ERROR: return "storage error";
+    case ML_MODEL_FILE_BUSY: return "busy";
+  }
+  return "unknown";
+}
+
+uint32_t mlCrc32(const uint8_t* data, size_t length, uint32_t crc) {
+  // Reflected 0xEDB88320, four bits per step: a 64-byte table instead of 1 KB
+  static const uint32_t TABLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+    crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+/**
+ * True if count items of itemSize at offset lie inside the file, aligned in memory
+ */
+static bool arrayFits(const uint8_t* data, uint32_t size, uint32_t offset, uint32_t count, uint32_t itemSize,
+                      uint32_t align) {
+  if ((uint64_t)offset + (uint64_t)count * itemSize > size) return false;
+  return ((uintptr_t)(data + offset)) % align == 0;
+}
+
+MLModelImage::MLModelImage() {
+  clear();
+}
+
+MLModelImage::MLModelImage(const MLModelImage& other) {
+  *this = other;
+}
+
+MLModelImage& MLModelImage::operator=(const MLModelImage& other) {
+  memcpy(layers, other.layers, sizeof(layers));
+  quantModel = other.quantModel;
+  // A parsed file's layers are this copy's own; a compiled model's stay where they are
+  if (other.quantModel.layers == other.layers) quantModel.layers = layers;
+  checkInputs = other.checkInputs;
+  checkOutputs = other.checkOutputs;
+  checks = other.checks;
+  modelId = other.modelId;
+  size = other.size;
+  return *this;
+}
+
+void MLModelImage::clear() {
+  memset(layers, 0, sizeof(layers));
+  memset(&quantModel, 0, sizeof(quantModel));
+  checkInputs = nullptr;
+  checkOutputs = nullptr;
+  checks = 0;
+  modelId = 0;
+  size = 0;
+}
+
+MLModelFileStatus MLModelImage::parse(const uint8_t* data, size_t length) {
+  clear();
+  if (!data || length == 0) return ML_MODEL_FILE_EMPTY;
+  if (length < sizeof(MLModelFileHeader)) return ML_MODEL_FILE_TRUNCATED;
+
+  MLModelFileHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic == ML_MODEL_FILE_ERASED) return ML_MODEL_FILE_EMPTY;
+  if (header.magic != ML_MODEL_FILE_MAGIC) return ML_MODEL_FILE_BAD_MAGIC;
+  if (header.version > ML_MODEL_FILE_VERSION) return ML_MODEL_FILE_NEWER_SCHEMA;
+  if (header.version == 0 || header.headerSize < sizeof(header)) return ML_MODEL_FILE_BAD_LAYOUT;
+  if (header.size > length) return ML_MODEL_FILE_TRUNCATED;
+  if (header.size < (uint32_t)header.headerSize + header.layerCount * sizeof(MLModelFileLayer)) {
+    return ML_MODEL_FILE_BAD_LAYOUT;
+  }
+  if (mlCrc32(data + ML_MODEL_FILE_CRC_START, header.size - ML_MODEL_FILE_CRC_START) != header.crc) {
+    return ML_MODEL_FILE_BAD_CRC;
+  }
+
+  // This firmware's features in and outputs out: anything else would predict from the wrong inputs
+  if (header.features != ML_FEATURE_COUNT - 1 || header.outputs != ML_QUANT_OUTPUT_COUNT ||
+      header.horizon != ML_HORIZON_S) {
+    return ML_MODEL_FILE_OTHER_FEATURES;
+  }
+  if (header.layerCount == 0 || header.layerCount > ML_QUANT_MAX_LAYERS || header.checks == 0 ||
+      header.checks > ML_MODEL_FILE_MAX_CHECKS || !(header.inputScale > 0) || !(header.outputScale > 0)) {
+    return ML_MODEL_FILE_BAD_LAYOUT;
+  }
+
+  uint8_t width = header.features;
+  for (uint8_t i = 0; i < header.layerCount; i++) {
+    MLModelFileLayer record;
+    memcpy(&record, data + header.headerSize + i * sizeof(record), sizeof(record));
+    if (record.inputs != width || record.outputs == 0 || record.outputs > ML_QUANT_MAX_WIDTH ||
+        record.multiplier <= 0 || record.relu > 1 ||
+        !arrayFits(data, header.size, record.weightsOffset, record.inputs * record.outputs, 1,
+                   ML_MODEL_FILE_ALIGN) ||
+        !arrayFits(data, header.size, record.biasOffset, record.outputs, sizeof(int32_t), sizeof(int32_t))) {
+      return ML_MODEL_FILE_BAD_LAYOUT;
+    }
+    MLQuantLayer& layer = layers[i];
+    layer.inputs = record.inputs;
+    layer.outputs = record.outputs;
+    layer.weights = (const int8_t*)(data + record.weightsOffset);
+    layer.bias = (const int32_t*)(data + record.biasOffset);
+    layer.multiplier = record.multiplier;
+    layer.shift = record.shift;
+    layer.relu = record.relu != 0;
+    width = record.outputs;
+  }
+  if (width != header.outputs ||
+      !arrayFits(data, header.size, header.checkOffset, header.checks, header.features + header.outputs, 1)) {
+    return ML_MODEL_FILE_BAD_LAYOUT;
+  }
+
+  checkInputs = (const int8_t*)(data + header.checkOffset);
+  checkOutputs = checkInputs + header.checks * header.features;
+  checks = header.checks;
+  modelId = header.modelId;
+  size = header.size;
+  quantModel.layerCount = header.layerCount;
+  quantModel.layers = layers;
+  quantModel.inputScale = header.inputScale;
+  quantModel.outputScale = header.outputScale;
+  return ML_MODEL_FILE_OK;
+}
+
+void MLModelImage::wrap(const MLQuantModel& compiled, const int8_t* checkInput, const int8_t* checkOutput,
+                        uint8_t count) {
+  clear();
+  quantModel = compiled;
+  checkInputs = checkInput;
+  checkOutputs = checkOutput;
+  checks = count;
+}
+
+bool MLModelImage::verify(MLQuantKernel kernel, MLQuantArena& arena) const {
+  if (!valid()) return false;
+  for (uint8_t i = 0; i < checks; i++) {
+    int8_t output[ML_QUANT_OUTPUT_COUNT];
+    if (!mlQuantRun(quantModel, checkInput(i), output, arena, kernel) ||
+        memcmp(output, checkOutputs + i * ML_QUANT_OUTPUT_COUNT, sizeof(output)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Round up to ML_MODEL_FILE_ALIGN
+ */
+static uint32_t alignUp(uint32_t offset) {
+  return (offset + ML_MODEL_FILE_ALIGN - 1) & ~(uint32_t)(ML_MODEL_FILE_ALIGN - 1);
+}
+
+size_t mlModelFileBuild(const MLQuantModel& model, const int8_t* checkInput, const int8_t* checkOutput,
+                        uint8_t checks, uint32_t horizon, uint32_t modelId, uint8_t* out, size_t cap) {
+  if (model.layerCount == 0 || model.layerCount > ML_QUANT_MAX_LAYERS || checks == 0 ||
+      checks > ML_MODEL_FILE_MAX_CHECKS) {
+    return 0;
+  }
+
+  // Offsets first: header, layer records, then each layer's biases and weights, then the check vectors
+  MLModelFileLayer records[ML_QUANT_MAX_LAYERS];
+  uint32_t offset = sizeof(MLModelFileHeader) + model.layerCount * sizeof(MLModelFileLayer);
+  for (uint8_t i = 0; i < model.layerCount; i++) {
+    const MLQuantLayer& layer = model.layers[i];
+    MLModelFileLayer& record = records[i];
+    record.inputs = layer.inputs;
+    record.outputs = layer.outputs;
+    record.relu = layer.relu ? 1 : 0;
+    record.shift = layer.shift;
+    record.multiplier = layer.multiplier;
+    record.biasOffset = alignUp(offset);
+    record.weightsOffset = alignUp(record.biasOffset + layer.outputs * sizeof(int32_t));
+    offset = record.weightsOffset + layer.inputs * layer.outputs;
+  }
+  uint8_t features = model.layers[0].inputs;
+  uint32_t checkOffset = alignUp(offset);
+  uint32_t size = checkOffset + checks * (features + ML_QUANT_OUTPUT_COUNT);
+  if (!out) return size;
+  if (size > cap) return 0;
+
+  memset(out, 0, size);
+  MLModelFileHeader header;
+  header.magic = ML_MODEL_FILE_MAGIC;
+  header.version = ML_MODEL_FILE_VERSION;
+  header.headerSize = sizeof(header);
+  header.size = size;
+  header.crc = 0;
+  header.modelId = modelId;
+  header.horizon = horizon;
+  header.features = features;
+  header.outputs = model.layers[model.layerCount - 1].outputs;
+  header.layerCount = model.layerCount;
+  header.checks = checks;
+  header.inputScale = model.inputScale;
+  header.outputScale = model.outputScale;
+  header.checkOffset = checkOffset;
+
+  for (uint8_t i = 0; i < model.layerCount; i++) {
+    const MLQuantLayer& layer = model.layers[i];
+    memcpy(out + sizeof(header) + i * sizeof(MLModelFileLayer), &records[i], sizeof(MLModelFileLayer));
+    memcpy(out + records[i].biasOffset, layer.bias, layer.outputs * sizeof(int32_t));
+    memcpy(out + records[i].weightsOffset, layer.weights, layer.inputs * layer.outputs);
+  }
+  memcpy(out + checkOffset, checkInput, checks * features);
+  memcpy(out + checkOffset + checks * features, checkOutput, checks * ML_QUANT_OUTPUT_COUNT);
+
+  memcpy(out, &header, sizeof(header));
+  header.crc = mlCrc32(out + ML_MODEL_FILE_CRC_START, size - ML_MODEL_FILE_CRC_START);
+  memcpy(out, &header, sizeof(header));
+  return size;
+}
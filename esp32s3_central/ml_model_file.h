@@ -0,0 +1,154 @@
+/**
+ * @file ml_model_file.h
+ * @brief int8 model files (.wxq): the compiled model's network as data, swappable at runtime
+ *
+ * Layout (little-endian, as the ESP32-S3 and the host both are):
+ *
+ *   MLModelFileHeader   headerSize bytes (a newer schema may append fields)
+ *   MLModelFileLayer    x layerCount
+ *   arrays              each at its offset, ML_MODEL_FILE_ALIGN aligned:
+ *                       per layer int32 biases and int8 weights (outputs x
+ *                       inputs, row-major); check inputs (checks x features)
+ *                       then check outputs (checks x outputs)
+ *
+ * The CRC-32 covers every byte after its own field, header included.
+ *
+ * MLModelImage::parse() checks a file and points an MLQuantModel's layers
+ * into it: the weights are used where they lie (a memory-mapped flash
+ * partition on the station) and nothing is copied. verify() then runs the
+ * check vectors, which must come out bit for bit as the trainer's.
+ *
+ * tools/wxtrain writes these files with mlModelFileBuild(), next to
+ * ml_model_int8.h; MLModelStore keeps them on the station.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef ML_MODEL_FILE_H
+#define ML_MODEL_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "ml_quant.h"
+
+#define ML_MODEL_FILE_MAGIC 0x514D5857  // "WXMQ"
+#define ML_MODEL_FILE_VERSION 1
+#define ML_MODEL_FILE_ALIGN 16          // Arrays, for the SIMD kernel's loads
+#define ML_MODEL_FILE_MAX_CHECKS 32
+
+/**
+ * File header (packed)
+ */
+struct __attribute__((packed)) MLModelFileHeader {
+  uint32_t magic;
+  uint16_t version;                     // Schema
+  uint16_t headerSize;                  // Layers follow it
+  uint32_t size;                        // Whole file
+  uint32_t crc;                         // CRC-32 of the bytes after this field
+  uint32_t modelId;                     // Set by the trainer (wxtrain: Unix time), to tell models apart
+  uint32_t horizon;                     // ML_HORIZON_S it predicts over
+  uint8_t features;                     // Inputs: MLFeatureWindow features after ML_BIAS
+  uint8_t outputs;                      // ML_QUANT_OUTPUT_COUNT
+  uint8_t layerCount;
+  uint8_t checks;                       // Check vectors
+  float inputScale;
+  float outputScale;
+  uint32_t checkOffset;                 // Check inputs, then outputs
+};
+
+/**
+ * One dense layer (packed)
+ */
+struct __attribute__((packed)) MLModelFileLayer {
+  uint8_t inputs;
+  uint8_t outputs;
+  uint8_t relu;
+  int8_t shift;
+  int32_t multiplier;
+  uint32_t weightsOffset;
+  uint32_t biasOffset;
+};
+
+/**
+ * Why a model file (or a slot holding one) cannot be used
+ */
+enum MLModelFileStatus : uint8_t {
+  ML_MODEL_FILE_OK,
+  ML_MODEL_FILE_EMPTY,                  // Nothing stored
+  ML_MODEL_FILE_TRUNCATED,              // Shorter than its header says
+  ML_MODEL_FILE_BAD_MAGIC,              // Not a model file
+  ML_MODEL_FILE_NEWER_SCHEMA,           // Written for a later firmware
+  ML_MODEL_FILE_BAD_CRC,
+  ML_MODEL_FILE_OTHER_FEATURES,         // Features, outputs or horizon are not this firmware's
+  ML_MODEL_FILE_BAD_LAYOUT,             // Layers that do not chain or fit the arena, arrays out of bounds or misaligned
+  ML_MODEL_FILE_CHECK_FAILED,           // Check vectors differ
+  ML_MODEL_FILE_TOO_LARGE,              // Over ML_MODEL_SLOT_BYTES
+  ML_MODEL_FILE_IO_ERROR,               // Storage read, write or map failed
+  ML_MODEL_FILE_BUSY                    // Another upload, or a switch not yet made
+};
+
+/**
+ * Short name of a status, for logs and the API
+ */
+const char* mlModelFileStatusName(MLModelFileStatus status);
+
+/**
+ * CRC-32 (IEEE, as zlib); pass the previous result as crc to continue over more data
+ */
+uint32_t mlCrc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+/**
+ * A network to run: a parsed model file, or the compiled-in model
+ */
+class MLModelImage {
+public:
+  MLModelImage();
+  MLModelImage(const MLModelImage& other);
+  MLModelImage& operator=(const MLModelImage& other);  // Keeps the layers pointing at the copy's own
+
+  /**
+   * Check a file and point the layers into it (zero-copy: data must stay
+   * valid, and in place, while the image is used)
+   */
+  MLModelFileStatus parse(const uint8_t* data, size_t length);
+
+  /**
+   * Use a network compiled into the firmware, with its check vectors
+   */
+  void wrap(const MLQuantModel& compiled, const int8_t* checkInput, const int8_t* checkOutput, uint8_t checks);
+
+  void clear();
+
+  /**
+   * Run the check vectors with a kernel
+   * @return true if every output matches bit for bit
+   */
+  bool verify(MLQuantKernel kernel, MLQuantArena& arena) const;
+
+  bool valid() const { return quantModel.layerCount > 0; }
+  const MLQuantModel& model() const { return quantModel; }
+  uint32_t id() const { return modelId; }
+  uint32_t bytes() const { return size; }       // File size (0: compiled in)
+  uint8_t checkCount() const { return checks; }
+  const int8_t* checkInput(uint8_t i) const { return checkInputs + i * quantModel.layers[0].inputs; }
+
+private:
+  MLQuantLayer layers[ML_QUANT_MAX_LAYERS];
+  MLQuantModel quantModel;
+  const int8_t* checkInputs;
+  const int8_t* checkOutputs;
+  uint8_t checks;
+  uint32_t modelId;
+  uint32_t size;
+};
+
+/**
+ * Write a model file
+ * @param checkInput checks x the first layer's inputs; checkOutput checks x ML_QUANT_OUTPUT_COUNT
+ * @return its size, 0 if it does not fit cap (out = nullptr: just the size)
+ */
+size_t mlModelFileBuild(const MLQuantModel& model, const int8_t* checkInput, const int8_t* checkOutput,
+                        uint8_t checks, uint32_t horizon, uint32_t modelId, uint8_t* out, size_t cap);
+
+#endif // ML_MODEL_FILE_H
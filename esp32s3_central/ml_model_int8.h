@@ -0,0 +1,82 @@
+/**
+ * @file ml_model_int8.h
+ * @brief int8 weather model (generated by tools/wxtrain: do not edit)
+ *
+ * Data: synthetic, 365 days shaped like data/weather_training_data.csv (seed 1)
+ * Network: 8 features -> 12 ReLU -> rain logit, temperature change (10800 s)
+ * Examples: 84040 trained on, 21010 held out (the newest)
+ * Held out: Brier 0.0248 (float 0.0245, climatology 0.0722), temperature MAE 0.427 C (float 0.414)
+ *
+ * Regenerate it after changing the features in ml_model.h (see tools/README.md).
+ */
+
+#ifndef ML_MODEL_INT8_H
+#define ML_MODEL_INT8_H
+
+#include "ml_quant.h"
+
+#define ML_INT8_FEATURES 8                // MLFeatureWindow features after ML_BIAS
+#define ML_INT8_HORIZON_S 10800
+#define ML_INT8_HIDDEN 12
+#define ML_INT8_CHECKS 8
+
+constexpr int8_t ML_INT8_W0[] = {
+   18,  43,  -5, -99,  20,  29,  -2,  -6,
+  -23,   9,  -4,  -8,  13,  36,  10, -36,
+   15,  -6,   0, 127, -10,  -7,   0,  -1,
+  -38,  11,  -2, -48,  19,  -4,  62, -21,
+  -74, -41, -49, -33, -49, -38,  37,  -6,
+   -6,  -2,  17,  23, -20, -42, -12,  35,
+  -18,   3, -14, -81,  54,  24,   1,   8,
+   18, -25,  23,  57, -47, -29, -27,   4,
+   94,  64,  10,   3, -18, -35,  -5, -28,
+    2,  -1,  -1, -22,   3,  -2,  61, -15,
+   22,  86,  12, 107,   5,  -3,  11, -20,
+  -21,  -3,   1,  34, -82, 103,   5,  -7,
+};
+
+constexpr int32_t ML_INT8_B0[] = {
+  3535, 1983, -5506, 3073, 1653, -1729, 3865, 1643,
+  2926, 3581, 1745, 3087,
+};
+
+constexpr int8_t ML_INT8_W1[] = {
+   -1,   2, 127, -14,  14,   0, -22,  -1, -22,   3,  18, -39,
+  -10,   6,  28,  -2,   0,  -5,  -5, -13,   6,  13,  -4,   2,
+};
+
+constexpr int32_t ML_INT8_B1[] = {
+  -137, 65,
+};
+
+constexpr MLQuantLayer ML_INT8_LAYERS[] = {
+  {8, 12, ML_INT8_W0, ML_INT8_B0, 1737352303, -7, true},
+  {12, 2, ML_INT8_W1, ML_INT8_B1, 2121768427, -4, false},
+};
+
+constexpr MLQuantModel ML_INT8_MODEL = {2, ML_INT8_LAYERS, 0.0174015742f, 0.153958112f};
+
+// Held-out inputs and the outputs ml_quant.cpp gives for them (bit-exact)
+constexpr int8_t ML_INT8_CHECK_INPUT[] = {
+    4,  14,   9,  52,  46, -23,  57,  -3,
+   -4,  -1,  20,  24,  13, -20,  41, -41,
+   26,  41,  14,  11,  18, -86,   3, -57,
+  -13, -21,  -1,  12,   8, -21, -37, -44,
+   -4,  -1,   5,  -6,   5, -15, -57,  -8,
+    6,  10, -33,  14,  30, -30, -47,  33,
+    1,  -2, -10,  -5,  -7, -13, -12,  56,
+   -7,  -5,  -5,  12,   7, -15,  29,  50,
+};
+
+constexpr int8_t ML_INT8_CHECK_OUTPUT[] = {
+   30,  30,
+  -49,  23,
+  -82,  12,
+  -52,  -6,
+  -83, -22,
+  -58, -22,
+  -80, -14,
+  -51,   2,
+};
+
+#endif // ML_MODEL_INT8_H
@@ -0,0 +1,367 @@
+/**
+ * @file ml_model_store.cpp
+ * @brief int8 model slots: partition mapping or LittleFS files, uploads, switching
+ */
+
+#include "ml_model_store.h"
+#include <new>
+
+#define ML_MODEL_SELECT_TEMP_FILE ML_MODEL_SELECT_FILE ".tmp"
+#define ML_MODEL_SECTOR_BYTES 4096      // Flash erase unit
+#define ML_MODEL_PATH_MAX 32
+
+/**
+ * LittleFS path of a slot's file
+ */
+static void slotPath(int8_t slot, char* path, size_t size) {
+  snprintf(path, size, ML_MODEL_SLOT_FILE, (unsigned)slot);
+}
+
+MLModelStore::MLModelStore()
+  : backing(ML_MODEL_BACKING_NONE),
+#if defined(ESP_PLATFORM)
+    partition(nullptr),
+#endif
+    pending(false), uploadSlot(ML_MODEL_NO_SLOT), erasedTo(0), uploadMs(0) {
+}
+
+MLModelStore::~MLModelStore() {
+  release(current);
+  release(staged);
+}
+
+void MLModelStore::begin() {
+  // LittleFS holds the selection either way
+  bool files = LittleFS.begin();
+#if defined(ESP_PLATFORM)
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ML_MODEL_PARTITION);
+  if (partition && partition->size >= ML_MODEL_SLOTS * ML_MODEL_SLOT_BYTES) {
+    backing = ML_MODEL_BACKING_PARTITION;
+  } else
+#endif
+  if (files) {
+    backing = ML_MODEL_BACKING_FILES;
+  }
+  stats.backing = backing;
+  if (backing == ML_MODEL_BACKING_NONE) return;
+
+  // The selected slot, else the other one; the slot not used is loaded once to report what it holds
+  int8_t selected = readSelection();
+  if (selected != ML_MODEL_NO_SLOT && load(selected, current) != ML_MODEL_FILE_OK) {
+    int8_t other = 1 - selected;
+    if (load(other, current) == ML_MODEL_FILE_OK) {
+      Serial.print(F("[ML] Model slot "));
+      Serial.print(selected);
+      Serial.print(F(" unusable, using slot "));
+      Serial.println(other);
+      writeSelection(other);
+    }
+  }
+  for (int8_t slot = 0; slot < ML_MODEL_SLOTS; slot++) {
+    if (slot == current.slot) continue;
+    Loaded probe;
+    if (load(slot, probe) == ML_MODEL_FILE_OK && stats.previous == ML_MODEL_NO_SLOT) stats.previous = slot;
+    release(probe);
+  }
+
+  stats.active = current.slot;
+  stats.mapped = current.mapped;
+  stats.loadUs = current.loadUs;
+  stats.residentBytes = current.image.valid() ? sizeof(MLModelImage) + current.heapBytes : 0;
+  stats.mappedBytes = current.mapped ? ML_MODEL_SLOT_BYTES : 0;
+}
+
+const MLModelImage* MLModelStore::active() const {
+  return current.image.valid() ? &current.image : nullptr;
+}
+
+MLModelFileStatus MLModelStore::load(int8_t slot, Loaded& out) {
+  release(out);
+  out.slot = slot;
+  uint32_t start = micros();
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  MLModelFileStatus status = ML_MODEL_FILE_OK;
+
+#if defined(ESP_PLATFORM)
+  if (backing == ML_MODEL_BACKING_PARTITION) {
+    const void* mapped = nullptr;
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_err_t err = esp_partition_mmap(partition, slot * ML_MODEL_SLOT_BYTES, ML_MODEL_SLOT_BYTES,
+                                       ESP_PARTITION_MMAP_DATA, &mapped, &out.map);
+#else
+    esp_err_t err = esp_partition_mmap(partition, slot * ML_MODEL_SLOT_BYTES, ML_MODEL_SLOT_BYTES,
+                                       SPI_FLASH_MMAP_DATA, &mapped, &out.map);
+#endif
+    if (err == ESP_OK) {
+      out.mapped = true;
+      data = (const uint8_t*)mapped;
+      length = ML_MODEL_SLOT_BYTES;
+    } else {
+      status = ML_MODEL_FILE_IO_ERROR;
+    }
+  }
+#endif
+  if (backing == ML_MODEL_BACKING_FILES) {
+    char path[ML_MODEL_PATH_MAX];
+    slotPath(slot, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    length = file ? file.size() : 0;
+    if (length > ML_MODEL_SLOT_BYTES) {
+      status = ML_MODEL_FILE_TOO_LARGE;
+    } else if (length > 0) {
+      // Aligned by hand: the layers' arrays are aligned relative to the start of the file
+      out.heapBytes = length + ML_MODEL_FILE_ALIGN - 1;
+      out.heap = new (std::nothrow) uint8_t[out.heapBytes];
+      uint8_t* aligned = out.heap ? out.heap + (ML_MODEL_FILE_ALIGN - (uintptr_t)out.heap % ML_MODEL_FILE_ALIGN) %
+                                               ML_MODEL_FILE_ALIGN
+                                  : nullptr;
+      if (!aligned || file.read(aligned, length) != length) status = ML_MODEL_FILE_IO_ERROR;
+      data = aligned;
+    }
+    file.close();
+  }
+
+  if (status == ML_MODEL_FILE_OK) status = out.image.parse(data, length);
+  if (status == ML_MODEL_FILE_OK && !out.image.verify(ML_QUANT_SCALAR, arena)) status = ML_MODEL_FILE_CHECK_FAILED;
+  out.loadUs = micros() - start;
+  setSlotInfo(slot, status, &out.image);
+  if (status != ML_MODEL_FILE_OK) {
+    release(out);
+    out.slot = ML_MODEL_NO_SLOT;
+  }
+  return status;
+}
+
+void MLModelStore::release(Loaded& loaded) {
+#if defined(ESP_PLATFORM)
+  if (loaded.mapped) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_munmap(loaded.map);
+#else
+    spi_flash_munmap(loaded.map);
+#endif
+  }
+#endif
+  delete[] loaded.heap;
+  loaded = Loaded();
+}
+
+void MLModelStore::setSlotInfo(int8_t slot, MLModelFileStatus status, const MLModelImage* image) {
+  MLModelSlotInfo info;
+  info.status = status;
+  if (status == ML_MODEL_FILE_OK) {
+    info.modelId = image->id();
+    info.bytes = image->bytes();
+  }
+  portENTER_CRITICAL(&lock);
+  stats.slots[slot] = info;
+  portEXIT_CRITICAL(&lock);
+}
+
+MLModelFileStatus MLModelStore::beginUpload() {
+  // An upload whose client went away never finishes: a new one replaces it after a while
+  bool stalled = millis() - uploadMs > ML_MODEL_UPLOAD_TIMEOUT_MS;
+  portENTER_CRITICAL(&lock);
+  if (stats.uploading && stalled) {
+    stats.uploading = false;
+    stats.rejected++;
+  }
+  bool busy = pending || stats.uploading || backing == ML_MODEL_BACKING_NONE;
+  // Not the slot in use, nor the one a rollback would go back to
+  int8_t slot = stats.active != ML_MODEL_NO_SLOT ? 1 - stats.active
+              : stats.previous != ML_MODEL_NO_SLOT ? 1 - stats.previous
+                                                   : 0;
+  if (!busy) {
+    stats.uploading = true;
+    stats.uploadBytes = 0;
+  }
+  portEXIT_CRITICAL(&lock);
+  if (busy) return backing == ML_MODEL_BACKING_NONE ? ML_MODEL_FILE_IO_ERROR : ML_MODEL_FILE_BUSY;
+
+  uploadFile.close();
+  uploadSlot = slot;
+  erasedTo = 0;
+  uploadMs = millis();
+  if (backing == ML_MODEL_BACKING_FILES) {
+    char path[ML_MODEL_PATH_MAX];
+    slotPath(slot, path, sizeof(path));
+    uploadFile = LittleFS.open(path, "w");
+    if (!uploadFile) {
+      portENTER_CRITICAL(&lock);
+      stats.uploading = false;
+      stats.rejected++;
+      stats.lastStatus = ML_MODEL_FILE_IO_ERROR;
+      portEXIT_CRITICAL(&lock);
+      return ML_MODEL_FILE_IO_ERROR;
+    }
+  }
+  return ML_MODEL_FILE_OK;
+}
+
+MLModelFileStatus MLModelStore::writeUpload(size_t index, const uint8_t* data, size_t length) {
+  portENTER_CRITICAL(&lock);
+  bool uploading = stats.uploading;
+  uint32_t received = stats.uploadBytes;
+  MLModelFileStatus last = stats.lastStatus;
+  portEXIT_CRITICAL(&lock);
+  if (!uploading) return last;
+
+  MLModelFileStatus status = ML_MODEL_FILE_OK;
+  if (index != received) {
+    status = ML_MODEL_FILE_IO_ERROR;
+  } else if (index + length > ML_MODEL_SLOT_BYTES) {
+    status = ML_MODEL_FILE_TOO_LARGE;
+  }
+#if defined(ESP_PLATFORM)
+  if (status == ML_MODEL_FILE_OK && backing == ML_MODEL_BACKING_PARTITION) {
+    // Erased a sector at a time as the file arrives, so no single call holds the flash for long
+    size_t base = uploadSlot * ML_MODEL_SLOT_BYTES;
+    while (status == ML_MODEL_FILE_OK && erasedTo < index + length) {
+      if (esp_partition_erase_range(partition, base + erasedTo, ML_MODEL_SECTOR_BYTES) != ESP_OK) {
+        status = ML_MODEL_FILE_IO_ERROR;
+      }
+      erasedTo += ML_MODEL_SECTOR_BYTES;
+    }
+    if (status == ML_MODEL_FILE_OK && esp_partition_write(partition, base + index, data, length) != ESP_OK) {
+      status = ML_MODEL_FILE_IO_ERROR;
+    }
+  }
+#endif
+  if (status == ML_MODEL_FILE_OK && backing == ML_MODEL_BACKING_FILES && uploadFile.write(data, length) != length) {
+    status = ML_MODEL_FILE_IO_ERROR;
+  }
+
+  if (status != ML_MODEL_FILE_OK) uploadFile.close();
+  uploadMs = millis();
+  portENTER_CRITICAL(&lock);
+  if (status == ML_MODEL_FILE_OK) {
+    stats.uploadBytes += length;
+  } else {
+    stats.uploading = false;
+    stats.rejected++;
+    stats.lastStatus = status;
+  }
+  portEXIT_CRITICAL(&lock);
+  return status;
+}
+
+MLModelFileStatus MLModelStore::finishUpload() {
+  portENTER_CRITICAL(&lock);
+  bool uploading = stats.uploading;
+  MLModelFileStatus last = stats.lastStatus;
+  portEXIT_CRITICAL(&lock);
+  if (!uploading) return last;
+
+  uploadFile.close();
+  MLModelFileStatus status = load(uploadSlot, staged);
+  portENTER_CRITICAL(&lock);
+  stats.uploading = false;
+  stats.lastStatus = status;
+  if (status == ML_MODEL_FILE_OK) {
+    stats.uploads++;
+    stats.pendingSlot = uploadSlot;
+    stats.pending = true;
+    pending = true;
+  } else {
+    stats.rejected++;
+  }
+  portEXIT_CRITICAL(&lock);
+  return status;
+}
+
+MLModelFileStatus MLModelStore::requestSlot(int8_t slot) {
+  portENTER_CRITICAL(&lock);
+  bool busy = pending || stats.uploading;
+  bool same = slot == stats.active;
+  portEXIT_CRITICAL(&lock);
+  if (busy) return ML_MODEL_FILE_BUSY;
+  if (same) return ML_MODEL_FILE_OK;
+
+  MLModelFileStatus status = ML_MODEL_FILE_OK;
+  if (slot == ML_MODEL_NO_SLOT) {
+    release(staged);
+  } else if (slot < 0 || slot >= ML_MODEL_SLOTS || backing == ML_MODEL_BACKING_NONE) {
+    status = ML_MODEL_FILE_EMPTY;
+  } else {
+    status = load(slot, staged);
+  }
+
+  portENTER_CRITICAL(&lock);
+  stats.lastStatus = status;
+  if (status == ML_MODEL_FILE_OK) {
+    stats.pendingSlot = slot;
+    stats.pending = true;
+    pending = true;
+  } else {
+    stats.rejected++;
+  }
+  portEXIT_CRITICAL(&lock);
+  return status;
+}
+
+int8_t MLModelStore::rollbackSlot() const {
+  portENTER_CRITICAL(&lock);
+  int8_t slot = stats.previous;
+  portEXIT_CRITICAL(&lock);
+  return slot;
+}
+
+bool MLModelStore::takePending() {
+  portENTER_CRITICAL(&lock);
+  bool ready = pending;
+  portEXIT_CRITICAL(&lock);
+  if (!ready) return false;
+
+  // The web task wrote staged before setting pending and leaves it alone until pending clears
+  Loaded previous = current;
+  current = staged;
+  staged = Loaded();
+  if (!writeSelection(current.slot)) {
+    Serial.println(F("[ML] Model selection not saved: the previous model returns after a reset"));
+  }
+
+  portENTER_CRITICAL(&lock);
+  stats.previous = previous.slot;
+  stats.active = current.slot;
+  stats.mapped = current.mapped;
+  stats.loadUs = current.loadUs;
+  stats.residentBytes = current.image.valid() ? sizeof(MLModelImage) + current.heapBytes : 0;
+  stats.mappedBytes = current.mapped ? ML_MODEL_SLOT_BYTES : 0;
+  stats.switches++;
+  stats.pending = false;
+  stats.pendingSlot = ML_MODEL_NO_SLOT;
+  pending = false;
+  portEXIT_CRITICAL(&lock);
+
+  // Nothing points into the old model any more (MLPredictor reselects before its next inference)
+  release(previous);
+  return true;
+}
+
+void MLModelStore::getStats(MLModelStoreStats& out) const {
+  portENTER_CRITICAL(&lock);
+  out = stats;
+  portEXIT_CRITICAL(&lock);
+}
+
+int8_t MLModelStore::readSelection() const {
+  File file = LittleFS.open(ML_MODEL_SELECT_FILE, "r");
+  if (!file) return 0;
+  int c = file.read();
+  file.close();
+  return c == '1' ? 1 : c == '-' ? ML_MODEL_NO_SLOT : 0;
+}
+
+bool MLModelStore::writeSelection(int8_t slot) {
+  // A temporary file renamed over the old one: a reset leaves either choice, never neither
+  File file = LittleFS.open(ML_MODEL_SELECT_TEMP_FILE, "w");
+  uint8_t c = slot == ML_MODEL_NO_SLOT ? '-' : '0' + slot;
+  bool ok = file && file.write(c) == 1;
+  file.close();
+  if (!ok) {
+    LittleFS.remove(ML_MODEL_SELECT_TEMP_FILE);
+    return false;
+  }
+  return LittleFS.rename(ML_MODEL_SELECT_TEMP_FILE, ML_MODEL_SELECT_FILE);
+}
@@ -0,0 +1,194 @@
+/**
+ * @file ml_model_store.h
+ * @brief int8 model files on the station: two slots, swapped at runtime with rollback
+ *
+ * Slots hold .wxq files (ml_model_file.h). The one in use is named in
+ * ML_MODEL_SELECT_FILE, replaced by a rename so a reset leaves the old
+ * choice or the new one. A new model goes to the other slot, so the model it
+ * replaces stays there for rollback.
+ *
+ * Slots are the two halves of the ML_MODEL_PARTITION data partition when the
+ * partition table has one (partitions.csv): the model in use is mapped with
+ * esp_partition_mmap() and its weights are read in place through the flash
+ * cache, costing no heap beyond its MLModelImage. Without the partition they
+ * are LittleFS files (ML_MODEL_SLOT_FILE), which cannot be mapped: the file
+ * is read into one heap block and the layers point into that.
+ *
+ * An upload (web server task) is written, parsed and checked against its
+ * check vectors there; only a model that passes becomes pending, and loop()
+ * switches to it with takePending(), between predictions. The image in use
+ * is never touched from another task.
+ */
+
+#ifndef ML_MODEL_STORE_H
+#define ML_MODEL_STORE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "config.h"
+#include "ml_model_file.h"
+
+#if defined(ESP_PLATFORM)
+#include <esp_partition.h>
+#include <esp_idf_version.h>
+#endif
+
+#define ML_MODEL_SLOTS 2
+#define ML_MODEL_NO_SLOT -1             // The compiled-in model
+
+/**
+ * Where the slots are
+ */
+enum MLModelBacking : uint8_t {
+  ML_MODEL_BACKING_NONE,                // Neither: only the compiled model
+  ML_MODEL_BACKING_PARTITION,           // Mapped from flash
+  ML_MODEL_BACKING_FILES                // Read from LittleFS into the heap
+};
+
+/**
+ * What a slot holds, as of its last load
+ */
+struct MLModelSlotInfo {
+  MLModelFileStatus status = ML_MODEL_FILE_EMPTY;
+  uint32_t modelId = 0;
+  uint32_t bytes = 0;
+};
+
+/**
+ * Model store state, for /api/ml/model
+ */
+struct MLModelStoreStats {
+  MLModelBacking backing = ML_MODEL_BACKING_NONE;
+  uint32_t slotBytes = ML_MODEL_SLOT_BYTES;
+  int8_t active = ML_MODEL_NO_SLOT;     // Slot in use (ML_MODEL_NO_SLOT: the compiled model)
+  bool pending = false;                 // A checked model (or the compiled one) waits for loop()
+  int8_t pendingSlot = ML_MODEL_NO_SLOT;
+  int8_t previous = ML_MODEL_NO_SLOT;   // What a rollback returns to: the model in use before the last switch
+  MLModelSlotInfo slots[ML_MODEL_SLOTS];
+  bool mapped = false;                  // Weights in use read in place from flash
+  uint32_t loadUs = 0;                  // Map or read, parse, CRC and check vectors of the model in use
+  uint32_t residentBytes = 0;           // RAM it holds: its image, plus the file when not mapped
+  uint32_t mappedBytes = 0;             // Flash mapped for it
+  uint32_t switches = 0;
+  uint32_t uploads = 0;                 // Accepted
+  uint32_t rejected = 0;                // Uploads and rollbacks refused
+  bool uploading = false;
+  uint32_t uploadBytes = 0;             // Received so far (or in the last upload)
+  MLModelFileStatus lastStatus = ML_MODEL_FILE_OK;  // Of the last upload or switch request
+};
+
+/**
+ * Two model slots and the one in use
+ */
+class MLModelStore {
+public:
+  MLModelStore();
+  ~MLModelStore();
+
+  /**
+   * Find the slots and load the selected model, or the other slot's if it
+   * does not load (loop task, before the web server starts)
+   */
+  void begin();
+
+  /**
+   * Model in use, nullptr for the compiled one; loop task only, valid until
+   * the next takePending()
+   */
+  const MLModelImage* active() const;
+
+  /**
+   * Start writing a model to the slot not in use (web server task)
+   */
+  MLModelFileStatus beginUpload();
+
+  /**
+   * Next part of the upload, at byte index of the file
+   */
+  MLModelFileStatus writeUpload(size_t index, const uint8_t* data, size_t length);
+
+  /**
+   * Check the uploaded file; if it passes, it is pending
+   */
+  MLModelFileStatus finishUpload();
+
+  /**
+   * Ask for another slot's model (rollback), or ML_MODEL_NO_SLOT for the
+   * compiled one; it is checked here and pending if it passes (web server task)
+   */
+  MLModelFileStatus requestSlot(int8_t slot);
+
+  /**
+   * The slot a rollback returns to (MLModelStoreStats::previous)
+   */
+  int8_t rollbackSlot() const;
+
+  /**
+   * Switch to the pending model, if any, and record the choice (loop task)
+   * @return true if the model in use changed
+   */
+  bool takePending();
+
+  /**
+   * Copy of the store's state (from any task)
+   */
+  void getStats(MLModelStoreStats& out) const;
+
+private:
+  /**
+   * One slot's model, mapped or read
+   */
+  struct Loaded {
+    MLModelImage image;
+    int8_t slot = ML_MODEL_NO_SLOT;
+    uint8_t* heap = nullptr;            // File copy (LittleFS)
+    size_t heapBytes = 0;
+    bool mapped = false;
+    uint32_t loadUs = 0;
+#if defined(ESP_PLATFORM)
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_mmap_handle_t map = 0;
+#else
+    spi_flash_mmap_handle_t map = 0;
+#endif
+#endif
+  };
+
+  MLModelBacking backing;
+#if defined(ESP_PLATFORM)
+  const esp_partition_t* partition;
+#endif
+  Loaded current;                       // loop() only
+  Loaded staged;                        // Written by the web task, handed over through pending
+  bool pending;                         // staged is ready (stats.pending, read by loop())
+  MLQuantArena arena;                   // Check vectors of a model being loaded
+  File uploadFile;
+  int8_t uploadSlot;
+  uint32_t erasedTo;                    // Partition slot bytes erased for the upload
+  uint32_t uploadMs;                    // millis() at its last part
+  MLModelStoreStats stats;
+  mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  /**
+   * Map or read a slot, parse it and run its check vectors
+   */
+  MLModelFileStatus load(int8_t slot, Loaded& out);
+
+  /**
+   * Unmap or free a slot's model
+   */
+  void release(Loaded& loaded);
+
+  /**
+   * Record what a slot holds
+   */
+  void setSlotInfo(int8_t slot, MLModelFileStatus status, const MLModelImage* image);
+
+  /**
+   * Selected slot, from ML_MODEL_SELECT_FILE (0 if there is none)
+   */
+  int8_t readSelection() const;
+  bool writeSelection(int8_t slot);
+};
+
+#endif // ML_MODEL_STORE_H
@@ -0,0 +1,233 @@
+/**
+ * @file ml_nowcast.cpp
+ * @brief Kalman nowcast of exterior temperature and pressure
+ */
+
+#include "ml_nowcast.h"
+#include <math.h>
+#include <string.h>
+
+#define N ML_NOWCAST_STATES
+#define STATE_LEVEL 0
+#define STATE_SLOPE 1
+#define STATE_COS 2
+#define STATE_SIN 3
+
+/**
+ * Per channel: temperatures wander and swing through the day; pressure
+ * drifts with the weather and carries a small 12-hour tide
+ */
+static const MLNowcastModel MODELS[ML_NOWCAST_CHANNELS] = {
+  // period, slope memory, level, slope, cycle noise, slope, cycle start
+  {24.0f, 12.0f, 0.02f, 0.002f, 0.001f, 1.0f, 25.0f},   // °C
+  {12.0f, 6.0f, 0.02f, 0.05f, 0.001f, 1.0f, 1.0f},     // hPa
+};
+
+/**
+ * Standard deviation of a reading, per channel and source
+ */
+struct MLNowcastInput {
+  MLFusedField field;
+  MLInputSource source;
+  float noise;
+};
+
+// In order of preference; the indoor temperature is not the weather
+static const MLNowcastInput INPUTS[ML_NOWCAST_CHANNELS][2] = {
+  {{ML_FUSED_EXTERIOR_TEMP, ML_INPUT_EXTERIOR, 0.3f}, {ML_FUSED_OBSERVED_TEMP, ML_INPUT_OBSERVATION, 1.0f}},
+  {{ML_FUSED_INDOOR_PRESSURE, ML_INPUT_INDOOR, 0.1f}, {ML_FUSED_EXTERIOR_PRESSURE, ML_INPUT_EXTERIOR, 0.2f}},
+};
+
+MLKalmanTrend::MLKalmanTrend(const MLNowcastModel& model) : model(model) {
+  clear();
+}
+
+void MLKalmanTrend::clear() {
+  memset(x, 0, sizeof(x));
+  memset(P, 0, sizeof(P));
+  first = 0;
+  last = 0;
+  updates = 0;
+  rejected = 0;
+  rejectStreak = 0;
+}
+
+void MLKalmanTrend::predict(float hours, float* state, float covariance[N][N]) const {
+  if (hours <= 0) return;
+
+  // F: the slope decays over its memory, adding its integral to the level; the cycle turns by hours / period
+  float damping = expf(-hours / model.slopeHours);
+  float angle = 2.0f * (float)M_PI * hours / model.periodHours;
+  float c = cosf(angle);
+  float s = sinf(angle);
+  float F[N][N] = {
+    {1, model.slopeHours * (1 - damping), 0, 0},
+    {0, damping, 0, 0},
+    {0, 0, c, s},
+    {0, 0, -s, c},
+  };
+
+  float next[N];
+  for (uint8_t i = 0; i < N; i++) {
+    next[i] = 0;
+    for (uint8_t j = 0; j < N; j++) next[i] += F[i][j] * state[j];
+  }
+  memcpy(state, next, sizeof(next));
+
+  // P = F P F' + Q
+  float FP[N][N];
+  for (uint8_t i = 0; i < N; i++) {
+    for (uint8_t j = 0; j < N; j++) {
+      float sum = 0;
+      for (uint8_t k = 0; k < N; k++) sum += F[i][k] * covariance[k][j];
+      FP[i][j] = sum;
+    }
+  }
+  for (uint8_t i = 0; i < N; i++) {
+    for (uint8_t j = i; j < N; j++) {
+      float sum = 0;
+      for (uint8_t k = 0; k < N; k++) sum += FP[i][k] * F[j][k];
+      covariance[i][j] = sum;
+      covariance[j][i] = sum;
+    }
+  }
+  covariance[STATE_LEVEL][STATE_LEVEL] += model.levelNoise * hours;
+  covariance[STATE_SLOPE][STATE_SLOPE] += model.slopeNoise * hours;
+  covariance[STATE_COS][STATE_COS] += model.cycleNoise * hours;
+  covariance[STATE_SIN][STATE_SIN] += model.cycleNoise * hours;
+}
+
+bool MLKalmanTrend::update(uint32_t time, float value, float noise) {
+  if (isnan(value)) return false;
+  if (updates > 0 && time == last) return true;
+  if (updates > 0 && (time < last || time - last > ML_NOWCAST_RESET_S)) clear();
+
+  float R = noise * noise;
+  if (updates == 0) {
+    x[STATE_LEVEL] = value;
+    P[STATE_LEVEL][STATE_LEVEL] = R;
+    P[STATE_SLOPE][STATE_SLOPE] = model.slopeStart;
+    P[STATE_COS][STATE_COS] = model.cycleStart;
+    P[STATE_SIN][STATE_SIN] = model.cycleStart;
+    first = time;
+    last = time;
+    updates = 1;
+    return true;
+  }
+
+  predict((time - last) / 3600.0f, x, P);
+  last = time;
+
+  // H = [1 0 1 0]: one reading of level + cycle, so S is a scalar
+  float PH[N];
+  for (uint8_t i = 0; i < N; i++) PH[i] = P[i][STATE_LEVEL] + P[i][STATE_COS];
+  float innovation = value - (x[STATE_LEVEL] + x[STATE_COS]);
+  float S = PH[STATE_LEVEL] + PH[STATE_COS] + R;
+
+  if (innovation * innovation > ML_NOWCAST_GATE * ML_NOWCAST_GATE * S) {
+    if (++rejectStreak < ML_NOWCAST_REJECT_LIMIT) {
+      rejected++;
+      return false;
+    }
+    // Persistent: take it, with the level as uncertain as the jump
+    P[STATE_LEVEL][STATE_LEVEL] += innovation * innovation;
+    PH[STATE_LEVEL] += innovation * innovation;
+    S += innovation * innovation;
+  }
+  rejectStreak = 0;
+
+  float K[N];
+  for (uint8_t i = 0; i < N; i++) {
+    K[i] = PH[i] / S;
+    x[i] += K[i] * innovation;
+  }
+  // P -= K H P, kept symmetric against rounding
+  for (uint8_t i = 0; i < N; i++) {
+    for (uint8_t j = i; j < N; j++) {
+      float entry = 0.5f * ((P[i][j] - K[i] * PH[j]) + (P[j][i] - K[j] * PH[i]));
+      P[i][j] = entry;
+      P[j][i] = entry;
+    }
+  }
+  updates++;
+  return true;
+}
+
+float MLKalmanTrend::forecast(uint32_t now, float noise, float* mean, float* sigma, uint8_t hours) const {
+  float state[N];
+  float covariance[N][N];
+  memcpy(state, x, sizeof(state));
+  memcpy(covariance, P, sizeof(covariance));
+
+  predict(now > last ? (now - last) / 3600.0f : 0, state, covariance);
+  float current = state[STATE_LEVEL] + state[STATE_COS];
+
+  float R = noise * noise;
+  for (uint8_t h = 0; h < hours; h++) {
+    predict(1.0f, state, covariance);
+    float variance = covariance[STATE_LEVEL][STATE_LEVEL] + 2 * covariance[STATE_LEVEL][STATE_COS] +
+                     covariance[STATE_COS][STATE_COS] + R;
+    mean[h] = state[STATE_LEVEL] + state[STATE_COS];
+    sigma[h] = sqrtf(variance > 0 ? variance : 0);
+  }
+  return current;
+}
+
+MLNowcaster::MLNowcaster()
+  : filters{MLKalmanTrend(MODELS[ML_NOWCAST_TEMPERATURE]), MLKalmanTrend(MODELS[ML_NOWCAST_PRESSURE])} {
+  clear();
+}
+
+void MLNowcaster::clear() {
+  for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+    filters[c].clear();
+    sources[c] = ML_INPUT_NONE;
+    noise[c] = 0;
+  }
+}
+
+void MLNowcaster::feed(MLNowcastChannel channel, const MLFusedFeatures& fused, MLFusedField field,
+                       MLInputSource source, float readingNoise) {
+  uint32_t age = fused.age[source];
+  uint32_t time = fused.time > age ? fused.time - age : 0;
+  MLKalmanTrend& filter = filters[channel];
+  // Fusion keeps a source's reading until the next one: take each once
+  if (filter.started() && time <= filter.lastTime() && time + ML_NOWCAST_RESET_S > filter.lastTime()) return;
+
+  filter.update(time, fused.values[field], readingNoise);
+  sources[channel] = source;
+  noise[channel] = readingNoise;
+}
+
+void MLNowcaster::update(const MLFusedFeatures& fused) {
+  for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+    for (const MLNowcastInput& input : INPUTS[c]) {
+      if (fused.usable(input.field)) {
+        feed((MLNowcastChannel)c, fused, input.field, input.source, input.noise);
+        break;
+      }
+    }
+  }
+}
+
+void MLNowcaster::forecast(uint32_t now, MLNowcast& out) const {
+  out.time = now;
+  out.ready = 0;
+  for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+    const MLKalmanTrend& filter = filters[c];
+    out.sources[c] = sources[c];
+    out.updates[c] = filter.getUpdates();
+    if (!filter.started()) {
+      out.now[c] = NAN;
+      for (uint8_t h = 0; h < ML_NOWCAST_HOURS; h++) {
+        out.mean[c][h] = NAN;
+        out.sigma[c][h] = NAN;
+      }
+      continue;
+    }
+    out.now[c] = filter.forecast(now, noise[c], out.mean[c], out.sigma[c], ML_NOWCAST_HOURS);
+    bool warm = filter.lastTime() - filter.firstTime() >= ML_NOWCAST_WARMUP_S;
+    bool recent = now <= filter.lastTime() || now - filter.lastTime() <= ML_NOWCAST_MAX_AGE_S;
+    if (warm && recent) out.ready |= 1u << c;
+  }
+}
@@ -0,0 +1,147 @@
+/**
+ * @file ml_nowcast.h
+ * @brief Kalman nowcast of exterior temperature and pressure, 1 to 6 hours ahead
+ *
+ * One linear Kalman filter per channel, with ML_NOWCAST_STATES states:
+ * a local level, its slope per hour (damped, so a trend is not carried on
+ * for hours after it stops), and a cycle (cosine and sine parts rotating
+ * with the channel's period: 24 h for temperature, the 12 h atmospheric
+ * tide for pressure). Readings observe level + cycle.
+ *
+ * Each reading is one predict and one scalar update, O(states^2) with no
+ * matrix inversion; forecast() runs the prediction on, one hour at a time,
+ * for the mean and its standard deviation. Everything sits in fixed
+ * arrays sized at compile time: no allocation.
+ *
+ * The cycle needs no clock: its phase is learned from the readings, so any
+ * monotonic time in seconds will do (MLPredictor passes uptime).
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef ML_NOWCAST_H
+#define ML_NOWCAST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "ml_fusion.h"
+
+#define ML_NOWCAST_STATES 4             // Level, slope, cycle cosine, cycle sine
+
+/**
+ * Channels forecast
+ */
+enum MLNowcastChannel : uint8_t {
+  ML_NOWCAST_TEMPERATURE,               // Exterior node, else the API's observation
+  ML_NOWCAST_PRESSURE,                  // BME680, else the exterior node
+  ML_NOWCAST_CHANNELS
+};
+
+/**
+ * Noise and period of one channel's filter
+ */
+struct MLNowcastModel {
+  float periodHours;                    // Of the cycle
+  float slopeHours;                     // Time constant the slope decays with (trends do not last)
+  float levelNoise;                     // Process noise, variance per hour
+  float slopeNoise;
+  float cycleNoise;
+  float slopeStart;                     // Initial variances (the level starts at the first reading's)
+  float cycleStart;
+};
+
+/**
+ * Level, slope and cycle of one channel
+ */
+class MLKalmanTrend {
+public:
+  explicit MLKalmanTrend(const MLNowcastModel& model);
+
+  void clear();
+
+  /**
+   * Predict to time and take one reading; a reading older than the last
+   * one, or after a gap of ML_NOWCAST_RESET_S, restarts the filter
+   * @param noise the reading's standard deviation
+   * @return false if it was rejected as an outlier (the filter still moved to time)
+   */
+  bool update(uint32_t time, float value, float noise);
+
+  /**
+   * Expected value and standard deviation of readings every hour after now
+   * @param noise standard deviation of a reading, added to the band
+   * @return the filtered value at now
+   */
+  float forecast(uint32_t now, float noise, float* mean, float* sigma, uint8_t hours) const;
+
+  bool started() const { return updates > 0; }
+  uint32_t firstTime() const { return first; }
+  uint32_t lastTime() const { return last; }
+  uint32_t getUpdates() const { return updates; }
+  uint32_t getRejected() const { return rejected; }
+
+private:
+  const MLNowcastModel& model;
+  float x[ML_NOWCAST_STATES];
+  float P[ML_NOWCAST_STATES][ML_NOWCAST_STATES];
+  uint32_t first;
+  uint32_t last;
+  uint32_t updates;
+  uint32_t rejected;
+  uint8_t rejectStreak;                 // Outliers in a row
+
+  /**
+   * x and P moved on by hours
+   */
+  void predict(float hours, float* state, float covariance[ML_NOWCAST_STATES][ML_NOWCAST_STATES]) const;
+};
+
+/**
+ * Forecast of both channels, for the UI and /api/ml
+ */
+struct MLNowcast {
+  uint32_t time = 0;                    // As of (store clock)
+  uint8_t ready = 0;                    // Bit per MLNowcastChannel: warmed up and fed recently
+  uint8_t sources[ML_NOWCAST_CHANNELS] = {ML_INPUT_NONE, ML_INPUT_NONE};  // Of the last reading used
+  float now[ML_NOWCAST_CHANNELS] = {};  // Filtered value at time
+  float mean[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};   // +1 h .. +ML_NOWCAST_HOURS
+  float sigma[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};  // One standard deviation
+  uint32_t updates[ML_NOWCAST_CHANNELS] = {};
+  uint32_t updateCycles = 0;            // Cost of the last sample's update (set by MLPredictor)
+  uint32_t updateCyclesMax = 0;
+  uint32_t forecastCycles = 0;          // and of computing this forecast
+
+  bool has(MLNowcastChannel channel) const { return (ready & (1u << channel)) != 0; }
+};
+
+/**
+ * The two filters, fed from the fused sources
+ */
+class MLNowcaster {
+public:
+  MLNowcaster();
+
+  void clear();
+
+  /**
+   * Take each channel's newest reading, if it is newer than the last one
+   * used and its source is fresh; O(1)
+   */
+  void update(const MLFusedFeatures& fused);
+
+  /**
+   * Forecast as of now
+   */
+  void forecast(uint32_t now, MLNowcast& out) const;
+
+private:
+  MLKalmanTrend filters[ML_NOWCAST_CHANNELS];
+  uint8_t sources[ML_NOWCAST_CHANNELS];
+  float noise[ML_NOWCAST_CHANNELS];     // Of the last reading used
+
+  void feed(MLNowcastChannel channel, const MLFusedFeatures& fused, MLFusedField field, MLInputSource source,
+            float readingNoise);
+};
+
+#endif // ML_NOWCAST_H
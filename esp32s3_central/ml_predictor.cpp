@@ -4,22 +4,396 @@
  */
 
 #include "ml_predictor.h"
+#include "data_logger.h"
+#include "ml_quant.h"
+#include "ml_model_int8.h"
+#include <LittleFS.h>
+#include <new>
 
-MLPredictor::MLPredictor() : historyIndex(0), historyFilled(0) {
-  memset(history, 0, sizeof(history));
+#define ML_MODEL_TEMP_FILE ML_MODEL_FILE ".tmp"
+#define ML_PATH_MAX 64
+#define ML_CSV_MAX_COLUMNS (LOG_MAX_CHANNELS + 1)
+#define ML_CSV_TIME_COLUMN -1           // Column map: the timestamp
+#define ML_CSV_IGNORED -2               //             not a weather channel
+#define ML_TREND_THRESHOLD 1.0f         // °C over the horizon that counts as rising / falling
+
+static_assert(ML_INT8_FEATURES == ML_FEATURE_COUNT - 1 && ML_INT8_HORIZON_S == ML_HORIZON_S,
+              "ml_model_int8.h was generated for other features: rerun tools/wxtrain");
+
+// Activations of the int8 model in use (loop() only): inference allocates nothing
+static MLQuantArena arena;
+
+/**
+ * A training run: its own window and model, so predictions keep using the
+ * current model until the run is complete
+ */
+struct MLTrainingJob {
+  enum Source : uint8_t { SOURCE_LOG, SOURCE_CSV, SOURCE_BINARY };
+
+  Source source;
+  MLFeatureWindow window;
+  MLOnlineModel model;
+  uint32_t cursor;                      // Log: next record time to read
+  uint32_t to;
+  char path[ML_PATH_MAX];               // File: path, next offset and size
+  uint32_t offset;
+  uint32_t fileSize;
+  uint8_t buffer[ML_READ_BUFFER + 1];   // File reads (+1: a CSV line is terminated in place)
+  size_t carried;                       // CSV: partial line at the start of buffer
+  bool skipLine;                        // CSV: rest of an overlong line
+  bool firstLine;
+  int8_t columns[ML_CSV_MAX_COLUMNS];   // CSV column -> WeatherChannel (or ML_CSV_*)
+  uint8_t columnCount;
+  LogSchema schema;                     // Binary: the file's
+  int8_t channels[WX_LOG_CHANNEL_COUNT];  // WeatherChannel -> file channel, -1 if absent
+  bool stopped;                         // Slice time was up inside readRange()
+  uint32_t sliceStart;                  // micros()
+  uint32_t records;
+  uint32_t examples;
+  uint32_t firstTime;
+  uint32_t lastTime;
+  uint64_t elapsedUs;
+  uint32_t slices;
+  uint32_t sliceMaxUs;
+  uint32_t heapStart;
+  uint32_t heapMin;
+
+  bool sliceOver() const { return micros() - sliceStart >= ML_TRAIN_SLICE_MS * 1000UL; }
+
+  void sampleHeap() {
+    uint32_t heap = ESP.getFreeHeap();
+    if (heap < heapMin) heapMin = heap;
+  }
+
+  /**
+   * One record, in time order: window, then every example it completes
+   */
+  void add(uint32_t time, const float* values, uint16_t validMask) {
+    float v[WX_LOG_CHANNEL_COUNT];
+    for (uint8_t i = 0; i < WX_LOG_CHANNEL_COUNT; i++) {
+      v[i] = (validMask & (1u << i)) ? values[i] : NAN;
+    }
+    records++;
+    if ((records & 0xFF) == 0) sampleHeap();
+
+    MLSample sample;
+    if (!mlSampleFrom(time, v[WX_LOG_PRESSURE], v[WX_LOG_TEMP_OUTDOOR], v[WX_LOG_HUMIDITY_OUTDOOR],
+                      v[WX_LOG_TEMP_INDOOR], v[WX_LOG_HUMIDITY_INDOOR], sample) ||
+        !window.add(sample)) {
+      return;
+    }
+    if (firstTime == 0) firstTime = time;
+    lastTime = time;
+
+    float features[ML_FEATURE_COUNT];
+    bool rain;
+    float tempChange;
+    while (window.nextExample(features, rain, tempChange)) {
+      model.train(features, rain, tempChange);
+      examples++;
+    }
+  }
+};
+
+/**
+ * readRange() callback: weather records straight from the partitions
+ */
+static bool trainOnRecord(const LogSchema& schema, const uint8_t* record, uint32_t time, void* context) {
+  MLTrainingJob& job = *static_cast<MLTrainingJob*>(context);
+  float values[LOG_MAX_CHANNELS];
+  uint16_t validMask;
+  if (schema.decode(record, time, values, validMask)) {
+    job.add(time, values, validMask);
+  }
+
+  job.cursor = time + 1;
+  if (job.sliceOver()) {
+    job.stopped = true;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Timestamp field: ISO 8601 (exportCSV()) or unix seconds
+ */
+static bool parseCsvTime(const char* text, uint32_t& time) {
+  if (parseIsoTime(text, time)) return true;
+  char* end;
+  unsigned long value = strtoul(text, &end, 10);
+  if (end == text || *end != '\0') return false;
+  time = value;
+  return true;
+}
+
+/**
+ * One CSV line, tokenized in place (the commas become terminators)
+ */
+static void trainOnCsvLine(MLTrainingJob& job, char* line) {
+  char* fields[ML_CSV_MAX_COLUMNS];
+  uint8_t count = 0;
+  for (char* p = line; count < ML_CSV_MAX_COLUMNS;) {
+    fields[count++] = p;
+    char* comma = strchr(p, ',');
+    if (!comma) break;
+    *comma = '\0';
+    p = comma + 1;
+  }
+  size_t lastLength = strlen(fields[count - 1]);
+  if (lastLength > 0 && fields[count - 1][lastLength - 1] == '\r') fields[count - 1][lastLength - 1] = '\0';
+
+  bool firstLine = job.firstLine;
+  job.firstLine = false;
+
+  // Header: map its columns by name (anything else keeps the log's column order)
+  uint32_t time = 0;
+  int timeColumn = -1;
+  for (uint8_t i = 0; i < job.columnCount; i++) {
+    if (job.columns[i] == ML_CSV_TIME_COLUMN) timeColumn = i;
+  }
+  if (timeColumn < 0 || timeColumn >= count || !parseCsvTime(fields[timeColumn], time)) {
+    if (!firstLine) return;
+    const LogSchema& weather = weatherLogSchema();
+    job.columnCount = count;
+    for (uint8_t i = 0; i < count; i++) {
+      int channel = weather.find(fields[i]);
+      job.columns[i] = strcmp(fields[i], "timestamp") == 0 ? ML_CSV_TIME_COLUMN
+                     : channel >= 0 ? channel : ML_CSV_IGNORED;
+    }
+    return;
+  }
+
+  float values[WX_LOG_CHANNEL_COUNT];
+  uint16_t validMask = 0;
+  for (uint8_t i = 0; i < count && i < job.columnCount; i++) {
+    int8_t channel = job.columns[i];
+    if (channel < 0 || fields[i][0] == '\0') continue;
+    char* end;
+    float value = strtof(fields[i], &end);
+    if (end == fields[i]) continue;
+    values[channel] = value;
+    validMask |= 1u << channel;
+  }
+  job.add(time, values, validMask);
+}
+
+MLPredictor::MLPredictor()
+  : logger(nullptr), job(nullptr), lastTraining(0), trainingAttempted(false), trainRequested(false),
+    compiledReady(false) {
+}
+
+void MLPredictor::begin(DataLogger* dataLogger) {
+  logger = dataLogger;
+
+  if (ML_COMPILED_MODEL) {
+    compiled.wrap(ML_INT8_MODEL, ML_INT8_CHECK_INPUT, ML_INT8_CHECK_OUTPUT, ML_INT8_CHECKS);
+    compiledReady = compiled.verify(ML_QUANT_SCALAR, arena);
+    Serial.println(compiledReady ? F("[ML] Compiled int8 model: check vectors match")
+                                 : F("[ML] Compiled int8 model: check vectors differ, not used"));
+  }
+
+  models.begin();
+  MLModelStoreStats stored;
+  models.getStats(stored);
+  if (stored.active != ML_MODEL_NO_SLOT) {
+    const MLModelSlotInfo& slot = stored.slots[stored.active];
+    Serial.print(F("[ML] Model file "));
+    Serial.print(slot.modelId);
+    Serial.print(F(" (slot "));
+    Serial.print(stored.active);
+    Serial.print(F(", "));
+    Serial.print(slot.bytes);
+    Serial.print(stored.mapped ? F(" bytes mapped from flash) loaded in ") : F(" bytes read into RAM) loaded in "));
+    Serial.print(stored.loadUs);
+    Serial.print(F(" us, "));
+    Serial.print(stored.residentBytes);
+    Serial.println(F(" bytes resident"));
+  }
+  benchmarkKernels();
+
+  if (loadModel()) {
+    const MLModelScore& score = model.getScore();
+    Serial.print(F("[ML] Model loaded: "));
+    Serial.print(score.examples);
+    Serial.print(F(" examples, Brier "));
+    Serial.print(score.brier, 3);
+    Serial.print(F(", temperature MAE "));
+    Serial.print(score.tempMae, 2);
+    Serial.println(F(" C"));
+  } else if (!int8Model()) {
+    Serial.println(F("[ML] Predictor initialized (rules until a model is trained)"));
+  }
 }
 
-void MLPredictor::begin() {
-  Serial.println(F("[ML] Predictor initialized"));
+const MLModelImage* MLPredictor::int8Model() const {
+  const MLModelImage* loaded = models.active();
+  if (loaded) return loaded;
+  return compiledReady ? &compiled : nullptr;
 }
 
-void MLPredictor::update(const SensorData& current) {
-  // Add current data to history
-  addHistoricalPoint(current);
+void MLPredictor::applyModelSwitch() {
+  if (!models.takePending()) return;
+
+  const MLModelImage* loaded = models.active();
+  if (loaded) {
+    Serial.print(F("[ML] Switched to model file "));
+    Serial.println(loaded->id());
+  } else {
+    Serial.println(F("[ML] Switched to the compiled model"));
+  }
+  // New weights, so the kernels are checked and timed again; then a prediction from them
+  benchmarkKernels();
+  update();
+}
+
+void MLPredictor::benchmarkKernels() {
+  const MLModelImage* image = int8Model();
+  MLKernelBenchmark bench;
+  if (image) {
+    const MLQuantModel& network = image->model();
+    bench.file = image != &compiled;
+    bench.modelId = image->id();
+    bench.macs = mlQuantMacs(network);
+    bench.simd = mlQuantHasVector();
+
+    // The check vectors cover a few inputs; random ones reach the clamps and rounding ties too
+    bench.exact = image->verify(ML_QUANT_VECTOR, arena);
+    uint8_t width = network.layers[0].inputs;
+    uint32_t seed = 0x2545F491;
+    for (uint16_t n = 0; bench.exact && n < ML_KERNEL_CROSSCHECK; n++) {
+      int8_t input[ML_QUANT_MAX_WIDTH];
+      int8_t scalar[ML_QUANT_OUTPUT_COUNT], vector[ML_QUANT_OUTPUT_COUNT];
+      for (uint8_t i = 0; i < width; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        input[i] = (int8_t)((int)(seed % 255) - 127);
+      }
+      mlQuantRun(network, input, scalar, arena, ML_QUANT_SCALAR);
+      mlQuantRun(network, input, vector, arena, ML_QUANT_VECTOR);
+      bench.exact = memcmp(scalar, vector, sizeof(scalar)) == 0;
+    }
+    bench.kernel = bench.simd && bench.exact ? ML_QUANT_VECTOR : ML_QUANT_SCALAR;
+
+    for (uint8_t k = 0; k < ML_QUANT_KERNEL_COUNT; k++) {
+      int8_t output[ML_QUANT_OUTPUT_COUNT];
+      uint32_t start = ESP.getCycleCount();
+      for (uint16_t n = 0; n < ML_KERNEL_BENCH_RUNS; n++) {
+        mlQuantRun(network, image->checkInput(n % image->checkCount()), output, arena, (MLQuantKernel)k);
+      }
+      bench.cycles[k] = (ESP.getCycleCount() - start) / ML_KERNEL_BENCH_RUNS;
+      bench.us[k] = (float)bench.cycles[k] / ESP.getCpuFreqMHz();
+    }
+
+    Serial.print(F("[ML] int8 kernels, "));
+    Serial.print(bench.macs);
+    Serial.print(F(" MACs: scalar "));
+    Serial.print(bench.us[ML_QUANT_SCALAR], 2);
+    Serial.print(F(" us ("));
+    Serial.print(bench.cyclesPerMac(ML_QUANT_SCALAR), 2);
+    Serial.print(F(" cycles/MAC), "));
+    if (bench.simd) {
+      Serial.print(F("SIMD "));
+      Serial.print(bench.us[ML_QUANT_VECTOR], 2);
+      Serial.print(F(" us ("));
+      Serial.print(bench.cyclesPerMac(ML_QUANT_VECTOR), 2);
+      Serial.println(bench.exact ? F(" cycles/MAC), using SIMD") : F(" cycles/MAC) differs from scalar, not used"));
+    } else {
+      Serial.println(F("no SIMD kernel in this build"));
+    }
+  }
+
+  portENTER_CRITICAL(&featuresLock);
+  kernels = bench;
+  portEXIT_CRITICAL(&featuresLock);
+}
+
+void MLPredictor::getKernelBenchmark(MLKernelBenchmark& out) const {
+  portENTER_CRITICAL(&featuresLock);
+  out = kernels;
+  portEXIT_CRITICAL(&featuresLock);
+}
+
+void MLPredictor::sample(const SensorData& data, uint32_t time) {
+  MLSourceReading indoor;
+  indoor.time = time;
+  indoor.temperature = data.temperature;
+  indoor.humidity = data.humidity;
+  indoor.pressure = data.pressure;
+  fusion.update(ML_INPUT_INDOOR, indoor);
+
+  // One value per channel from the first fresh source; a channel without one skips this sample
+  MLFusedFeatures fused;
+  fusion.fuse(time, fused);
+  store.add(time, fused.channels, fused.channelSource);
+  MLLiveFeatures current;
+  store.read(current);
+
+  // Readings newer than the filters have seen, then the hours ahead
+  MLNowcast forecast;
+  uint32_t start = ESP.getCycleCount();
+  nowcaster.update(fused);
+  uint32_t updated = ESP.getCycleCount();
+  nowcaster.forecast(time, forecast);
+  forecast.updateCycles = updated - start;
+  forecast.forecastCycles = ESP.getCycleCount() - updated;
+  forecast.updateCyclesMax = forecast.updateCycles > nowcast.updateCyclesMax ? forecast.updateCycles
+                                                                              : nowcast.updateCyclesMax;
+
+  portENTER_CRITICAL(&featuresLock);
+  fusedFeatures = fused;
+  liveFeatures = current;
+  nowcast = forecast;
+  portEXIT_CRITICAL(&featuresLock);
+}
+
+void MLPredictor::observeSource(MLInputSource source, const MLSourceReading& reading) {
+  fusion.update(source, reading);
+}
+
+void MLPredictor::getFusedFeatures(MLFusedFeatures& out) const {
+  portENTER_CRITICAL(&featuresLock);
+  out = fusedFeatures;
+  portEXIT_CRITICAL(&featuresLock);
+}
+
+void MLPredictor::getLiveFeatures(MLLiveFeatures& out) const {
+  portENTER_CRITICAL(&featuresLock);
+  out = liveFeatures;
+  portEXIT_CRITICAL(&featuresLock);
+}
+
+void MLPredictor::getNowcast(MLNowcast& out) const {
+  portENTER_CRITICAL(&featuresLock);
+  out = nowcast;
+  portEXIT_CRITICAL(&featuresLock);
+}
 
-  // Calculate predictions
-  lastPrediction.rainProbability = estimateRainProbability();
-  lastPrediction.temperatureTrend = calculateTemperatureTrend();
+void MLPredictor::update() {
+  // An uploaded model, else the station's once trained, else the compiled one; all need logged history
+  float features[ML_FEATURE_COUNT];
+  bool windowReady = live.latest(features);
+  const MLModelImage* loaded = models.active();
+  if (windowReady && loaded) {
+    predictInt8(*loaded, features);
+    lastPrediction.source = ML_SOURCE_FILE;
+  } else if (windowReady && model.isTrained()) {
+    lastPrediction.rainProbability = model.rainProbability(features) * 100.0f;
+    lastPrediction.temperatureChange = model.temperatureChange(features);
+    lastPrediction.source = ML_SOURCE_ONLINE;
+  } else if (windowReady && compiledReady) {
+    predictInt8(compiled, features);
+    lastPrediction.source = ML_SOURCE_COMPILED;
+  } else {
+    lastPrediction.rainProbability = estimateRainProbability();
+    lastPrediction.temperatureTrend = calculateTemperatureTrend();
+    lastPrediction.temperatureChange = 0;
+    lastPrediction.source = ML_SOURCE_RULES;
+  }
+  if (lastPrediction.source != ML_SOURCE_RULES) {
+    lastPrediction.temperatureTrend = lastPrediction.temperatureChange > ML_TREND_THRESHOLD ? 1
+                                    : lastPrediction.temperatureChange < -ML_TREND_THRESHOLD ? -1 : 0;
+  }
   lastPrediction.generalCondition = classifyWeather();
   lastPrediction.timestamp = millis();
 
@@ -27,28 +401,38 @@ void MLPredictor::update(const SensorData& current) {
     Serial.print(F("[ML] Rain prob: "));
     Serial.print(lastPrediction.rainProbability);
     Serial.print(F("% Condition: "));
-    Serial.println(lastPrediction.generalCondition);
+    Serial.print(lastPrediction.generalCondition);
+    Serial.println(lastPrediction.source == ML_SOURCE_ONLINE     ? F(" (model)")
+                   : lastPrediction.source == ML_SOURCE_COMPILED ? F(" (int8 model)")
+                   : lastPrediction.source == ML_SOURCE_FILE     ? F(" (int8 model file)")
+                                                                 : F(" (rules)"));
   }
 }
 
-void MLPredictor::addHistoricalPoint(const SensorData& data) {
-  history[historyIndex].pressure = data.pressure;
-  history[historyIndex].temperature = data.temperature;
-  history[historyIndex].humidity = data.humidity;
-  history[historyIndex].timestamp = millis();
+void MLPredictor::predictInt8(const MLModelImage& image, const float* features) {
+  const MLQuantModel& network = image.model();
+  int8_t input[ML_QUANT_MAX_WIDTH];
+  int8_t output[ML_QUANT_OUTPUT_COUNT];
+  mlQuantizeInput(network, features + 1, input);  // The network has its own biases
+  mlQuantRun(network, input, output, arena, kernels.kernel);
+  float logit = output[ML_QUANT_RAIN_LOGIT] * network.outputScale;
+  lastPrediction.rainProbability = 100.0f / (1.0f + expf(-logit));
+  lastPrediction.temperatureChange = output[ML_QUANT_TEMP_CHANGE] * network.outputScale;
+}
 
-  historyIndex = (historyIndex + 1) % 144;
-  if (historyFilled < 144) historyFilled++;
+void MLPredictor::observe(const CSVRecord& record) {
+  MLSample sample;
+  if (mlSampleFrom(record.timestamp, record.pressure, record.temp_outdoor, record.humidity_outdoor,
+                   record.temp_indoor, record.humidity_indoor, sample)) {
+    live.add(sample);
+  }
 }
 
 int MLPredictor::calculatePressureTrend() {
-  if (historyFilled < 12) return 0;  // Not enough data
+  if (!liveFeatures.has(ML_LIVE_PRESSURE_1H)) return 0;  // Not enough data
 
-  // Compare current pressure with 1 hour ago
-  float currentPressure = history[(historyIndex - 1 + 144) % 144].pressure;
-  float pressureHourAgo = history[(historyIndex - 12 + 144) % 144].pressure;
-
-  float delta = currentPressure - pressureHourAgo;
+  // Change over the last hour (least-squares fit, so one noisy reading does not flip it)
+  float delta = liveFeatures.pressureTrend1h;
 
   if (delta < -5.0) return -1;  // Falling rapidly = rain likely
   if (delta < -1.0) return -1;  // Falling
@@ -57,12 +441,10 @@ int MLPredictor::calculatePressureTrend() {
 }
 
 int MLPredictor::calculateTemperatureTrend() {
-  if (historyFilled < 6) return 0;
-
-  float currentTemp = history[(historyIndex - 1 + 144) % 144].temperature;
-  float tempBefore = history[(historyIndex - 6 + 144) % 144].temperature;
+  if (!liveFeatures.has(ML_LIVE_TEMP_30MIN)) return 0;
 
-  float delta = currentTemp - tempBefore;
+  // Change over the last 30 minutes
+  float delta = liveFeatures.temperatureTrend * 0.5f;
 
   if (delta > 0.5) return 1;   // Rising
   if (delta < -0.5) return -1; // Falling
@@ -70,7 +452,7 @@ int MLPredictor::calculateTemperatureTrend() {
 }
 
 float MLPredictor::estimateRainProbability() {
-  if (historyFilled < 12) return 0;
+  if (!liveFeatures.has(ML_LIVE_PRESSURE_1H)) return 0;
 
   float rainProb = 0;
 
@@ -80,12 +462,8 @@ float MLPredictor::estimateRainProbability() {
     rainProb += 40;  // 40% if pressure falling
   }
 
-  // Factor 2: Humidity (high humidity = rain possible)
-  float avgHumidity = 0;
-  for (int i = 0; i < historyFilled; i++) {
-    avgHumidity += history[i].humidity;
-  }
-  avgHumidity /= historyFilled;
+  // Factor 2: Humidity (high humidity = rain possible), over up to 12 hours
+  float avgHumidity = liveFeatures.humidityMean;
 
   if (avgHumidity > 75) {
     rainProb += (avgHumidity - 75) * 1.6;  // Up to 40% for very high humidity
@@ -97,6 +475,12 @@ float MLPredictor::estimateRainProbability() {
     rainProb += 20;
   }
 
+  // Factor 4: the forecast for the next 3 hours, while it is fresh
+  if (fusedFeatures.usable(ML_FUSED_FORECAST_RAIN)) {
+    float forecast = fusedFeatures.values[ML_FUSED_FORECAST_RAIN] * 100.0f;
+    rainProb = rainProb * (1.0f - ML_FORECAST_RAIN_WEIGHT) + forecast * ML_FORECAST_RAIN_WEIGHT;
+  }
+
   // Clamp to 0-100
   if (rainProb > 100) rainProb = 100;
   if (rainProb < 0) rainProb = 0;
@@ -118,9 +502,281 @@ String MLPredictor::classifyWeather() {
   }
 }
 
-void MLPredictor::trainFromCSV(const char* csvFileName) {
-  // TODO: Implement CSV loading and model training
-  // This would be called offline with historical data
-  Serial.print(F("[ML] Training from: "));
+// ============================================================================
+// Training
+// ============================================================================
+
+bool MLPredictor::startJob() {
+  if (job || !logger) return false;
+
+  uint32_t heapStart = ESP.getFreeHeap();
+  job = new (std::nothrow) MLTrainingJob();
+  if (!job) {
+    Serial.println(F("[ML] Not enough memory to train"));
+    return false;
+  }
+  job->heapStart = heapStart;
+  job->heapMin = ESP.getFreeHeap();
+
+  lastTraining = millis();
+  trainingAttempted = true;
+  trainRequested = false;
+
+  portENTER_CRITICAL(&trainingLock);
+  training.running = true;
+  portEXIT_CRITICAL(&trainingLock);
+  return true;
+}
+
+bool MLPredictor::trainFromLog(uint32_t from, uint32_t to) {
+  if (!startJob()) return false;
+  job->source = MLTrainingJob::SOURCE_LOG;
+  job->cursor = from;
+  job->to = to;
+
+  Serial.println(F("[ML] Training on the log..."));
+  return true;
+}
+
+bool MLPredictor::trainFromCSV(const char* csvFileName) {
+  if (strlen(csvFileName) >= ML_PATH_MAX || !startJob()) return false;
+  strcpy(job->path, csvFileName);
+
+  // A binary partition starts with its header; anything else is read as CSV
+  long n = logger->readFile(job->path, 0, job->buffer, LOG_MAX_HEADER_SIZE, job->fileSize);
+  if (n < 0) {
+    Serial.print(F("[ML] Cannot read training file: "));
+    Serial.println(csvFileName);
+    delete job;
+    job = nullptr;
+    portENTER_CRITICAL(&trainingLock);
+    training.running = false;
+    portEXIT_CRITICAL(&trainingLock);
+    return false;
+  }
+
+  if (job->schema.parse(job->buffer, n)) {
+    job->source = MLTrainingJob::SOURCE_BINARY;
+    job->offset = job->schema.headerSize();
+    const LogSchema& weather = weatherLogSchema();
+    for (uint8_t i = 0; i < WX_LOG_CHANNEL_COUNT; i++) {
+      job->channels[i] = job->schema.find(weather.channel(i).name);
+    }
+  } else {
+    job->source = MLTrainingJob::SOURCE_CSV;
+    job->offset = 0;
+    job->firstLine = true;
+    job->columnCount = WX_LOG_CHANNEL_COUNT + 1;
+    job->columns[0] = ML_CSV_TIME_COLUMN;
+    for (uint8_t i = 0; i < WX_LOG_CHANNEL_COUNT; i++) job->columns[i + 1] = i;
+  }
+
+  Serial.print(F("[ML] Training on "));
   Serial.println(csvFileName);
+  return true;
+}
+
+void MLPredictor::trainStep() {
+  if (!job) return;
+
+  job->sliceStart = micros();
+  bool more;
+  if (job->source == MLTrainingJob::SOURCE_LOG) {
+    job->stopped = false;
+    more = job->cursor <= job->to && logger->readRange(job->cursor, job->to, trainOnRecord, job) >= 0 && job->stopped;
+  } else {
+    do {
+      more = stepFile();
+    } while (more && !job->sliceOver());
+  }
+  job->sampleHeap();
+
+  uint32_t elapsed = micros() - job->sliceStart;
+  job->elapsedUs += elapsed;
+  job->slices++;
+  if (elapsed > job->sliceMaxUs) job->sliceMaxUs = elapsed;
+
+  if (!more) finishJob();
+}
+
+bool MLPredictor::stepFile() {
+  MLTrainingJob& j = *job;
+  if (j.offset >= j.fileSize) {
+    // The last line may have no newline
+    if (j.source == MLTrainingJob::SOURCE_CSV && j.carried > 0 && !j.skipLine) {
+      j.buffer[j.carried] = '\0';
+      trainOnCsvLine(j, (char*)j.buffer);
+    }
+    return false;
+  }
+
+  if (j.source == MLTrainingJob::SOURCE_BINARY) {
+    // Whole records per read
+    size_t recordSize = j.schema.recordSize();
+    size_t length = ML_READ_BUFFER / recordSize * recordSize;
+    long n = logger->readFile(j.path, j.offset, j.buffer, length, j.fileSize);
+    if (n < (long)recordSize) return false;
+
+    float values[LOG_MAX_CHANNELS];
+    float weather[WX_LOG_CHANNEL_COUNT];
+    for (long at = 0; at + (long)recordSize <= n; at += recordSize) {
+      const uint8_t* record = j.buffer + at;
+      if (j.schema.isUnwritten(record)) return false;  // Preallocated space: end of the data
+      uint32_t time;
+      uint16_t fileMask;
+      if (!j.schema.decode(record, time, values, fileMask)) continue;  // Torn or failed its CRC
+
+      uint16_t validMask = 0;
+      for (uint8_t i = 0; i < WX_LOG_CHANNEL_COUNT; i++) {
+        int8_t channel = j.channels[i];
+        if (channel >= 0 && (fileMask & (1u << channel))) {
+          weather[i] = values[channel];
+          validMask |= 1u << i;
+        }
+      }
+      j.add(time, weather, validMask);
+    }
+    j.offset += n / recordSize * recordSize;
+    return true;
+  }
+
+  // CSV: append to the partial line carried over, then train on each complete line in place
+  long n = logger->readFile(j.path, j.offset, j.buffer + j.carried, ML_READ_BUFFER - j.carried, j.fileSize);
+  if (n <= 0) return false;
+  j.offset += n;
+
+  char* text = (char*)j.buffer;
+  size_t length = j.carried + n;
+  size_t start = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] != '\n') continue;
+    text[i] = '\0';
+    if (!j.skipLine) trainOnCsvLine(j, text + start);
+    j.skipLine = false;
+    start = i + 1;
+  }
+
+  j.carried = length - start;
+  if (j.carried == ML_READ_BUFFER) {
+    // No newline in a whole buffer: not a line of ours
+    j.carried = 0;
+    j.skipLine = true;
+  } else if (start > 0 && j.carried > 0) {
+    memmove(j.buffer, j.buffer + start, j.carried);
+  }
+  return true;
+}
+
+void MLPredictor::finishJob() {
+  MLTrainingJob& j = *job;
+  bool trained = j.model.isTrained();  // Too little data would replace a model with a worse one
+  bool saved = false;
+
+  if (trained) {
+    model = j.model;
+    saved = saveModel(j.firstTime, j.lastTime);
+
+    // Its window ends at the newest record: predictions need not wait hours for history
+    if (j.source == MLTrainingJob::SOURCE_LOG && j.window.newestTime() > live.newestTime()) {
+      live = j.window;
+    }
+  }
+
+  const MLModelScore& score = j.model.getScore();
+  portENTER_CRITICAL(&trainingLock);
+  training.runs++;
+  training.running = false;
+  training.records = j.records;
+  training.examples = j.examples;
+  training.ms = j.elapsedUs / 1000;
+  training.slices = j.slices;
+  training.sliceMaxUs = j.sliceMaxUs;
+  training.heapPeak = j.heapStart > j.heapMin ? j.heapStart - j.heapMin : 0;
+  training.stateBytes = sizeof(MLTrainingJob);
+  training.trainedFrom = j.firstTime;
+  training.trainedTo = j.lastTime;
+  training.brier = score.brier;
+  training.tempMae = score.tempMae;
+  training.saved = saved;
+  MLTrainingStats report = training;
+  portEXIT_CRITICAL(&trainingLock);
+
+  delete job;
+  job = nullptr;
+
+  Serial.print(F("[ML] Training done: "));
+  Serial.print(report.records);
+  Serial.print(F(" records, "));
+  Serial.print(report.examples);
+  Serial.print(F(" examples in "));
+  Serial.print(report.ms);
+  Serial.print(F(" ms ("));
+  Serial.print(report.recordsPerSecond(), 0);
+  Serial.print(F(" records/s, longest slice "));
+  Serial.print(report.sliceMaxUs);
+  Serial.print(F(" us), heap peak "));
+  Serial.print(report.heapPeak);
+  Serial.print(F(" B ("));
+  Serial.print(report.stateBytes);
+  Serial.println(F(" B state)"));
+  if (trained) {
+    Serial.print(F("[ML] Brier "));
+    Serial.print(report.brier, 3);
+    Serial.print(F(", temperature MAE "));
+    Serial.print(report.tempMae, 2);
+    Serial.println(report.saved ? F(" C, model saved") : F(" C, model not saved"));
+  } else {
+    Serial.println(F("[ML] Too few examples: model unchanged"));
+  }
+}
+
+bool MLPredictor::retrainDue() const {
+  if (job || !logger) return false;
+  return trainRequested || !trainingAttempted || millis() - lastTraining >= ML_RETRAIN_INTERVAL_MS;
+}
+
+void MLPredictor::getTrainingStats(MLTrainingStats& out) const {
+  portENTER_CRITICAL(&trainingLock);
+  out = training;
+  portEXIT_CRITICAL(&trainingLock);
+}
+
+// ============================================================================
+// Model file
+// ============================================================================
+
+bool MLPredictor::loadModel() {
+  if (!LittleFS.begin()) return false;
+  File file = LittleFS.open(ML_MODEL_FILE, "r");
+  if (!file) return false;
+
+  size_t size = MLOnlineModel::storedSize();
+  uint8_t* data = new (std::nothrow) uint8_t[size];
+  bool ok = data && file.size() == size && file.read(data, size) == size;
+  file.close();
+
+  uint32_t trainedFrom, trainedTo;
+  ok = ok && model.restore(data, size, trainedFrom, trainedTo);
+  delete[] data;
+  if (!ok) {
+    model.reset();
+    Serial.println(F("[ML] Stored model unreadable or for other features: ignored"));
+  }
+  return ok;
+}
+
+bool MLPredictor::saveModel(uint32_t trainedFrom, uint32_t trainedTo) {
+  // In the job's read buffer; a temporary file then rename, so a reset never leaves half a model
+  size_t size = model.store(job->buffer, sizeof(job->buffer), trainedFrom, trainedTo);
+  if (size == 0 || !LittleFS.begin()) return false;
+
+  File file = LittleFS.open(ML_MODEL_TEMP_FILE, "w");
+  bool ok = file && file.write(job->buffer, size) == size;
+  file.close();
+  if (!ok) {
+    LittleFS.remove(ML_MODEL_TEMP_FILE);
+    return false;
+  }
+  // LittleFS replaces the old model in the rename itself: there is no moment without one
+  return LittleFS.rename(ML_MODEL_TEMP_FILE, ML_MODEL_FILE);
 }
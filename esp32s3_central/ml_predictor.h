@@ -9,6 +9,26 @@
 #include <Arduino.h>
 #include "config.h"
 #include "sensor_manager.h"
+#include "ml_model.h"
+#include "ml_quant.h"
+#include "ml_model_file.h"
+#include "ml_model_store.h"
+#include "ml_features.h"
+#include "ml_fusion.h"
+#include "ml_nowcast.h"
+
+class DataLogger;
+struct CSVRecord;
+
+/**
+ * What made a prediction
+ */
+enum MLPredictionSource : uint8_t {
+  ML_SOURCE_RULES,                  // No model yet, or too little history for its features
+  ML_SOURCE_ONLINE,                 // Model trained on the station (ml_model.h)
+  ML_SOURCE_COMPILED,               // int8 model in flash (ml_model_int8.h)
+  ML_SOURCE_FILE                    // int8 model uploaded at runtime (ml_model_store.h)
+};
 
 /**
  * Weather prediction data
@@ -16,27 +36,88 @@
 struct WeatherPrediction {
   float rainProbability = 0;        // 0-100%
   int temperatureTrend = 0;         // -1=falling, 0=stable, 1=rising
+  float temperatureChange = 0;      // °C expected over ML_HORIZON_S (model only)
+  MLPredictionSource source = ML_SOURCE_RULES;
   String generalCondition = "";     // "sunny", "cloudy", "rainy", "stormy"
   unsigned long timestamp = 0;
 };
 
 /**
- * Simple rule-based weather prediction
- * Can be enhanced with TinyML models trained on logged data
+ * Last training run (a run is sliced over loop() iterations)
+ */
+struct MLTrainingStats {
+  uint32_t runs = 0;
+  bool running = false;
+  uint32_t records = 0;             // Read by the last run
+  uint32_t examples = 0;            // Trained on (records with a full window around them)
+  uint32_t ms = 0;                  // Time spent in its slices
+  uint32_t slices = 0;
+  uint32_t sliceMaxUs = 0;          // Longest loop() stall
+  uint32_t heapPeak = 0;            // Most heap in use above the level it started at
+  uint32_t stateBytes = 0;          // Of that, window, models and read buffer
+  uint32_t trainedFrom = 0;         // Record times it covered
+  uint32_t trainedTo = 0;
+  float brier = 0;                  // Prequential scores (ml_model.h)
+  float tempMae = 0;
+  bool saved = false;               // Coefficients written to ML_MODEL_FILE
+
+  float recordsPerSecond() const { return ms ? records * 1000.0f / ms : 0.0f; }
+};
+
+/**
+ * The int8 model's kernels, measured at boot and when the model changes (per inference)
+ */
+struct MLKernelBenchmark {
+  bool file = false;                // Measured on the uploaded model, not the compiled one
+  uint32_t modelId = 0;             // Its id
+  uint32_t macs = 0;
+  uint32_t cycles[ML_QUANT_KERNEL_COUNT] = {};
+  float us[ML_QUANT_KERNEL_COUNT] = {};
+  bool simd = false;                // ML_QUANT_VECTOR is SIMD in this build
+  bool exact = false;               // It matched the scalar kernel bit for bit
+  MLQuantKernel kernel = ML_QUANT_SCALAR;  // The one predictions use
+
+  float cyclesPerMac(MLQuantKernel k) const { return macs ? (float)cycles[k] / macs : 0.0f; }
+};
+
+/**
+ * Weather prediction: an int8 model uploaded at runtime (ml_model_store.h)
+ * when one is selected, else online models trained on the log (ml_model.h),
+ * the int8 model compiled in (ml_model_int8.h) until they are, rules without any
  */
 class MLPredictor {
 public:
   MLPredictor();
 
   /**
-   * Initialize predictor
+   * Load the stored model
+   * @param logger card access for training (nullptr = no training)
+   */
+  void begin(DataLogger* logger = nullptr);
+
+  /**
+   * Feed the BME680's reading (every SENSOR_READ_INTERVAL): fuses every
+   * source as of time and adds the result to the live features and the
+   * nowcast
+   * @param time seconds on a monotonic clock (uptime)
    */
-  void begin();
+  void sample(const SensorData& data, uint32_t time);
 
   /**
-   * Update prediction based on current sensor data
+   * Newest reading of another source (exterior node, API observation or
+   * forecast), used from the next sample() on; O(1)
    */
-  void update(const SensorData& current);
+  void observeSource(MLInputSource source, const MLSourceReading& reading);
+
+  /**
+   * Predict from the features as they are now (any cadence, O(1) to read them)
+   */
+  void update();
+
+  /**
+   * Feed a logged record to the live feature window (every SD_LOG_INTERVAL)
+   */
+  void observe(const CSVRecord& record);
 
   /**
    * Get latest prediction
@@ -44,23 +125,95 @@ public:
   WeatherPrediction getPrediction() const { return lastPrediction; }
 
   /**
-   * Train model from CSV data (would be called offline)
+   * Start training a new model on a file on the card: CSV (exportCSV(),
+   * training data) or a binary day partition (.wxb). It streams through
+   * trainStep(); the model in use changes only once the run is complete.
+   * @return false if a run is in progress or the file cannot be read
+   */
+  bool trainFromCSV(const char* csvFileName);
+
+  /**
+   * Start training a new model on the log's records with from <= time <= to
+   */
+  bool trainFromLog(uint32_t from, uint32_t to);
+
+  /**
+   * Advance the run in progress by one slice (about ML_TRAIN_SLICE_MS);
+   * call from loop(). Finishes it, storing the model, at the end.
+   */
+  void trainStep();
+
+  /**
+   * True when the model should be retrained: none yet, ML_RETRAIN_INTERVAL_MS
+   * since the last run, or requestTraining()
+   */
+  bool retrainDue() const;
+
+  /**
+   * Retrain at the next retrainDue() check (from any task)
    */
-  void trainFromCSV(const char* csvFileName);
+  void requestTraining() { trainRequested = true; }
+
+  /**
+   * Switch to the model uploaded or rolled back to through getModelStore(),
+   * if one is pending; call from loop() (between predictions)
+   */
+  void applyModelSwitch();
+
+  bool isTrained() const { return model.isTrained(); }
+  bool hasCompiledModel() const { return compiledReady; }
+  MLModelStore& getModelStore() { return models; }
+
+  /**
+   * Copy of the kernel benchmark of the int8 model in use (from any task)
+   */
+  void getKernelBenchmark(MLKernelBenchmark& out) const;
+
+  /**
+   * Copy of the last run's statistics (from any task)
+   */
+  void getTrainingStats(MLTrainingStats& out) const;
+
+  /**
+   * Copy of the live features as of the last sample() (from any task)
+   */
+  void getLiveFeatures(MLLiveFeatures& out) const;
+
+  /**
+   * Copy of the fused sources as of the last sample() (from any task)
+   */
+  void getFusedFeatures(MLFusedFeatures& out) const;
+
+  /**
+   * Copy of the exterior temperature and pressure nowcast as of the last
+   * sample() (from any task)
+   */
+  void getNowcast(MLNowcast& out) const;
 
 private:
   WeatherPrediction lastPrediction;
+  DataLogger* logger;
+  MLOnlineModel model;
+  MLFeatureWindow live;                 // Logged records, for predictions
+  struct MLTrainingJob* job;            // Run in progress (heap), nullptr = none
+  MLTrainingStats training;
+  mutable portMUX_TYPE trainingLock = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t lastTraining;                // millis() at the last run start
+  bool trainingAttempted;
+  volatile bool trainRequested;
+  bool compiledReady;                   // ml_model_int8.h passed its check vectors
+  MLModelImage compiled;                // ml_model_int8.h
+  MLModelStore models;                  // Uploaded int8 models
+  MLKernelBenchmark kernels;            // Of the int8 model in use (written by loop() only)
 
-  // Historical data for trend analysis
-  struct HistoricalPoint {
-    float pressure;
-    float temperature;
-    float humidity;
-    unsigned long timestamp;
-  } history[144];  // 12 hours of 5-minute samples
-
-  uint8_t historyIndex;
-  uint8_t historyFilled;
+  // Trends for the rules, fed on every sensor read from the fused sources
+  MLFusion fusion;
+  MLFeatureStore store;
+  MLFusedFeatures fusedFeatures;        // As of the last sample() (written by loop() only)
+  MLLiveFeatures liveFeatures;
+  MLNowcaster nowcaster;                // Kalman filters on the exterior temperature and pressure
+  MLNowcast nowcast;
+  mutable portMUX_TYPE featuresLock = portMUX_INITIALIZER_UNLOCKED;
 
   /**
    * Calculate pressure trend (falling = rain)
@@ -83,9 +236,41 @@ private:
   String classifyWeather();
 
   /**
-   * Add data point to history
+   * Set up a run; the job then only needs its source filled in
+   */
+  bool startJob();
+
+  /**
+   * Read and train on the next part of a file job
+   * @return false at the end of the file
+   */
+  bool stepFile();
+
+  /**
+   * Swap the new model in, store it and report the run
+   */
+  void finishJob();
+
+  /**
+   * int8 model predictions use: the uploaded one, else the compiled one
+   * (nullptr: neither)
+   */
+  const MLModelImage* int8Model() const;
+
+  /**
+   * Predict with an int8 model
    */
-  void addHistoricalPoint(const SensorData& data);
+  void predictInt8(const MLModelImage& image, const float* features);
+
+  /**
+   * Time both kernels on the int8 model in use and pick the one to use: the
+   * SIMD kernel only if it passes the check vectors and matches the scalar
+   * kernel on ML_KERNEL_CROSSCHECK random inputs
+   */
+  void benchmarkKernels();
+
+  bool loadModel();
+  bool saveModel(uint32_t trainedFrom, uint32_t trainedTo);
 };
 
 #endif // ML_PREDICTOR_H
@@ -0,0 +1,131 @@
+/**
+ * @file ml_quant.cpp
+ * @brief int8 inference kernels
+ */
+
+#include "ml_quant.h"
+#include <math.h>
+#include <string.h>
+
+// esp-nn ships with ESP-IDF's component registry and the Arduino core's SDK;
+// its generic entry points pick the ESP32-S3 (PIE) kernels on that chip
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include(<esp_nn.h>)
+#include <esp_nn.h>
+#define ML_QUANT_ESP_NN 1
+#endif
+#endif
+
+#if defined(ML_QUANT_ESP_NN) && defined(CONFIG_IDF_TARGET_ESP32S3)
+#define ML_QUANT_SIMD 1
+#else
+#define ML_QUANT_SIMD 0
+#endif
+
+void mlQuantMultiplier(double real, int32_t& multiplier, int8_t& shift) {
+  // real = m * 2^exponent with 0.5 <= m < 1; Q31 of m, shift = exponent
+  int exponent;
+  double mantissa = frexp(real, &exponent);
+  int64_t q = (int64_t)llround(mantissa * 2147483648.0);
+  if (q == 2147483648LL) {
+    q /= 2;
+    exponent++;
+  }
+  multiplier = (int32_t)q;
+  shift = (int8_t)exponent;
+}
+
+/**
+ * (a * b) / 2^31, rounded half away from zero (gemmlowp's
+ * SaturatingRoundingDoublingHighMul)
+ */
+static int32_t roundingDoublingHighMul(int32_t a, int32_t b) {
+  if (a == INT32_MIN && b == INT32_MIN) return INT32_MAX;
+  int64_t product = (int64_t)a * b;
+  int64_t nudge = product >= 0 ? (1 << 30) : (1 - (1 << 30));
+  return (int32_t)((product + nudge) / ((int64_t)1 << 31));
+}
+
+/**
+ * x / 2^exponent, rounded half away from zero (gemmlowp's RoundingDivideByPOT)
+ */
+static int32_t roundingDivideByPOT(int32_t x, int exponent) {
+  if (exponent <= 0) return x;
+  int32_t mask = (int32_t)((1u << exponent) - 1);
+  int32_t remainder = x & mask;
+  int32_t threshold = (mask >> 1) + (x < 0 ? 1 : 0);
+  return (x >> exponent) + (remainder > threshold ? 1 : 0);
+}
+
+int8_t mlActivate(int32_t value, bool relu) {
+  int32_t low = relu ? 0 : -127;
+  if (value < low) value = low;
+  if (value > 127) value = 127;
+  return (int8_t)value;
+}
+
+int8_t mlRequantize(int32_t acc, int32_t multiplier, int8_t shift, bool relu) {
+  int left = shift > 0 ? shift : 0;
+  int32_t value = roundingDoublingHighMul((int32_t)((uint32_t)acc << left), multiplier);
+  return mlActivate(roundingDivideByPOT(value, shift > 0 ? 0 : -shift), relu);
+}
+
+void mlQuantizeInput(const MLQuantModel& model, const float* features, int8_t* out) {
+  uint8_t inputs = model.layers[0].inputs;
+  for (uint8_t i = 0; i < inputs; i++) {
+    float q = roundf(features[i] / model.inputScale);
+    if (!(q >= -127.0f)) q = -127.0f;  // Also NaN
+    if (q > 127.0f) q = 127.0f;
+    out[i] = (int8_t)q;
+  }
+}
+
+void mlDenseScalar(const MLQuantLayer& layer, const int8_t* input, int8_t* output) {
+  const int8_t* row = layer.weights;
+  for (uint8_t o = 0; o < layer.outputs; o++, row += layer.inputs) {
+    int32_t acc = layer.bias[o];
+    for (uint8_t i = 0; i < layer.inputs; i++) acc += (int32_t)row[i] * input[i];
+    output[o] = mlRequantize(acc, layer.multiplier, layer.shift, layer.relu);
+  }
+}
+
+void mlDenseVector(const MLQuantLayer& layer, const int8_t* input, int8_t* output) {
+#if ML_QUANT_SIMD
+  // Symmetric quantization: every zero point is 0; the activation is the clamp
+  esp_nn_fully_connected_s8(input, 0, layer.inputs, layer.weights, 0, layer.bias, output, layer.outputs, 0,
+                            layer.shift, layer.multiplier, layer.relu ? 0 : -127, 127);
+#else
+  mlDenseScalar(layer, input, output);
+#endif
+}
+
+bool mlQuantHasVector() {
+  return ML_QUANT_SIMD;
+}
+
+uint32_t mlQuantMacs(const MLQuantModel& model) {
+  uint32_t macs = 0;
+  for (uint8_t l = 0; l < model.layerCount; l++) {
+    macs += (uint32_t)model.layers[l].inputs * model.layers[l].outputs;
+  }
+  return macs;
+}
+
+bool mlQuantRun(const MLQuantModel& model, const int8_t* input, int8_t* output, MLQuantArena& arena,
+                MLQuantKernel kernel) {
+  const int8_t* in = input;
+
+  for (uint8_t l = 0; l < model.layerCount; l++) {
+    const MLQuantLayer& layer = model.layers[l];
+    if (layer.outputs > ML_QUANT_MAX_WIDTH) return false;
+    int8_t* out = l + 1 == model.layerCount ? output : arena.activations[l & 1];
+
+    if (kernel == ML_QUANT_VECTOR) {
+      mlDenseVector(layer, in, out);
+    } else {
+      mlDenseScalar(layer, in, out);
+    }
+    in = out;
+  }
+  return true;
+}
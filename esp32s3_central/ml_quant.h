@@ -0,0 +1,146 @@
+/**
+ * @file ml_quant.h
+ * @brief int8 inference for the model compiled into the firmware (generated by tools/wxtrain)
+ *
+ * A small dense network over MLFeatureWindow's features, quantized with
+ * one scale per layer:
+ *
+ *   input   x_q = round(x / inputScale), clamped to -127..127
+ *   layer   acc = bias + sum(w_q * x_q)              (int32)
+ *           y_q = acc * multiplier / 2^31 * 2^shift, rounded, clamped
+ *                 (to 0..127 after ReLU, -127..127 otherwise)
+ *   output  y = y_q * outputScale
+ *
+ * multiplier / 2^31 * 2^shift is inputScale_l * weightScale_l / outputScale_l,
+ * so everything between the input and the output is integer arithmetic and
+ * gives the same bits on the host and on the station. The rounding is
+ * TensorFlow Lite's (a rounding doubling high multiply, then a rounding
+ * right shift), which is what esp-nn's kernels implement.
+ *
+ * Two kernels run a dense layer with its activation:
+ * - scalar: plain loops, builds anywhere; the reference
+ * - vector: esp-nn's fully connected kernel, which on the ESP32-S3 uses the
+ *   PIE SIMD instructions (16 int8 multiply-accumulates per instruction).
+ *   Only there; elsewhere it is the scalar kernel.
+ * Accumulation is exact int32 in both and requantization is the same
+ * arithmetic, so they agree bit for bit; MLPredictor still compares them at
+ * boot before it uses the vector kernel.
+ *
+ * Activations live in an MLQuantArena the caller owns (static in
+ * MLPredictor): inference allocates nothing.
+ *
+ * tools/wxtrain uses this file to score the quantized model and to compute
+ * the check vectors it writes next to the weights; the station runs them at
+ * boot, tools/mlbench on the host.
+ *
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef ML_QUANT_H
+#define ML_QUANT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ML_QUANT_MAX_WIDTH 32           // Widest layer (activations)
+#define ML_QUANT_MAX_LAYERS 4
+
+/**
+ * One dense layer, weights row-major (outputs x inputs)
+ */
+struct MLQuantLayer {
+  uint8_t inputs;
+  uint8_t outputs;
+  const int8_t* weights;
+  const int32_t* bias;                  // At inputScale * weightScale
+  int32_t multiplier;                   // Requantization, Q31 (2^30 .. 2^31 - 1)
+  int8_t shift;                         // Then times 2^shift (negative: a right shift)
+  bool relu;
+};
+
+/**
+ * A whole network
+ */
+struct MLQuantModel {
+  uint8_t layerCount;
+  const MLQuantLayer* layers;
+  float inputScale;
+  float outputScale;                    // Last layer's activations
+};
+
+/**
+ * Model outputs, in order
+ */
+enum MLQuantOutput : uint8_t {
+  ML_QUANT_RAIN_LOGIT,                  // Rain within the horizon (logit)
+  ML_QUANT_TEMP_CHANGE,                 // Temperature change over it (°C)
+  ML_QUANT_OUTPUT_COUNT
+};
+
+/**
+ * Dense layer implementations
+ */
+enum MLQuantKernel : uint8_t {
+  ML_QUANT_SCALAR,
+  ML_QUANT_VECTOR,                      // Scalar where there is no SIMD kernel
+  ML_QUANT_KERNEL_COUNT
+};
+
+/**
+ * Activations between layers, 16-byte aligned for the SIMD loads
+ */
+struct MLQuantArena {
+  alignas(16) int8_t activations[2][ML_QUANT_MAX_WIDTH];
+};
+
+/**
+ * Scale a real multiplier (0 < real < 1) to Q31 and a shift
+ */
+void mlQuantMultiplier(double real, int32_t& multiplier, int8_t& shift);
+
+/**
+ * Requantize one accumulator (TensorFlow Lite rounding, then clamp)
+ */
+int8_t mlRequantize(int32_t acc, int32_t multiplier, int8_t shift, bool relu);
+
+/**
+ * Activation: clamp requantized values to the layer's output range
+ * (0..127 after ReLU, -127..127 otherwise)
+ */
+int8_t mlActivate(int32_t value, bool relu);
+
+/**
+ * Dense layer and its activation, plain loops
+ */
+void mlDenseScalar(const MLQuantLayer& layer, const int8_t* input, int8_t* output);
+
+/**
+ * Dense layer and its activation, SIMD where available (mlQuantHasVector())
+ */
+void mlDenseVector(const MLQuantLayer& layer, const int8_t* input, int8_t* output);
+
+/**
+ * True if ML_QUANT_VECTOR is a SIMD kernel in this build (esp-nn on the ESP32-S3)
+ */
+bool mlQuantHasVector();
+
+/**
+ * Multiply-accumulates per inference (the benchmark's unit of work)
+ */
+uint32_t mlQuantMacs(const MLQuantModel& model);
+
+/**
+ * Quantize features (float) to the model's input
+ */
+void mlQuantizeInput(const MLQuantModel& model, const float* features, int8_t* out);
+
+/**
+ * Run the network
+ * @param output the last layer's outputs
+ * @param arena activations between layers
+ * @return false if the model does not fit the arena
+ */
+bool mlQuantRun(const MLQuantModel& model, const int8_t* input, int8_t* output, MLQuantArena& arena,
+                MLQuantKernel kernel = ML_QUANT_SCALAR);
+
+#endif // ML_QUANT_H
@@ -0,0 +1,117 @@
+/**
+ * @file node_registry.cpp
+ * @brief Node registry implementation
+ */
+
+#include "node_registry.h"
+#include <string.h>
+#include <stdio.h>
+
+static_assert((NODE_REGISTRY_CAPACITY & (NODE_REGISTRY_CAPACITY - 1)) == 0,
+              "NODE_REGISTRY_CAPACITY must be a power of two");
+static_assert(NODE_REGISTRY_CAPACITY <= 256, "order[] stores slot indices as uint8_t");
+
+NodeRegistry::NodeRegistry() {
+  clear();
+}
+
+void NodeRegistry::clear() {
+  for (size_t i = 0; i < NODE_REGISTRY_CAPACITY; i++) {
+    slots[i] = NodeEntry();
+    used[i] = false;
+    order[i] = 0;
+  }
+  count = 0;
+}
+
+uint32_t NodeRegistry::hashMac(const uint8_t* mac) {
+  // FNV-1a over the 6 address bytes
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < 6; i++) {
+    hash ^= mac[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+int NodeRegistry::probe(const uint8_t* mac) const {
+  const uint32_t mask = NODE_REGISTRY_CAPACITY - 1;
+  uint32_t index = hashMac(mac) & mask;
+
+  // Nodes are never removed individually, so the first free slot ends the chain
+  for (size_t i = 0; i < NODE_REGISTRY_CAPACITY; i++) {
+    if (!used[index] || memcmp(slots[index].mac, mac, 6) == 0) {
+      return (int)index;
+    }
+    index = (index + 1) & mask;
+  }
+
+  return -1;
+}
+
+NodeEntry* NodeRegistry::update(const uint8_t* mac, const char* nodeType, const NodeReading& reading,
+                                uint32_t sequence, int8_t rssi, uint32_t now, uint32_t samples,
+                                uint32_t firstSample) {
+  int index = probe(mac);
+  if (index < 0) return nullptr;
+
+  NodeEntry& entry = slots[index];
+
+  if (!used[index]) {
+    used[index] = true;
+    entry = NodeEntry();
+    entry.slot = (uint8_t)count;
+    order[count++] = (uint8_t)index;
+    memcpy(entry.mac, mac, 6);
+    entry.firstSeen = now;
+  } else {
+    if (sequence > entry.lastSequence + 1) {
+      // Gap in the sequence = packets lost in the air
+      entry.lossCount += sequence - entry.lastSequence - 1;
+    }
+    if (firstSample > entry.nextSample) {
+      // Gap in the sample numbering = samples lost end to end (air or node buffer)
+      entry.samplesLost += firstSample - entry.nextSample;
+    }
+  }
+  // Going backwards means the node rebooted and restarted its counters
+
+  strncpy(entry.nodeType, nodeType, NODE_TYPE_MAX_LEN - 1);
+  entry.nodeType[NODE_TYPE_MAX_LEN - 1] = '\0';
+  entry.latest = reading;
+  entry.lastSequence = sequence;
+  entry.nextSample = firstSample + samples;
+  entry.lastSeen = now;
+  entry.packetCount++;
+  entry.sampleCount += samples;
+  if (rssi != 0) entry.rssi = rssi;
+
+  return &entry;
+}
+
+NodeEntry* NodeRegistry::find(const uint8_t* mac) {
+  int index = probe(mac);
+  if (index < 0 || !used[index]) return nullptr;
+  return &slots[index];
+}
+
+const NodeEntry* NodeRegistry::find(const uint8_t* mac) const {
+  int index = probe(mac);
+  if (index < 0 || !used[index]) return nullptr;
+  return &slots[index];
+}
+
+const NodeEntry* NodeRegistry::findByType(const char* nodeType) const {
+  for (size_t i = 0; i < count; i++) {
+    const NodeEntry& entry = slots[order[i]];
+    if (strncmp(entry.nodeType, nodeType, NODE_TYPE_MAX_LEN) == 0) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void NodeRegistry::formatMac(const uint8_t* mac, char* out) {
+  snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+           mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
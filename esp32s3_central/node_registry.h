@@ -0,0 +1,158 @@
+/**
+ * @file node_registry.h
+ * @brief Fixed-capacity registry of remote ESP-NOW nodes keyed by MAC
+ *
+ * Open-addressing hash table (linear probing) sized at compile time, so
+ * updates from the ESP-NOW receive callback are O(1) and never allocate.
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef NODE_REGISTRY_H
+#define NODE_REGISTRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Must be a power of two; 32 slots keep the table under ~65% load at 20 nodes
+#ifndef NODE_REGISTRY_CAPACITY
+#define NODE_REGISTRY_CAPACITY 32
+#endif
+
+#define NODE_TYPE_MAX_LEN 16
+#define NODE_OFFLINE_TIMEOUT 600000  // 10 minutes without packets = offline
+
+/**
+ * Latest sensor values reported by a node
+ */
+struct NodeReading {
+  float temperature = 0;
+  float humidity = 0;
+  float pressure = 0;
+  float light = 0;
+  uint32_t remoteTimestamp = 0;  // Node-side millis() when sampled
+  uint8_t channelMask = 0;       // Which of the values above the node measures
+};
+
+/**
+ * One decoded sample from a batch, queued for the time series / logger
+ */
+struct NodeSample {
+  uint8_t mac[6] = {0};
+  char nodeType[NODE_TYPE_MAX_LEN] = {0};
+  uint32_t timestamp = 0;        // Central millis() when the sample was taken
+  NodeReading reading;
+};
+
+/**
+ * One registered remote node
+ */
+struct NodeEntry {
+  uint8_t mac[6] = {0};
+  char nodeType[NODE_TYPE_MAX_LEN] = {0};  // "interior", "exterior", room name...
+  NodeReading latest;
+
+  uint32_t lastSeen = 0;       // Central millis() of last valid packet
+  uint32_t firstSeen = 0;
+  uint32_t packetCount = 0;    // Valid packets received
+  uint32_t sampleCount = 0;    // Samples carried by those packets
+  uint32_t lossCount = 0;      // Packets missing from the sequence
+  uint32_t lastSequence = 0;
+  uint32_t samplesLost = 0;    // Samples the node took that never arrived (numbering gaps)
+  uint32_t nextSample = 0;     // Sample number expected at the start of the next batch
+  uint32_t retryCount = 0;     // Batches that only got through on a retransmission
+  uint32_t duplicateCount = 0; // Retransmissions of batches already received (ACK lost)
+  uint16_t sendWakeMs = 0;     // Node's awake time for a transmit cycle, 0 = unknown
+  uint16_t readWakeMs = 0;     // Node's awake time for a read-only cycle
+  int8_t rssi = 0;             // dBm of the last packet, 0 = unknown
+
+  uint8_t slot = 0;            // TDMA slot (assigned in arrival order)
+  uint32_t slotMisses = 0;     // Scheduled transmits that missed their slot
+  int32_t slotErrorMs = 0;     // Last packet's distance from its slot start
+
+  bool isOnline(uint32_t now) const {
+    return packetCount > 0 && (now - lastSeen) < NODE_OFFLINE_TIMEOUT;
+  }
+
+  /**
+   * Fraction of packets lost since first contact (0.0 - 1.0)
+   */
+  float lossRatio() const {
+    uint32_t expected = packetCount + lossCount;
+    return expected ? (float)lossCount / expected : 0.0f;
+  }
+
+  /**
+   * End-to-end fraction of the node's samples that reached the central (0.0 - 1.0)
+   */
+  float deliveryRatio() const {
+    uint32_t expected = sampleCount + samplesLost;
+    return expected ? (float)sampleCount / expected : 1.0f;
+  }
+};
+
+/**
+ * Node registry: O(1) lookup/insert by MAC, stable iteration in arrival order
+ */
+class NodeRegistry {
+public:
+  NodeRegistry();
+
+  /**
+   * Record a packet from a node, inserting it on first contact
+   * @param firstSample node-side number of the packet's first sample
+   * @return entry, or nullptr if the registry is full
+   */
+  NodeEntry* update(const uint8_t* mac, const char* nodeType, const NodeReading& reading,
+                    uint32_t sequence, int8_t rssi, uint32_t now, uint32_t samples = 1,
+                    uint32_t firstSample = 0);
+
+  /**
+   * Find a node by MAC address
+   */
+  NodeEntry* find(const uint8_t* mac);
+  const NodeEntry* find(const uint8_t* mac) const;
+
+  /**
+   * Find the first node reporting the given type (e.g. "exterior")
+   */
+  const NodeEntry* findByType(const char* nodeType) const;
+
+  /**
+   * Number of registered nodes
+   */
+  size_t size() const { return count; }
+
+  /**
+   * Registered nodes in arrival order, index 0..size()-1
+   */
+  NodeEntry& at(size_t index) { return slots[order[index]]; }
+  const NodeEntry& at(size_t index) const { return slots[order[index]]; }
+
+  static constexpr size_t capacity() { return NODE_REGISTRY_CAPACITY; }
+
+  /**
+   * Remove all nodes
+   */
+  void clear();
+
+  /**
+   * Format a MAC as "AA:BB:CC:DD:EE:FF" (buffer must hold 18 bytes)
+   */
+  static void formatMac(const uint8_t* mac, char* out);
+
+private:
+  NodeEntry slots[NODE_REGISTRY_CAPACITY];
+  bool used[NODE_REGISTRY_CAPACITY];
+  uint8_t order[NODE_REGISTRY_CAPACITY];  // Slot indices in arrival order
+  size_t count;
+
+  static uint32_t hashMac(const uint8_t* mac);
+
+  /**
+   * Probe for the slot holding mac, or the first free slot on the way
+   * @return slot index, or -1 if the table is full and mac is absent
+   */
+  int probe(const uint8_t* mac) const;
+};
+
+#endif // NODE_REGISTRY_H
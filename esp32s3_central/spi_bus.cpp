@@ -0,0 +1,23 @@
+/**
+ * @file spi_bus.cpp
+ * @brief SPI bus lock
+ */
+
+#include "spi_bus.h"
+
+/**
+ * The bus mutex, created on first use (thread-safe static initialisation),
+ * so neither the display nor the logger depends on which starts first
+ */
+static SemaphoreHandle_t busMutex() {
+  static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  return mutex;
+}
+
+void spiBusLock() {
+  xSemaphoreTake(busMutex(), portMAX_DELAY);
+}
+
+void spiBusUnlock() {
+  xSemaphoreGive(busMutex());
+}
@@ -0,0 +1,30 @@
+/**
+ * @file spi_bus.h
+ * @brief Arbitration of the SPI bus shared by the displays, touch and SD card
+ *
+ * The three displays, their XPT2046 touch controllers and the SD card hang
+ * off one SPI bus (config.h). loop() draws and reads touch on core 1 while
+ * the log drain and retention tasks write the card on core 0, so once they
+ * run every transfer - and the card's re-initialisation - happens with the
+ * bus lock held. A device's chip select is only driven low while its owner
+ * holds the lock, so the bus is never left addressed to one device between
+ * transfers.
+ */
+
+#ifndef SPI_BUS_H
+#define SPI_BUS_H
+
+#include <Arduino.h>
+
+/**
+ * Wait for the bus (any task; not from an ISR). Not recursive: take it
+ * once per transfer sequence and give it back with spiBusUnlock()
+ */
+void spiBusLock();
+
+/**
+ * Give the bus back
+ */
+void spiBusUnlock();
+
+#endif // SPI_BUS_H
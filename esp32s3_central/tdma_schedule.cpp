@@ -0,0 +1,36 @@
+/**
+ * @file tdma_schedule.cpp
+ * @brief TDMA slot plan implementation
+ */
+
+#include "tdma_schedule.h"
+
+TdmaSchedule::TdmaSchedule(uint32_t frameMs, uint16_t slotCount, uint32_t guardMs, uint32_t minLeadMs)
+    : frame(frameMs), slots(slotCount ? slotCount : 1), guard(guardMs), minLead(minLeadMs) {
+  spacing = frame / slots;
+}
+
+uint32_t TdmaSchedule::phase(uint16_t slot, uint32_t now) const {
+  // Work modulo the frame so millis() wrap-around only costs one misaligned frame
+  uint32_t offset = (uint32_t)(slot % slots) * spacing;
+  return (now % frame + frame - offset) % frame;
+}
+
+uint32_t TdmaSchedule::untilSlot(uint16_t slot, uint32_t now) const {
+  uint32_t elapsed = phase(slot, now);
+  uint32_t until = elapsed ? frame - elapsed : 0;
+  while (until < minLead) {
+    until += frame;
+  }
+  return until;
+}
+
+int32_t TdmaSchedule::slotError(uint16_t slot, uint32_t now) const {
+  uint32_t elapsed = phase(slot, now);
+  return elapsed < frame / 2 ? (int32_t)elapsed : (int32_t)elapsed - (int32_t)frame;
+}
+
+bool TdmaSchedule::inSlot(uint16_t slot, uint32_t now) const {
+  int32_t error = slotError(slot, now);
+  return (uint32_t)(error < 0 ? -error : error) <= guard;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file tdma_schedule.h
+ * @brief TDMA slot plan for remote-node transmissions
+ *
+ * The central clock (millis()) is the time base. A frame is one node
+ * transmit period; slot s starts at k * frameMs + s * (frameMs / slotCount).
+ * Slots are spread over the whole frame rather than packed, so even a node
+ * whose sleep timer drifted by seconds stays clear of its neighbours.
+ * Kept free of Arduino dependencies so it can also be built on the host.
+ */
+
+#ifndef TDMA_SCHEDULE_H
+#define TDMA_SCHEDULE_H
+
+#include <stdint.h>
+
+class TdmaSchedule {
+public:
+  /**
+   * @param frameMs   transmit period of every node
+   * @param slotCount slots per frame (one per node)
+   * @param guardMs   max distance from the slot start still counted as on-slot
+   * @param minLeadMs never hand out a slot starting sooner than this
+   */
+  TdmaSchedule(uint32_t frameMs, uint16_t slotCount, uint32_t guardMs, uint32_t minLeadMs);
+
+  uint32_t frameMs() const { return frame; }
+  uint16_t slotCount() const { return slots; }
+  uint32_t slotSpacing() const { return spacing; }
+
+  /**
+   * Time from now until the next start of slot that is at least minLeadMs away
+   */
+  uint32_t untilSlot(uint16_t slot, uint32_t now) const;
+
+  /**
+   * Signed distance (ms) of now from the nearest start of slot (negative = early)
+   */
+  int32_t slotError(uint16_t slot, uint32_t now) const;
+
+  /**
+   * True if now is within guardMs of a start of slot
+   */
+  bool inSlot(uint16_t slot, uint32_t now) const;
+
+private:
+  uint32_t frame;
+  uint16_t slots;
+  uint32_t spacing;
+  uint32_t guard;
+  uint32_t minLead;
+
+  /**
+   * Time elapsed since the last start of slot (0..frame-1)
+   */
+  uint32_t phase(uint16_t slot, uint32_t now) const;
+};
+
+#endif // TDMA_SCHEDULE_H
@@ -4,6 +4,8 @@
  */
 
 #include "touch_handler.h"
+#include <SPI.h>
+#include "spi_bus.h"
 
 TouchHandler::TouchHandler() : enabled_(false) {}
 
@@ -60,8 +62,9 @@ TouchEvent TouchHandler::readTouch(uint8_t display) {
     return event;  // Return empty event
   }
 
-  // Select the appropriate CS pin
+  // Select the appropriate CS pin, with the bus to ourselves (the SD card shares it)
   static const uint8_t csPin[] = {TOUCH_1_CS, TOUCH_2_CS, TOUCH_3_CS};
+  spiBusLock();
   digitalWrite(csPin[display], LOW);
   delayMicroseconds(10);
 
@@ -80,6 +83,7 @@ TouchEvent TouchHandler::readTouch(uint8_t display) {
 
   SPI.endTransaction();
   digitalWrite(csPin[display], HIGH);
+  spiBusUnlock();
 
   // Convert to display coordinates
   calibrateCoordinates(display, rawX, rawY);
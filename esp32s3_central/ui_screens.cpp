@@ -5,6 +5,8 @@
 
 #include "ui_screens.h"
 #include "display_manager.h"
+#include "espnow_receiver.h"
+#include "ml_nowcast.h"
 
 UIScreens::UIScreens() : displayMgr(nullptr) {}
 
@@ -12,7 +14,7 @@ void UIScreens::setDisplayManager(DisplayManager* dm) {
   displayMgr = dm;
 }
 
-void UIScreens::drawMainScreen(const SensorData& local, const RemoteSensorData& remote, const WeatherData& weather) {
+void UIScreens::drawMainScreen(const SensorData& local, const ESPNowReceiver& remote, const WeatherData& weather) {
   if (displayMgr == nullptr) return;
 
   // Clear all displays
@@ -24,7 +26,7 @@ void UIScreens::drawMainScreen(const SensorData& local, const RemoteSensorData&
   drawDisplay3();
 }
 
-void UIScreens::drawDisplay1(const SensorData& local, const RemoteSensorData& remote) {
+void UIScreens::drawDisplay1(const SensorData& local, const ESPNowReceiver& remote) {
   if (displayMgr == nullptr) return;
 
   displayMgr->selectDisplay(0);
@@ -56,24 +58,44 @@ void UIScreens::drawDisplay1(const SensorData& local, const RemoteSensorData& re
   displayMgr->print(F("IAQ: "));
   displayMgr->print(local.iaq);
 
-  // Secondary room
+  // Remote nodes, one line each (as many as fit above the status row)
   displayMgr->setCursor(10, 160);
-  displayMgr->print(F("Indoor Sec:"));
-  displayMgr->setCursor(10, 180);
-  displayMgr->print(F("T: "));
-  displayMgr->print(remote.temp_interior, 1);
-  displayMgr->print(F("C"));
+  displayMgr->print(F("Remote Nodes:"));
 
-  displayMgr->setCursor(10, 200);
-  displayMgr->print(F("H: "));
-  displayMgr->print(remote.humidity_interior, 0);
-  displayMgr->print(F("%"));
+  uint32_t now = millis();
+  bool allOnline = true;
+  size_t nodeCount = remote.getNodeCount();
+
+  for (size_t i = 0; i < nodeCount; i++) {
+    NodeEntry node;
+    if (!remote.getNode(i, node)) break;
+
+    bool online = node.isOnline(now);
+    if (!online) allOnline = false;
+
+    int16_t y = 175 + i * 12;
+    if (y > 210) continue;  // Keep counting offline nodes for the status row
+
+    displayMgr->setCursor(10, y);
+    displayMgr->setTextColor(online ? 0xFFFF : 0x7BEF, 0x0000);  // Grey when offline
+    displayMgr->print(node.nodeType);
+    displayMgr->print(F(" "));
+    displayMgr->print(node.latest.temperature, 1);
+    displayMgr->print(F("C "));
+    displayMgr->print(node.latest.humidity, 0);
+    displayMgr->print(F("%"));
+  }
 
   // Status indicators
   displayMgr->setTextSize(1);
   displayMgr->setCursor(240, 220);
-  displayMgr->setTextColor(0x00FF00, 0x0000);  // Green for online
-  displayMgr->print(F("OK"));
+  if (nodeCount > 0 && allOnline) {
+    displayMgr->setTextColor(0x07E0, 0x0000);  // Green for online
+    displayMgr->print(F("OK"));
+  } else {
+    displayMgr->setTextColor(0xFFE0, 0x0000);  // Yellow: missing nodes
+    displayMgr->print(F("NODES"));
+  }
 }
 
 void UIScreens::drawDisplay2(const WeatherData& weather) {
@@ -149,7 +171,7 @@ void UIScreens::drawDisplay3() {
   displayMgr->print(F("HOME"));
 }
 
-void UIScreens::drawForecastScreen(const WeatherData& weather) {
+void UIScreens::drawForecastScreen(const WeatherData& weather, const MLNowcast& nowcast) {
   if (displayMgr == nullptr) return;
 
   displayMgr->selectDisplay(1);
@@ -179,6 +201,38 @@ void UIScreens::drawForecastScreen(const WeatherData& weather) {
     displayMgr->print(weather.forecastRain[i] * 100, 0);
     displayMgr->print(F("%"));
   }
+
+  // Station nowcast: value and one standard deviation per hour, grey until the filter has warmed up
+  displayMgr->setCursor(10, 110);
+  displayMgr->print(F("Station nowcast"));
+  displayMgr->drawLine(10, 125, 310, 125, 0x4208);
+
+  for (int i = 0; i < ML_NOWCAST_HOURS; i++) {
+    int xPos = 10 + (i * 50);
+    int yPos = 135;
+
+    displayMgr->setTextColor(0xFFFF, 0x0000);
+    displayMgr->setCursor(xPos, yPos);
+    displayMgr->print(F("+"));
+    displayMgr->print(i + 1);
+    displayMgr->print(F("h"));
+
+    for (int c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+      int row = yPos + 15 + c * 30;
+      displayMgr->setTextColor(nowcast.has((MLNowcastChannel)c) ? 0xFFFF : 0x7BEF, 0x0000);  // Grey when not ready
+      displayMgr->setCursor(xPos, row);
+      if (isnan(nowcast.mean[c][i])) {
+        displayMgr->print(F("--"));
+        continue;
+      }
+      displayMgr->print(nowcast.mean[c][i], c == ML_NOWCAST_TEMPERATURE ? 1 : 0);
+      if (c == ML_NOWCAST_TEMPERATURE) displayMgr->print(F("C"));
+      displayMgr->setCursor(xPos, row + 12);
+      displayMgr->print(F("+-"));
+      displayMgr->print(nowcast.sigma[c][i], 1);
+    }
+  }
+  displayMgr->setTextColor(0xFFFF, 0x0000);
 }
 
 void UIScreens::drawHeartRateScreen(const HeartRateData& hrData) {
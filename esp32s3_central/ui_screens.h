@@ -11,8 +11,9 @@
 #include "sensor_manager.h"
 
 // Forward declare structures
-struct RemoteSensorData;
+class ESPNowReceiver;
 struct WeatherData;
+struct MLNowcast;
 
 /**
  * Manages UI screen layouts for 3 displays
@@ -29,12 +30,13 @@ public:
   /**
    * Draw main screen (Display 1 - Time/Indoor, Display 2 - Weather, Display 3 - Extended)
    */
-  void drawMainScreen(const SensorData& local, const RemoteSensorData& remote, const WeatherData& weather);
+  void drawMainScreen(const SensorData& local, const ESPNowReceiver& remote, const WeatherData& weather);
 
   /**
-   * Draw weather forecast screen
+   * Draw weather forecast screen: the API's days, then the station's own
+   * hourly nowcast of exterior temperature and pressure
    */
-  void drawForecastScreen(const WeatherData& weather);
+  void drawForecastScreen(const WeatherData& weather, const MLNowcast& nowcast);
 
   /**
    * Draw heart rate screen
@@ -55,9 +57,9 @@ private:
   class DisplayManager* displayMgr;
 
   /**
-   * Draw Display 1 (Top) - Time and Indoor Sensors
+   * Draw Display 1 (Top) - Time, Indoor Sensors and one line per remote node
    */
-  void drawDisplay1(const SensorData& local, const RemoteSensorData& remote);
+  void drawDisplay1(const SensorData& local, const ESPNowReceiver& remote);
 
   /**
    * Draw Display 2 (Middle) - Outdoor Weather
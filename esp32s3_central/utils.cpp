@@ -4,24 +4,43 @@
  */
 
 #include "utils.h"
+#include "config.h"
+#include "log_format.h"
+#include <time.h>
+#include <esp_timer.h>
 
 String getISO8601Timestamp() {
-  // TODO: Integrate with RTC for accurate time
-  // For now, return a placeholder based on system millis
-  unsigned long ms = millis();
-  unsigned long totalSeconds = ms / 1000;
+  return getISO8601Timestamp(millis());
+}
 
-  // Simple counter-based timestamp (not real calendar)
-  unsigned long days = totalSeconds / 86400;
-  unsigned long hours = (totalSeconds % 86400) / 3600;
-  unsigned long minutes = (totalSeconds % 3600) / 60;
-  unsigned long seconds = totalSeconds % 60;
+String getISO8601Timestamp(unsigned long ms) {
+  char buffer[21];
+  formatIsoTime(getUnixTime() - (millis() - ms) / 1000, buffer);
+  return String(buffer);
+}
 
-  char buffer[25];
-  snprintf(buffer, sizeof(buffer), "2024-01-%02d T%02d:%02d:%02d Z",
-           (int)(days % 31) + 1, (int)hours, (int)minutes, (int)seconds);
+uint32_t getUnixTime() {
+  time_t now = time(nullptr);
 
-  return String(buffer);
+  // Anything before the fallback epoch means NTP has not answered yet
+  if (now >= LOG_FALLBACK_EPOCH) {
+    return (uint32_t)now;
+  }
+  return LOG_FALLBACK_EPOCH + millis() / 1000;
+}
+
+bool isClockSet() {
+  return time(nullptr) >= LOG_FALLBACK_EPOCH;
+}
+
+uint32_t getUptimeSeconds() {
+  return (uint32_t)(esp_timer_get_time() / 1000000ULL);
+}
+
+uint32_t getUptimeSeconds(unsigned long ms) {
+  uint32_t now = getUptimeSeconds();
+  uint32_t ago = (millis() - ms) / 1000;
+  return ago < now ? now - ago : 0;
 }
 
 String colorToHex(uint16_t color) {
@@ -14,6 +14,31 @@
  */
 String getISO8601Timestamp();
 
+/**
+ * Timestamp for a past point in time, given as a millis() value
+ */
+String getISO8601Timestamp(unsigned long ms);
+
+/**
+ * Current UTC unix time: NTP time once synced, LOG_FALLBACK_EPOCH + uptime before
+ */
+uint32_t getUnixTime();
+
+/**
+ * Whether NTP has set the clock (getUnixTime() is real time, not uptime)
+ */
+bool isClockSet();
+
+/**
+ * Seconds since boot (64-bit timer: no wrap, unlike millis() / 1000)
+ */
+uint32_t getUptimeSeconds();
+
+/**
+ * Uptime seconds of a past point in time, given as a millis() value
+ */
+uint32_t getUptimeSeconds(unsigned long ms);
+
 /**
  * Convert RGB565 color to hex string
  */
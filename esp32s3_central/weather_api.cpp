@@ -104,9 +104,22 @@ bool WeatherAPI::parseCurrentWeatherJSON(const String& jsonStr) {
 }
 
 bool WeatherAPI::parseForecastJSON(const String& jsonStr) {
-  DynamicJsonDocument doc(4096);
-
-  DeserializationError error = deserializeJson(doc, jsonStr);
+  // Only the fields used: the whole response is about 16 KB of JSON
+  StaticJsonDocument<384> filter;
+  JsonObject fields = filter["list"].createNestedObject();
+  fields["dt"] = true;
+  fields["main"]["temp"] = true;
+  fields["main"]["temp_max"] = true;
+  fields["main"]["temp_min"] = true;
+  fields["main"]["humidity"] = true;
+  fields["main"]["pressure"] = true;
+  fields["pop"] = true;
+  fields["weather"][0]["id"] = true;
+  fields["rain"]["3h"] = true;
+
+  DynamicJsonDocument doc(12288);
+
+  DeserializationError error = deserializeJson(doc, jsonStr, DeserializationOption::Filter(filter));
   if (error) {
     Serial.print(F("[ERROR] Forecast JSON parse error: "));
     Serial.println(error.c_str());
@@ -117,19 +130,29 @@ bool WeatherAPI::parseForecastJSON(const String& jsonStr) {
   JsonArray list = doc["list"];
   int forecastIndex = 0;
 
+  if (list.size() > 0) {
+    JsonObject next = list[0];
+    nextSlot.time = next["dt"] | 0;
+    nextSlot.temp = next["main"]["temp"] | 0.0f;
+    nextSlot.humidity = next["main"]["humidity"] | 0;
+    nextSlot.pressure = next["main"]["pressure"] | 0.0f;
+    nextSlot.rainProbability = next["pop"] | 0.0f;
+    nextSlot.valid = true;
+  }
+
   for (int i = 0; i < list.size() && forecastIndex < 5; i += 8) {
     JsonObject item = list[i];
-    forecast[forecastIndex].tempMax = item["main"]["temp_max"] | 0;
-    forecast[forecastIndex].tempMin = item["main"]["temp_min"] | 0;
+    forecast[forecastIndex].tempMax = item["main"]["temp_max"] | 0.0f;
+    forecast[forecastIndex].tempMin = item["main"]["temp_min"] | 0.0f;
     forecast[forecastIndex].humidity = item["main"]["humidity"] | 0;
-    forecast[forecastIndex].rainProbability = item["pop"] | 0;
+    forecast[forecastIndex].rainProbability = item["pop"] | 0.0f;
 
     if (item["weather"].size() > 0) {
       forecast[forecastIndex].weatherCode = item["weather"][0]["id"] | 0;
     }
 
     if (item["rain"] && item["rain"]["3h"]) {
-      forecast[forecastIndex].rainfall = item["rain"]["3h"] | 0;
+      forecast[forecastIndex].rainfall = item["rain"]["3h"] | 0.0f;
     }
 
     forecastIndex++;
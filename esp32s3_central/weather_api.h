@@ -39,6 +39,18 @@ struct ForecastDay {
   float windSpeed = 0;
 };
 
+/**
+ * First 3-hour slot of the forecast (what the predictor fuses)
+ */
+struct ForecastSlot {
+  uint32_t time = 0;            // Unix time the slot starts
+  float temp = 0;
+  int humidity = 0;
+  float pressure = 0;
+  float rainProbability = 0;    // 0-1
+  bool valid = false;
+};
+
 /**
  * Manages weather API calls
  */
@@ -73,6 +85,11 @@ public:
    */
   ForecastDay* getForecast() { return forecast; }
 
+  /**
+   * Get the forecast's next 3-hour slot
+   */
+  ForecastSlot getNextSlot() const { return nextSlot; }
+
   /**
    * Get weather icon code for display
    */
@@ -88,6 +105,7 @@ private:
   String tomorrowApiKey;
   CurrentWeather currentWeather;
   ForecastDay forecast[5];
+  ForecastSlot nextSlot;
 
   /**
    * Parse JSON from OpenWeatherMap current weather
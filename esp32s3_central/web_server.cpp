@@ -9,7 +9,14 @@
 #include "weather_api.h"
 #include "config_manager.h"
 #include "ota_handler.h"
+#include "data_logger.h"
+#include "log_retention.h"
+#include "ml_predictor.h"
+#include "lttb.h"
+#include "utils.h"
 #include <LittleFS.h>
+#include <memory>
+#include <new>
 
 // Static instance for lambda callbacks
 static WebServer* webServerInstance = nullptr;
@@ -21,7 +28,9 @@ WebServer::WebServer(uint16_t port, uint16_t wsPort)
     : server(nullptr), ws(nullptr), httpPort(port), wsPort(wsPort),
       running(false), wsClientCount(0),
       sensorMgr(nullptr), espnowRcv(nullptr), weatherApi(nullptr),
-      configMgr(nullptr), otaHandler(nullptr) {
+      configMgr(nullptr), otaHandler(nullptr), dataLogger(nullptr),
+      logRetention(nullptr), mlPredictor(nullptr), modelUpload(nullptr),
+      modelUploadStatus(ML_MODEL_FILE_OK) {
     webServerInstance = this;
 }
 
@@ -147,6 +156,191 @@ void WebServer::setupAPIEndpoints() {
         handleAPISensors(request);
     });
 
+    // Link diagnostics (registered before /api/nodes, which also matches /api/nodes/*)
+    server->on("/api/nodes/diagnostics", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!espnowRcv) {
+            request->send(503, "application/json", "{\"error\":\"ESP-NOW receiver not initialized\"}");
+            return;
+        }
+        handleAPINodeDiagnostics(request);
+    });
+
+    server->on("/api/nodes/diagnostics", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        if (!isAuthenticated(request)) {
+            request->send(401, "application/json", "{\"error\":\"Unauthorized\"}");
+            return;
+        }
+        if (!espnowRcv) {
+            request->send(503, "application/json", "{\"error\":\"ESP-NOW receiver not initialized\"}");
+            return;
+        }
+        if (request->hasParam("reset")) {
+            espnowRcv->resetDiagnostics();
+        }
+        if (request->hasParam("enable")) {
+            espnowRcv->setDiagnostics(request->getParam("enable")->value() == "1");
+        }
+        handleAPINodeDiagnostics(request);
+    });
+
+    // SD logger statistics / flush policy
+    server->on("/api/logger", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!dataLogger || !dataLogger->isReady()) {
+            request->send(503, "application/json", "{\"error\":\"Data logger not initialized\"}");
+            return;
+        }
+        handleAPILogger(request);
+    });
+
+    server->on("/api/logger", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        if (!isAuthenticated(request)) {
+            request->send(401, "application/json", "{\"error\":\"Unauthorized\"}");
+            return;
+        }
+        if (!dataLogger || !dataLogger->isReady()) {
+            request->send(503, "application/json", "{\"error\":\"Data logger not initialized\"}");
+            return;
+        }
+        LogFlushPolicy policy = dataLogger->getFlushPolicy();
+        if (request->hasParam("chunk")) {
+            policy.chunkSize = request->getParam("chunk")->value().toInt();
+        }
+        if (request->hasParam("max_delay_ms")) {
+            policy.maxDelayMs = request->getParam("max_delay_ms")->value().toInt();
+        }
+        if (request->hasParam("sync_ms")) {
+            policy.syncIntervalMs = request->getParam("sync_ms")->value().toInt();
+        }
+        dataLogger->setFlushPolicy(policy);
+        if (request->hasParam("flush")) {
+            dataLogger->flush();
+        }
+        if (logRetention) {
+            LogRetentionPolicy retention = logRetention->getPolicy();
+            if (request->hasParam("raw_days")) {
+                retention.rawDays = request->getParam("raw_days")->value().toInt();
+            }
+            if (request->hasParam("hourly_days")) {
+                retention.hourlyDays = request->getParam("hourly_days")->value().toInt();
+            }
+            if (request->hasParam("horizon_days")) {
+                retention.horizonDays = request->getParam("horizon_days")->value().toInt();
+            }
+            if (request->hasParam("budget_mb")) {
+                retention.budgetMB = request->getParam("budget_mb")->value().toInt();
+            }
+            if (request->hasParam("min_free_mb")) {
+                retention.minFreeMB = request->getParam("min_free_mb")->value().toInt();
+            }
+            logRetention->setPolicy(retention);
+            if (request->hasParam("retention")) {
+                logRetention->trigger();
+            }
+        }
+        handleAPILogger(request);
+    });
+
+    // Log files off the card (registered before /api/logs, which would match it as a prefix)
+    server->on("/api/logs/download", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!dataLogger || !dataLogger->isReady()) {
+            request->send(503, "application/json", "{\"error\":\"Data logger not initialized\"}");
+            return;
+        }
+        handleAPILogDownload(request);
+    });
+
+    // Logged history, downsampled for charts
+    server->on("/api/history", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!dataLogger || !dataLogger->isReady()) {
+            request->send(503, "application/json", "{\"error\":\"Data logger not initialized\"}");
+            return;
+        }
+        handleAPIHistory(request);
+    });
+
+    // Uploaded int8 models (registered before /api/ml, which would match them as a prefix)
+    server->on("/api/ml/model", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!mlPredictor) {
+            request->send(503, "application/json", "{\"error\":\"ML predictor not initialized\"}");
+            return;
+        }
+        handleAPIMLModel(request);
+    });
+
+    // A .wxq file (multipart) goes to the slot not in use; or rollback=1, compiled=1 switch back.
+    // Checked here, switched to by loop() between predictions.
+    server->on("/api/ml/model", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        if (!isAuthenticated(request)) {
+            request->send(401, "application/json", "{\"error\":\"Unauthorized\"}");
+            return;
+        }
+        if (!mlPredictor) {
+            request->send(503, "application/json", "{\"error\":\"ML predictor not initialized\"}");
+            return;
+        }
+        MLModelStore& models = mlPredictor->getModelStore();
+        MLModelFileStatus status;
+        if (request == modelUpload) {
+            status = modelUploadStatus;
+            modelUpload = nullptr;
+        } else if (request->hasParam("rollback")) {
+            status = models.requestSlot(models.rollbackSlot());
+        } else if (request->hasParam("compiled")) {
+            status = models.requestSlot(ML_MODEL_NO_SLOT);
+        } else {
+            request->send(400, "application/json", "{\"error\":\"No model file, rollback or compiled\"}");
+            return;
+        }
+        int code = status == ML_MODEL_FILE_OK         ? 202
+                 : status == ML_MODEL_FILE_BUSY       ? 409
+                 : status == ML_MODEL_FILE_TOO_LARGE  ? 413
+                 : status == ML_MODEL_FILE_IO_ERROR   ? 500
+                                                      : 422;
+        handleAPIMLModel(request, code, mlModelFileStatusName(status));
+    }, [this](AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+        if (!mlPredictor) return;
+        MLModelStore& models = mlPredictor->getModelStore();
+        // Authenticated once, at the first part; later parts only if that one was
+        if (index == 0) {
+            modelUpload = nullptr;
+            if (!isAuthenticated(request)) return;
+            modelUpload = request;
+            modelUploadStatus = models.beginUpload();
+        }
+        if (request != modelUpload || modelUploadStatus != ML_MODEL_FILE_OK) return;
+        if (len > 0) {
+            modelUploadStatus = models.writeUpload(index, data, len);
+        }
+        if (final && modelUploadStatus == ML_MODEL_FILE_OK) {
+            modelUploadStatus = models.finishUpload();
+        }
+    });
+
+    // Weather prediction and its on-device training
+    server->on("/api/ml", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!mlPredictor) {
+            request->send(503, "application/json", "{\"error\":\"ML predictor not initialized\"}");
+            return;
+        }
+        handleAPIML(request);
+    });
+
+    server->on("/api/ml", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        if (!isAuthenticated(request)) {
+            request->send(401, "application/json", "{\"error\":\"Unauthorized\"}");
+            return;
+        }
+        if (!mlPredictor) {
+            request->send(503, "application/json", "{\"error\":\"ML predictor not initialized\"}");
+            return;
+        }
+        // Runs in loop(): retraining starts at its next check
+        if (request->hasParam("train")) {
+            mlPredictor->requestTraining();
+        }
+        handleAPIML(request);
+    });
+
     // Node Status
     server->on("/api/nodes", HTTP_GET, [this](AsyncWebServerRequest* request) {
         if (!espnowRcv) {
@@ -303,7 +497,7 @@ void WebServer::handleWebSocketMessage(const String& message) {
 
 void WebServer::handleAPISensors(AsyncWebServerRequest* request) {
     // Build sensor data response
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(512 + NODE_REGISTRY_CAPACITY * 256);
 
     if (sensorMgr) {
         SensorData data = sensorMgr->getLastData();
@@ -314,15 +508,26 @@ void WebServer::handleAPISensors(AsyncWebServerRequest* request) {
     }
 
     if (espnowRcv) {
-        ESPNowData interiorData = espnowRcv->getInteriorData();
-        doc["indoor_secondary"]["temperature"] = interiorData.temperature;
-        doc["indoor_secondary"]["humidity"] = interiorData.humidity;
+        JsonObject nodes = doc.createNestedObject("nodes");
+        uint32_t now = millis();
+
+        for (size_t i = 0; i < espnowRcv->getNodeCount(); i++) {
+            NodeEntry node;
+            if (!espnowRcv->getNode(i, node)) break;
+
+            JsonObject obj = nodes.createNestedObject(node.nodeType);
+            obj["temperature"] = node.latest.temperature;
+            obj["humidity"] = node.latest.humidity;
+            obj["pressure"] = node.latest.pressure;
+            obj["light"] = node.latest.light;
+            obj["rssi"] = node.rssi;
+            obj["online"] = node.isOnline(now);
+            obj["age_ms"] = now - node.lastSeen;
+        }
 
-        ESPNowData exteriorData = espnowRcv->getExteriorData();
-        doc["outdoor"]["temperature"] = exteriorData.temperature;
-        doc["outdoor"]["humidity"] = exteriorData.humidity;
-        doc["outdoor"]["pressure"] = exteriorData.pressure;
-        doc["outdoor"]["light"] = exteriorData.light;
+        // Legacy keys used by the dashboard
+        if (nodes.containsKey("interior")) doc["indoor_secondary"] = nodes["interior"];
+        if (nodes.containsKey("exterior")) doc["outdoor"] = nodes["exterior"];
     }
 
     String response;
@@ -331,27 +536,881 @@ void WebServer::handleAPISensors(AsyncWebServerRequest* request) {
 }
 
 void WebServer::handleAPINodes(AsyncWebServerRequest* request) {
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(256 + NODE_REGISTRY_CAPACITY * 512);
     JsonArray nodesArray = doc.createNestedArray("nodes");
 
     if (espnowRcv) {
-        // Add interior node
-        JsonObject interior = nodesArray.createNestedObject();
-        interior["name"] = "Interior Room";
-        interior["mac"] = "XX:XX:XX:XX:XX:XX";  // Would get from config
-        interior["online"] = espnowRcv->isInteriorOnline();
-        interior["rssi"] = -50;  // Would get actual value
-        interior["last_packet"] = espnowRcv->getLastInteriorUpdate();
-
-        // Add exterior node
-        JsonObject exterior = nodesArray.createNestedObject();
-        exterior["name"] = "Exterior Sensors";
-        exterior["mac"] = "XX:XX:XX:XX:XX:XX";
-        exterior["online"] = espnowRcv->isExteriorOnline();
-        exterior["rssi"] = -60;
-        exterior["last_packet"] = espnowRcv->getLastExteriorUpdate();
+        uint32_t now = millis();
+        uint32_t totalSamples = 0;
+        uint32_t totalLost = 0;
+        doc["rejected_packets"] = espnowRcv->getRejectedCount();
+
+        for (size_t i = 0; i < espnowRcv->getNodeCount(); i++) {
+            NodeEntry node;
+            if (!espnowRcv->getNode(i, node)) break;
+
+            char mac[18];
+            NodeRegistry::formatMac(node.mac, mac);
+
+            JsonObject obj = nodesArray.createNestedObject();
+            obj["name"] = node.nodeType;
+            obj["mac"] = mac;
+            obj["online"] = node.isOnline(now);
+            obj["rssi"] = node.rssi;
+            obj["last_packet"] = node.lastSeen;
+            obj["age_ms"] = now - node.lastSeen;
+            obj["packets"] = node.packetCount;
+            obj["lost"] = node.lossCount;
+            obj["loss_ratio"] = node.lossRatio();
+            obj["send_wake_ms"] = node.sendWakeMs;
+            obj["read_wake_ms"] = node.readWakeMs;
+            obj["samples"] = node.sampleCount;
+            obj["samples_lost"] = node.samplesLost;
+            obj["delivery_ratio"] = node.deliveryRatio();
+            obj["retries"] = node.retryCount;
+            obj["duplicates"] = node.duplicateCount;
+            obj["slot"] = node.slot;
+            obj["slot_misses"] = node.slotMisses;
+            obj["slot_error_ms"] = node.slotErrorMs;
+
+            totalSamples += node.sampleCount;
+            totalLost += node.samplesLost;
+        }
+
+        // End to end over all nodes: samples taken vs. samples that reached us
+        doc["delivery_ratio"] = (totalSamples + totalLost) ? (float)totalSamples / (totalSamples + totalLost) : 1.0f;
+    }
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+}
+
+void WebServer::handleAPILogger(AsyncWebServerRequest* request) {
+    LogWriterStats stats;
+    dataLogger->getStats(stats);
+    LogFlushPolicy policy = dataLogger->getFlushPolicy();
+
+    DynamicJsonDocument doc(3072);
+    doc["records"] = dataLogger->getRecordCount();
+    doc["file_size"] = dataLogger->getFileSize();
+
+    JsonObject ring = doc.createNestedObject("ring");
+    ring["capacity"] = stats.ringCapacity;
+    ring["used"] = stats.ringUsed;
+    ring["peak"] = stats.ringPeak;
+    ring["psram"] = stats.ringInPsram;
+    ring["queued"] = stats.recordsQueued;
+    ring["dropped"] = stats.recordsDropped;
+
+    JsonObject sd = doc.createNestedObject("sd");
+    sd["records_written"] = stats.recordsWritten;
+    sd["bytes_written"] = stats.bytesWritten;
+    sd["writes"] = stats.writes;
+    sd["partial_writes"] = stats.partialWrites;
+    sd["syncs"] = stats.syncs;
+    sd["errors"] = stats.writeErrors;
+    sd["write_max_us"] = stats.writeMaxUs;
+    sd["throughput_kbps"] = stats.throughputKBps();
+    sd["preallocated"] = stats.preallocatedBytes;
+
+    // Journaled binary log: checkpoints, last reopen's recovery scan, failed records
+    JsonObject journal = doc.createNestedObject("journal");
+    journal["checkpoints"] = stats.checkpoints;
+    journal["recovery_us"] = stats.recoveryUs;
+    journal["recovery_scanned"] = stats.recoveryScanned;
+    journal["corrupt_found"] = stats.corruptFound;
+    journal["torn_erased"] = stats.tornRecords;
+    journal["corrupt_skipped"] = stats.corruptSkipped;
+
+    // Closed days rewritten as compressed blocks
+    JsonObject compression = doc.createNestedObject("compression");
+    compression["partitions"] = stats.compactedPartitions;
+    compression["bytes_in"] = stats.compactedBytesIn;
+    compression["bytes_out"] = stats.compactedBytesOut;
+    compression["ratio"] = stats.compressionRatio();
+    compression["last_ms"] = stats.compactUs / 1000;
+
+    // Enqueue to on-card, oldest record of each write
+    JsonObject latency = doc.createNestedObject("drain_latency_ms");
+    latency["mean"] = stats.latencyMeanMs();
+    latency["max"] = stats.latencyMaxMs;
+
+    JsonObject flush = doc.createNestedObject("policy");
+    flush["chunk"] = policy.chunkSize;
+    flush["max_delay_ms"] = policy.maxDelayMs;
+    flush["sync_ms"] = policy.syncIntervalMs;
+
+    // Card presence, and the flash spool that stands in for it
+    JsonObject spool = doc.createNestedObject("spool");
+    spool["card_present"] = stats.cardPresent;
+    spool["backfilling"] = stats.backfilling;
+    spool["card_losses"] = stats.cardLosses;
+    spool["quota_bytes"] = stats.spool.quotaBytes;
+    spool["pending_bytes"] = stats.spool.pendingBytes;
+    spool["segments"] = stats.spool.segments;
+    spool["records_spooled"] = stats.spool.recordsSpooled;
+    spool["records_replayed"] = stats.spool.recordsReplayed;
+    spool["segments_dropped"] = stats.spool.segmentsDropped;
+    spool["flash_bytes_written"] = stats.spool.flashBytesWritten;
+    spool["appends"] = stats.spool.appends;
+    spool["append_max_us"] = stats.spool.appendMaxUs;
+    spool["errors"] = stats.spool.writeErrors;
+
+    // Last log download: throughput and heap it took
+    JsonObject download = doc.createNestedObject("download");
+    download["count"] = lastDownload.downloads;
+    download["bytes"] = lastDownload.bytes;
+    download["ms"] = lastDownload.ms;
+    download["mbps"] = lastDownload.throughputMBps();
+    download["heap_peak"] = lastDownload.heapPeak;
+    download["csv"] = lastDownload.csv;
+
+    // Space on the card, what retention still has to do and what it freed
+    if (logRetention) {
+        LogRetentionStats kept;
+        logRetention->getStats(kept);
+        LogRetentionPolicy limits = logRetention->getPolicy();
+
+        JsonObject retention = doc.createNestedObject("retention");
+        retention["card_bytes"] = kept.cardBytes;
+        retention["free_bytes"] = kept.freeBytes;
+        retention["log_bytes"] = kept.logBytes;
+        retention["raw_days"] = kept.rawDays;
+        retention["oldest_raw_day"] = kept.oldestRawDay;
+        retention["backlog_days"] = kept.backlogDays;
+        retention["backlog_bytes"] = kept.backlogBytes;
+        retention["over_bytes"] = kept.overBytes;
+        retention["reclaimed_bytes"] = kept.bytesReclaimed;
+        retention["files_deleted"] = kept.filesDeleted;
+        retention["days_compressed"] = kept.daysCompressed;
+        retention["passes"] = kept.passes;
+        retention["pass_ms"] = kept.passMs;
+        retention["slice_max_us"] = kept.sliceMaxUs;
+        retention["running"] = kept.running;
+
+        JsonObject keep = retention.createNestedObject("policy");
+        keep["raw_days"] = limits.rawDays;
+        keep["hourly_days"] = limits.hourlyDays;
+        keep["horizon_days"] = limits.horizonDays;
+        keep["budget_mb"] = limits.budgetMB;
+        keep["min_free_mb"] = limits.minFreeMB;
+    }
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+}
+
+void WebServer::handleAPIML(AsyncWebServerRequest* request) {
+    WeatherPrediction prediction = mlPredictor->getPrediction();
+    MLTrainingStats training;
+    mlPredictor->getTrainingStats(training);
+
+    DynamicJsonDocument doc(4096);
+    JsonObject predicted = doc.createNestedObject("prediction");
+    predicted["rain_probability"] = prediction.rainProbability;
+    predicted["temperature_change"] = prediction.temperatureChange;
+    predicted["temperature_trend"] = prediction.temperatureTrend;
+    predicted["condition"] = prediction.generalCondition;
+    predicted["source"] = prediction.source == ML_SOURCE_ONLINE     ? "online"
+                        : prediction.source == ML_SOURCE_COMPILED ? "int8"
+                        : prediction.source == ML_SOURCE_FILE     ? "file"
+                                                                  : "rules";
+    predicted["horizon_s"] = ML_HORIZON_S;
+    doc["trained"] = mlPredictor->isTrained();
+    doc["compiled_model"] = mlPredictor->hasCompiledModel();
+
+    // Live trends the rules read, updated on every sensor read
+    MLLiveFeatures live;
+    mlPredictor->getLiveFeatures(live);
+    JsonObject features = doc.createNestedObject("features");
+    features["samples"] = live.samples;
+    features["pressure"] = live.pressure;
+    features["pressure_trend_1h"] = live.pressureTrend1h;
+    features["pressure_trend_3h"] = live.pressureTrend3h;
+    features["temperature"] = live.temperature;
+    features["temperature_trend"] = live.temperatureTrend;
+    features["humidity"] = live.humidity;
+    features["humidity_mean_12h"] = live.humidityMean;
+    features["ready_1h"] = live.has(ML_LIVE_PRESSURE_1H);
+    features["ready_3h"] = live.has(ML_LIVE_PRESSURE_3H);
+    features["ready_12h"] = live.has(ML_LIVE_HUMIDITY_12H);
+
+    // Sources fused into them: age of each one's reading, and where each channel came from
+    static const char* const sourceNames[ML_INPUT_COUNT] = {"indoor", "exterior", "observation", "forecast"};
+    static const char* const channelKeys[ML_STORE_CHANNELS] = {"pressure_source", "temperature_source",
+                                                               "humidity_source"};
+    MLFusedFeatures fused;
+    mlPredictor->getFusedFeatures(fused);
+    JsonObject sources = doc.createNestedObject("sources");
+    for (uint8_t s = 0; s < ML_INPUT_COUNT; s++) {
+        JsonObject source = sources.createNestedObject(sourceNames[s]);
+        if (fused.age[s] == ML_AGE_UNKNOWN) {
+            source["age_s"] = nullptr;
+        } else {
+            source["age_s"] = fused.age[s];
+        }
+        source["stale"] = fused.age[s] > MLFusion::maxAge((MLInputSource)s);
+    }
+    for (uint8_t c = 0; c < ML_STORE_CHANNELS; c++) {
+        uint8_t from = fused.channelSource[c];
+        features[channelKeys[c]] = from < ML_INPUT_COUNT ? sourceNames[from] : "none";
+    }
+    if (fused.usable(ML_FUSED_FORECAST_RAIN)) {
+        features["forecast_rain"] = fused.values[ML_FUSED_FORECAST_RAIN];
+    }
+
+    // Station nowcast: hourly mean and standard deviation per channel, and what the filters cost
+    static const char* const nowcastKeys[ML_NOWCAST_CHANNELS] = {"temperature", "pressure"};
+    MLNowcast nowcast;
+    mlPredictor->getNowcast(nowcast);
+    JsonObject nowcasted = doc.createNestedObject("nowcast");
+    nowcasted["hours"] = ML_NOWCAST_HOURS;
+    for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+        JsonObject channel = nowcasted.createNestedObject(nowcastKeys[c]);
+        uint8_t from = nowcast.sources[c];
+        channel["source"] = from < ML_INPUT_COUNT ? sourceNames[from] : "none";
+        channel["ready"] = nowcast.has((MLNowcastChannel)c);
+        channel["updates"] = nowcast.updates[c];
+        if (isnan(nowcast.now[c])) continue;
+        channel["now"] = nowcast.now[c];
+        JsonArray mean = channel.createNestedArray("mean");
+        JsonArray sigma = channel.createNestedArray("sigma");
+        for (uint8_t h = 0; h < ML_NOWCAST_HOURS; h++) {
+            mean.add(nowcast.mean[c][h]);
+            sigma.add(nowcast.sigma[c][h]);
+        }
+    }
+    float mhz = ESP.getCpuFreqMHz();
+    nowcasted["update_us"] = nowcast.updateCycles / mhz;
+    nowcasted["update_max_us"] = nowcast.updateCyclesMax / mhz;
+    nowcasted["forecast_us"] = nowcast.forecastCycles / mhz;
+
+    // Kernel benchmark of the int8 model in use (at boot and on every switch)
+    MLKernelBenchmark bench;
+    mlPredictor->getKernelBenchmark(bench);
+    if (bench.macs > 0) {
+        JsonObject kernels = doc.createNestedObject("kernels");
+        kernels["model"] = bench.file ? "file" : "int8";
+        if (bench.file) {
+            kernels["model_id"] = bench.modelId;
+        }
+        kernels["macs"] = bench.macs;
+        kernels["used"] = bench.kernel == ML_QUANT_VECTOR ? "simd" : "scalar";
+        kernels["simd"] = bench.simd;
+        kernels["simd_exact"] = bench.exact;
+        kernels["scalar_us"] = bench.us[ML_QUANT_SCALAR];
+        kernels["scalar_cycles_per_mac"] = bench.cyclesPerMac(ML_QUANT_SCALAR);
+        if (bench.simd) {
+            kernels["simd_us"] = bench.us[ML_QUANT_VECTOR];
+            kernels["simd_cycles_per_mac"] = bench.cyclesPerMac(ML_QUANT_VECTOR);
+        }
+    }
+
+    // Last run: throughput, loop() stall and memory it took, and how well it scored
+    JsonObject run = doc.createNestedObject("training");
+    run["runs"] = training.runs;
+    run["running"] = training.running;
+    run["records"] = training.records;
+    run["examples"] = training.examples;
+    run["ms"] = training.ms;
+    run["records_per_s"] = training.recordsPerSecond();
+    run["slices"] = training.slices;
+    run["slice_max_us"] = training.sliceMaxUs;
+    run["heap_peak"] = training.heapPeak;
+    run["state_bytes"] = training.stateBytes;
+    run["trained_from"] = training.trainedFrom;
+    run["trained_to"] = training.trainedTo;
+    run["brier"] = training.brier;
+    run["temp_mae"] = training.tempMae;
+    run["saved"] = training.saved;
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+}
+
+void WebServer::handleAPIMLModel(AsyncWebServerRequest* request, int code, const char* status) {
+    static const char* const backings[] = {"none", "partition", "littlefs"};
+    MLModelStoreStats stats;
+    mlPredictor->getModelStore().getStats(stats);
+
+    DynamicJsonDocument doc(1536);
+    if (status) {
+        doc["result"] = status;
+    }
+    doc["backing"] = backings[stats.backing];
+    doc["slot_bytes"] = stats.slotBytes;
+    // Slots by number; null is the compiled model
+    if (stats.active == ML_MODEL_NO_SLOT) {
+        doc["active"] = nullptr;
+    } else {
+        doc["active"] = stats.active;
+    }
+    if (stats.previous == ML_MODEL_NO_SLOT) {
+        doc["rollback"] = nullptr;
+    } else {
+        doc["rollback"] = stats.previous;
+    }
+    doc["pending"] = stats.pending;
+    JsonArray slots = doc.createNestedArray("slots");
+    for (uint8_t i = 0; i < ML_MODEL_SLOTS; i++) {
+        JsonObject slot = slots.createNestedObject();
+        slot["status"] = mlModelFileStatusName(stats.slots[i].status);
+        if (stats.slots[i].status == ML_MODEL_FILE_OK) {
+            slot["model_id"] = stats.slots[i].modelId;
+            slot["bytes"] = stats.slots[i].bytes;
+        }
+    }
+
+    // The model in use: mapped in place or read into RAM, and what that cost
+    doc["mapped"] = stats.mapped;
+    doc["load_us"] = stats.loadUs;
+    doc["resident_bytes"] = stats.residentBytes;
+    doc["mapped_bytes"] = stats.mappedBytes;
+    doc["switches"] = stats.switches;
+    doc["uploads"] = stats.uploads;
+    doc["rejected"] = stats.rejected;
+    doc["uploading"] = stats.uploading;
+    doc["upload_bytes"] = stats.uploadBytes;
+    doc["last_status"] = mlModelFileStatusName(stats.lastStatus);
+
+    String response;
+    serializeJson(doc, response);
+    request->send(code, "application/json", response);
+}
+
+/**
+ * /api/history request: the downsampled series, read a slice per response
+ * chunk, and how much of it has been sent
+ */
+struct HistoryQuery {
+    DataLogger* logger = nullptr;
+    uint8_t channel = 0;
+    uint32_t from = 0;
+    uint32_t to = 0;
+    long resolution = 0;
+    uint32_t next = 0;            // Start of the next slice to read
+    uint32_t sliceCount = 0;      // Summaries read by this slice
+    uint32_t queryMs = 0;         // Time spent reading, over all slices
+    HistoryPoint* points = nullptr;
+    LttbSampler* sampler = nullptr;
+    size_t count = 0;             // Points the sampler has written
+    size_t sent = 0;              // Points written to the response
+    bool headerSent = false;
+    bool finished = false;        // Range read, sampler finished
+    bool done = false;
+
+    ~HistoryQuery() {
+        delete sampler;
+        delete[] points;
+    }
+};
+
+static bool addHistoryPoint(const LogRollup& rollup, void* context) {
+    HistoryQuery& query = *static_cast<HistoryQuery*>(context);
+    uint8_t ch = query.channel;
+    if (rollup.count[ch] > 0) {
+        query.sampler->add({rollup.start, rollup.mean[ch], rollup.min[ch], rollup.max[ch]});
+    }
+    query.next = rollup.start + (query.resolution > 0 ? query.resolution : 1);
+    return ++query.sliceCount < HISTORY_SLICE;
+}
+
+/**
+ * Read the next HISTORY_SLICE summaries of the range; the sampler writes
+ * each bucket's pick once the bucket after it fills
+ */
+static void readHistorySlice(HistoryQuery& query) {
+    uint32_t first = query.next;
+    unsigned long start = millis();
+    query.sliceCount = 0;
+    long read = query.logger->readSummaryAt(query.resolution, first, query.to, addHistoryPoint, &query);
+    query.queryMs += millis() - start;
+
+    // A slice not stopped by the count read the rest of the range
+    if (read < 0 || query.sliceCount < HISTORY_SLICE || query.next > query.to || query.next <= first) {
+        query.count = query.sampler->finish();
+        query.finished = true;
+    } else {
+        query.count = query.sampler->getOutputCount();
+    }
+}
+
+/**
+ * Next piece of the /api/history JSON: as many whole pieces as fit in
+ * buffer, reading one slice of the range when the points read so far are sent
+ * @return bytes written, 0 once the document is complete
+ */
+static size_t writeHistoryChunk(HistoryQuery& query, uint8_t* buffer, size_t maxLen) {
+    const LogChannel& channel = weatherLogSchema().channel(query.channel);
+    const int decimals = channel.decimals;
+    size_t used = 0;
+    bool sliceRead = false;
+    char piece[160];
+
+    while (!query.done) {
+        if (query.headerSent && query.sent == query.count && !query.finished) {
+            if (sliceRead) break;
+            readHistorySlice(query);
+            sliceRead = true;
+            continue;
+        }
+
+        int n;
+        if (!query.headerSent) {
+            n = snprintf(piece, sizeof(piece),
+                         "{\"channel\":\"%s\",\"from\":%u,\"to\":%u,\"resolution\":%ld,\"points\":[",
+                         channel.name, (unsigned)query.from, (unsigned)query.to, query.resolution);
+        } else if (query.sent < query.count) {
+            const HistoryPoint& p = query.points[query.sent];
+            n = snprintf(piece, sizeof(piece), "%s[%u,%.*f,%.*f,%.*f]", query.sent ? "," : "",
+                         (unsigned)p.time, decimals, p.value, decimals, p.min, decimals, p.max);
+        } else {
+            n = snprintf(piece, sizeof(piece), "],\"inputs\":%u,\"query_ms\":%u}",
+                         (unsigned)query.sampler->getInputCount(), (unsigned)query.queryMs);
+        }
+
+        if (n <= 0 || used + n > maxLen) break;
+        memcpy(buffer + used, piece, n);
+        used += n;
+
+        if (!query.headerSent) {
+            query.headerSent = true;
+        } else if (query.sent < query.count) {
+            query.sent++;
+        } else {
+            query.done = true;
+        }
+    }
+
+    // A slice that closed no bucket: asked again on the next poll
+    return used == 0 && !query.done ? RESPONSE_TRY_AGAIN : used;
+}
+
+void WebServer::handleAPIHistory(AsyncWebServerRequest* request) {
+    const LogSchema& schema = weatherLogSchema();
+    String name = request->hasParam("channel") ? request->getParam("channel")->value() : String("temp_outdoor");
+    int channel = schema.find(name.c_str());
+    if (channel < 0) {
+        request->send(400, "application/json", "{\"error\":\"Unknown channel\"}");
+        return;
+    }
+
+    // Default: the last 24 hours
+    uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : getUnixTime();
+    uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10)
+                                               : (to > 86400 ? to - 86400 : 0);
+    long points = request->hasParam("points") ? request->getParam("points")->value().toInt() : HISTORY_DEFAULT_POINTS;
+    if (points < 3) points = 3;
+    if (points > HISTORY_MAX_POINTS) points = HISTORY_MAX_POINTS;
+    if (from > to) {
+        request->send(400, "application/json", "{\"error\":\"from is after to\"}");
+        return;
+    }
+    if (!dataLogger->isReady()) {
+        request->send(503, "application/json", "{\"error\":\"History not available\"}");
+        return;
     }
 
+    // Only the downsampled points are held: the series streams through LTTB,
+    // read from the card a slice at a time as the response goes out
+    std::shared_ptr<HistoryQuery> query = std::make_shared<HistoryQuery>();
+    query->logger = dataLogger;
+    query->channel = channel;
+    query->from = from;
+    query->to = to;
+    query->next = from;
+    query->resolution = dataLogger->summaryResolution(from, to, points);
+    query->points = new (std::nothrow) HistoryPoint[points];
+    query->sampler = query->points ? new (std::nothrow) LttbSampler(query->points, points, from, to) : nullptr;
+    if (!query->sampler) {
+        request->send(503, "application/json", "{\"error\":\"Out of memory\"}");
+        return;
+    }
+
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+        [query](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            return writeHistoryChunk(*query, buffer, maxLen);
+        });
+    request->send(response);
+}
+
+/**
+ * /api/logs/download request: what is sent, how far it has got and what it cost
+ */
+struct LogDownload {
+    DataLogger* logger = nullptr;
+    LogDownloadStats* stats = nullptr;
+    bool csv = false;
+    char path[LOG_PARTITION_PATH_MAX] = "";
+    uint32_t offset = 0;            // File: next byte to send
+    uint32_t end = 0;               // and the end of the range
+    AsyncClient* client = nullptr;  // and the connection, dropped if the file comes up short
+    uint32_t to = 0;                // CSV: records up to this time
+    uint32_t resumeTime = 0;        // Newest record time sent (the next pull reads from it)
+    uint32_t resumeCount = 0;       // Records at resumeTime sent already
+    char line[LOG_CSV_LINE_MAX];    // Line cut at the end of the last chunk
+    size_t lineLength = 0;
+    size_t lineSent = 0;
+    bool headerSent = false;
+    bool done = false;
+    uint32_t startMs = 0;
+    uint64_t bytes = 0;
+    uint32_t heapStart = 0;
+    uint32_t heapMin = 0;
+
+    ~LogDownload() {
+        if (!stats) return;
+        stats->downloads++;
+        stats->bytes = bytes;
+        stats->ms = millis() - startMs;
+        stats->heapPeak = heapStart > heapMin ? heapStart - heapMin : 0;
+        stats->csv = csv;
+
+        Serial.print(F("[WEB] Log download: "));
+        Serial.print((unsigned long)bytes);
+        Serial.print(F(" bytes in "));
+        Serial.print(stats->ms);
+        Serial.print(F(" ms ("));
+        Serial.print(stats->throughputMBps(), 2);
+        Serial.print(F(" MB/s), heap peak "));
+        Serial.println(stats->heapPeak);
+    }
+
+    void sampleHeap() {
+        uint32_t heap = ESP.getFreeHeap();
+        if (heap < heapMin) heapMin = heap;
+    }
+};
+
+/**
+ * Copy what fits of the pending line
+ * @return false if some of it is still left
+ */
+static bool sendPendingLine(LogDownload& download, uint8_t* buffer, size_t maxLen, size_t& used) {
+    size_t n = download.lineLength - download.lineSent;
+    if (n > maxLen - used) n = maxLen - used;
+    memcpy(buffer + used, download.line + download.lineSent, n);
+    download.lineSent += n;
+    used += n;
+    return download.lineSent == download.lineLength;
+}
+
+/**
+ * One pull of the CSV stream (readRange() context)
+ */
+struct CsvPull {
+    LogDownload* download;
+    uint8_t* buffer;
+    size_t maxLen;
+    size_t used;
+    uint32_t skip;                  // Records at resumeTime still to pass over
+    bool stopped;                   // Chunk full before the end of the range
+};
+
+static bool pullCsvRecord(const LogSchema& schema, const uint8_t* record, uint32_t time, void* context) {
+    CsvPull& pull = *static_cast<CsvPull*>(context);
+    LogDownload& download = *pull.download;
+
+    // Sent by an earlier pull
+    if (time == download.resumeTime && pull.skip > 0) {
+        pull.skip--;
+        return true;
+    }
+
+    if (time > download.resumeTime) {
+        download.resumeTime = time;
+        download.resumeCount = 0;
+    }
+    if (time == download.resumeTime) download.resumeCount++;
+
+    size_t n = schema.formatCsv(record, download.line, sizeof(download.line));
+    if (n == 0) return true;
+
+    // A line that does not fit is finished by the next pull
+    download.lineLength = n;
+    download.lineSent = 0;
+    if (!sendPendingLine(download, pull.buffer, pull.maxLen, pull.used) || pull.used == pull.maxLen) {
+        pull.stopped = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Next piece of a CSV download. Each pull reads the range again from the
+ * newest record sent, so nothing is held open between pulls.
+ * @return bytes written, 0 once the range is complete
+ */
+static size_t writeCsvChunk(LogDownload& download, uint8_t* buffer, size_t maxLen) {
+    size_t used = 0;
+    download.sampleHeap();
+    bool lineDone = sendPendingLine(download, buffer, maxLen, used);
+
+    if (lineDone && !download.headerSent) {
+        download.lineLength = weatherLogSchema().formatCsvHeader(download.line, sizeof(download.line));
+        download.lineSent = 0;
+        download.headerSent = true;
+        lineDone = sendPendingLine(download, buffer, maxLen, used);
+    }
+
+    if (lineDone && !download.done && used < maxLen) {
+        CsvPull pull = {&download, buffer, maxLen, used, download.resumeCount, false};
+        long records = download.logger->readRange(download.resumeTime, download.to, pullCsvRecord, &pull);
+        used = pull.used;
+        if (records < 0 || !pull.stopped) download.done = true;
+    }
+    download.bytes += used;
+    return used;
+}
+
+/**
+ * Next piece of a file download, read straight into the response buffer
+ * (the file is opened for each piece, under the card lock)
+ * @return bytes written, 0 at the end of the range
+ */
+static size_t writeFileChunk(LogDownload& download, uint8_t* buffer, size_t maxLen) {
+    download.sampleHeap();
+    size_t length = download.end - download.offset;
+    if (length > maxLen) length = maxLen;
+    if (length == 0) return 0;
+
+    uint32_t size;
+    long n = download.logger->readFile(download.path, download.offset, buffer, length, size);
+    if (n <= 0) {
+        // Deleted or cut short meanwhile: the Content-Length cannot be met,
+        // so drop the connection rather than leave the client waiting
+        download.end = download.offset;
+        if (download.client) download.client->close();
+        return 0;
+    }
+    download.offset += n;
+    download.bytes += n;
+    return n;
+}
+
+/**
+ * A log file name under LOG_DIR ("YYYY/MM/DD.wxb", "YYYY/hourly.wxr", ...):
+ * plain characters, no way out of the directory, a known extension
+ */
+static bool isLogFileName(const String& file) {
+    if (file.length() == 0 || file.length() + strlen(LOG_DIR) + 2 > LOG_PARTITION_PATH_MAX) return false;
+    if (file[0] == '/' || file.indexOf("..") >= 0) return false;
+    for (size_t i = 0; i < file.length(); i++) {
+        char c = file[i];
+        if (!isalnum((unsigned char)c) && c != '/' && c != '.' && c != '_' && c != '-') return false;
+    }
+    return file.endsWith(".wxb") || file.endsWith(".wxc") || file.endsWith(".idx") ||
+           file.endsWith(".wxr") || file.endsWith(".csv");
+}
+
+/**
+ * Parse a Range header of one byte range ("bytes=first-last", "bytes=first-"
+ * or "bytes=-suffix") against a file of size bytes
+ * @return 1 with first/last set, 0 to ignore it (send everything), -1 if unsatisfiable
+ */
+static int parseByteRange(const String& header, uint32_t size, uint32_t& first, uint32_t& last) {
+    if (!header.startsWith("bytes=") || header.indexOf(',') >= 0) return 0;
+    const char* spec = header.c_str() + 6;
+    const char* dash = strchr(spec, '-');
+    if (!dash) return 0;
+
+    if (dash == spec) {
+        // Suffix: the last n bytes
+        unsigned long n = strtoul(dash + 1, nullptr, 10);
+        if (n == 0 || size == 0) return -1;
+        first = n < size ? size - n : 0;
+        last = size - 1;
+        return 1;
+    }
+
+    char* tail;
+    unsigned long start = strtoul(spec, &tail, 10);
+    if (tail != dash) return 0;
+    if (start >= size) return -1;
+    first = start;
+    last = size - 1;
+    if (dash[1] != '\0') {
+        unsigned long stop = strtoul(dash + 1, &tail, 10);
+        if (*tail != '\0' || stop < start) return 0;
+        if (stop < last) last = stop;
+    }
+    return 1;
+}
+
+void WebServer::handleAPILogDownload(AsyncWebServerRequest* request) {
+    uint32_t heapStart = ESP.getFreeHeap();
+    std::shared_ptr<LogDownload> download = std::make_shared<LogDownload>();
+    download->logger = dataLogger;
+    download->heapStart = heapStart;
+    download->heapMin = heapStart;
+    download->startMs = millis();
+
+    bool csv = request->hasParam("format") && request->getParam("format")->value() == "csv";
+    uint32_t from = 0;
+    String name;
+
+    if (request->hasParam("file")) {
+        String file = request->getParam("file")->value();
+        if (!isLogFileName(file)) {
+            request->send(400, "application/json", "{\"error\":\"Invalid file\"}");
+            return;
+        }
+        snprintf(download->path, sizeof(download->path), "%s/%s", LOG_DIR, file.c_str());
+        name = file;
+        name.replace('/', '-');
+
+        // A day as CSV: its records, from whichever of its files holds them
+        if (csv) {
+            int year;
+            unsigned month, day;
+            if (sscanf(file.c_str(), "%4d/%2u/%2u.", &year, &month, &day) != 3) {
+                request->send(400, "application/json", "{\"error\":\"CSV needs a day partition\"}");
+                return;
+            }
+            from = (uint32_t)daysFromCivil(year, month, day) * 86400;
+            download->to = from + 86399;
+        }
+    } else {
+        // Records as CSV, by default the last 24 hours
+        csv = true;
+        download->to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10)
+                                               : getUnixTime();
+        from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10)
+                                         : (download->to > 86400 ? download->to - 86400 : 0);
+        if (from > download->to) {
+            request->send(400, "application/json", "{\"error\":\"from is after to\"}");
+            return;
+        }
+    }
+
+    if (csv) {
+        download->csv = true;
+        download->resumeTime = from;
+        download->stats = &lastDownload;
+
+        // Length unknown up front: chunked, resumed with a later from= rather than Range
+        AsyncWebServerResponse* response = request->beginChunkedResponse("text/csv",
+            [download](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+                return writeCsvChunk(*download, buffer, maxLen);
+            });
+        char disposition[80];
+        snprintf(disposition, sizeof(disposition), "attachment; filename=\"weather_%u_%u.csv\"",
+                 (unsigned)from, (unsigned)download->to);
+        response->addHeader("Content-Disposition", disposition);
+        request->send(response);
+        return;
+    }
+
+    uint32_t size = 0;
+    if (dataLogger->readFile(download->path, 0, nullptr, 0, size) < 0) {
+        request->send(404, "application/json", "{\"error\":\"No such file\"}");
+        return;
+    }
+
+    // The file as stored; a Range picks up an interrupted download
+    int code = 200;
+    uint32_t first = 0, last = size ? size - 1 : 0;
+    if (request->hasHeader("Range")) {
+        int range = parseByteRange(request->getHeader("Range")->value(), size, first, last);
+        if (range < 0) {
+            AsyncWebServerResponse* response = request->beginResponse(416, "text/plain", "Range Not Satisfiable");
+            response->addHeader("Content-Range", "bytes */" + String(size));
+            request->send(response);
+            return;
+        }
+        if (range > 0) code = 206;
+    }
+    download->offset = first;
+    download->end = size ? last + 1 : 0;
+    download->client = request->client();
+    download->stats = &lastDownload;
+
+    AsyncWebServerResponse* response = request->beginResponse("application/octet-stream",
+        download->end - download->offset,
+        [download](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            return writeFileChunk(*download, buffer, maxLen);
+        });
+    response->setCode(code);
+    response->addHeader("Accept-Ranges", "bytes");
+    if (code == 206) {
+        char contentRange[48];
+        snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u",
+                 (unsigned)first, (unsigned)last, (unsigned)size);
+        response->addHeader("Content-Range", contentRange);
+    }
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + name + "\"");
+    request->send(response);
+}
+
+void WebServer::handleAPINodeDiagnostics(AsyncWebServerRequest* request) {
+    // Sized for the nodes registered so far (each carries a 32-bucket histogram)
+    DynamicJsonDocument doc(768 + espnowRcv->getNodeCount() * 1536);
+    doc["enabled"] = espnowRcv->isDiagnosticsEnabled();
+    doc["channel"] = ESPNOW_CHANNEL;
+    doc["probe_bytes"] = DIAG_PROBE_BYTES;
+    doc["probes_per_wake"] = DIAG_PROBES_PER_WAKE;
+    doc["timeout_ms"] = DIAG_PROBE_TIMEOUT_MS;
+
+    // Upper bounds of the histogram buckets (the last one is open-ended)
+    JsonArray bounds = doc.createNestedArray("rtt_buckets_us");
+    for (size_t b = 0; b < DIAG_RTT_BUCKETS - 1; b++) {
+        bounds.add(LinkStats::bucketLimitUs(b));
+    }
+
+    JsonArray nodesArray = doc.createNestedArray("nodes");
+    uint32_t totalSent = 0;
+    uint32_t totalLost = 0;
+
+    for (size_t i = 0; i < espnowRcv->getNodeCount(); i++) {
+        NodeEntry node;
+        LinkStats stats;
+        if (!espnowRcv->getNode(i, node) || !espnowRcv->getLinkStats(i, stats)) break;
+
+        char mac[18];
+        NodeRegistry::formatMac(node.mac, mac);
+
+        JsonObject obj = nodesArray.createNestedObject();
+        obj["name"] = node.nodeType;
+        obj["mac"] = mac;
+        obj["rssi"] = stats.lastRssi ? stats.lastRssi : node.rssi;
+        obj["probes"] = stats.probesSent;
+        obj["echoes"] = stats.echoes;
+        obj["late"] = stats.lateEchoes;
+        obj["loss_ratio"] = stats.lossRatio();
+
+        JsonObject rtt = obj.createNestedObject("rtt_us");
+        rtt["min"] = stats.rttMinUs;
+        rtt["p50"] = stats.rttPercentileUs(0.50f);
+        rtt["p90"] = stats.rttPercentileUs(0.90f);
+        rtt["p99"] = stats.rttPercentileUs(0.99f);
+        rtt["max"] = stats.rttMaxUs;
+        rtt["mean"] = stats.rttMeanUs();
+
+        JsonArray histogram = obj.createNestedArray("rtt_histogram");
+        for (size_t b = 0; b < DIAG_RTT_BUCKETS; b++) {
+            histogram.add(stats.rttHistogram[b]);
+        }
+
+        // Loss by the RSSI the link had when each probe went out (bands with data only)
+        JsonArray bands = obj.createNestedArray("rssi_vs_loss");
+        for (size_t b = 0; b < DIAG_RSSI_BANDS; b++) {
+            if (stats.bandSent[b] == 0) continue;
+            JsonObject band = bands.createNestedObject();
+            band["rssi_min"] = LinkStats::bandFloor(b);
+            band["probes"] = stats.bandSent[b];
+            band["lost"] = stats.bandLost[b];
+            band["loss_ratio"] = (float)stats.bandLost[b] / stats.bandSent[b];
+        }
+
+        totalSent += stats.probesSent;
+        totalLost += stats.lost();
+    }
+
+    doc["loss_ratio"] = totalSent ? (float)totalLost / totalSent : 0.0f;
+
     String response;
     serializeJson(doc, response);
     request->send(200, "application/json", response);
@@ -12,12 +12,26 @@
 #include <ESPAsyncWebServer.h>
 #include <ESPmDNS.h>
 #include <ArduinoJson.h>
+#include "ml_model_file.h"
 
 // Forward declarations
 class WebSocketHandler;
 class ConfigManager;
 class OTAHandler;
 
+/**
+ * Cost of the last /api/logs/download (reported by /api/logger)
+ */
+struct LogDownloadStats {
+    uint32_t downloads = 0;
+    uint64_t bytes = 0;         // Sent by the last one
+    uint32_t ms = 0;
+    uint32_t heapPeak = 0;      // Most heap in use above the level it started at
+    bool csv = false;
+
+    float throughputMBps() const { return ms ? (float)bytes / 1048.576f / ms : 0.0f; }
+};
+
 /**
  * Web server interface for system control and monitoring
  */
@@ -64,6 +78,9 @@ public:
     void setWeatherAPI(class WeatherAPI* api) { weatherApi = api; }
     void setConfigManager(class ConfigManager* cfg) { configMgr = cfg; }
     void setOTAHandler(class OTAHandler* ota) { otaHandler = ota; }
+    void setDataLogger(class DataLogger* logger) { dataLogger = logger; }
+    void setLogRetention(class LogRetention* retention) { logRetention = retention; }
+    void setMLPredictor(class MLPredictor* predictor) { mlPredictor = predictor; }
 
 private:
     AsyncWebServer* server;
@@ -80,6 +97,12 @@ private:
     class WeatherAPI* weatherApi;
     class ConfigManager* configMgr;
     class OTAHandler* otaHandler;
+    class DataLogger* dataLogger;
+    class LogRetention* logRetention;
+    class MLPredictor* mlPredictor;
+    LogDownloadStats lastDownload;      // Written by the async_tcp task only
+    AsyncWebServerRequest* modelUpload; // Request whose file goes to a model slot (async_tcp task)
+    MLModelFileStatus modelUploadStatus;
 
     // CRITICAL: Authentication token
     static const char* ADMIN_TOKEN;  // Define in cpp as hardcoded or from config
@@ -127,6 +150,37 @@ private:
      */
     void handleAPINodes(AsyncWebServerRequest* request);
 
+    /**
+     * GET /api/nodes/diagnostics - Probe RTT / loss statistics per node
+     */
+    void handleAPINodeDiagnostics(AsyncWebServerRequest* request);
+
+    /**
+     * GET /api/logger - Write-behind SD logger statistics and flush policy
+     */
+    void handleAPILogger(AsyncWebServerRequest* request);
+
+    /**
+     * GET /api/history - One logged channel over a time range, downsampled (chunked response)
+     */
+    void handleAPIHistory(AsyncWebServerRequest* request);
+
+    /**
+     * GET /api/logs/download - A log file as stored (HTTP Range), or records as CSV (chunked response)
+     */
+    void handleAPILogDownload(AsyncWebServerRequest* request);
+
+    /**
+     * GET /api/ml - Prediction, model scores and the last training run
+     */
+    void handleAPIML(AsyncWebServerRequest* request);
+
+    /**
+     * GET /api/ml/model - Uploaded int8 models: slots, the one in use, load time and memory
+     * @param code HTTP status, and status the result of the POST being answered
+     */
+    void handleAPIMLModel(AsyncWebServerRequest* request, int code = 200, const char* status = nullptr);
+
     /**
      * GET /api/weather - Weather API data
      */
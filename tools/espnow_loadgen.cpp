@@ -0,0 +1,405 @@
+/**
+ * @file espnow_loadgen.cpp
+ * @brief Host-side multi-node ESP-NOW load generator for ESPNowReceiver
+ *
+ * Builds the real receiver (espnow_receiver.cpp, node_registry.cpp,
+ * tdma_schedule.cpp, link_diagnostics.cpp) against tools/host_shim and feeds its registered
+ * receive callback from a "WiFi task" thread, while a second thread plays
+ * the central's loop(): drain popSample(), read the registry for the UI and
+ * block for a display redraw every DISPLAY_REFRESH_INTERVAL.
+ *
+ * Simulated nodes send real BatchEncoder packets (sequence, sample numbering,
+ * retries disabled) at a configurable aggregate rate with jitter and bursts;
+ * a fraction of frames is replaced by malformed / wrong-size packets, which
+ * must all be rejected.
+ *
+ * Reports offered vs sustained packets/s, callback (decode) latency
+ * percentiles, critical-section hold times, rejected/dropped/lost counts and
+ * end-to-end sample delivery. --sweep doubles the rate until the receiver
+ * saturates. Host CPU figures are not ESP32 figures: scale per-packet costs
+ * by the host/ESP32-S3 speed ratio (roughly 10-30x) before comparing.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++17 -O2 -pthread -Itools/host_shim -Iesp32s3_central \
+ *       tools/espnow_loadgen.cpp tools/host_shim/host_shim.cpp \
+ *       esp32s3_central/espnow_receiver.cpp esp32s3_central/node_registry.cpp \
+ *       esp32s3_central/tdma_schedule.cpp esp32s3_central/link_diagnostics.cpp \
+ *       -o espnow_loadgen
+ *
+ * Usage:
+ *   ./espnow_loadgen [--nodes N] [--rate PPS] [--duration S] [--samples N]
+ *                    [--jitter MS] [--burst N] [--malformed FRACTION]
+ *                    [--ui-ms MS] [--sample-us US] [--sweep] [--seed N]
+ *   --rate 0 sends as fast as the receive path accepts frames.
+ */
+
+#include <Arduino.h>
+#include "espnow_receiver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// Options
+// ============================================================================
+
+struct Options {
+  int nodes = 20;
+  double rate = 100;          // Aggregate packets/s offered (0 = unpaced)
+  double duration = 5;        // Seconds per run
+  int samples = 10;           // Samples per batch
+  double jitterMs = 5;        // Uniform +/- jitter on every send time
+  int burst = 1;              // Packets sent back-to-back per burst
+  double malformed = 0.02;    // Fraction of frames replaced by bad packets
+  double uiMs = 50;           // Display redraw (loop blocked) every DISPLAY_REFRESH_INTERVAL
+  double sampleUs = 200;      // Per-sample logging cost in the loop (SD write)
+  bool sweep = false;
+  unsigned seed = 1;
+};
+
+static void usage() {
+  printf("usage: espnow_loadgen [--nodes N] [--rate PPS] [--duration S] [--samples N]\n"
+         "                      [--jitter MS] [--burst N] [--malformed FRACTION]\n"
+         "                      [--ui-ms MS] [--sample-us US] [--sweep] [--seed N]\n");
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (!strcmp(arg, "--sweep")) { opt.sweep = true; continue; }
+    if (!hasValue) return false;
+    const char* value = argv[++i];
+
+    if (!strcmp(arg, "--nodes")) opt.nodes = atoi(value);
+    else if (!strcmp(arg, "--rate")) opt.rate = atof(value);
+    else if (!strcmp(arg, "--duration")) opt.duration = atof(value);
+    else if (!strcmp(arg, "--samples")) opt.samples = atoi(value);
+    else if (!strcmp(arg, "--jitter")) opt.jitterMs = atof(value);
+    else if (!strcmp(arg, "--burst")) opt.burst = atoi(value);
+    else if (!strcmp(arg, "--malformed")) opt.malformed = atof(value);
+    else if (!strcmp(arg, "--ui-ms")) opt.uiMs = atof(value);
+    else if (!strcmp(arg, "--sample-us")) opt.sampleUs = atof(value);
+    else if (!strcmp(arg, "--seed")) opt.seed = (unsigned)atoi(value);
+    else return false;
+  }
+
+  return opt.nodes > 0 && opt.nodes <= 250 && opt.samples > 0 &&
+         opt.samples <= ESPNOW_BATCH_MAX_SAMPLES && opt.burst > 0 && opt.duration > 0;
+}
+
+// ============================================================================
+// Simulated nodes
+// ============================================================================
+
+struct SimNode {
+  uint8_t mac[6];
+  char nodeType[ESPNOW_NODE_TYPE_LEN];
+  uint32_t sequence = 0;
+  uint32_t nextSample = 0;
+  uint32_t clock = 0;         // Node ms clock
+  int32_t values[WX_CHANNEL_COUNT] = {2150, 4500, 101325, 1200};
+};
+
+static const uint8_t NODE_MASK = WX_MASK(WX_CH_TEMPERATURE) | WX_MASK(WX_CH_HUMIDITY) |
+                                 WX_MASK(WX_CH_PRESSURE) | WX_MASK(WX_CH_LIGHT);
+
+/**
+ * Build the node's next batch: samples 30 s apart, small random walk
+ */
+static size_t buildBatch(SimNode& node, int samples, std::mt19937& rng, BatchEncoder& encoder) {
+  std::uniform_int_distribution<int> step(-15, 15);
+
+  node.clock += 30000 * samples;
+  encoder.begin((uint8_t)(node.mac[5]), node.nodeType, ++node.sequence, node.clock, NODE_MASK);
+  encoder.setDelivery(node.nextSample, 0);
+
+  WxSample sample;
+  int packed = 0;
+  for (; packed < samples; packed++) {
+    sample.timestamp = node.clock - 30000 * (samples - 1 - packed);
+    for (int ch = 0; ch < WX_CHANNEL_COUNT; ch++) {
+      node.values[ch] += step(rng);
+      sample.values[ch] = node.values[ch];
+    }
+    if (!encoder.add(sample)) break;
+  }
+  node.nextSample += packed;
+  return (size_t)packed;
+}
+
+/**
+ * Replace a valid packet with one of the malformed variants
+ */
+static size_t corrupt(uint8_t* packet, size_t length, std::mt19937& rng) {
+  std::uniform_int_distribution<int> kind(0, 6);
+  std::uniform_int_distribution<int> byte(0, 255);
+
+  switch (kind(rng)) {
+    case 0:  // Truncated mid-sample
+      return length > sizeof(BatchHeader) + 1 ? length - 1 : sizeof(BatchHeader) - 1;
+    case 1:  // Trailing garbage (wrong size)
+      if (length < ESPNOW_MAX_PAYLOAD) packet[length++] = 0x00;
+      else packet[0] ^= 0xFF;
+      return length;
+    case 2:  // Wrong protocol version
+      packet[0] = ESPNOW_PROTOCOL_VERSION + 1;
+      return length;
+    case 3:  // Header only
+      return sizeof(BatchHeader) / 2;
+    case 4:  // Overlong varint in sample 0
+      for (size_t i = sizeof(BatchHeader); i < length; i++) packet[i] = 0xFF;
+      return length;
+    case 5: {  // Random bytes
+      std::uniform_int_distribution<int> size(1, ESPNOW_MAX_PAYLOAD);
+      size_t n = (size_t)size(rng);
+      for (size_t i = 0; i < n; i++) packet[i] = (uint8_t)byte(rng);
+      packet[0] = 0xEE;  // Keep it from ever passing as a batch
+      return n;
+    }
+    default:  // Empty frame
+      return 0;
+  }
+}
+
+// ============================================================================
+// Run
+// ============================================================================
+
+struct RunResult {
+  double offeredPps = 0;
+  double sustainedPps = 0;
+  uint64_t framesSent = 0;
+  uint64_t validSent = 0;
+  uint64_t malformedSent = 0;
+  uint64_t samplesSent = 0;
+  uint64_t samplesPopped = 0;
+  uint32_t rejected = 0;
+  uint32_t dropped = 0;
+  uint64_t acks = 0;
+  uint32_t lossCount = 0;
+  uint32_t samplesLost = 0;
+  size_t nodesTracked = 0;
+  std::vector<uint32_t> latencyNs;   // Receive callback duration per frame
+  HostCriticalStats critical = {};
+  double loopMaxGapMs = 0;           // Longest time the loop could not drain
+};
+
+static std::atomic<uint64_t> ackCount{0};
+
+static void onSend(const uint8_t*, const uint8_t* data, size_t len) {
+  if (len == sizeof(AckPacket) && data[1] == ESPNOW_MSG_ACK) ackCount++;
+}
+
+static double percentile(std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t index = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)] / 1000.0;
+}
+
+static RunResult run(const Options& opt, double rate) {
+  ESPNowReceiver receiver;
+  receiver.begin();
+  hostShimSendHook = onSend;
+  ackCount = 0;
+  hostShimResetCriticalStats();
+
+  RunResult result;
+  result.offeredPps = rate;
+  result.latencyNs.reserve(rate > 0 ? (size_t)(rate * opt.duration * 1.1) : 1 << 20);
+
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> popped{0};
+  double maxGapMs = 0;
+
+  // loop(): drain samples, touch the registry like the UI, redraw the display
+  std::thread loopThread([&] {
+    using clock = std::chrono::steady_clock;
+    auto lastRedraw = clock::now();
+    auto lastDrain = clock::now();
+    NodeSample sample;
+
+    while (running.load()) {
+      auto now = clock::now();
+      maxGapMs = std::max(maxGapMs, std::chrono::duration<double, std::milli>(now - lastDrain).count());
+      lastDrain = now;
+
+      while (receiver.popSample(sample)) {
+        popped++;
+        if (opt.sampleUs > 0) {
+          auto until = clock::now() + std::chrono::duration<double, std::micro>(opt.sampleUs);
+          while (clock::now() < until) {}
+        }
+      }
+
+      if (now - lastRedraw >= std::chrono::milliseconds(DISPLAY_REFRESH_INTERVAL)) {
+        NodeEntry node;
+        for (size_t i = 0; i < receiver.getNodeCount(); i++) receiver.getNode(i, node);
+        auto until = clock::now() + std::chrono::duration<double, std::milli>(opt.uiMs);
+        while (clock::now() < until) {}  // Display SPI transfer: the loop is blocked
+        lastRedraw = clock::now();
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  // WiFi task: deliver frames to the receive callback
+  std::mt19937 rng(opt.seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::uniform_real_distribution<double> jitter(-opt.jitterMs, opt.jitterMs);
+  std::uniform_int_distribution<int> rssi(-90, -40);
+
+  std::vector<SimNode> nodes(opt.nodes);
+  for (int i = 0; i < opt.nodes; i++) {
+    uint8_t mac[6] = {0x24, 0x0A, 0xC4, 0x00, (uint8_t)(i >> 8), (uint8_t)i};
+    memcpy(nodes[i].mac, mac, 6);
+    snprintf(nodes[i].nodeType, sizeof(nodes[i].nodeType), "node%02d", i);
+  }
+
+  BatchEncoder encoder;
+  uint8_t packet[ESPNOW_MAX_PAYLOAD + 1];
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::duration<double>(opt.duration);
+  uint64_t frame = 0;
+
+  while (std::chrono::steady_clock::now() < end) {
+    if (rate > 0) {
+      // Frames of a burst share one send time; every frame gets its own jitter
+      double due = (double)(frame / opt.burst) * opt.burst / rate * 1000.0 + jitter(rng);
+      auto at = start + std::chrono::duration<double, std::milli>(std::max(0.0, due));
+      std::this_thread::sleep_until(at);
+    }
+
+    SimNode& node = nodes[frame % nodes.size()];
+    size_t samples = buildBatch(node, opt.samples, rng, encoder);
+    size_t length = encoder.size();
+    memcpy(packet, encoder.data(), length);
+
+    bool bad = unit(rng) < opt.malformed;
+    if (bad) {
+      length = corrupt(packet, length, rng);
+      node.sequence--;                  // The node never sent this sequence
+      node.nextSample -= samples;
+      result.malformedSent++;
+    } else {
+      result.validSent++;
+      result.samplesSent += samples;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    hostShimInjectFrame(node.mac, packet, (int)length, (int8_t)rssi(rng));
+    auto t1 = std::chrono::steady_clock::now();
+    result.latencyNs.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+
+    frame++;
+  }
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Let loop() catch up before counting what it drained
+  std::this_thread::sleep_for(std::chrono::milliseconds(DISPLAY_REFRESH_INTERVAL + (int)opt.uiMs + 50));
+  running = false;
+  loopThread.join();
+
+  result.framesSent = frame;
+  result.sustainedPps = frame / elapsed;
+  result.samplesPopped = popped.load();
+  result.rejected = receiver.getRejectedCount();
+  result.dropped = receiver.getDroppedSampleCount();
+  result.acks = ackCount.load();
+  result.critical = hostShimCriticalStats();
+  result.loopMaxGapMs = maxGapMs;
+
+  NodeEntry node;
+  for (size_t i = 0; i < receiver.getNodeCount(); i++) {
+    if (!receiver.getNode(i, node)) break;
+    result.lossCount += node.lossCount;
+    result.samplesLost += node.samplesLost;
+    result.nodesTracked++;
+  }
+
+  if (rate <= 0) result.offeredPps = result.sustainedPps;
+  std::sort(result.latencyNs.begin(), result.latencyNs.end());
+  return result;
+}
+
+// ============================================================================
+// Report
+// ============================================================================
+
+static void printReport(const Options& opt, RunResult& r) {
+  uint64_t delivered = r.samplesPopped + r.dropped;
+  printf("\n=== %d nodes, %d samples/batch, offered %.0f pkt/s, burst %d, jitter +/-%.1f ms ===\n",
+         opt.nodes, opt.samples, r.offeredPps, opt.burst, opt.jitterMs);
+  printf("frames:     %llu sent (%llu valid, %llu malformed), sustained %.0f pkt/s\n",
+         (unsigned long long)r.framesSent, (unsigned long long)r.validSent,
+         (unsigned long long)r.malformedSent, r.sustainedPps);
+  printf("decode:     p50 %.1f us  p90 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+         percentile(r.latencyNs, 50), percentile(r.latencyNs, 90), percentile(r.latencyNs, 99),
+         percentile(r.latencyNs, 99.9), percentile(r.latencyNs, 100));
+  printf("critical:   %llu sections, max hold %llu us, %.3f%% of wall time\n",
+         (unsigned long long)r.critical.count, (unsigned long long)r.critical.maxUs,
+         r.critical.totalUs / (opt.duration * 1e4));
+  printf("rejected:   %u (expected %llu)%s\n", r.rejected, (unsigned long long)r.malformedSent,
+         r.rejected == r.malformedSent ? "" : "  <-- MISMATCH");
+  printf("acks:       %llu (expected %llu)\n", (unsigned long long)r.acks, (unsigned long long)r.validSent);
+  printf("samples:    %llu sent, %llu drained by loop(), %u dropped (queue full), %u lost by numbering\n",
+         (unsigned long long)r.samplesSent, (unsigned long long)r.samplesPopped, r.dropped, r.samplesLost);
+  printf("loss:       %.3f%% of samples, %u packet sequence gaps, %zu/%d nodes tracked\n",
+         r.samplesSent ? 100.0 * (r.samplesSent - std::min<uint64_t>(r.samplesPopped, r.samplesSent)) / r.samplesSent : 0.0,
+         r.lossCount, r.nodesTracked, opt.nodes);
+  printf("loop():     longest gap between drains %.1f ms (queue holds %d samples)\n",
+         r.loopMaxGapMs, ESPNOW_SAMPLE_QUEUE_SIZE);
+  if (delivered != r.samplesSent) {
+    printf("WARNING:    %llu samples unaccounted for\n",
+           (unsigned long long)(r.samplesSent > delivered ? r.samplesSent - delivered : delivered - r.samplesSent));
+  }
+}
+
+/**
+ * Saturated: frames not absorbed at the offered rate, samples dropped, or
+ * malformed frames not rejected one-for-one
+ */
+static bool saturated(const RunResult& r) {
+  return r.sustainedPps < 0.95 * r.offeredPps || r.dropped > 0 || r.rejected != r.malformedSent ||
+         r.samplesPopped < r.samplesSent;
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage();
+    return 2;
+  }
+
+  if (!opt.sweep) {
+    RunResult r = run(opt, opt.rate);
+    printReport(opt, r);
+    return saturated(r) ? 1 : 0;
+  }
+
+  printf("%10s %10s %9s %9s %9s %8s %8s\n", "offered", "sustained", "p50 us", "p99 us", "max us", "dropped", "lost");
+  double lastGood = 0;
+  for (double rate = std::max(opt.rate, 10.0); rate <= 1e6; rate *= 2) {
+    RunResult r = run(opt, rate);
+    printf("%10.0f %10.0f %9.1f %9.1f %9.1f %8u %8llu\n", r.offeredPps, r.sustainedPps,
+           percentile(r.latencyNs, 50), percentile(r.latencyNs, 99), percentile(r.latencyNs, 100),
+           r.dropped, (unsigned long long)(r.samplesSent - std::min<uint64_t>(r.samplesPopped, r.samplesSent)));
+    if (saturated(r)) {
+      printf("\nSaturation between %.0f and %.0f pkt/s (%d nodes, %d samples/batch, %.0f ms UI redraw)\n",
+             lastGood, rate, opt.nodes, opt.samples, opt.uiMs);
+      printReport(opt, r);
+      return 0;
+    }
+    lastGood = rate;
+  }
+
+  printf("\nNo saturation up to %.0f pkt/s\n", lastGood);
+  return 0;
+}
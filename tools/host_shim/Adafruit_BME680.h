@@ -0,0 +1,11 @@
+/**
+ * @file Adafruit_BME680.h
+ * @brief Sensor driver placeholder: sensor_manager.h declares one
+ */
+
+#ifndef HOST_SHIM_ADAFRUIT_BME680_H
+#define HOST_SHIM_ADAFRUIT_BME680_H
+
+class Adafruit_BME680 {};
+
+#endif // HOST_SHIM_ADAFRUIT_BME680_H
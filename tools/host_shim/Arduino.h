@@ -0,0 +1,183 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino/ESP32 shim so firmware modules build on Linux
+ *
+ * Only what the host tools in tools/ need: Serial (discarded unless
+ * hostShimEchoSerial is set), millis()/micros() on a steady clock, and
+ * portMUX critical sections backed by a spinlock that also records hold
+ * times (the ESP32 masks interrupts while one is held, so long holds
+ * starve everything else on the core). String, ESP and the FreeRTOS handle
+ * types are enough for MLPredictor and the headers it includes; tasks,
+ * notifications and mutexes on host threads are enough for DataLogger.
+ */
+
+#ifndef HOST_SHIM_ARDUINO_H
+#define HOST_SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <string>
+
+class __FlashStringHelper;
+#define F(x) (reinterpret_cast<const __FlashStringHelper*>(x))
+#define PROGMEM
+#define HEX 16
+#define DEC 10
+
+// Pin numbers, for config.h (nothing drives them on the host)
+enum gpio_num_t {
+  GPIO_NUM_0, GPIO_NUM_1, GPIO_NUM_2, GPIO_NUM_3, GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_6, GPIO_NUM_7,
+  GPIO_NUM_8, GPIO_NUM_9, GPIO_NUM_10, GPIO_NUM_11, GPIO_NUM_12, GPIO_NUM_13, GPIO_NUM_14,
+  GPIO_NUM_15, GPIO_NUM_16, GPIO_NUM_17, GPIO_NUM_18, GPIO_NUM_19, GPIO_NUM_20, GPIO_NUM_21,
+  GPIO_NUM_22, GPIO_NUM_23, GPIO_NUM_24, GPIO_NUM_25, GPIO_NUM_26, GPIO_NUM_27, GPIO_NUM_28,
+  GPIO_NUM_29, GPIO_NUM_30, GPIO_NUM_31, GPIO_NUM_32, GPIO_NUM_33, GPIO_NUM_34, GPIO_NUM_35,
+  GPIO_NUM_36, GPIO_NUM_37, GPIO_NUM_38, GPIO_NUM_39, GPIO_NUM_40, GPIO_NUM_41, GPIO_NUM_42,
+  GPIO_NUM_43, GPIO_NUM_44, GPIO_NUM_45, GPIO_NUM_46, GPIO_NUM_47, GPIO_NUM_48
+};
+
+extern bool hostShimEchoSerial;
+
+/**
+ * Arduino String over std::string (what the firmware modules use of it)
+ */
+class String {
+public:
+  String() {}
+  String(const char* s) : text(s ? s : "") {}
+  String(const __FlashStringHelper* s) : text((const char*)s) {}
+
+  const char* c_str() const { return text.c_str(); }
+  size_t length() const { return text.size(); }
+  bool isEmpty() const { return text.empty(); }
+  String& operator+=(const String& other) { text += other.text; return *this; }
+  String operator+(const String& other) const { String sum(*this); sum += other; return sum; }
+  bool operator==(const String& other) const { return text == other.text; }
+  bool operator==(const char* other) const { return text == other; }
+  bool operator!=(const String& other) const { return text != other.text; }
+
+private:
+  std::string text;
+};
+
+/**
+ * Serial replacement: prints to stdout only when hostShimEchoSerial is set
+ */
+class HostSerial {
+public:
+  void begin(unsigned long) {}
+  void flush() { fflush(stdout); }
+
+  void print(const __FlashStringHelper* s) { print((const char*)s); }
+  void print(const char* s) { if (hostShimEchoSerial) fputs(s, stdout); }
+  void print(const String& s) { print(s.c_str()); }
+  void print(char c) { if (hostShimEchoSerial) fputc(c, stdout); }
+  void print(long v, int base = DEC) { if (hostShimEchoSerial) printf(base == HEX ? "%lX" : "%ld", v); }
+  void print(int v, int base = DEC) { print((long)v, base); }
+  void print(unsigned long v, int base = DEC) { if (hostShimEchoSerial) printf(base == HEX ? "%lX" : "%lu", v); }
+  void print(unsigned int v, int base = DEC) { print((unsigned long)v, base); }
+  void print(double v, int digits = 2) { if (hostShimEchoSerial) printf("%.*f", digits, v); }
+
+  template <typename T> void println(T v) { print(v); println(); }
+  template <typename T> void println(T v, int format) { print(v, format); println(); }
+  void println() { print('\n'); }
+};
+
+extern HostSerial Serial;
+
+extern uint32_t hostShimClockRate;      // millis(), micros(), delay() and task waits run this many times faster
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+/**
+ * ESP object: cycles count host time at hostShimCpuMHz, so cycle figures
+ * read as if the host ran at the ESP32-S3's clock
+ */
+class EspClass {
+public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz();
+  uint32_t getFreeHeap();
+};
+
+extern EspClass ESP;
+extern uint32_t hostShimCpuMHz;         // Default 240
+
+extern bool hostShimPsram;              // psramFound(), default true
+bool psramFound();
+
+// ============================================================================
+// FreeRTOS
+// ============================================================================
+
+// A task is a detached host thread; the tick is 1 ms of the shim's clock
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackBytes, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+
+/**
+ * Stop every task started so far, for good, as a reset would: each one
+ * parks at its next vTaskDelay() or ulTaskNotifyTake() (where the firmware's
+ * tasks hold no lock) and this returns once all of them have. The objects
+ * they ran on must then be left in place, never destroyed
+ */
+void hostShimHaltTasks();
+
+// ============================================================================
+// portMUX critical sections
+// ============================================================================
+
+struct portMUX_TYPE {
+  std::atomic<bool> locked;
+  uint64_t enteredAt;  // micros() when taken
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+void hostShimEnterCritical(portMUX_TYPE* mux);
+void hostShimExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux) hostShimEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) hostShimExitCritical(mux)
+
+/**
+ * Critical section statistics since the last reset
+ */
+struct HostCriticalStats {
+  uint64_t count;
+  uint64_t totalUs;
+  uint64_t maxUs;
+};
+
+HostCriticalStats hostShimCriticalStats();
+void hostShimResetCriticalStats();
+
+#endif // HOST_SHIM_ARDUINO_H
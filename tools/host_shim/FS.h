@@ -0,0 +1,137 @@
+/**
+ * @file FS.h
+ * @brief Arduino FS / File on a host directory
+ *
+ * A file system is mounted on a directory with hostShimMount(); firmware
+ * paths ("/ml_model.bin") are resolved under it. Until then every open
+ * fails, as on a station without the card or partition.
+ *
+ * For the logger's checks a file system can also be ejected or made to
+ * fail its writes, reports its capacity as set by hostShimSetCapacity(),
+ * and counts what goes through it (hostShimFsStats(), hostShimWriteHook).
+ */
+
+#ifndef HOST_SHIM_FS_H
+#define HOST_SHIM_FS_H
+
+#include "Arduino.h"
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+class FS;
+
+/**
+ * Open file or directory; copies share the handle, which closes with the last of them
+ */
+class File {
+public:
+  File() {}
+  File(FS* fs, FILE* file, const std::string& path);
+  File(FS* fs, const std::string& path, std::vector<std::string> entries);
+
+  operator bool() const { return (bool)handle || directory; }
+
+  size_t read(uint8_t* buffer, size_t length);
+  int read();
+  size_t write(const uint8_t* buffer, size_t length);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  bool seek(uint32_t position, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void flush();
+  void close();
+  const char* name() const;
+  bool isDirectory() const { return (bool)directory; }
+  File openNextFile();
+
+private:
+  struct Listing {
+    std::vector<std::string> entries;   // Full firmware paths, sorted
+    size_t next = 0;
+  };
+
+  FS* fs = nullptr;
+  std::shared_ptr<FILE> handle;
+  std::shared_ptr<Listing> directory;
+  std::string path;
+};
+
+/**
+ * What went through a file system since it was mounted or its stats reset
+ */
+struct HostFsStats {
+  uint64_t opens;
+  uint64_t reads;             // read() calls
+  uint64_t bytesRead;
+  uint64_t writes;            // write() calls that reached the file
+  uint64_t bytesWritten;
+  uint64_t flushes;
+};
+
+class FS {
+public:
+  File open(const char* path, const char* mode = FILE_READ, bool create = false);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+  bool mkdir(const char* path);
+  bool rmdir(const char* path);
+  uint64_t totalBytes() { return mounted() ? capacity : 0; }
+  uint64_t usedBytes();
+
+protected:
+  friend class File;
+  friend void hostShimMount(FS& fs, const char* directory);
+  friend void hostShimEject(FS& fs, bool ejected);
+  friend void hostShimFailWrites(FS& fs, bool fail);
+  friend void hostShimSetCapacity(FS& fs, uint64_t bytes);
+  friend HostFsStats hostShimFsStats(FS& fs);
+  friend void hostShimResetFsStats(FS& fs);
+
+  std::string root;                     // Empty: not mounted
+  std::atomic<bool> ejected{false};
+  std::atomic<bool> failWrites{false};
+  uint64_t capacity = 1ULL << 30;
+  std::atomic<uint64_t> opens{0}, reads{0}, bytesRead{0}, writes{0}, bytesWritten{0}, flushes{0};
+
+  bool mounted() const { return !root.empty() && !ejected; }
+  std::string hostPath(const char* path) const { return root + path; }
+};
+
+/**
+ * Serve fs from directory (which must exist)
+ */
+void hostShimMount(FS& fs, const char* directory);
+
+/**
+ * Take the card out (begin(), open() and exists() fail, and so does every
+ * read and write of a file already open), or put it back
+ */
+void hostShimEject(FS& fs, bool ejected);
+
+/**
+ * Make every write return 0 (a card that answers but no longer takes data), or stop
+ */
+void hostShimFailWrites(FS& fs, bool fail);
+
+/**
+ * Size reported by totalBytes() (default 1 GB); usedBytes() is what the files take
+ */
+void hostShimSetCapacity(FS& fs, uint64_t bytes);
+
+HostFsStats hostShimFsStats(FS& fs);
+void hostShimResetFsStats(FS& fs);
+
+/**
+ * Called for every write that reaches a file, with the offset it went to
+ */
+typedef void (*HostWriteHook)(FS& fs, const char* path, uint32_t offset, const uint8_t* data, size_t length);
+extern HostWriteHook hostShimWriteHook;
+
+#endif // HOST_SHIM_FS_H
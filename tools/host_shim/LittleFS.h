@@ -0,0 +1,19 @@
+/**
+ * @file LittleFS.h
+ * @brief LittleFS partition on a host directory (see FS.h)
+ */
+
+#ifndef HOST_SHIM_LITTLEFS_H
+#define HOST_SHIM_LITTLEFS_H
+
+#include "FS.h"
+
+class LittleFSFS : public FS {
+public:
+  bool begin(bool = false) { return mounted(); }
+  void end() {}
+};
+
+extern LittleFSFS LittleFS;
+
+#endif // HOST_SHIM_LITTLEFS_H
@@ -0,0 +1,19 @@
+/**
+ * @file SD.h
+ * @brief SD card on a host directory (see FS.h)
+ */
+
+#ifndef HOST_SHIM_SD_H
+#define HOST_SHIM_SD_H
+
+#include "FS.h"
+
+class SDFS : public FS {
+public:
+  bool begin(uint8_t = 0) { return mounted(); }
+  void end() {}
+};
+
+extern SDFS SD;
+
+#endif // HOST_SHIM_SD_H
@@ -0,0 +1,21 @@
+/**
+ * @file WiFi.h
+ * @brief Host shim: WiFi object with the calls ESP-NOW code makes
+ */
+
+#ifndef HOST_SHIM_WIFI_H
+#define HOST_SHIM_WIFI_H
+
+#include "Arduino.h"
+
+#define WIFI_STA 1
+
+class HostWiFi {
+public:
+  bool mode(int) { return true; }
+  int8_t RSSI() { return 0; }
+};
+
+extern HostWiFi WiFi;
+
+#endif // HOST_SHIM_WIFI_H
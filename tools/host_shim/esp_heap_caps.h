@@ -0,0 +1,19 @@
+/**
+ * @file esp_heap_caps.h
+ * @brief ESP-IDF capability allocator on the host heap (capabilities ignored)
+ */
+
+#ifndef HOST_SHIM_ESP_HEAP_CAPS_H
+#define HOST_SHIM_ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void* heap_caps_malloc(size_t size, unsigned int) { return malloc(size); }
+inline void heap_caps_free(void* memory) { free(memory); }
+
+#endif // HOST_SHIM_ESP_HEAP_CAPS_H
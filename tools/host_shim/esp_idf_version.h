@@ -0,0 +1,12 @@
+/**
+ * @file esp_idf_version.h
+ * @brief Host shim: pretend to be IDF 5 (receive callback carries rx_ctrl)
+ */
+
+#ifndef HOST_SHIM_ESP_IDF_VERSION_H
+#define HOST_SHIM_ESP_IDF_VERSION_H
+
+#define ESP_IDF_VERSION_MAJOR 5
+#define ESP_IDF_VERSION_MINOR 1
+
+#endif // HOST_SHIM_ESP_IDF_VERSION_H
@@ -0,0 +1,58 @@
+/**
+ * @file esp_now.h
+ * @brief Host shim: ESP-NOW API (IDF 5 flavour) backed by in-process hooks
+ *
+ * Registered callbacks are kept so a host tool can inject frames exactly as
+ * the WiFi task would (hostShimInjectFrame), and every esp_now_send() is
+ * handed to hostShimSendHook.
+ */
+
+#ifndef HOST_SHIM_ESP_NOW_H
+#define HOST_SHIM_ESP_NOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_wifi.h"
+
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_MAX_DATA_LEN 250
+
+typedef enum { ESP_NOW_SEND_SUCCESS = 0, ESP_NOW_SEND_FAIL } esp_now_send_status_t;
+
+typedef struct {
+  uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+  uint8_t lmk[16];
+  uint8_t channel;
+  int ifidx;
+  bool encrypt;
+  void* priv;
+} esp_now_peer_info_t;
+
+typedef struct {
+  uint8_t* src_addr;
+  uint8_t* des_addr;
+  wifi_pkt_rx_ctrl_t* rx_ctrl;
+} esp_now_recv_info_t;
+
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t* info, const uint8_t* data, int len);
+typedef void (*esp_now_send_cb_t)(const uint8_t* mac, esp_now_send_status_t status);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_deinit();
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer);
+bool esp_now_is_peer_exist(const uint8_t* mac);
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t len);
+
+// Host side
+typedef void (*HostSendHook)(const uint8_t* mac, const uint8_t* data, size_t len);
+extern HostSendHook hostShimSendHook;
+
+/**
+ * Deliver a frame to the registered receive callback (as the WiFi task would)
+ * @return false if no callback is registered
+ */
+bool hostShimInjectFrame(const uint8_t* srcMac, const uint8_t* data, int len, int8_t rssi);
+
+#endif // HOST_SHIM_ESP_NOW_H
@@ -0,0 +1,11 @@
+/**
+ * @file esp_task_wdt.h
+ * @brief Task watchdog (nothing watches on the host)
+ */
+
+#ifndef HOST_SHIM_ESP_TASK_WDT_H
+#define HOST_SHIM_ESP_TASK_WDT_H
+
+inline int esp_task_wdt_reset() { return 0; }
+
+#endif // HOST_SHIM_ESP_TASK_WDT_H
@@ -0,0 +1,21 @@
+/**
+ * @file esp_wifi.h
+ * @brief Host shim: the parts of the WiFi driver API ESP-NOW code touches
+ */
+
+#ifndef HOST_SHIM_ESP_WIFI_H
+#define HOST_SHIM_ESP_WIFI_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef struct {
+  int8_t rssi;
+  uint8_t channel;
+  uint16_t sig_len;
+} wifi_pkt_rx_ctrl_t;
+
+#endif // HOST_SHIM_ESP_WIFI_H
@@ -0,0 +1,462 @@
+/**
+ * @file host_shim.cpp
+ * @brief Host shim implementation
+ */
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_now.h"
+#include "SD.h"
+#include "LittleFS.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+HostSerial Serial;
+HostWiFi WiFi;
+EspClass ESP;
+SDFS SD;
+LittleFSFS LittleFS;
+bool hostShimEchoSerial = false;
+uint32_t hostShimCpuMHz = 240;
+uint32_t hostShimClockRate = 1;
+bool hostShimPsram = true;
+HostSendHook hostShimSendHook = nullptr;
+HostWriteHook hostShimWriteHook = nullptr;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - startTime).count() * hostShimClockRate;
+}
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - startTime).count() * hostShimClockRate;
+}
+
+/**
+ * Host time that ms of the shim's clock take
+ */
+static std::chrono::microseconds hostDuration(unsigned long ms) {
+  return std::chrono::microseconds((uint64_t)ms * 1000 / hostShimClockRate);
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(hostDuration(ms));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+uint32_t EspClass::getCycleCount() {
+  uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+  return (uint32_t)(ns * hostShimCpuMHz / 1000);
+}
+
+uint32_t EspClass::getCpuFreqMHz() {
+  return hostShimCpuMHz;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return 320 * 1024;  // Internal RAM left on a running station, roughly; nothing tracks it here
+}
+
+bool psramFound() {
+  return hostShimPsram;
+}
+
+// ============================================================================
+// FreeRTOS
+// ============================================================================
+
+struct HostTask {
+  TaskFunction_t function;
+  void* arg;
+  std::mutex mutex;
+  std::condition_variable wake;
+  uint32_t notifications = 0;
+  bool halted = false;
+  bool parked = false;
+};
+
+struct HostMutex {
+  std::mutex mutex;
+  std::condition_variable released;
+  bool taken = false;
+};
+
+static std::mutex tasksMutex;
+static std::vector<HostTask*> tasks;
+static thread_local HostTask* currentTask = nullptr;
+
+/**
+ * Halted: stay here for good (lock is the task's own)
+ */
+static void parkIfHalted(HostTask* task, std::unique_lock<std::mutex>& lock) {
+  if (!task->halted) return;
+  task->parked = true;
+  task->wake.notify_all();
+  task->wake.wait(lock, [] { return false; });
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char*, uint32_t, void* arg,
+                                   UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+  HostTask* task = new HostTask();
+  task->function = function;
+  task->arg = arg;
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    tasks.push_back(task);
+  }
+  if (handle) *handle = task;
+
+  std::thread([task] {
+    currentTask = task;
+    task->function(task->arg);
+  }).detach();
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  HostTask* task = currentTask;
+  if (!task) {
+    delay(ticks);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(task->mutex);
+  parkIfHalted(task, lock);
+  task->wake.wait_for(lock, hostDuration(ticks), [task] { return task->halted; });
+  parkIfHalted(task, lock);
+}
+
+void xTaskNotifyGive(TaskHandle_t handle) {
+  HostTask* task = static_cast<HostTask*>(handle);
+  if (!task) return;
+
+  std::lock_guard<std::mutex> lock(task->mutex);
+  task->notifications++;
+  task->wake.notify_all();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  HostTask* task = currentTask;
+  if (!task) return 0;
+
+  std::unique_lock<std::mutex> lock(task->mutex);
+  parkIfHalted(task, lock);
+  auto ready = [task] { return task->notifications > 0 || task->halted; };
+  if (ticks == portMAX_DELAY) {
+    task->wake.wait(lock, ready);
+  } else {
+    task->wake.wait_for(lock, hostDuration(ticks), ready);
+  }
+  parkIfHalted(task, lock);
+
+  uint32_t value = task->notifications;
+  if (value > 0) task->notifications = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+void hostShimHaltTasks() {
+  std::vector<HostTask*> running;
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    running.swap(tasks);
+  }
+
+  for (HostTask* task : running) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->halted = true;
+    task->wake.notify_all();
+  }
+  for (HostTask* task : running) {
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->wake.wait(lock, [task] { return task->parked; });
+  }
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new HostMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+  HostMutex* mutex = static_cast<HostMutex*>(handle);
+  std::unique_lock<std::mutex> lock(mutex->mutex);
+  auto free = [mutex] { return !mutex->taken; };
+  if (ticks == portMAX_DELAY) {
+    mutex->released.wait(lock, free);
+  } else if (!mutex->released.wait_for(lock, hostDuration(ticks), free)) {
+    return pdFALSE;
+  }
+  mutex->taken = true;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+  HostMutex* mutex = static_cast<HostMutex*>(handle);
+  std::lock_guard<std::mutex> lock(mutex->mutex);
+  if (!mutex->taken) return pdFALSE;
+  mutex->taken = false;
+  mutex->released.notify_one();
+  return pdTRUE;
+}
+
+// ============================================================================
+// File systems
+// ============================================================================
+
+File::File(FS* owner, FILE* file, const std::string& filePath) : fs(owner), handle(file, fclose), path(filePath) {
+}
+
+File::File(FS* owner, const std::string& dirPath, std::vector<std::string> entries)
+  : fs(owner), directory(std::make_shared<Listing>()), path(dirPath) {
+  directory->entries = std::move(entries);
+}
+
+size_t File::read(uint8_t* buffer, size_t length) {
+  if (!handle || fs->ejected) return 0;
+  size_t n = fread(buffer, 1, length, handle.get());
+  fs->reads++;
+  fs->bytesRead += n;
+  return n;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::write(const uint8_t* buffer, size_t length) {
+  if (!handle || fs->ejected || fs->failWrites) return 0;
+  long offset = ftell(handle.get());
+  size_t n = fwrite(buffer, 1, length, handle.get());
+  fs->writes++;
+  fs->bytesWritten += n;
+  if (hostShimWriteHook) hostShimWriteHook(*fs, path.c_str(), (uint32_t)offset, buffer, n);
+  return n;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+  int whence = mode == SeekCur ? SEEK_CUR : mode == SeekEnd ? SEEK_END : SEEK_SET;
+  return handle && !fs->ejected && fseek(handle.get(), (long)position, whence) == 0;
+}
+
+size_t File::position() const {
+  return handle ? (size_t)ftell(handle.get()) : 0;
+}
+
+size_t File::size() const {
+  if (!handle) return 0;
+  long at = ftell(handle.get());
+  fseek(handle.get(), 0, SEEK_END);
+  long end = ftell(handle.get());
+  fseek(handle.get(), at, SEEK_SET);
+  return (size_t)end;
+}
+
+void File::flush() {
+  if (!handle) return;
+  fflush(handle.get());
+  fs->flushes++;
+}
+
+void File::close() {
+  handle.reset();
+  directory.reset();
+}
+
+const char* File::name() const {
+  size_t slash = path.rfind('/');
+  return path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+File File::openNextFile() {
+  if (!directory || directory->next >= directory->entries.size()) return File();
+  return fs->open(directory->entries[directory->next++].c_str());
+}
+
+File FS::open(const char* path, const char* mode, bool) {
+  if (!mounted()) return File();
+  opens++;
+
+  struct stat info;
+  if (mode[0] == 'r' && stat(hostPath(path).c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+    std::vector<std::string> entries;
+    DIR* dir = opendir(hostPath(path).c_str());
+    if (!dir) return File();
+    std::string prefix = strcmp(path, "/") == 0 ? "/" : std::string(path) + "/";
+    while (dirent* entry = readdir(dir)) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) entries.push_back(prefix + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(entries.begin(), entries.end());
+    return File(this, path, std::move(entries));
+  }
+
+  const char* hostMode = mode[0] == 'w' ? (mode[1] == '+' ? "w+b" : "wb")
+                       : mode[0] == 'a' ? (mode[1] == '+' ? "a+b" : "ab")
+                                        : (mode[1] == '+' ? "r+b" : "rb");
+  FILE* file = fopen(hostPath(path).c_str(), hostMode);
+  return file ? File(this, file, path) : File();
+}
+
+bool FS::exists(const char* path) {
+  struct stat info;
+  return mounted() && stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return mounted() && ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return mounted() && ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  return mounted() && (::mkdir(hostPath(path).c_str(), 0755) == 0 || exists(path));
+}
+
+bool FS::rmdir(const char* path) {
+  return mounted() && ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+/**
+ * Bytes the files under hostDir take
+ */
+static uint64_t treeBytes(const std::string& hostDir) {
+  uint64_t bytes = 0;
+  DIR* dir = opendir(hostDir.c_str());
+  if (!dir) return 0;
+  while (dirent* entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    std::string child = hostDir + "/" + entry->d_name;
+    struct stat info;
+    if (stat(child.c_str(), &info) != 0) continue;
+    bytes += S_ISDIR(info.st_mode) ? treeBytes(child) : (uint64_t)info.st_size;
+  }
+  closedir(dir);
+  return bytes;
+}
+
+uint64_t FS::usedBytes() {
+  return mounted() ? treeBytes(root) : 0;
+}
+
+void hostShimMount(FS& fs, const char* directory) {
+  fs.root = directory;
+  while (fs.root.size() > 1 && fs.root.back() == '/') fs.root.pop_back();
+}
+
+void hostShimEject(FS& fs, bool ejected) {
+  fs.ejected = ejected;
+}
+
+void hostShimFailWrites(FS& fs, bool fail) {
+  fs.failWrites = fail;
+}
+
+void hostShimSetCapacity(FS& fs, uint64_t bytes) {
+  fs.capacity = bytes;
+}
+
+HostFsStats hostShimFsStats(FS& fs) {
+  return HostFsStats{fs.opens.load(), fs.reads.load(), fs.bytesRead.load(),
+                     fs.writes.load(), fs.bytesWritten.load(), fs.flushes.load()};
+}
+
+void hostShimResetFsStats(FS& fs) {
+  fs.opens = 0;
+  fs.reads = 0;
+  fs.bytesRead = 0;
+  fs.writes = 0;
+  fs.bytesWritten = 0;
+  fs.flushes = 0;
+}
+
+// ============================================================================
+// Critical sections
+// ============================================================================
+
+static std::atomic<uint64_t> criticalCount{0};
+static std::atomic<uint64_t> criticalTotalUs{0};
+static std::atomic<uint64_t> criticalMaxUs{0};
+
+static uint64_t nowUs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+}
+
+void hostShimEnterCritical(portMUX_TYPE* mux) {
+  while (mux->locked.exchange(true, std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  mux->enteredAt = nowUs();
+}
+
+void hostShimExitCritical(portMUX_TYPE* mux) {
+  uint64_t held = nowUs() - mux->enteredAt;
+  mux->locked.store(false, std::memory_order_release);
+
+  criticalCount++;
+  criticalTotalUs += held;
+  uint64_t max = criticalMaxUs.load();
+  while (held > max && !criticalMaxUs.compare_exchange_weak(max, held)) {}
+}
+
+HostCriticalStats hostShimCriticalStats() {
+  return HostCriticalStats{criticalCount.load(), criticalTotalUs.load(), criticalMaxUs.load()};
+}
+
+void hostShimResetCriticalStats() {
+  criticalCount = 0;
+  criticalTotalUs = 0;
+  criticalMaxUs = 0;
+}
+
+// ============================================================================
+// ESP-NOW
+// ============================================================================
+
+static esp_now_recv_cb_t recvCallback = nullptr;
+static esp_now_send_cb_t sendCallback = nullptr;
+
+esp_err_t esp_now_init() { return ESP_OK; }
+esp_err_t esp_now_deinit() { recvCallback = nullptr; sendCallback = nullptr; return ESP_OK; }
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) { recvCallback = cb; return ESP_OK; }
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) { sendCallback = cb; return ESP_OK; }
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t*) { return ESP_OK; }
+bool esp_now_is_peer_exist(const uint8_t*) { return true; }
+
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t len) {
+  if (len > ESP_NOW_MAX_DATA_LEN) return ESP_FAIL;
+  if (hostShimSendHook) hostShimSendHook(mac, data, len);
+  if (sendCallback) sendCallback(mac, ESP_NOW_SEND_SUCCESS);
+  return ESP_OK;
+}
+
+bool hostShimInjectFrame(const uint8_t* srcMac, const uint8_t* data, int len, int8_t rssi) {
+  if (recvCallback == nullptr) return false;
+
+  uint8_t src[ESP_NOW_ETH_ALEN];
+  uint8_t dst[ESP_NOW_ETH_ALEN] = {0};
+  memcpy(src, srcMac, ESP_NOW_ETH_ALEN);
+  wifi_pkt_rx_ctrl_t rxCtrl = {};
+  rxCtrl.rssi = rssi;
+  rxCtrl.sig_len = (uint16_t)len;
+
+  esp_now_recv_info_t info = {src, dst, &rxCtrl};
+  recvCallback(&info, data, len);
+  return true;
+}
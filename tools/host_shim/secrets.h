@@ -0,0 +1,8 @@
+/**
+ * @file secrets.h
+ * @brief Host shim: placeholder credentials for host builds
+ *
+ * A real esp32s3_central/secrets.h takes precedence (same-directory include).
+ */
+
+#include "secrets_template.h"
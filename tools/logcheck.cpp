@@ -0,0 +1,988 @@
+/**
+ * @file logcheck.cpp
+ * @brief Host checks of the SD log: DataLogger, LogRetention and the flash spool
+ *
+ * Builds the logger's own sources against tools/host_shim, with the SD card
+ * and LittleFS on two directories under a scratch directory, and drives it
+ * through its public API the way the station does: records in time order
+ * from writeRecord(), the drain and retention tasks on host threads, a reset
+ * as hostShimHaltTasks() followed by a new DataLogger on the same files.
+ * Every check compares what the logger reads back with the records it was
+ * given:
+ *
+ * 1. writes: data writes to a partition end on the flush policy's chunk
+ *    (4096, then 512) unless they are partial writes forced by a sync
+ * 2. ranges: random readRange() spans, the file reads a one-record lookup
+ *    takes, exportCSV() and readFile()
+ * 3. reset: a reset in the middle of a day whose index is then lost
+ * 4. rollups: readRollups() against sums of the records, and the
+ *    resolution and file reads of readSummary()
+ * 5. charts: LttbSampler on random series (first and last kept, in order,
+ *    every point taken from the input)
+ * 6. damage: a record corrupted in the middle and a torn one at the end of
+ *    the open day
+ * 7. compaction: closed days become .wxc and read back the same; a late
+ *    record for a compressed day
+ * 8. retention: the raw-days limit, then the minimum free space (oldest days first)
+ * 9. spool: no card at boot, writes failing at runtime, a reset with records
+ *    spooled, the card failing or a reset in the middle of writing the spool
+ *    back (records, node lines and rollups each once), and the spool's quota
+ *    (oldest records dropped, in order)
+ *
+ * The shim's clock runs --rate times faster than the host's, so the
+ * logger's timers (card probe, flush delay, retention slices) run in
+ * seconds. Figures that depend on timing (slice times, throughput) are the
+ * host's, not the station's.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++17 -O2 -pthread -Itools/host_shim -Iesp32s3_central tools/logcheck.cpp \
+ *       tools/host_shim/host_shim.cpp esp32s3_central/data_logger.cpp esp32s3_central/log_retention.cpp \
+ *       esp32s3_central/log_spool.cpp esp32s3_central/log_ring.cpp esp32s3_central/log_format.cpp \
+ *       esp32s3_central/log_rollup.cpp esp32s3_central/log_compress.cpp esp32s3_central/lttb.cpp \
+ *       esp32s3_central/node_registry.cpp esp32s3_central/spi_bus.cpp -o logcheck
+ *
+ * Usage:
+ *   ./logcheck [--days N] [--seed N] [--rate N] [--keep] [--verbose]
+ *     --days N     days of 5-minute records (default 40, at least 32)
+ *     --seed N     random series and ranges
+ *     --rate N     shim clock speed-up (default 100)
+ *     --keep       leave the scratch directory (its path is printed)
+ *     --verbose    echo the logger's serial output
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <LittleFS.h>
+#include "data_logger.h"
+#include "espnow_protocol.h"
+#include "log_retention.h"
+#include "lttb.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DAY LOG_SECONDS_PER_DAY
+#define INTERVAL 300                    // Seconds between records, as SD_LOG_INTERVAL
+#define FIRST_DAY 1717200000            // 2024-06-01T00:00:00Z
+#define GAP_DAY 10                      // Day without records
+#define WAIT_MS 600000                  // sync() and pass timeouts (shim clock)
+#define FLASH_BYTES 0x350000            // LittleFS in partitions.csv
+
+// ============================================================================
+// Firmware pieces not built here (utils.cpp needs the ESP timer)
+// ============================================================================
+
+static std::atomic<uint32_t> unixTime{FIRST_DAY};
+static uint32_t sampleTime = FIRST_DAY;  // Node samples: the time of the record just logged
+
+uint32_t getUnixTime() {
+  return unixTime;
+}
+
+String getISO8601Timestamp(unsigned long) {
+  char buffer[21];
+  formatIsoTime(sampleTime, buffer);
+  return String(buffer);
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+
+/**
+ * A record as the logger should give it back (decoded from its packed form)
+ */
+struct Expected {
+  uint32_t time;
+  float values[WX_LOG_CHANNEL_COUNT];
+  uint16_t mask;
+};
+
+static std::vector<Expected> expected;   // In time order
+static std::set<uint32_t> daysLogged;    // Days given records, whether kept or not
+static uint32_t nodeSamples = 0;         // Node samples logged
+static std::mt19937 rng;
+static int failures = 0;
+
+static void report(bool ok, const char* what) {
+  printf("  %-68s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+static CSVRecord makeRecord(uint32_t time) {
+  std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+  float phase = (float)(time % DAY) / DAY * 6.2832f;
+
+  CSVRecord record;
+  record.timestamp = time;
+  record.temp_indoor = 21.0f + sinf(phase) + noise(rng);
+  record.humidity_indoor = 45.0f + 5 * noise(rng);
+  record.pressure = 1013.0f + 4 * sinf(phase / 7) + noise(rng);
+  record.iaq = (uint8_t)(1 + rng() % 5);
+  // The exterior node is away now and then: its channels stay NAN
+  if (rng() % 10 != 0) {
+    record.temp_outdoor = 15.0f + 8 * sinf(phase) + noise(rng);
+    record.humidity_outdoor = 70.0f - 20 * sinf(phase) + noise(rng);
+    record.light = fmaxf(0.0f, 800 * sinf(phase - 1.5f));
+  }
+  return record;
+}
+
+static Expected expect(const CSVRecord& record) {
+  const float values[WX_LOG_CHANNEL_COUNT] = {
+    record.temp_indoor, record.humidity_indoor, record.temp_outdoor, record.humidity_outdoor,
+    record.pressure, record.light, (float)record.iaq
+  };
+  const LogSchema& schema = weatherLogSchema();
+  uint8_t packed[LOG_MAX_RECORD_SIZE];
+  schema.encode(record.timestamp, values, 0xFFFF, packed);
+
+  Expected out;
+  schema.decode(packed, out.time, out.values, out.mask);
+  return out;
+}
+
+static bool sameRecord(const Expected& a, const Expected& b) {
+  if (a.time != b.time || a.mask != b.mask) return false;
+  for (int c = 0; c < WX_LOG_CHANNEL_COUNT; c++) {
+    if ((a.mask & (1 << c)) && a.values[c] != b.values[c]) return false;
+  }
+  return true;
+}
+
+/**
+ * Log one record and remember it (expected stays in time order)
+ */
+static bool logRecord(DataLogger& logger, uint32_t time) {
+  CSVRecord record = makeRecord(time);
+  if (!logger.writeRecord(record)) return false;
+  Expected entry = expect(record);
+  auto at = std::upper_bound(expected.begin(), expected.end(), time,
+                             [](uint32_t t, const Expected& e) { return t < e.time; });
+  expected.insert(at, entry);
+  daysLogged.insert(time / DAY);
+  sampleTime = time;
+  if (time > unixTime) unixTime = time;
+  return true;
+}
+
+/**
+ * Log samples from that many remote nodes, all in the second of the record just logged
+ */
+static bool logNodes(DataLogger& logger, int nodes) {
+  std::uniform_real_distribution<float> value(0.0f, 100.0f);
+  for (int i = 0; i < nodes; i++) {
+    NodeSample sample;
+    sample.mac[5] = (uint8_t)(i + 1);
+    snprintf(sample.nodeType, sizeof(sample.nodeType), "room%d", i + 1);
+    sample.timestamp = millis();
+    sample.reading.temperature = value(rng);
+    sample.reading.humidity = value(rng);
+    sample.reading.channelMask = WX_MASK(0) | WX_MASK(1);
+    if (!logger.writeNodeSample(sample)) return false;
+    nodeSamples++;
+  }
+  return true;
+}
+
+/**
+ * Log a day's records from slot first to slot last (288 a day), each
+ * followed by samples from nodes remote nodes, then sync
+ */
+static bool logDay(DataLogger& logger, uint32_t day, uint32_t first = 0, uint32_t last = DAY / INTERVAL, int nodes = 0) {
+  for (uint32_t slot = first; slot < last; slot++) {
+    // A few seconds late now and then, as the loop's timing is
+    uint32_t time = FIRST_DAY + day * DAY + slot * INTERVAL + (rng() % 8 == 0 ? rng() % 60 : 0);
+    if (!logRecord(logger, time) || !logNodes(logger, nodes)) return false;
+    // Samples come in at their own pace on the station: here the ring would fill
+    if (nodes > 0 && slot % 24 == 23 && !logger.sync(WAIT_MS)) return false;
+  }
+  return logger.sync(WAIT_MS);
+}
+
+static void expectedRange(uint32_t from, uint32_t to, std::vector<Expected>& out) {
+  out.clear();
+  for (const Expected& e : expected) {
+    if (e.time >= from && e.time <= to) out.push_back(e);
+  }
+}
+
+static bool collectRecord(const LogSchema& schema, const uint8_t* record, uint32_t, void* context) {
+  Expected got;
+  if (schema.decode(record, got.time, got.values, got.mask)) {
+    static_cast<std::vector<Expected>*>(context)->push_back(got);
+  }
+  return true;
+}
+
+/**
+ * readRange() over [from, to] gives exactly the expected records, in order
+ */
+static bool rangeMatches(DataLogger& logger, uint32_t from, uint32_t to, long* count = nullptr) {
+  std::vector<Expected> got, want;
+  long n = logger.readRange(from, to, collectRecord, &got);
+  expectedRange(from, to, want);
+  if (count) *count = n;
+  if (n != (long)want.size() || got.size() != want.size()) return false;
+  for (size_t i = 0; i < got.size(); i++) {
+    if (!sameRecord(got[i], want[i])) return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// Card and station
+// ============================================================================
+
+static std::string scratch;
+static std::string sdDir;
+static std::string flashDir;
+
+/**
+ * Record writes to weather partitions (the hook runs on the drain task)
+ */
+struct WriteWatch {
+  std::atomic<bool> on{false};
+  std::atomic<uint32_t> chunk{LOG_WRITE_CHUNK};
+  std::atomic<uint32_t> writes{0};
+  std::atomic<uint32_t> unaligned{0};
+  std::atomic<uint32_t> flashMax{0};    // Largest LittleFS write
+  std::atomic<int> tripAfter{0};        // Partition data writes let through before the trip (0 = none armed)
+  std::atomic<bool> tripReset{false};   // The trip: both file systems stop (a reset), or the card's writes fail
+  std::atomic<bool> tripped{false};
+};
+
+static WriteWatch watch;
+
+static void onWrite(FS& fs, const char* path, uint32_t offset, const uint8_t* data, size_t length) {
+  if (&fs == &LittleFS) {
+    uint32_t max = watch.flashMax;
+    while (length > max && !watch.flashMax.compare_exchange_weak(max, (uint32_t)length)) {}
+    return;
+  }
+  size_t len = strlen(path);
+  bool partition = len > 4 && strcmp(path + len - 4, ".wxb") == 0;
+  if (!partition) return;
+
+  // Preallocation: erased space ahead of the data
+  size_t erased = 0;
+  while (erased < length && data[erased] == 0xFF) erased++;
+  if (erased == length) return;
+
+  // Everything after this write is lost: the card's writes fail, or
+  // neither file system takes anything more until the reset
+  if (watch.tripAfter > 0 && --watch.tripAfter == 0) {
+    hostShimEject(SD, watch.tripReset);
+    hostShimEject(LittleFS, watch.tripReset);
+    hostShimFailWrites(SD, !watch.tripReset);
+    watch.tripped = true;
+  }
+  if (!watch.on || offset < weatherLogSchema().headerSize()) return;
+
+  watch.writes++;
+  if ((offset + length) % watch.chunk != 0) watch.unaligned++;
+}
+
+static std::string hostFile(const char* path) {
+  return sdDir + path;
+}
+
+static bool hostExists(const char* path) {
+  struct stat info;
+  return stat(hostFile(path).c_str(), &info) == 0;
+}
+
+static void partitionPath(uint32_t day, const char* ext, char* out, size_t cap) {
+  formatPartitionPath(LOG_DIR, FIRST_DAY + day * DAY, ext, out, cap);
+}
+
+/**
+ * Power up: a new logger (and retention task) on whatever the card and flash hold
+ */
+static DataLogger* boot(LogRetention** retention = nullptr) {
+  DataLogger* logger = new DataLogger();
+  if (!logger->begin()) return nullptr;
+  if (retention) {
+    *retention = new LogRetention();
+    if (!(*retention)->begin(*logger)) return nullptr;
+  }
+  return logger;
+}
+
+/**
+ * Reset: the tasks stop where they are; the old objects are left behind, as RAM would be
+ */
+static void reset() {
+  hostShimHaltTasks();
+}
+
+/**
+ * Wait for a complete retention pass that started after this call
+ */
+static bool retentionPass(LogRetention& retention, LogRetentionStats& out) {
+  LogRetentionStats before;
+  retention.getStats(before);
+  uint32_t target = before.passes + (before.running ? 2 : 1);
+  retention.trigger();
+
+  unsigned long start = millis();
+  do {
+    delay(50);
+    retention.getStats(out);
+    if (out.passes >= target && !out.running) return true;
+  } while (millis() - start < WAIT_MS);
+  return false;
+}
+
+/**
+ * Wait for the trip armed in watch
+ */
+static bool tripped() {
+  unsigned long start = millis();
+  while (!watch.tripped && millis() - start < WAIT_MS) delay(10);
+  return watch.tripped;
+}
+
+/**
+ * nodes.csv holds nodeSamples lines, none of them twice
+ */
+static bool nodeLogMatches() {
+  FILE* file = fopen(hostFile(NODE_LOG_FILE_NAME).c_str(), "r");
+  if (!file) return nodeSamples == 0;
+  std::set<std::string> lines;
+  uint32_t count = 0;
+  char line[LOG_CSV_LINE_MAX];
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, "timestamp", 9) == 0) continue;
+    lines.insert(line);
+    count++;
+  }
+  fclose(file);
+  return count == nodeSamples && lines.size() == count;
+}
+
+/**
+ * Wait until records reach the card again (backfill done)
+ */
+static bool cardBack(DataLogger& logger) {
+  unsigned long start = millis();
+  LogWriterStats stats;
+  do {
+    delay(100);
+    logger.getStats(stats);
+    if (stats.cardPresent && !stats.backfilling && logger.cardReady()) return logger.sync(WAIT_MS);
+  } while (millis() - start < WAIT_MS);
+  return false;
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static void checkWrites(DataLogger& logger, int days) {
+  printf("writes\n");
+  LogWriterStats before, after;
+  logger.getStats(before);
+  watch.on = true;
+  bool logged = true;
+  for (int day = 0; day < days && logged; day++) {
+    if (day == GAP_DAY) continue;
+    if (day == days - 3) {
+      // The last days with 512-byte writes
+      LogFlushPolicy policy;
+      policy.chunkSize = 512;
+      logger.setFlushPolicy(policy);
+      watch.chunk = 512;
+    }
+    logged = logDay(logger, day, 0, day == days - 1 ? DAY / INTERVAL / 2 : DAY / INTERVAL);
+  }
+  watch.on = false;
+  logger.getStats(after);
+
+  char line[96];
+  snprintf(line, sizeof(line), "%zu records over %d days reach the card", expected.size(), days);
+  report(logged && after.recordsDropped == 0 && after.recordsWritten - before.recordsWritten == expected.size(), line);
+  snprintf(line, sizeof(line), "%u data writes, %u off the chunk, %u partial", (unsigned)watch.writes,
+           (unsigned)watch.unaligned, after.partialWrites - before.partialWrites);
+  report(watch.writes > 0 && watch.unaligned <= after.partialWrites - before.partialWrites, line);
+}
+
+static void checkRanges(DataLogger& logger) {
+  printf("ranges\n");
+  uint32_t first = expected.front().time;
+  uint32_t last = expected.back().time;
+  std::uniform_int_distribution<uint32_t> at(first - 600, last + 600);
+  std::uniform_int_distribution<uint32_t> span(0, 3 * DAY);
+
+  int bad = 0;
+  for (int i = 0; i < 200; i++) {
+    uint32_t from = at(rng);
+    uint32_t to = from + span(rng);
+    bad += !rangeMatches(logger, from, to);
+  }
+  report(bad == 0 && rangeMatches(logger, 0, UINT32_MAX), "200 random ranges and the whole log match the records");
+
+  // One record from the middle of a closed day
+  const Expected& one = expected[expected.size() / 3];
+  hostShimResetFsStats(SD);
+  long count;
+  bool found = rangeMatches(logger, one.time, one.time, &count);
+  HostFsStats io = hostShimFsStats(SD);
+  char line[96];
+  snprintf(line, sizeof(line), "one-record lookup: %ld record, %llu file reads", count, (unsigned long long)io.reads);
+  report(found && count == 1 && io.reads <= 16, line);
+
+  long exported = logger.exportCSV(first, last, "/export.csv");
+  FILE* csv = fopen(hostFile("/export.csv").c_str(), "r");
+  long lines = 0;
+  for (int c; csv && (c = fgetc(csv)) != EOF;) lines += c == '\n';
+  if (csv) fclose(csv);
+  snprintf(line, sizeof(line), "exportCSV: %ld records, %ld lines after the header", exported, lines - 1);
+  report(exported == (long)expected.size() && lines - 1 == exported, line);
+
+  // readFile() against the file itself, at random offsets
+  char path[LOG_PARTITION_PATH_MAX];
+  partitionPath(1, "wxb", path, sizeof(path));
+  FILE* host = fopen(hostFile(path).c_str(), "rb");
+  std::vector<uint8_t> whole;
+  for (int c; host && (c = fgetc(host)) != EOF;) whole.push_back((uint8_t)c);
+  if (host) fclose(host);
+  bad = whole.empty();
+  for (int i = 0; i < 100 && !bad; i++) {
+    uint32_t offset = rng() % (whole.size() + 100);
+    uint8_t buffer[1500];
+    uint32_t size = 0;
+    long n = logger.readFile(path, offset, buffer, 1 + rng() % sizeof(buffer), size);
+    size_t want = offset < whole.size() ? std::min<size_t>(whole.size() - offset, n) : 0;
+    bad += size != whole.size() || n < 0 || (size_t)n != want || memcmp(buffer, whole.data() + offset, want) != 0;
+  }
+  uint32_t size;
+  report(bad == 0 && logger.readFile("/logs/none.wxb", 0, nullptr, 0, size) == -1,
+         "readFile() gives the partition's bytes at 100 offsets");
+}
+
+static DataLogger* checkReset(DataLogger* logger, int days) {
+  printf("reset\n");
+  // Half a day is logged; a reset, and the day's index is lost with it
+  reset();
+  char path[LOG_PARTITION_PATH_MAX];
+  partitionPath(days - 1, "idx", path, sizeof(path));
+  unlink(hostFile(path).c_str());
+
+  logger = boot();
+  bool ok = logger && logDay(*logger, days - 1, DAY / INTERVAL / 2, DAY / INTERVAL);
+  uint32_t day = FIRST_DAY + (days - 1) * DAY;
+  report(ok && rangeMatches(*logger, day, day + DAY - 1) && rangeMatches(*logger, 0, UINT32_MAX),
+         "records after a reset join the day, its index rebuilt");
+  report(ok && rangeMatches(*logger, day + 6 * 3600, day + 6 * 3600 + 7200), "range inside the day by the new index");
+  return logger;
+}
+
+struct RollupCollect {
+  std::vector<LogRollup> rollups;
+};
+
+static bool collectRollup(const LogRollup& rollup, void* context) {
+  static_cast<RollupCollect*>(context)->rollups.push_back(rollup);
+  return true;
+}
+
+/**
+ * A rollup agrees with the records of its period
+ */
+static bool rollupMatches(const LogRollup& rollup, uint32_t period) {
+  std::vector<Expected> records;
+  expectedRange(rollup.start, rollup.start + period - 1, records);
+  for (int c = 0; c < WX_LOG_CHANNEL_COUNT; c++) {
+    uint32_t count = 0;
+    float min = INFINITY, max = -INFINITY;
+    double sum = 0;
+    for (const Expected& e : records) {
+      if (!(e.mask & (1 << c))) continue;
+      count++;
+      min = fminf(min, e.values[c]);
+      max = fmaxf(max, e.values[c]);
+      sum += e.values[c];
+    }
+    if (rollup.count[c] != count) return false;
+    if (count == 0) continue;
+    double mean = sum / count;
+    if (rollup.min[c] != min || rollup.max[c] != max || fabs(rollup.mean[c] - mean) > 1e-3 * fmax(1.0, fabs(mean))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Every hourly rollup over [from, to] agrees with the records
+ */
+static bool rollupsMatch(DataLogger& logger, uint32_t from, uint32_t to) {
+  RollupCollect got;
+  logger.readRollups(LOG_ROLLUP_HOUR, from, to, collectRollup, &got);
+  for (const LogRollup& rollup : got.rollups) {
+    if (!rollupMatches(rollup, 3600)) return false;
+  }
+  return !got.rollups.empty();
+}
+
+static void checkRollups(DataLogger& logger, int days) {
+  printf("rollups\n");
+  uint32_t first = FIRST_DAY;
+  uint32_t end = FIRST_DAY + days * DAY;
+  std::uniform_int_distribution<uint32_t> at(first, end);
+
+  const LogRollupLevel levels[] = {LOG_ROLLUP_HOUR, LOG_ROLLUP_DAY};
+  for (LogRollupLevel level : levels) {
+    uint32_t period = rollupPeriod(level);
+    int bad = 0;
+    for (int i = 0; i < 100; i++) {
+      uint32_t from = at(rng);
+      uint32_t to = from + rng() % (level == LOG_ROLLUP_DAY ? 20 * DAY : 3 * DAY);
+      RollupCollect got;
+      long n = logger.readRollups(level, from, to, collectRollup, &got);
+
+      // Every period with records that overlaps the range, once, in order
+      std::vector<uint32_t> periods;
+      for (const Expected& e : expected) {
+        uint32_t start = e.time - e.time % period;
+        if (start + period > from && start <= to && (periods.empty() || periods.back() != start)) periods.push_back(start);
+      }
+      bool ok = n == (long)got.rollups.size() && got.rollups.size() == periods.size();
+      for (size_t k = 0; ok && k < periods.size(); k++) {
+        ok = got.rollups[k].start == periods[k] && rollupMatches(got.rollups[k], period);
+      }
+      bad += !ok;
+    }
+    report(bad == 0, level == LOG_ROLLUP_DAY ? "100 random daily ranges match sums of the records"
+                                             : "100 random hourly ranges match sums of the records");
+  }
+
+  struct Query {
+    uint32_t span;
+    uint32_t points;
+    long resolution;
+  };
+  const Query queries[] = {{30 * DAY, 30, DAY}, {DAY, 24, 3600}, {DAY, 200, 0}};
+  for (const Query& q : queries) {
+    uint32_t to = end - 1;
+    RollupCollect got;
+    hostShimResetFsStats(SD);
+    long resolution = logger.readSummary(to - q.span, to, q.points, collectRollup, &got);
+    HostFsStats io = hostShimFsStats(SD);
+    char line[96];
+    snprintf(line, sizeof(line), "summary of %u h at %u points: %ld s/period, %zu values, %llu reads",
+             q.span / 3600, q.points, resolution, got.rollups.size(), (unsigned long long)io.reads);
+    report(resolution == q.resolution && got.rollups.size() >= q.points, line);
+  }
+}
+
+static void checkCharts() {
+  printf("charts\n");
+  int bad = 0;
+  for (int series = 0; series < 200; series++) {
+    size_t count = rng() % 3000;
+    size_t points = 3 + rng() % 300;
+    uint32_t from = FIRST_DAY;
+    uint32_t to = from + 1 + rng() % (30 * DAY);
+
+    std::vector<HistoryPoint> in;
+    uint32_t time = from;
+    std::normal_distribution<float> step(0, 1);
+    float value = 0;
+    for (size_t i = 0; i < count; i++) {
+      time += 1 + rng() % (2 * (to - from) / (count + 1) + 1);
+      if (time > to) break;
+      value += step(rng);
+      in.push_back(HistoryPoint{time, value, value - 1, value + 1});
+    }
+
+    std::vector<HistoryPoint> out(points);
+    LttbSampler sampler(out.data(), points, from, to);
+    for (const HistoryPoint& p : in) sampler.add(p);
+    size_t n = sampler.finish();
+
+    bool ok = n <= points && n <= in.size() && n >= std::min<size_t>(in.size(), 2);
+    if (ok && n > 0) ok = out[0].time == in.front().time && out[n - 1].time == in.back().time;
+    for (size_t i = 0; ok && i < n; i++) {
+      if (i > 0 && out[i].time <= out[i - 1].time) ok = false;
+      auto match = std::find_if(in.begin(), in.end(), [&](const HistoryPoint& p) {
+        return p.time == out[i].time && p.value == out[i].value;
+      });
+      ok = ok && match != in.end();
+    }
+    bad += !ok;
+  }
+  report(bad == 0, "200 random series: ends kept, in order, points from the input");
+}
+
+static DataLogger* checkDamage(DataLogger* logger, int days) {
+  printf("damage\n");
+  // Half of the next day, then a reset; a bit flips in one of its records
+  // and half a record is left at the end of its data, as a cut write would
+  uint32_t day = days;
+  bool ok = logDay(*logger, day, 0, DAY / INTERVAL / 2);
+  reset();
+
+  const LogSchema& schema = weatherLogSchema();
+  char path[LOG_PARTITION_PATH_MAX];
+  partitionPath(day, "wxb", path, sizeof(path));
+  std::vector<Expected> records;
+  expectedRange(FIRST_DAY + day * DAY, FIRST_DAY + (day + 1) * DAY - 1, records);
+  size_t victim = records.size() - 20;
+  FILE* file = fopen(hostFile(path).c_str(), "r+b");
+  ok = ok && file;
+  if (file) {
+    long at = (long)(schema.headerSize() + victim * schema.recordSize() + 6);
+    fseek(file, at, SEEK_SET);
+    int c = fgetc(file);
+    fseek(file, at, SEEK_SET);
+    fputc(c ^ 0x10, file);
+    uint8_t torn[LOG_MAX_RECORD_SIZE];
+    memset(torn, 0x5A, sizeof(torn));
+    fseek(file, (long)(schema.headerSize() + records.size() * schema.recordSize()), SEEK_SET);
+    fwrite(torn, 1, schema.recordSize() / 2, file);
+    fclose(file);
+  }
+  uint32_t lost = records[victim].time;
+  expected.erase(std::find_if(expected.begin(), expected.end(), [&](const Expected& e) { return e.time == lost; }));
+
+  logger = boot();
+  LogWriterStats before, after;
+  ok = ok && logger && logDay(*logger, day, DAY / INTERVAL / 2, DAY / INTERVAL);
+  if (logger) logger->getStats(before);
+  ok = ok && rangeMatches(*logger, FIRST_DAY + day * DAY, FIRST_DAY + (day + 1) * DAY - 1);
+  if (logger) logger->getStats(after);
+
+  char line[96];
+  snprintf(line, sizeof(line), "reopen: %u torn erased; the day reads without the bad record", before.tornRecords);
+  report(ok && before.tornRecords >= 1, line);
+  report(ok && after.corruptSkipped - before.corruptSkipped == 1, "readers skip the corrupted record, once");
+  return logger;
+}
+
+static void checkCompaction(DataLogger& logger, LogRetention& retention, int days) {
+  printf("compaction\n");
+  LogRetentionPolicy policy;
+  policy.rawDays = 0;
+  policy.hourlyDays = 0;
+  policy.horizonDays = 0;
+  policy.minFreeMB = 0;
+  retention.setPolicy(policy);
+
+  LogRetentionStats passed;
+  bool ok = retentionPass(retention, passed);
+  int packed = 0, left = 0;
+  for (int day = 0; day < days; day++) {
+    char wxc[LOG_PARTITION_PATH_MAX], wxb[LOG_PARTITION_PATH_MAX];
+    partitionPath(day, "wxc", wxc, sizeof(wxc));
+    partitionPath(day, "wxb", wxb, sizeof(wxb));
+    packed += hostExists(wxc);
+    left += hostExists(wxb);
+  }
+  LogWriterStats stats;
+  logger.getStats(stats);
+  char line[96];
+  snprintf(line, sizeof(line), "%d closed days compressed, %d left as .wxb, %.2fx", packed, left,
+           stats.compressionRatio());
+  report(ok && packed == days - 1 && left == 0 && stats.compressionRatio() > 1, line);
+  report(ok && rangeMatches(logger, 0, UINT32_MAX), "compressed days read back the same records");
+
+  // A record for the first day, long closed and compressed
+  uint32_t late = FIRST_DAY + DAY - 1;
+  ok = logRecord(logger, late) && logger.sync(WAIT_MS);
+  report(ok && rangeMatches(logger, FIRST_DAY, FIRST_DAY + DAY - 1), "a late record joins its compressed day");
+  ok = ok && logDay(logger, days + 1, 0, 12);
+  ok = ok && retentionPass(retention, passed);
+  report(ok && rangeMatches(logger, 0, UINT32_MAX), "and stays there after the next pass");
+}
+
+/**
+ * Days from the first whose partition (either form) is on the card
+ */
+static std::vector<int> daysOnCard(int days) {
+  std::vector<int> out;
+  for (int day = 0; day <= days + 1; day++) {
+    char wxc[LOG_PARTITION_PATH_MAX], wxb[LOG_PARTITION_PATH_MAX];
+    partitionPath(day, "wxc", wxc, sizeof(wxc));
+    partitionPath(day, "wxb", wxb, sizeof(wxb));
+    if (hostExists(wxc) || hostExists(wxb)) out.push_back(day);
+  }
+  return out;
+}
+
+static void checkRetention(DataLogger& logger, LogRetention& retention, int days) {
+  printf("retention\n");
+  const uint16_t rawDays = 20;
+  LogRetentionPolicy policy;
+  policy.rawDays = rawDays;
+  policy.hourlyDays = 0;
+  policy.horizonDays = 0;
+  policy.minFreeMB = 0;
+  retention.setPolicy(policy);
+
+  // Records of the days past the limit go; their rollups stay
+  LogRetentionStats passed;
+  bool ok = retentionPass(retention, passed);
+  uint32_t today = unixTime / DAY;
+  uint32_t keepFrom = (today - rawDays + 1) * DAY;
+  expected.erase(std::remove_if(expected.begin(), expected.end(), [&](const Expected& e) { return e.time < keepFrom; }),
+                 expected.end());
+  std::vector<int> kept = daysOnCard(days);
+  char line[96];
+  snprintf(line, sizeof(line), "raw limit %u days: %zu days of records kept, from day %d", rawDays, kept.size(),
+           kept.empty() ? -1 : kept.front());
+  report(ok && !kept.empty() && FIRST_DAY + (uint32_t)kept.front() * DAY >= keepFrom && kept.size() <= rawDays, line);
+  report(ok && rangeMatches(logger, 0, UINT32_MAX), "the days kept read back the same records");
+  RollupCollect daily;
+  logger.readRollups(LOG_ROLLUP_DAY, FIRST_DAY, UINT32_MAX, collectRollup, &daily);
+  snprintf(line, sizeof(line), "daily rollups of all %zu days with records remain", daily.rollups.size());
+  report(daily.rollups.size() == daysLogged.size(), line);
+
+  // 10 KB short of the free space it must leave: oldest days first
+  policy.minFreeMB = 1;
+  retention.setPolicy(policy);
+  hostShimSetCapacity(SD, SD.usedBytes() + 1024 * 1024 - 10 * 1024);
+  ok = retentionPass(retention, passed);
+  std::vector<int> after = daysOnCard(days);
+  size_t removed = kept.size() - after.size();
+  bool oldest = removed > 0 && std::equal(after.begin(), after.end(), kept.begin() + removed);
+  snprintf(line, sizeof(line), "10 KB short of free space: oldest %zu days removed, %llu B reclaimed", removed,
+           (unsigned long long)passed.bytesReclaimed);
+  report(ok && oldest && SD.totalBytes() - SD.usedBytes() >= 1024 * 1024, line);
+  hostShimSetCapacity(SD, 1ULL << 30);
+
+  if (!after.empty()) {
+    uint32_t from = FIRST_DAY + after.front() * DAY;
+    expected.erase(std::remove_if(expected.begin(), expected.end(), [&](const Expected& e) { return e.time < from; }),
+                   expected.end());
+  }
+  report(ok && rangeMatches(logger, 0, UINT32_MAX), "what is left reads back the same records");
+}
+
+static void checkSpool(int days) {
+  printf("spool\n");
+  // A new card and flash, with no card at boot
+  reset();
+  expected.clear();
+  std::string sd = scratch + "/sd2", flash = scratch + "/flash2";
+  mkdir(sd.c_str(), 0755);
+  mkdir(flash.c_str(), 0755);
+  sdDir = sd;
+  hostShimMount(SD, sd.c_str());
+  hostShimMount(LittleFS, flash.c_str());
+  hostShimSetCapacity(LittleFS, FLASH_BYTES);
+  hostShimEject(SD, true);
+  watch.flashMax = 0;
+
+  DataLogger* logger = boot();
+  if (!logger) {
+    report(false, "logger boots without a card");
+    return;
+  }
+  bool ok = logDay(*logger, 0) && logDay(*logger, 1, 0, 100);
+  LogWriterStats stats;
+  logger->getStats(stats);
+  char line[96];
+  snprintf(line, sizeof(line), "no card at boot: %u records spooled, %u B pending", stats.spool.recordsSpooled,
+           stats.spool.pendingBytes);
+  report(ok && !stats.cardPresent && stats.spool.recordsSpooled == expected.size(), line);
+  hostShimEject(SD, false);
+  ok = ok && cardBack(*logger) && logDay(*logger, 1, 100, DAY / INTERVAL);
+  report(ok && rangeMatches(*logger, 0, UINT32_MAX), "card back: spooled records written back, in order");
+
+  // The card stops taking writes in the middle of a day
+  ok = ok && logDay(*logger, 2, 0, 100);
+  hostShimFailWrites(SD, true);
+  ok = ok && logDay(*logger, 2, 100, 200);
+  LogWriterStats failed;
+  logger->getStats(failed);
+  hostShimFailWrites(SD, false);
+  ok = ok && cardBack(*logger) && logDay(*logger, 2, 200, DAY / INTERVAL);
+  snprintf(line, sizeof(line), "writes failing: %u card loss, no record lost or repeated", failed.cardLosses);
+  report(ok && failed.cardLosses >= 1 && rangeMatches(*logger, 0, UINT32_MAX), line);
+
+  // A reset while records are in the spool: written back after the boot
+  hostShimEject(SD, true);
+  ok = ok && logDay(*logger, 3, 0, 150);
+  reset();
+  hostShimEject(SD, false);
+  logger = boot();
+  if (!logger) {
+    report(false, "logger boots with records spooled");
+    return;
+  }
+  ok = ok && cardBack(*logger) && logDay(*logger, 3, 150, DAY / INTERVAL);
+  report(ok && rangeMatches(*logger, 0, UINT32_MAX), "reset with records spooled: written back after the boot");
+
+  // The card fails again while the spool is written back, after the first
+  // partition write of a slice: the slice is replayed, that write is not repeated
+  hostShimEject(SD, true);
+  ok = ok && logDay(*logger, 4, 0, DAY / INTERVAL, 3) && logDay(*logger, 5, 0, 100, 3);
+  LogWriterStats lost;
+  logger->getStats(lost);
+  watch.tripped = false;
+  watch.tripReset = false;
+  watch.tripAfter = 1;
+  hostShimEject(SD, false);
+  ok = ok && tripped();
+  for (unsigned long start = millis(); ok && stats.cardLosses <= lost.cardLosses && millis() - start < WAIT_MS;) {
+    delay(10);
+    logger->getStats(stats);
+  }
+  hostShimFailWrites(SD, false);
+  ok = ok && stats.cardLosses > lost.cardLosses && cardBack(*logger) && logDay(*logger, 5, 100, DAY / INTERVAL, 3);
+  logger->getStats(stats);
+  uint32_t from = FIRST_DAY + 4 * DAY;
+  snprintf(line, sizeof(line), "card failing in a backfill: %u records it wrote not written again", stats.replaySkipped);
+  report(ok && stats.replaySkipped > 0 && rangeMatches(*logger, 0, UINT32_MAX) && nodeLogMatches() &&
+         rollupsMatch(*logger, from, from + 2 * DAY - 1), line);
+
+  // The same with a reset: the spool's last commit is before what reached the card
+  hostShimEject(SD, true);
+  ok = ok && logDay(*logger, 6, 0, DAY / INTERVAL, 3) && logDay(*logger, 7, 0, 100, 3);
+  watch.tripped = false;
+  watch.tripReset = true;
+  watch.tripAfter = 1;
+  hostShimEject(SD, false);
+  ok = ok && tripped();
+  reset();
+  hostShimEject(SD, false);
+  hostShimEject(LittleFS, false);
+  logger = boot();
+  if (!logger) {
+    report(false, "logger boots after a reset in a backfill");
+    return;
+  }
+  ok = ok && cardBack(*logger) && logDay(*logger, 7, 100, DAY / INTERVAL, 3);
+  logger->getStats(stats);
+  from = FIRST_DAY + 6 * DAY;
+  snprintf(line, sizeof(line), "reset in a backfill: %u records on the card not written again", stats.replaySkipped);
+  report(ok && stats.replaySkipped > 0 && rangeMatches(*logger, 0, UINT32_MAX) && nodeLogMatches() &&
+         rollupsMatch(*logger, from, from + 2 * DAY - 1), line);
+
+  // A long outage on a nearly full flash: the oldest spooled records go
+  reset();
+  hostShimSetCapacity(LittleFS, LittleFS.usedBytes() + 4 * LOG_SPOOL_SEGMENT_BYTES);
+  hostShimEject(SD, true);
+  logger = boot();
+  if (!logger) {
+    report(false, "logger boots on a nearly full flash");
+    return;
+  }
+  size_t before = expected.size();
+  int day = 8;
+  do {
+    ok = ok && logDay(*logger, day++);
+    logger->getStats(stats);
+  } while (ok && stats.spool.segmentsDropped == 0 && day < days + 4);
+  uint32_t quota = stats.spool.quotaBytes;
+  uint32_t outageEnd = expected.back().time;
+  hostShimEject(SD, false);
+  ok = ok && cardBack(*logger);
+
+  std::vector<Expected> got;
+  logger->readRange(0, UINT32_MAX, collectRecord, &got);
+  // Everything before the outage, then an unbroken run that ends with its last record
+  size_t dropped = expected.size() - got.size();
+  bool suffix = got.size() <= expected.size() && dropped > 0;
+  for (size_t i = 0; suffix && i < got.size(); i++) {
+    suffix = sameRecord(got[i], expected[i < before ? i : i + dropped]);
+  }
+  snprintf(line, sizeof(line), "quota %u KB: %u segment%s dropped, oldest %zu records gone", quota / 1024,
+           stats.spool.segmentsDropped, stats.spool.segmentsDropped == 1 ? "" : "s", dropped);
+  report(ok && suffix && got.back().time == outageEnd, line);
+
+  snprintf(line, sizeof(line), "flash writes at most one page (largest %u B)", (unsigned)watch.flashMax);
+  report(watch.flashMax > 0 && watch.flashMax <= LOG_SPOOL_PAGE_BYTES, line);
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv) {
+  int days = 40;
+  unsigned seed = 1;
+  bool keep = false;
+  hostShimClockRate = 100;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--days") && i + 1 < argc) {
+      days = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+      hostShimClockRate = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--keep")) {
+      keep = true;
+    } else if (!strcmp(argv[i], "--verbose")) {
+      hostShimEchoSerial = true;
+    } else {
+      fprintf(stderr, "usage: logcheck [--days N] [--seed N] [--rate N] [--keep] [--verbose]\n");
+      return 2;
+    }
+  }
+  if (days < 32) days = 32;
+  if (hostShimClockRate < 1) hostShimClockRate = 1;
+  rng.seed(seed);
+
+  char dir[] = "/tmp/logcheck.XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  scratch = dir;
+  sdDir = scratch + "/sd";
+  flashDir = scratch + "/flash";
+  mkdir(sdDir.c_str(), 0755);
+  mkdir(flashDir.c_str(), 0755);
+  hostShimMount(SD, sdDir.c_str());
+  hostShimMount(LittleFS, flashDir.c_str());
+  hostShimSetCapacity(LittleFS, FLASH_BYTES);
+  hostShimWriteHook = onWrite;
+
+  auto start = std::chrono::steady_clock::now();
+  DataLogger* logger = boot();
+  if (!logger) {
+    fprintf(stderr, "DataLogger::begin() failed\n");
+    return 1;
+  }
+
+  checkWrites(*logger, days);
+  checkRanges(*logger);
+  logger = checkReset(logger, days);
+  if (logger) checkRollups(*logger, days);
+  checkCharts();
+  if (logger) logger = checkDamage(logger, days);
+  if (logger) {
+    // Retention runs from here on; the day after the last one is the open partition
+    LogRetention* retention = new LogRetention();
+    retention->begin(*logger);
+    checkCompaction(*logger, *retention, days);
+    checkRetention(*logger, *retention, days);
+    checkSpool(days);
+  } else {
+    report(false, "logger back after a reset");
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%s: %d failed, %.1f s\n", failures ? "FAILED" : "all checks passed", failures, seconds);
+  if (keep) {
+    printf("files kept in %s\n", dir);
+  } else {
+    std::string command = "rm -rf '" + scratch + "'";
+    if (system(command.c_str()) != 0) fprintf(stderr, "could not remove %s\n", dir);
+  }
+
+  // The logger's tasks never return: leave without running static destructors under them
+  fflush(stdout);
+  _exit(failures ? 1 : 0);
+}
@@ -0,0 +1,382 @@
+/**
+ * @file mlbench.cpp
+ * @brief Host check and microbenchmark of the predictor's per-sample work
+ *
+ * Runs the model compiled into the firmware (esp32s3_central/ml_model_int8.h)
+ * through ml_quant.cpp's kernels, the way MLPredictor does:
+ *
+ * 1. the header's check vectors, with each kernel
+ * 2. optionally every row of a wxtrain --reference CSV (bit for bit)
+ * 3. random inputs, scalar kernel against vector kernel
+ * 4. per-inference latency and time per MAC of each kernel
+ *
+ * Then times what MLPredictor::sample() does on every sensor read: the
+ * four sources' readings into MLFusion (ml_fusion.cpp), the fused vector,
+ * and its channels through MLFeatureStore (ml_features.cpp), with sources
+ * going stale and coming back so every path of the fusion is taken.
+ *
+ * Last, the Kalman nowcast (ml_nowcast.cpp) on a month of synthetic
+ * exterior temperature and pressure: the cost of a sample's update and of a
+ * forecast, and the forecast's error against persistence and how often the
+ * truth falls inside its bands.
+ *
+ * On the host the vector kernel is the scalar one (the SIMD kernel needs
+ * esp-nn on an ESP32-S3), so this measures the scalar path and proves it
+ * matches the reference; the station's own numbers for both paths are in
+ * its boot log and GET /api/ml ("kernels").
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++17 -O2 -Itools/host_shim -Iesp32s3_central tools/mlbench.cpp esp32s3_central/ml_quant.cpp \
+ *       esp32s3_central/ml_fusion.cpp esp32s3_central/ml_features.cpp esp32s3_central/ml_nowcast.cpp -o mlbench
+ *
+ * Usage:
+ *   ./mlbench [--reference <csv>] [--runs <n>] [--ghz <f>]
+ *     --reference <csv>  wxtrain --reference output for the same header
+ *     --runs <n>         inferences per kernel and fused samples (default 1000000)
+ *     --ghz <f>          host clock, to also print cycles per MAC
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include "ml_quant.h"
+#include "ml_model_int8.h"
+#include "ml_fusion.h"
+#include "ml_features.h"
+#include "ml_nowcast.h"
+
+#define CROSSCHECK_INPUTS 100000
+
+static const char* kernelName(MLQuantKernel kernel) {
+  return kernel == ML_QUANT_VECTOR ? (mlQuantHasVector() ? "simd" : "vector (= scalar)") : "scalar";
+}
+
+static bool checkVectors(MLQuantKernel kernel, MLQuantArena& arena) {
+  for (int i = 0; i < ML_INT8_CHECKS; i++) {
+    int8_t output[ML_QUANT_OUTPUT_COUNT];
+    mlQuantRun(ML_INT8_MODEL, ML_INT8_CHECK_INPUT + i * ML_INT8_FEATURES, output, arena, kernel);
+    if (memcmp(output, ML_INT8_CHECK_OUTPUT + i * ML_QUANT_OUTPUT_COUNT, sizeof(output)) != 0) return false;
+  }
+  return true;
+}
+
+/**
+ * Columns: time, x0.., q0.. (the int8 input), out_rain, out_temp, ...
+ * @return rows that differ, -1 if the file cannot be read
+ */
+static long checkReference(const char* path, MLQuantArena& arena, long& rows) {
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+  char line[1024];
+  long differ = 0;
+  rows = 0;
+  if (!fgets(line, sizeof(line), f)) { fclose(f); return -1; }
+
+  while (fgets(line, sizeof(line), f)) {
+    long fields[1 + 2 * ML_INT8_FEATURES + ML_QUANT_OUTPUT_COUNT];
+    const int count = sizeof(fields) / sizeof(fields[0]);
+    char* p = line;
+    int n = 0;
+    for (; n < count; n++) {
+      fields[n] = strtol(p, &p, 10);
+      p = strchr(p, ',');
+      if (!p) break;
+      p++;
+    }
+    if (n + 1 < count) continue;
+
+    int8_t input[ML_INT8_FEATURES];
+    for (int i = 0; i < ML_INT8_FEATURES; i++) input[i] = (int8_t)fields[1 + ML_INT8_FEATURES + i];
+    const long* expected = fields + 1 + 2 * ML_INT8_FEATURES;
+    rows++;
+    for (int k = 0; k < ML_QUANT_KERNEL_COUNT; k++) {
+      int8_t output[ML_QUANT_OUTPUT_COUNT];
+      mlQuantRun(ML_INT8_MODEL, input, output, arena, (MLQuantKernel)k);
+      if (output[ML_QUANT_RAIN_LOGIT] != expected[0] || output[ML_QUANT_TEMP_CHANGE] != expected[1]) {
+        differ++;
+        break;
+      }
+    }
+  }
+  fclose(f);
+  return differ;
+}
+
+/**
+ * A day of one-minute samples, repeated: the exterior node drops out for an
+ * hour twice a day, the API every third hour, the forecast is refreshed
+ * every 3 hours
+ * @return false if a channel's source or the stale masks came out wrong
+ */
+static bool benchFusion(long runs, double& fuseNs, double& sampleNs) {
+  MLFusion fusion;
+  MLFeatureStore store;
+  MLFusedFeatures fused;
+  MLLiveFeatures live;
+  bool ok = true;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (long n = 0; n < runs; n++) {
+    uint32_t now = 60 + (uint32_t)n * 60;
+    uint32_t minute = (uint32_t)n % 1440;
+    bool exteriorUp = !(minute >= 600 && minute < 660) && !(minute >= 1200 && minute < 1260);
+
+    MLSourceReading indoor;
+    indoor.time = now;
+    indoor.temperature = 21.0f;
+    indoor.humidity = 45.0f;
+    indoor.pressure = 1013.0f + sinf(now / 40000.0f);
+    fusion.update(ML_INPUT_INDOOR, indoor);
+    if (exteriorUp) {
+      MLSourceReading exterior;
+      exterior.time = now - 20;
+      exterior.temperature = 12.0f + 5.0f * sinf(now / 13751.0f);
+      exterior.humidity = 70.0f;
+      exterior.light = 500.0f;
+      fusion.update(ML_INPUT_EXTERIOR, exterior);
+    }
+    if (minute % 15 == 0 && (minute / 60) % 3 != 2) {
+      MLSourceReading observed;
+      observed.time = now;
+      observed.temperature = 12.5f;
+      observed.humidity = 72.0f;
+      observed.pressure = 1012.0f;
+      fusion.update(ML_INPUT_OBSERVATION, observed);
+    }
+    if (minute % 180 == 0) {
+      MLSourceReading forecast;
+      forecast.time = now;
+      forecast.temperature = 13.0f;
+      forecast.humidity = 75.0f;
+      forecast.rainProbability = 0.3f;
+      fusion.update(ML_INPUT_FORECAST, forecast);
+    }
+
+    fusion.fuse(now, fused);
+    store.add(now, fused.channels, fused.channelSource);
+    store.read(live);
+
+    // The exterior node is preferred for temperature while fresh, the observation covers its gaps
+    if (n >= 1440) {
+      bool exteriorFresh = fused.usable(ML_FUSED_EXTERIOR_TEMP);
+      uint8_t expected = exteriorFresh ? ML_INPUT_EXTERIOR
+                       : fused.usable(ML_FUSED_OBSERVED_TEMP) ? ML_INPUT_OBSERVATION : ML_INPUT_INDOOR;
+      ok &= fused.channelSource[ML_STORE_TEMPERATURE] == expected;
+      ok &= fused.channelSource[ML_STORE_PRESSURE] == ML_INPUT_INDOOR;
+      ok &= fused.age[ML_INPUT_INDOOR] == 0;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  // fuse() alone, every source present, some stale
+  uint32_t end = 60 + (uint32_t)runs * 60;
+  volatile float sink = 0;
+  auto t2 = std::chrono::steady_clock::now();
+  for (long n = 0; n < runs; n++) {
+    fusion.fuse(end + (uint32_t)(n & 4095), fused);
+    sink = sink + fused.channels[ML_STORE_TEMPERATURE];
+  }
+  auto t3 = std::chrono::steady_clock::now();
+
+  fuseNs = std::chrono::duration<double, std::nano>(t3 - t2).count() / runs;
+  sampleNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / runs;
+  return ok;
+}
+
+/**
+ * Nowcast scores at +1 h and +ML_NOWCAST_HOURS
+ */
+struct NowcastScore {
+  double updateNs = 0;                  // Per sample
+  double forecastNs = 0;
+  long forecasts = 0;
+  double error[ML_NOWCAST_CHANNELS][2] = {};        // Mean absolute, nowcast
+  double persistence[ML_NOWCAST_CHANNELS][2] = {};  // ... and the last reading carried forward
+  double inside1[ML_NOWCAST_CHANNELS][2] = {};      // Share within one standard deviation
+  double inside2[ML_NOWCAST_CHANNELS][2] = {};      // ... and two
+};
+
+/**
+ * A month of one-minute samples: the exterior temperature swings through
+ * the day around a level that wanders, pressure drifts with passing
+ * weather and a 12-hour tide, and both carry sensor noise. A forecast is
+ * made every hour once the filters are warm, and scored at +1 h and at
+ * the last step against the reading the sensor will then give
+ */
+static void benchNowcast(NowcastScore& score) {
+  const uint32_t minutes = 30 * 1440;
+  const uint8_t last = ML_NOWCAST_HOURS - 1;
+  static float temperature[30 * 1440 + ML_NOWCAST_HOURS * 60 + 1];
+  static float pressure[30 * 1440 + ML_NOWCAST_HOURS * 60 + 1];
+  std::mt19937 rng(3);
+  std::normal_distribution<float> gauss(0.0f, 1.0f);
+  float level = 12.0f, drift = 0.0f, weather = 0.0f, tendency = 0.0f;
+  for (uint32_t m = 0; m < sizeof(temperature) / sizeof(temperature[0]); m++) {
+    float hours = m / 60.0f;
+    drift = 0.999f * drift + 0.0002f * gauss(rng);         // °C per minute, fronts over a day or so
+    level += drift;
+    level += 0.001f * (12.0f - level);
+    tendency = 0.9995f * tendency + 0.00015f * gauss(rng); // hPa per minute
+    weather += tendency;
+    weather -= 0.0002f * weather;
+    temperature[m] = level + 5.0f * sinf(2.0f * (float)M_PI * (hours - 9.0f) / 24.0f);
+    pressure[m] = 1013.0f + weather + 0.6f * cosf(2.0f * (float)M_PI * (hours - 10.0f) / 12.0f);
+    temperature[m] += 0.3f * gauss(rng);
+    pressure[m] += 0.1f * gauss(rng);
+  }
+
+  MLNowcaster nowcaster;
+  MLNowcast nowcast;
+  MLFusedFeatures fused;
+  double updateNs = 0;
+  for (uint32_t m = 0; m < minutes; m++) {
+    fused.time = 60 + m * 60;
+    fused.values[ML_FUSED_EXTERIOR_TEMP] = temperature[m];
+    fused.values[ML_FUSED_INDOOR_PRESSURE] = pressure[m];
+    fused.present = ML_FUSED_BIT(ML_FUSED_EXTERIOR_TEMP) | ML_FUSED_BIT(ML_FUSED_INDOOR_PRESSURE);
+    fused.age[ML_INPUT_INDOOR] = 0;
+    fused.age[ML_INPUT_EXTERIOR] = 20;
+
+    auto t0 = std::chrono::steady_clock::now();
+    nowcaster.update(fused);
+    auto t1 = std::chrono::steady_clock::now();
+    updateNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+    if (m % 60 != 59 || m < 2 * 1440) continue;
+    auto t2 = std::chrono::steady_clock::now();
+    nowcaster.forecast(fused.time, nowcast);
+    auto t3 = std::chrono::steady_clock::now();
+    score.forecastNs += std::chrono::duration<double, std::nano>(t3 - t2).count();
+    score.forecasts++;
+
+    const float* truth[ML_NOWCAST_CHANNELS] = {temperature, pressure};
+    const MLFusedField fields[ML_NOWCAST_CHANNELS] = {ML_FUSED_EXTERIOR_TEMP, ML_FUSED_INDOOR_PRESSURE};
+    for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+      const uint8_t steps[2] = {0, last};
+      for (uint8_t k = 0; k < 2; k++) {
+        float actual = truth[c][m + (steps[k] + 1) * 60];
+        float error = fabsf(nowcast.mean[c][steps[k]] - actual);
+        score.error[c][k] += error;
+        score.persistence[c][k] += fabsf(fused.values[fields[c]] - actual);
+        score.inside1[c][k] += error <= nowcast.sigma[c][steps[k]];
+        score.inside2[c][k] += error <= 2 * nowcast.sigma[c][steps[k]];
+      }
+    }
+  }
+
+  score.updateNs = updateNs / minutes;
+  if (score.forecasts == 0) return;
+  score.forecastNs /= score.forecasts;
+  for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+    for (uint8_t k = 0; k < 2; k++) {
+      score.error[c][k] /= score.forecasts;
+      score.persistence[c][k] /= score.forecasts;
+      score.inside1[c][k] /= score.forecasts;
+      score.inside2[c][k] /= score.forecasts;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* referencePath = nullptr;
+  long runs = 1000000;
+  double ghz = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--reference") && i + 1 < argc) {
+      referencePath = argv[++i];
+    } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+      runs = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--ghz") && i + 1 < argc) {
+      ghz = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: mlbench [--reference <csv>] [--runs <n>] [--ghz <f>]\n");
+      return 2;
+    }
+  }
+  if (runs < 1) runs = 1;
+
+  static MLQuantArena arena;
+  uint32_t macs = mlQuantMacs(ML_INT8_MODEL);
+  printf("model: %u layers, %u MACs per inference, arena %zu bytes, SIMD kernel: %s\n",
+         ML_INT8_MODEL.layerCount, macs, sizeof(arena), mlQuantHasVector() ? "yes" : "no (not an ESP32-S3 with esp-nn)");
+
+  bool ok = true;
+  for (int k = 0; k < ML_QUANT_KERNEL_COUNT; k++) {
+    bool match = checkVectors((MLQuantKernel)k, arena);
+    printf("check vectors, %s: %s\n", kernelName((MLQuantKernel)k), match ? "match" : "DIFFER");
+    ok &= match;
+  }
+
+  if (referencePath) {
+    long rows;
+    long differ = checkReference(referencePath, arena, rows);
+    if (differ < 0) { perror(referencePath); return 1; }
+    printf("reference: %ld rows, %ld differ\n", rows, differ);
+    ok &= differ == 0;
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> value(-127, 127);
+  long mismatched = 0;
+  for (long n = 0; n < CROSSCHECK_INPUTS; n++) {
+    int8_t input[ML_INT8_FEATURES], scalar[ML_QUANT_OUTPUT_COUNT], vector[ML_QUANT_OUTPUT_COUNT];
+    for (int8_t& x : input) x = (int8_t)value(rng);
+    mlQuantRun(ML_INT8_MODEL, input, scalar, arena, ML_QUANT_SCALAR);
+    mlQuantRun(ML_INT8_MODEL, input, vector, arena, ML_QUANT_VECTOR);
+    mismatched += memcmp(scalar, vector, sizeof(scalar)) != 0;
+  }
+  printf("random inputs: %d, scalar and vector differ on %ld\n", CROSSCHECK_INPUTS, mismatched);
+  ok &= mismatched == 0;
+
+  printf("\n  kernel               ns/inference   ns/MAC%s\n", ghz > 0 ? "  cycles/MAC" : "");
+  for (int k = 0; k < ML_QUANT_KERNEL_COUNT; k++) {
+    int8_t output[ML_QUANT_OUTPUT_COUNT];
+    volatile int8_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long n = 0; n < runs; n++) {
+      mlQuantRun(ML_INT8_MODEL, ML_INT8_CHECK_INPUT + (n % ML_INT8_CHECKS) * ML_INT8_FEATURES, output, arena,
+                 (MLQuantKernel)k);
+      sink = sink + output[0];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / runs;
+    printf("  %-20s %12.1f %8.3f", kernelName((MLQuantKernel)k), ns, ns / macs);
+    if (ghz > 0) printf("  %10.2f", ns * ghz / macs);
+    printf("\n");
+  }
+  printf("(host CPU; the station reports its own cycles at boot and in GET /api/ml)\n");
+
+  double fuseNs, sampleNs;
+  bool fusionOk = benchFusion(runs, fuseNs, sampleNs);
+  printf("\nfusion: %d sources, %d fields, state %zu + %zu bytes (MLFusion + MLFeatureStore)\n", ML_INPUT_COUNT,
+         ML_FUSED_COUNT, sizeof(MLFusion), sizeof(MLFeatureStore));
+  printf("  fuse()                                  %8.1f ns\n", fuseNs);
+  printf("  per sample (sources, fuse, store add/read) %8.1f ns\n", sampleNs);
+  printf("  channel sources and stale masks: %s\n", fusionOk ? "as expected" : "WRONG");
+  ok &= fusionOk;
+
+  NowcastScore nowcast;
+  benchNowcast(nowcast);
+  printf("\nnowcast: %d states per channel, state %zu bytes, forecast %zu bytes\n", ML_NOWCAST_STATES,
+         sizeof(MLNowcaster), sizeof(MLNowcast));
+  printf("  update, per sample                      %8.1f ns\n", nowcast.updateNs);
+  printf("  forecast, %d hours                       %8.1f ns\n", ML_NOWCAST_HOURS, nowcast.forecastNs);
+  printf("  %ld forecasts       MAE  persistence  within 1 sd  within 2 sd\n", nowcast.forecasts);
+  const char* names[ML_NOWCAST_CHANNELS] = {"temperature", "pressure"};
+  for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+    for (uint8_t k = 0; k < 2; k++) {
+      printf("  %-11s +%dh  %8.3f %12.3f %11.0f%% %11.0f%%\n", names[c], k ? ML_NOWCAST_HOURS : 1,
+             nowcast.error[c][k], nowcast.persistence[c][k], 100 * nowcast.inside1[c][k], 100 * nowcast.inside2[c][k]);
+    }
+  }
+  bool nowcastOk = nowcast.forecasts > 0;
+  for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+    nowcastOk &= nowcast.error[c][1] < nowcast.persistence[c][1] && nowcast.inside2[c][1] >= 0.8;
+  }
+  printf("  beats persistence at +%dh with calibrated bands: %s\n", ML_NOWCAST_HOURS, nowcastOk ? "yes" : "NO");
+  ok &= nowcastOk;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,722 @@
+/**
+ * @file wxbacktest.cpp
+ * @brief Backtest of MLPredictor on a weather log
+ *
+ * Replays a log through the firmware's own MLPredictor (ml_predictor.cpp
+ * and everything it uses, built against host_shim/) as fast as it runs,
+ * fed the way the station feeds it, record by record:
+ *
+ * - the outdoor columns as the exterior node's reading (observeSource())
+ * - the indoor columns and pressure as the BME680's (sample())
+ * - the record itself to the model's window (observe())
+ * - then a prediction (update()), every record or every --interval seconds
+ *
+ * Each prediction is scored against what the log shows ML_HORIZON_S later,
+ * with the outcome the models train on (MLFeatureWindow::nextExample()):
+ * rain if humidity reaches ML_RAIN_HUMIDITY by then, and the temperature
+ * change to the record closest to the horizon. Every record is replayed,
+ * so the features are warm, but only the newest --holdout of them is
+ * scored; the rest is what the online model trains on.
+ *
+ * Report: Brier score against climatology, temperature change MAE against
+ * persistence (no change), trend hits, a calibration table of the rain
+ * probability, and the thread CPU time of each call.
+ *
+ * The Kalman nowcast (ml_nowcast.cpp) is scored too, once an hour of log
+ * time over the same records: each hour ahead against the record closest
+ * to it, with persistence for comparison and how often the record falls
+ * within one and two of the nowcast's standard deviations.
+ *
+ * Models (--model):
+ *   rules   MLPredictor is not begun, so it has neither model
+ *   int8    begin() without a stored model: ml_model_int8.h, as the station boots
+ *   online  a model trained on the records before the scored ones, the way
+ *           MLPredictor's training job does, stored as ML_MODEL_FILE in a
+ *           temporary LittleFS directory and loaded by begin(); or
+ *           --model-file, a ml_model.bin taken off a station
+ *   file    --model-file, a .wxq model file (wxtrain --wxq), put in the first
+ *           model slot of a temporary LittleFS directory and loaded by begin()
+ *           as the station loads an uploaded one (ml_model_store.cpp)
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++17 -O2 -Itools/host_shim -Iesp32s3_central tools/wxbacktest.cpp tools/host_shim/host_shim.cpp \
+ *       esp32s3_central/ml_predictor.cpp esp32s3_central/ml_model.cpp esp32s3_central/ml_quant.cpp \
+ *       esp32s3_central/ml_features.cpp esp32s3_central/ml_fusion.cpp esp32s3_central/ml_nowcast.cpp \
+ *       esp32s3_central/ml_model_file.cpp esp32s3_central/ml_model_store.cpp esp32s3_central/log_format.cpp \
+ *       -o wxbacktest
+ *
+ * Usage:
+ *   ./wxbacktest [options] <in.csv|in.wxb>...
+ *     --model <m>          rules, int8 (default), online or file
+ *     --model-file <path>  online: use this stored model instead of training one; file: the .wxq
+ *     --holdout <f>        newest fraction of the records scored (default 0.5)
+ *     --interval <s>       predict every s seconds of log time (default 0: every record)
+ *     --synthetic <days>   replay generated weather shaped like the first input (as wxtrain)
+ *     --seed <n>           default 2 (wxtrain trains on seed 1)
+ *     --predictions <csv>  every scored prediction with its outcome
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "ml_predictor.h"
+#include "data_logger.h"
+#include "ml_model_int8.h"
+#include <LittleFS.h>
+
+#define TREND_THRESHOLD 1.0f            // ML_TREND_THRESHOLD in ml_predictor.cpp
+#define CALIBRATION_BINS 10
+
+static int usage() {
+  fprintf(stderr, "usage: wxbacktest [--model rules|int8|online|file] [--model-file ml_model.bin|model.wxq]\n"
+                  "                  [--holdout fraction] [--interval s] [--synthetic days] [--seed n]\n"
+                  "                  [--predictions out.csv] <in.csv|in.wxb>...\n");
+  return 2;
+}
+
+// MLPredictor is begun without a DataLogger here, so it never trains from the
+// card (trainFromCSV() / trainFromLog() refuse); these only complete the link.
+long DataLogger::readRange(uint32_t, uint32_t, LogRecordCallback, void*) {
+  return -1;
+}
+
+long DataLogger::readFile(const char*, uint32_t, uint8_t*, size_t, uint32_t&) {
+  return -1;
+}
+
+// ============================================================================
+// Data
+// ============================================================================
+
+struct Row {
+  uint32_t time;
+  float values[WX_LOG_CHANNEL_COUNT];   // NAN = empty
+};
+
+/**
+ * Split one CSV line in place (no quoting in these files)
+ */
+static std::vector<char*> splitCsv(char* line) {
+  std::vector<char*> fields;
+  line[strcspn(line, "\r\n")] = '\0';
+  char* start = line;
+  for (char* p = line;; p++) {
+    if (*p == ',' || *p == '\0') {
+      bool end = *p == '\0';
+      *p = '\0';
+      fields.push_back(start);
+      if (end) break;
+      start = p + 1;
+    }
+  }
+  return fields;
+}
+
+/**
+ * Append a CSV's rows, mapping its columns onto the weather channels by name
+ */
+static bool loadCsv(const char* path, std::vector<Row>& rows) {
+  FILE* in = fopen(path, "r");
+  if (!in) { perror(path); return false; }
+
+  const LogSchema& schema = weatherLogSchema();
+  char line[1024];
+  if (!fgets(line, sizeof(line), in)) { fprintf(stderr, "%s: empty\n", path); fclose(in); return false; }
+
+  std::vector<char*> names = splitCsv(line);
+  std::vector<int> column(names.size(), -1);
+  int timeColumn = -1;
+  for (size_t i = 0; i < names.size(); i++) {
+    if (strcmp(names[i], "timestamp") == 0) timeColumn = (int)i;
+    else column[i] = schema.find(names[i]);
+  }
+  if (timeColumn < 0) { fprintf(stderr, "%s: no timestamp column\n", path); fclose(in); return false; }
+
+  while (fgets(line, sizeof(line), in)) {
+    std::vector<char*> fields = splitCsv(line);
+    Row row;
+    if ((int)fields.size() <= timeColumn || !parseIsoTime(fields[timeColumn], row.time)) continue;
+    for (float& v : row.values) v = NAN;
+    for (size_t i = 0; i < fields.size() && i < column.size(); i++) {
+      if (column[i] >= 0 && column[i] < WX_LOG_CHANNEL_COUNT && fields[i][0] != '\0') {
+        row.values[column[i]] = strtof(fields[i], nullptr);
+      }
+    }
+    rows.push_back(row);
+  }
+  fclose(in);
+  return true;
+}
+
+/**
+ * Append a day partition's records (.wxb), mapping its channels by name;
+ * torn or failed records are skipped, preallocated space ends the data
+ */
+static bool loadBinary(const char* path, std::vector<Row>& rows) {
+  FILE* in = fopen(path, "rb");
+  if (!in) { perror(path); return false; }
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + n);
+  fclose(in);
+
+  LogSchema schema;
+  if (!schema.parse(data.data(), data.size())) { fprintf(stderr, "%s: not a log partition\n", path); return false; }
+  const LogSchema& weather = weatherLogSchema();
+  int channels[WX_LOG_CHANNEL_COUNT];
+  for (uint8_t i = 0; i < WX_LOG_CHANNEL_COUNT; i++) channels[i] = schema.find(weather.channel(i).name);
+
+  for (size_t offset = schema.headerSize(); offset + schema.recordSize() <= data.size();
+       offset += schema.recordSize()) {
+    const uint8_t* record = data.data() + offset;
+    if (schema.isUnwritten(record)) break;
+    float values[LOG_MAX_CHANNELS];
+    uint16_t mask;
+    Row row;
+    if (!schema.decode(record, row.time, values, mask)) continue;
+    for (uint8_t i = 0; i < WX_LOG_CHANNEL_COUNT; i++) {
+      row.values[i] = channels[i] >= 0 && (mask & (1u << channels[i])) ? values[channels[i]] : NAN;
+    }
+    rows.push_back(row);
+  }
+  return true;
+}
+
+/**
+ * Mean of a channel over the rows that have it
+ */
+static float channelMean(const std::vector<Row>& rows, uint8_t channel, float fallback) {
+  double sum = 0;
+  size_t n = 0;
+  for (const Row& row : rows) {
+    if (!isnan(row.values[channel])) { sum += row.values[channel]; n++; }
+  }
+  return n ? (float)(sum / n) : fallback;
+}
+
+/**
+ * wxtrain's generator: days of 5-minute records, a daily temperature cycle
+ * and fronts every few days (pressure falls for hours, the air saturates
+ * and cools, then clears)
+ */
+static std::vector<Row> synthesize(const std::vector<Row>& like, int days, std::mt19937& random) {
+  std::normal_distribution<float> gauss(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+  uint32_t time = like.empty() ? LOG_FALLBACK_EPOCH : like[0].time;
+  float pressureMean = channelMean(like, WX_LOG_PRESSURE, 1013.0f);
+  float tempMean = channelMean(like, WX_LOG_TEMP_OUTDOOR, 12.0f);
+  float humidityMean = channelMean(like, WX_LOG_HUMIDITY_OUTDOOR, 65.0f);
+  float indoorTemp = channelMean(like, WX_LOG_TEMP_INDOOR, 21.0f);
+  float indoorHumidity = channelMean(like, WX_LOG_HUMIDITY_INDOOR, 45.0f);
+
+  enum { CLEAR, APPROACHING, RAINING } state = CLEAR;
+  float pressure = pressureMean, humidity = humidityMean, front = 0, frontLength = 0, depth = 0;
+  float drift = 0;
+  std::vector<Row> rows;
+
+  for (long i = 0; i < (long)days * 288; i++, time += 300) {
+    switch (state) {
+      case CLEAR:
+        pressure += (pressureMean - pressure) * 0.003f + gauss(random) * 0.03f;
+        humidity += (humidityMean - humidity) * 0.01f + gauss(random) * 0.8f;
+        if (uniform(random) < 1.0f / 700) {
+          state = APPROACHING;
+          front = 0;
+          frontLength = 6 * 3600 + uniform(random) * 8 * 3600;
+          depth = 4 + uniform(random) * 12;
+        }
+        break;
+      case APPROACHING:
+        pressure -= depth / (frontLength / 300) + gauss(random) * 0.02f;
+        humidity += (92 - humidity) * 0.01f + gauss(random) * 0.5f;
+        front += 300;
+        if (front >= frontLength) {
+          state = uniform(random) < 0.8f ? RAINING : CLEAR;  // Some fronts pass dry
+          front = 0;
+          frontLength = 2 * 3600 + uniform(random) * 4 * 3600;
+        }
+        break;
+      case RAINING:
+        pressure += depth / 2 / (frontLength / 300) + gauss(random) * 0.02f;
+        humidity += (98 - humidity) * 0.2f + gauss(random) * 0.3f;
+        front += 300;
+        if (front >= frontLength) state = CLEAR;
+        break;
+    }
+    humidity = std::min(100.0f, std::max(15.0f, humidity));
+
+    float hour = (float)(time % 86400) / 3600.0f;
+    drift = 0.9995f * drift + gauss(random) * 0.05f;
+    float temp = tempMean + drift + 5.0f * sinf((hour - 9.0f) / 24.0f * 2.0f * (float)M_PI) -
+                 (state == RAINING ? 3.0f : 0.0f) + gauss(random) * 0.15f;
+
+    Row row;
+    row.time = time;
+    row.values[WX_LOG_TEMP_INDOOR] = roundf((indoorTemp + gauss(random) * 0.2f) * 100) / 100;
+    row.values[WX_LOG_HUMIDITY_INDOOR] = roundf((indoorHumidity + gauss(random)) * 100) / 100;
+    row.values[WX_LOG_TEMP_OUTDOOR] = roundf(temp * 100) / 100;
+    row.values[WX_LOG_HUMIDITY_OUTDOOR] = roundf(humidity * 100) / 100;
+    row.values[WX_LOG_PRESSURE] = roundf(pressure * 100) / 100;
+    row.values[WX_LOG_LIGHT] = NAN;
+    row.values[WX_LOG_IAQ] = NAN;
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+static bool sampleOf(const Row& row, MLSample& sample) {
+  const float* v = row.values;
+  return mlSampleFrom(row.time, v[WX_LOG_PRESSURE], v[WX_LOG_TEMP_OUTDOOR], v[WX_LOG_HUMIDITY_OUTDOOR],
+                      v[WX_LOG_TEMP_INDOOR], v[WX_LOG_HUMIDITY_INDOOR], sample);
+}
+
+/**
+ * What happened within ML_HORIZON_S of each record, as MLFeatureWindow::nextExample()
+ * sees it: the wettest sample up to the horizon and the one closest to it
+ */
+struct Outcome {
+  bool known;                           // A sample within ML_TIME_TOLERANCE_S of the horizon
+  bool rain;
+  float tempChange;
+};
+
+static std::vector<Outcome> outcomes(const std::vector<Row>& rows) {
+  std::vector<MLSample> samples(rows.size());
+  std::vector<bool> usable(rows.size());
+  for (size_t i = 0; i < rows.size(); i++) usable[i] = sampleOf(rows[i], samples[i]);
+
+  std::vector<Outcome> out(rows.size(), Outcome{false, false, 0});
+  for (size_t i = 0; i < rows.size(); i++) {
+    if (!usable[i]) continue;
+    const MLSample& then = samples[i];
+    uint32_t target = then.time + ML_HORIZON_S;
+    int outcome = -1;
+    uint32_t bestDistance = ML_TIME_TOLERANCE_S + 1;
+    float wettest = then.humidity;
+    for (size_t later = i + 1; later < rows.size(); later++) {
+      if (!usable[later]) continue;
+      const MLSample& sample = samples[later];
+      uint32_t distance = sample.time > target ? sample.time - target : target - sample.time;
+      if (distance < bestDistance) {
+        outcome = (int)later;
+        bestDistance = distance;
+      }
+      if (sample.time <= target && sample.humidity > wettest) wettest = sample.humidity;
+      if (sample.time > target + ML_TIME_TOLERANCE_S) break;
+    }
+    if (outcome < 0) continue;
+    out[i] = Outcome{true, wettest >= ML_RAIN_HUMIDITY, samples[outcome].temperature - then.temperature};
+  }
+  return out;
+}
+
+// ============================================================================
+// Online model
+// ============================================================================
+
+/**
+ * Train on rows [0, end) as MLTrainingJob::add() does, and store the model
+ * at path
+ * @return examples trained on, 0 if the model could not be stored
+ */
+static uint32_t trainOnline(const std::vector<Row>& rows, size_t end, const char* path) {
+  MLFeatureWindow window;
+  MLOnlineModel model;
+  uint32_t examples = 0, first = 0, last = 0;
+  for (size_t i = 0; i < end; i++) {
+    MLSample sample;
+    if (!sampleOf(rows[i], sample) || !window.add(sample)) continue;
+    if (first == 0) first = rows[i].time;
+    last = rows[i].time;
+    float features[ML_FEATURE_COUNT];
+    bool rain;
+    float tempChange;
+    while (window.nextExample(features, rain, tempChange)) {
+      model.train(features, rain, tempChange);
+      examples++;
+    }
+  }
+
+  std::vector<uint8_t> blob(MLOnlineModel::storedSize());
+  size_t size = model.store(blob.data(), blob.size(), first, last);
+  FILE* out = fopen(path, "wb");
+  bool ok = size > 0 && out && fwrite(blob.data(), 1, size, out) == size;
+  if (out) fclose(out);
+  return ok ? examples : 0;
+}
+
+static bool copyFile(const char* from, const std::string& to) {
+  FILE* in = fopen(from, "rb");
+  if (!in) { perror(from); return false; }
+  FILE* out = fopen(to.c_str(), "wb");
+  if (!out) { perror(to.c_str()); fclose(in); return false; }
+  uint8_t chunk[4096];
+  size_t n;
+  bool ok = true;
+  while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) ok &= fwrite(chunk, 1, n, out) == n;
+  fclose(in);
+  fclose(out);
+  return ok;
+}
+
+// ============================================================================
+// Scores
+// ============================================================================
+
+struct Score {
+  uint32_t n = 0;
+  uint32_t rain = 0;
+  double brier = 0;
+  double climateBrier = 0;
+  double mae = 0;
+  double persistenceMae = 0;
+  uint32_t trendHits = 0;
+
+  void add(float probability, float climatology, const Outcome& o, float tempChange, int trend) {
+    float y = o.rain ? 1.0f : 0.0f;
+    n++;
+    rain += o.rain;
+    brier += (probability - y) * (probability - y);
+    climateBrier += (climatology - y) * (climatology - y);
+    mae += fabsf(tempChange - o.tempChange);
+    persistenceMae += fabsf(o.tempChange);
+    int actual = o.tempChange > TREND_THRESHOLD ? 1 : o.tempChange < -TREND_THRESHOLD ? -1 : 0;
+    trendHits += trend == actual;
+  }
+
+  void print(const char* name) const {
+    if (n == 0) return;
+    double skill = climateBrier > 0 ? 1.0 - brier / climateBrier : 0.0;
+    printf("  %-8s %8u %6.1f%% %8.4f %8.4f %7.3f %8.3f %8.3f %8.1f%%\n", name, n, 100.0 * rain / n, brier / n,
+           climateBrier / n, skill, mae / n, persistenceMae / n, 100.0 * trendHits / n);
+  }
+};
+
+struct Calibration {
+  uint32_t n[CALIBRATION_BINS] = {};
+  double predicted[CALIBRATION_BINS] = {};
+  uint32_t rain[CALIBRATION_BINS] = {};
+
+  void add(float probability, bool outcome) {
+    int bin = std::min(CALIBRATION_BINS - 1, (int)(probability * CALIBRATION_BINS));
+    n[bin]++;
+    predicted[bin] += probability;
+    rain[bin] += outcome;
+  }
+
+  void print() const {
+    printf("calibration (rain probability):\n");
+    printf("  %-9s %8s %10s %9s\n", "bin", "count", "predicted", "observed");
+    for (int b = 0; b < CALIBRATION_BINS; b++) {
+      if (n[b] == 0) continue;
+      printf("  %.1f-%.1f  %8u %10.3f %9.3f\n", (double)b / CALIBRATION_BINS, (double)(b + 1) / CALIBRATION_BINS,
+             n[b], predicted[b] / n[b], (double)rain[b] / n[b]);
+    }
+  }
+};
+
+struct NowcastScore {
+  uint32_t n[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};
+  double mae[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};
+  double persistenceMae[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};
+  uint32_t inside1[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};
+  uint32_t inside2[ML_NOWCAST_CHANNELS][ML_NOWCAST_HOURS] = {};
+
+  void add(uint8_t channel, uint8_t hour, float mean, float sigma, float now, float actual) {
+    float error = fabsf(mean - actual);
+    n[channel][hour]++;
+    mae[channel][hour] += error;
+    persistenceMae[channel][hour] += fabsf(now - actual);
+    inside1[channel][hour] += error <= sigma;
+    inside2[channel][hour] += error <= 2 * sigma;
+  }
+
+  void print() const {
+    static const char* const names[ML_NOWCAST_CHANNELS] = {"temp C", "pres hPa"};
+    printf("nowcast (Kalman, ml_nowcast.cpp):\n");
+    printf("  %-8s %5s %8s %8s %8s %8s %8s\n", "channel", "ahead", "count", "MAE", "persist", "1 sd", "2 sd");
+    for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+      for (uint8_t h = 0; h < ML_NOWCAST_HOURS; h++) {
+        uint32_t count = n[c][h];
+        if (count == 0) continue;
+        printf("  %-8s %4uh %8u %8.3f %8.3f %7.1f%% %7.1f%%\n", names[c], h + 1, count, mae[c][h] / count,
+               persistenceMae[c][h] / count, 100.0 * inside1[c][h] / count, 100.0 * inside2[c][h] / count);
+      }
+    }
+  }
+};
+
+/**
+ * Index of the record closest to time, within ML_TIME_TOLERANCE_S; -1 if none
+ */
+static long closestRow(const std::vector<Row>& rows, uint32_t time) {
+  auto after = std::lower_bound(rows.begin(), rows.end(), time,
+                                [](const Row& row, uint32_t t) { return row.time < t; });
+  long best = -1;
+  uint32_t bestDistance = ML_TIME_TOLERANCE_S + 1;
+  if (after != rows.end() && after->time - time < bestDistance) {
+    best = after - rows.begin();
+    bestDistance = after->time - time;
+  }
+  if (after != rows.begin() && time - (after - 1)->time < bestDistance) best = after - 1 - rows.begin();
+  return best;
+}
+
+/**
+ * Thread CPU time in ns (preemption is not counted)
+ */
+static uint64_t cpuNs() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void printTimes(const char* name, std::vector<uint32_t>& ns) {
+  if (ns.empty()) return;
+  double sum = 0;
+  for (uint32_t t : ns) sum += t;
+  std::sort(ns.begin(), ns.end());
+  printf("  %-26s %8zu %9.0f %8u %8u %8u\n", name, ns.size(), sum / ns.size(), ns[ns.size() / 2],
+         ns[ns.size() * 99 / 100], ns.back());
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv) {
+  const char* modelName = "int8";
+  const char* modelFile = nullptr;
+  const char* predictionsPath = nullptr;
+  float holdout = 0.5f;
+  uint32_t interval = 0;
+  int syntheticDays = 0;
+  unsigned seed = 2;
+  std::vector<const char*> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    bool value = i + 1 < argc;
+    if (strcmp(argv[i], "--model") == 0 && value) modelName = argv[++i];
+    else if (strcmp(argv[i], "--model-file") == 0 && value) modelFile = argv[++i];
+    else if (strcmp(argv[i], "--holdout") == 0 && value) holdout = strtof(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--interval") == 0 && value) interval = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--synthetic") == 0 && value) syntheticDays = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && value) seed = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--predictions") == 0 && value) predictionsPath = argv[++i];
+    else if (argv[i][0] == '-') return usage();
+    else inputs.push_back(argv[i]);
+  }
+  bool rules = strcmp(modelName, "rules") == 0;
+  bool online = strcmp(modelName, "online") == 0;
+  bool file = strcmp(modelName, "file") == 0;
+  if (inputs.empty() || (!rules && !online && !file && strcmp(modelName, "int8") != 0) || holdout <= 0 ||
+      holdout > 1 || (file && !modelFile)) {
+    return usage();
+  }
+
+  std::vector<Row> rows;
+  for (const char* path : inputs) {
+    size_t length = strlen(path);
+    bool binary = length > 4 && strcmp(path + length - 4, ".wxb") == 0;
+    if (!(binary ? loadBinary(path, rows) : loadCsv(path, rows))) return 1;
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.time < b.time; });
+  if (syntheticDays > 0) {
+    std::mt19937 random(seed);
+    rows = synthesize(rows, syntheticDays, random);
+  }
+  if (rows.empty()) { fprintf(stderr, "no records\n"); return 1; }
+
+  size_t split = rows.size() - (size_t)(rows.size() * holdout);
+  std::vector<Outcome> truth = outcomes(rows);
+
+  // Climatology: the rain rate before the scored records (all of them if none are before)
+  uint32_t known = 0, rainy = 0;
+  size_t climateEnd = split > 0 ? split : rows.size();
+  for (size_t i = 0; i < climateEnd; i++) {
+    known += truth[i].known;
+    rainy += truth[i].known && truth[i].rain;
+  }
+  float climatology = known ? (float)rainy / known : 0.0f;
+
+  char first[21], last[21];
+  formatIsoTime(rows.front().time, first);
+  formatIsoTime(rows.back().time, last);
+  if (syntheticDays > 0) printf("data:    synthetic, %d days shaped like %s (seed %u)\n", syntheticDays, inputs[0], seed);
+  printf("records: %zu, %s to %s, newest %zu scored\n", rows.size(), first, last, rows.size() - split);
+
+  // The predictor, set up as the station would be for that model. begin() reads
+  // the online model or the model file from a temporary LittleFS directory,
+  // removed once it has (a model file is read into RAM: there is no partition to map).
+  MLPredictor predictor;
+  if (file) {
+    char directory[] = "/tmp/wxbacktest.XXXXXX";
+    if (!mkdtemp(directory)) { perror("mkdtemp"); return 1; }
+    char slot[32];
+    snprintf(slot, sizeof(slot), ML_MODEL_SLOT_FILE, 0u);
+    std::string path = std::string(directory) + slot;
+    if (!copyFile(modelFile, path)) return 1;
+    hostShimMount(LittleFS, directory);
+    predictor.begin(nullptr);
+    remove(path.c_str());
+    remove((std::string(directory) + ML_MODEL_SELECT_FILE).c_str());
+    rmdir(directory);
+
+    MLModelStoreStats stored;
+    predictor.getModelStore().getStats(stored);
+    if (stored.active != 0) {
+      fprintf(stderr, "%s: %s\n", modelFile, mlModelFileStatusName(stored.slots[0].status));
+      return 1;
+    }
+    MLKernelBenchmark kernels;
+    predictor.getKernelBenchmark(kernels);
+    printf("model:   file %s, id %u, %u bytes, loaded in %u us (%u bytes resident), %u MACs, %s kernel\n",
+           modelFile, stored.slots[0].modelId, stored.slots[0].bytes, stored.loadUs, stored.residentBytes,
+           kernels.macs, kernels.kernel == ML_QUANT_VECTOR ? "SIMD" : "scalar");
+  } else if (online) {
+    char directory[] = "/tmp/wxbacktest.XXXXXX";
+    if (!mkdtemp(directory)) { perror("mkdtemp"); return 1; }
+    std::string path = std::string(directory) + ML_MODEL_FILE;
+    if (modelFile) {
+      if (copyFile(modelFile, path)) printf("model:   online, %s\n", modelFile);
+    } else {
+      uint32_t examples = trainOnline(rows, split, path.c_str());
+      printf("model:   online, trained on the %zu records before (%u examples)\n", split, examples);
+    }
+    hostShimMount(LittleFS, directory);
+    predictor.begin(nullptr);
+    remove(path.c_str());
+    rmdir(directory);
+  } else if (!rules) {
+    predictor.begin(nullptr);
+  }
+  if (online && !predictor.isTrained()) {
+    fprintf(stderr, "no usable online model (too few examples to train on, or another build's model file)\n");
+    return 1;
+  }
+  if (!rules && !online && !file) {
+    MLKernelBenchmark kernels;
+    predictor.getKernelBenchmark(kernels);
+    printf("model:   int8 (ml_model_int8.h), %s, %u MACs, %s kernel\n",
+           predictor.hasCompiledModel() ? "check vectors match" : "check vectors differ: not used", kernels.macs,
+           kernels.kernel == ML_QUANT_VECTOR ? "SIMD" : "scalar");
+  }
+  if (rules) printf("model:   rules\n");
+
+  FILE* predictions = nullptr;
+  if (predictionsPath) {
+    predictions = fopen(predictionsPath, "w");
+    if (!predictions) { perror(predictionsPath); return 1; }
+    fprintf(predictions, "timestamp,source,rain_probability,rain,temp_change,actual_change,trend\n");
+  }
+
+  // Replay
+  static const char* const sourceNames[] = {"rules", "online", "int8", "file"};
+  Score scores[4], total;
+  Calibration calibration;
+  NowcastScore nowcastScore;
+  static const uint8_t nowcastColumns[ML_NOWCAST_CHANNELS] = {WX_LOG_TEMP_OUTDOOR, WX_LOG_PRESSURE};
+  uint32_t nextNowcast = 0;
+  std::vector<uint32_t> recordNs, updateNs;
+  recordNs.reserve(rows.size());
+  updateNs.reserve(rows.size());
+  uint32_t unscored = 0, nextPrediction = 0;
+
+  for (size_t i = 0; i < rows.size(); i++) {
+    const Row& row = rows[i];
+    const float* v = row.values;
+
+    MLSourceReading exterior;
+    exterior.time = row.time;
+    exterior.temperature = v[WX_LOG_TEMP_OUTDOOR];
+    exterior.humidity = v[WX_LOG_HUMIDITY_OUTDOOR];
+    exterior.light = v[WX_LOG_LIGHT];
+    SensorData indoor;
+    indoor.temperature = v[WX_LOG_TEMP_INDOOR];
+    indoor.humidity = v[WX_LOG_HUMIDITY_INDOOR];
+    indoor.pressure = v[WX_LOG_PRESSURE];
+    CSVRecord record;
+    record.timestamp = row.time;
+    record.temp_indoor = v[WX_LOG_TEMP_INDOOR];
+    record.humidity_indoor = v[WX_LOG_HUMIDITY_INDOOR];
+    record.temp_outdoor = v[WX_LOG_TEMP_OUTDOOR];
+    record.humidity_outdoor = v[WX_LOG_HUMIDITY_OUTDOOR];
+    record.pressure = v[WX_LOG_PRESSURE];
+    record.light = v[WX_LOG_LIGHT];
+
+    uint64_t t0 = cpuNs();
+    if (!isnan(exterior.temperature) || !isnan(exterior.humidity) || !isnan(exterior.light)) {
+      predictor.observeSource(ML_INPUT_EXTERIOR, exterior);
+    }
+    if (indoor.pressure > 0) predictor.sample(indoor, row.time);  // As readLocalSensors()
+    predictor.observe(record);
+    uint64_t t1 = cpuNs();
+    recordNs.push_back((uint32_t)(t1 - t0));
+
+    // Nowcast as of this record, hourly, against the records it looks ahead to
+    if (i >= split && row.time >= nextNowcast) {
+      nextNowcast = row.time + 3600;
+      MLNowcast nowcast;
+      predictor.getNowcast(nowcast);
+      for (uint8_t c = 0; c < ML_NOWCAST_CHANNELS; c++) {
+        if (!nowcast.has((MLNowcastChannel)c) || isnan(v[nowcastColumns[c]])) continue;
+        for (uint8_t h = 0; h < ML_NOWCAST_HOURS; h++) {
+          long ahead = closestRow(rows, row.time + (h + 1) * 3600);
+          if (ahead < 0 || isnan(rows[ahead].values[nowcastColumns[c]])) continue;
+          nowcastScore.add(c, h, nowcast.mean[c][h], nowcast.sigma[c][h], v[nowcastColumns[c]],
+                           rows[ahead].values[nowcastColumns[c]]);
+        }
+      }
+    }
+
+    if (row.time < nextPrediction) continue;
+    nextPrediction = row.time + interval;
+    uint64_t t2 = cpuNs();
+    predictor.update();
+    uint64_t t3 = cpuNs();
+    updateNs.push_back((uint32_t)(t3 - t2));
+
+    if (i < split) continue;
+    if (!truth[i].known) {
+      unscored++;
+      continue;
+    }
+    WeatherPrediction p = predictor.getPrediction();
+    float probability = p.rainProbability / 100.0f;
+    scores[p.source].add(probability, climatology, truth[i], p.temperatureChange, p.temperatureTrend);
+    total.add(probability, climatology, truth[i], p.temperatureChange, p.temperatureTrend);
+    calibration.add(probability, truth[i].rain);
+    if (predictions) {
+      char stamp[21];
+      formatIsoTime(row.time, stamp);
+      fprintf(predictions, "%s,%s,%.4f,%d,%.3f,%.3f,%d\n", stamp, sourceNames[p.source], probability,
+              truth[i].rain, p.temperatureChange, truth[i].tempChange, p.temperatureTrend);
+    }
+  }
+  if (predictions) fclose(predictions);
+
+  printf("scored:  %u predictions, %u without an outcome (gap or end of the log)\n\n", total.n, unscored);
+  printf("  %-8s %8s %7s %8s %8s %7s %8s %8s %9s\n", "source", "count", "rain", "Brier", "climate", "skill",
+         "MAE C", "persist", "trend");
+  for (int s = 0; s < 4; s++) scores[s].print(sourceNames[s]);
+  total.print("all");
+  printf("\n");
+  calibration.print();
+  printf("\n");
+  nowcastScore.print();
+
+  printf("\nCPU time per call (host, ns):\n");
+  printf("  %-26s %8s %9s %8s %8s %8s\n", "call", "count", "mean", "p50", "p99", "max");
+  printTimes("record (sample, observe)", recordNs);
+  printTimes("update()", updateNs);
+  return total.n > 0 ? 0 : 1;
+}
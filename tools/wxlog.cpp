@@ -0,0 +1,462 @@
+/**
+ * @file wxlog.cpp
+ * @brief Host converter between CSV, the packed binary weather log (.wxb)
+ *        and its compressed form (.wxc)
+ *
+ * Uses the firmware's own log_format.cpp and log_compress.cpp, so files are
+ * byte-identical to what DataLogger writes to a day partition and CSV
+ * output matches DataLogger::exportCSV().
+ *
+ *   tobin   CSV (training-data columns, any order) -> .wxb with the weather schema
+ *   tocsv   .wxb -> CSV, streamed through LogCsvConverter in 512-byte chunks
+ *   pack    .wxb -> .wxc (compressed blocks, as a closed day is rewritten)
+ *   unpack  .wxc -> .wxb
+ *   bench   size and speed of each format, on the CSV and on a synthetic
+ *           series with its columns, resolution and logging interval
+ *
+ * tobin also reports file sizes and the per-record write cost of both
+ * formats (host CPU; scale by the host/ESP32-S3 speed ratio).
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++17 -O2 -Iesp32s3_central tools/wxlog.cpp \
+ *       esp32s3_central/log_format.cpp esp32s3_central/log_compress.cpp -o wxlog
+ *
+ * Usage:
+ *   ./wxlog tobin data/weather_training_data.csv weather.wxb
+ *   ./wxlog tocsv weather.wxb [out.csv]
+ *   ./wxlog pack weather.wxb weather.wxc
+ *   ./wxlog unpack weather.wxc weather.wxb
+ *   ./wxlog bench data/weather_training_data.csv [days]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "log_format.h"
+#include "log_compress.h"
+
+static int usage() {
+  fprintf(stderr, "usage: wxlog tobin <in.csv> <out.wxb>\n"
+                  "       wxlog tocsv <in.wxb> [out.csv]\n"
+                  "       wxlog pack <in.wxb> <out.wxc>\n"
+                  "       wxlog unpack <in.wxc> <out.wxb>\n"
+                  "       wxlog bench <in.csv> [days]\n");
+  return 2;
+}
+
+/**
+ * Split one CSV line in place (no quoting in these files)
+ */
+static std::vector<char*> splitCsv(char* line) {
+  std::vector<char*> fields;
+  line[strcspn(line, "\r\n")] = '\0';
+  char* start = line;
+  for (char* p = line;; p++) {
+    if (*p == ',' || *p == '\0') {
+      bool end = *p == '\0';
+      *p = '\0';
+      fields.push_back(start);
+      if (end) break;
+      start = p + 1;
+    }
+  }
+  return fields;
+}
+
+/**
+ * One CSV row: time and values in schema order (NAN = empty)
+ */
+struct CsvRow {
+  uint32_t time;
+  std::vector<float> values;
+};
+
+struct CsvData {
+  std::vector<CsvRow> rows;
+  std::vector<int> decimals;            // Most digits after the point seen per channel
+  uint32_t rejected = 0;
+  size_t bytes = 0;
+};
+
+/**
+ * Read a CSV with a timestamp column, mapping the other columns onto the
+ * weather schema's channels by name
+ */
+static bool loadCsv(const char* path, CsvData& csv) {
+  FILE* in = fopen(path, "r");
+  if (!in) { perror(path); return false; }
+
+  const LogSchema& schema = weatherLogSchema();
+  char line[1024];
+  if (!fgets(line, sizeof(line), in)) { fprintf(stderr, "%s: empty\n", path); fclose(in); return false; }
+  csv.bytes = strlen(line);
+
+  std::vector<char*> names = splitCsv(line);
+  std::vector<int> column(names.size(), -1);
+  int timeColumn = -1;
+  for (size_t i = 0; i < names.size(); i++) {
+    if (strcmp(names[i], "timestamp") == 0) timeColumn = (int)i;
+    else column[i] = schema.find(names[i]);
+  }
+  if (timeColumn < 0) { fprintf(stderr, "%s: no timestamp column\n", path); fclose(in); return false; }
+  csv.decimals.assign(schema.channelCount(), 0);
+
+  while (fgets(line, sizeof(line), in)) {
+    csv.bytes += strlen(line);
+    std::vector<char*> fields = splitCsv(line);
+    CsvRow row;
+    if ((int)fields.size() <= timeColumn || !parseIsoTime(fields[timeColumn], row.time)) {
+      csv.rejected++;
+      continue;
+    }
+
+    row.values.assign(schema.channelCount(), NAN);
+    for (size_t i = 0; i < fields.size() && i < column.size(); i++) {
+      if (column[i] < 0 || fields[i][0] == '\0') continue;
+      row.values[column[i]] = strtof(fields[i], nullptr);
+      const char* point = strchr(fields[i], '.');
+      int digits = point ? (int)strlen(point + 1) : 0;
+      if (digits > csv.decimals[column[i]]) csv.decimals[column[i]] = digits;
+    }
+    csv.rows.push_back(row);
+  }
+  fclose(in);
+  return true;
+}
+
+static int toBinary(const char* inPath, const char* outPath) {
+  CsvData csv;
+  if (!loadCsv(inPath, csv)) return 1;
+
+  const LogSchema& schema = weatherLogSchema();
+  std::vector<uint8_t> output(schema.headerSize());
+  schema.writeHeader(output.data(), output.size(), 0);
+
+  for (const CsvRow& row : csv.rows) {
+    uint8_t record[LOG_MAX_RECORD_SIZE];
+    schema.encode(row.time, row.values.data(), 0xFFFF, record);
+    output.insert(output.end(), record, record + schema.recordSize());
+  }
+  uint32_t records = csv.rows.size();
+  uint32_t rejected = csv.rejected;
+  size_t csvBytes = csv.bytes;
+
+  FILE* out = fopen(outPath, "wb");
+  if (!out) { perror(outPath); return 1; }
+  fwrite(output.data(), 1, output.size(), out);
+  fclose(out);
+
+  // Write cost: format each record as the old CSV line vs pack it (repeated for stable timing)
+  const int rounds = 20000 / (records ? records : 1) + 1;
+  char text[LOG_CSV_LINE_MAX];
+  uint8_t packed[LOG_MAX_RECORD_SIZE];
+  volatile size_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const CsvRow& row : csv.rows) {
+      char stamp[21];
+      formatIsoTime(row.time, stamp);
+      int n = snprintf(text, sizeof(text), "%s", stamp);
+      for (float v : row.values) n += snprintf(text + n, sizeof(text) - n, ",%.2f", v);
+      sink += n;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (const CsvRow& row : csv.rows) {
+      schema.encode(row.time, row.values.data(), 0xFFFF, packed);
+      sink += packed[0];
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  double n = (double)rounds * (records ? records : 1);
+  double csvNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  double binNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / n;
+
+  printf("records:     %u (%u rejected)\n", records, rejected);
+  printf("csv:         %zu bytes, %.1f bytes/record\n", csvBytes, records ? (double)csvBytes / records : 0.0);
+  printf("wxb:         %zu bytes (%zu header + %zu/record)\n", output.size(), schema.headerSize(), schema.recordSize());
+  printf("size ratio:  %.2fx smaller per record\n",
+         records ? ((double)csvBytes / records) / schema.recordSize() : 0.0);
+  printf("write cost:  csv format %.0f ns/record, binary pack %.0f ns/record (%.1fx, host CPU)\n",
+         csvNs, binNs, binNs > 0 ? csvNs / binNs : 0.0);
+  return 0;
+}
+
+static int toCsv(const char* inPath, const char* outPath) {
+  FILE* in = fopen(inPath, "rb");
+  if (!in) { perror(inPath); return 1; }
+  FILE* out = outPath ? fopen(outPath, "w") : stdout;
+  if (!out) { perror(outPath); return 1; }
+
+  // Fixed buffers: one SD sector in, a few CSV lines out (as on the device)
+  LogCsvConverter converter;
+  uint8_t input[512];
+  char output[1024];
+  size_t n;
+
+  while ((n = fread(input, 1, sizeof(input), in)) > 0) {
+    size_t offset = 0;
+    while (offset < n) {
+      size_t produced;
+      size_t consumed = converter.convert(input + offset, n - offset, output, sizeof(output), produced);
+      offset += consumed;
+      fwrite(output, 1, produced, out);
+      if (converter.failed()) {
+        fprintf(stderr, "%s: not a .wxb weather log (unpack a .wxc first)\n", inPath);
+        return 1;
+      }
+    }
+  }
+
+  fclose(in);
+  if (out != stdout) fclose(out);
+  fprintf(stderr, "%u records, %u skipped\n", converter.getRecordCount(), converter.getSkippedCount());
+  return 0;
+}
+
+/**
+ * .wxc file for count packed records: the schema header flagged as blocks, then the blocks
+ */
+static std::vector<uint8_t> packRecords(const LogSchema& schema, const uint8_t* records, size_t count,
+                                        uint32_t created) {
+  std::vector<uint8_t> output(schema.headerSize());
+  schema.writeHeader(output.data(), output.size(), created, LOG_FLAG_BLOCKS);
+
+  static LogBlockEncoder encoder;  // Fixed queue, too large for the stack on the device too
+  encoder.begin(schema);
+  uint8_t block[sizeof(LogBlockHeader) + LOG_BLOCK_MAX_BYTES];
+  for (size_t i = 0; i < count || encoder.pending() > 0;) {
+    while (i < count && !encoder.full()) encoder.add(records + i++ * schema.recordSize());
+    size_t n = encoder.emit(block, sizeof(block));
+    output.insert(output.end(), block, block + n);
+  }
+  return output;
+}
+
+/**
+ * Blocks of a .wxc file (after its header) back to packed records
+ * @return false at the first damaged block
+ */
+static bool unpackBlocks(const LogSchema& schema, const uint8_t* data, size_t length, std::vector<uint8_t>& out) {
+  LogBlockReader reader;
+  uint8_t record[LOG_MAX_RECORD_SIZE];
+  uint32_t time;
+
+  for (size_t offset = schema.headerSize(); offset < length;) {
+    LogBlockHeader header;
+    if (length - offset < sizeof(header)) return false;
+    memcpy(&header, data + offset, sizeof(header));
+    offset += sizeof(header);
+    if (!checkBlockHeader(header) || length - offset < header.length ||
+        !reader.begin(schema, header, data + offset)) {
+      return false;
+    }
+    while (reader.next(record, time)) out.insert(out.end(), record, record + schema.recordSize());
+    if (reader.failed()) return false;
+    offset += header.length;
+  }
+  return true;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* in = fopen(path, "rb");
+  if (!in) { perror(path); return false; }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) data.insert(data.end(), buffer, buffer + n);
+  fclose(in);
+  return true;
+}
+
+static bool writeFile(const char* path, const std::vector<uint8_t>& data) {
+  FILE* out = fopen(path, "wb");
+  if (!out) { perror(path); return false; }
+  bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+  return fclose(out) == 0 && ok;
+}
+
+static int pack(const char* inPath, const char* outPath) {
+  std::vector<uint8_t> data;
+  if (!readFile(inPath, data)) return 1;
+
+  LogSchema schema;
+  if (!schema.parse(data.data(), data.size()) || (schema.getFlags() & LOG_FLAG_BLOCKS)) {
+    fprintf(stderr, "%s: not a .wxb weather log\n", inPath);
+    return 1;
+  }
+  LogFileHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+
+  // Same as compaction on the device: failed records are dropped, preallocated space ends the data
+  std::vector<uint8_t> records;
+  uint32_t skipped = 0;
+  float values[LOG_MAX_CHANNELS];
+  uint32_t time;
+  uint16_t mask;
+  for (size_t offset = schema.headerSize(); offset + schema.recordSize() <= data.size(); offset += schema.recordSize()) {
+    const uint8_t* record = data.data() + offset;
+    if (schema.isUnwritten(record)) break;
+    if (!schema.decode(record, time, values, mask)) {
+      skipped++;
+      continue;
+    }
+    records.insert(records.end(), record, record + schema.recordSize());
+  }
+
+  size_t count = records.size() / schema.recordSize();
+  std::vector<uint8_t> output = packRecords(schema, records.data(), count, header.created);
+  if (!writeFile(outPath, output)) return 1;
+
+  size_t dataBytes = schema.headerSize() + records.size();
+  fprintf(stderr, "%zu records (%u skipped): %zu -> %zu bytes (%.2fx)\n", count, skipped, dataBytes,
+          output.size(), (double)dataBytes / output.size());
+  return 0;
+}
+
+static int unpack(const char* inPath, const char* outPath) {
+  std::vector<uint8_t> data;
+  if (!readFile(inPath, data)) return 1;
+
+  LogSchema schema;
+  if (!schema.parse(data.data(), data.size()) || !(schema.getFlags() & LOG_FLAG_BLOCKS)) {
+    fprintf(stderr, "%s: not a .wxc weather log\n", inPath);
+    return 1;
+  }
+  LogFileHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+
+  std::vector<uint8_t> output(schema.headerSize());
+  schema.writeHeader(output.data(), output.size(), header.created);
+  bool ok = unpackBlocks(schema, data.data(), data.size(), output);
+  if (!ok) fprintf(stderr, "%s: damaged block, stopped there\n", inPath);
+  if (!writeFile(outPath, output)) return 1;
+
+  fprintf(stderr, "%zu records\n", (output.size() - schema.headerSize()) / schema.recordSize());
+  return ok ? 0 : 1;
+}
+
+/**
+ * Every storage format of the same records: bytes per record and host CPU per record
+ */
+static void benchRecords(const char* title, const LogSchema& schema, const std::vector<uint8_t>& records) {
+  const size_t count = records.size() / schema.recordSize();
+  if (count == 0) return;
+
+  // CSV as exportCSV() writes it
+  char line[LOG_CSV_LINE_MAX];
+  size_t csvBytes = schema.formatCsvHeader(line, sizeof(line));
+  for (size_t i = 0; i < count; i++) csvBytes += schema.formatCsv(records.data() + i * schema.recordSize(), line, sizeof(line));
+  const size_t floatBytes = count * (4 + 4 * schema.channelCount());  // time + one float per channel
+
+  const int rounds = 2000000 / count + 1;
+  std::vector<uint8_t> packed;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) packed = packRecords(schema, records.data(), count, 0);
+  auto t1 = std::chrono::steady_clock::now();
+  std::vector<uint8_t> unpacked;
+  for (int r = 0; r < rounds; r++) {
+    unpacked.clear();
+    unpackBlocks(schema, packed.data(), packed.size(), unpacked);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  bool exact = unpacked == records;
+  size_t blocks = 0;
+  for (size_t offset = schema.headerSize(); offset < packed.size(); blocks++) {
+    LogBlockHeader header;
+    memcpy(&header, packed.data() + offset, sizeof(header));
+    offset += sizeof(header) + header.length;
+  }
+
+  double n = (double)rounds * count;
+  double wxc = (double)(packed.size() - schema.headerSize()) / count;
+  printf("%s: %zu records, %zu blocks, round trip %s\n", title, count, blocks, exact ? "exact" : "MISMATCH");
+  printf("  %-22s %8s %10s\n", "format", "B/record", "wxc ratio");
+  printf("  %-22s %8.1f %9.1fx\n", "csv", (double)csvBytes / count, csvBytes / (wxc * count));
+  printf("  %-22s %8.1f %9.1fx\n", "time + float32 values", (double)floatBytes / count, floatBytes / (wxc * count));
+  printf("  %-22s %8.1f %9.1fx\n", ".wxb (fixed point)", (double)schema.recordSize(), schema.recordSize() / wxc);
+  printf("  %-22s %8.2f\n", ".wxc (blocks)", wxc);
+  printf("  encode %.0f ns/record, decode %.0f ns/record (host CPU)\n\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / n);
+}
+
+static int bench(const char* csvPath, int days) {
+  CsvData csv;
+  if (!loadCsv(csvPath, csv)) return 1;
+  if (csv.rows.empty()) { fprintf(stderr, "%s: no records\n", csvPath); return 1; }
+
+  const LogSchema& schema = weatherLogSchema();
+  const uint8_t channels = schema.channelCount();
+  std::vector<uint8_t> records(csv.rows.size() * schema.recordSize());
+  for (size_t i = 0; i < csv.rows.size(); i++) {
+    schema.encode(csv.rows[i].time, csv.rows[i].values.data(), 0xFFFF, records.data() + i * schema.recordSize());
+  }
+  benchRecords(csvPath, schema, records);
+
+  // Synthetic series shaped like the CSV: its columns, ranges, decimals and
+  // logging interval (the shortest gap; longer ones are holes); a daily
+  // cycle, slow drift and one step of noise
+  uint32_t interval = 0;
+  for (size_t i = 1; i < csv.rows.size(); i++) {
+    uint32_t gap = csv.rows[i].time - csv.rows[i - 1].time;
+    if (csv.rows[i].time > csv.rows[i - 1].time && (interval == 0 || gap < interval)) interval = gap;
+  }
+  if (interval == 0) interval = 300;
+
+  std::vector<float> low(channels, INFINITY), high(channels, -INFINITY);
+  for (const CsvRow& row : csv.rows) {
+    for (uint8_t c = 0; c < channels; c++) {
+      if (isnan(row.values[c])) continue;
+      low[c] = fminf(low[c], row.values[c]);
+      high[c] = fmaxf(high[c], row.values[c]);
+    }
+  }
+
+  std::mt19937 random(1);
+  std::normal_distribution<float> gauss(0.0f, 1.0f);
+  std::vector<float> drift(channels, 0.0f);
+  size_t count = (size_t)days * LOG_SECONDS_PER_DAY / interval;
+  records.assign(count * schema.recordSize(), 0);
+  uint32_t time = csv.rows[0].time;
+
+  for (size_t i = 0; i < count; i++, time += interval) {
+    float values[LOG_MAX_CHANNELS];
+    float phase = 2.0f * (float)M_PI * (time % LOG_SECONDS_PER_DAY) / LOG_SECONDS_PER_DAY;
+    for (uint8_t c = 0; c < channels; c++) {
+      if (isinf(low[c])) {
+        values[c] = NAN;
+        continue;
+      }
+      float range = high[c] - low[c];
+      float step = powf(10.0f, -(float)csv.decimals[c]);
+      drift[c] = 0.999f * drift[c] + gauss(random) * range / 200.0f;
+      float v = (low[c] + high[c]) / 2 + range / 4 * sinf(phase - (float)M_PI / 2) + drift[c] + gauss(random) * step;
+      if (low[c] >= 0 && v < 0) v = 0;
+      values[c] = roundf(v / step) * step;
+    }
+    schema.encode(time, values, 0xFFFF, records.data() + i * schema.recordSize());
+  }
+
+  char title[64];
+  snprintf(title, sizeof(title), "synthetic, %d days at %u s", days, interval);
+  benchRecords(title, schema, records);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 4 && strcmp(argv[1], "tobin") == 0) return toBinary(argv[2], argv[3]);
+  if (argc >= 3 && strcmp(argv[1], "tocsv") == 0) return toCsv(argv[2], argc >= 4 ? argv[3] : nullptr);
+  if (argc >= 4 && strcmp(argv[1], "pack") == 0) return pack(argv[2], argv[3]);
+  if (argc >= 4 && strcmp(argv[1], "unpack") == 0) return unpack(argv[2], argv[3]);
+  if (argc >= 3 && strcmp(argv[1], "bench") == 0) return bench(argv[2], argc >= 4 ? atoi(argv[3]) : 365);
+  return usage();
+}
@@ -0,0 +1,637 @@
+/**
+ * @file wxtrain.cpp
+ * @brief Host trainer for the int8 model compiled into the firmware
+ *
+ * Reads weather logs in the CSV schema (DataLogger::exportCSV(),
+ * /api/logs/download, wxlog tocsv, data/weather_training_data.csv) and runs
+ * them through the firmware's own MLFeatureWindow (ml_model.cpp), so the
+ * examples are exactly what MLPredictor sees on the station. Then:
+ *
+ * 1. trains a small MLP (features -> hidden ReLU -> rain logit and
+ *    temperature change) in float, on the oldest examples
+ * 2. quantizes it to int8 with one scale per layer (ml_quant.h), calibrated
+ *    on the training examples
+ * 3. scores the float and the int8 model on the newest examples (held out:
+ *    split by time, so no hour is both trained and tested on), against
+ *    climatology, persistence and the station's own online model
+ * 4. writes the weights, scales and check vectors as a constexpr header
+ *    (esp32s3_central/ml_model_int8.h) that MLPredictor compiles into flash
+ * 5. optionally writes the same network as a model file (.wxq,
+ *    ml_model_file.h), which the station takes at runtime through
+ *    POST /api/ml/model instead of a reflash
+ * 6. optionally writes a bit-exact reference: every held-out example's int8
+ *    input and output from ml_quant.cpp, to check the device's inference
+ *
+ * The bundled CSV holds a few hours, less than one example needs (3 h of
+ * history and 3 h of outcome); --synthetic generates days of weather
+ * starting where the CSV starts, at its levels, with passing fronts (falling
+ * pressure, then saturated air and cooling) over a daily temperature cycle.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++17 -O2 -Itools/host_shim -Iesp32s3_central tools/wxtrain.cpp esp32s3_central/ml_model.cpp \
+ *       esp32s3_central/ml_quant.cpp esp32s3_central/ml_model_file.cpp esp32s3_central/log_format.cpp -o wxtrain
+ *
+ * Usage:
+ *   ./wxtrain [options] <in.csv>...
+ *     -o <header>        generated header (default esp32s3_central/ml_model_int8.h)
+ *     --wxq <file>       also write a model file for upload
+ *     --model-id <n>     its id (default: the Unix time)
+ *     --reference <csv>  bit-exact reference for the held-out examples
+ *     --synthetic <days> train on generated weather shaped like the first CSV
+ *     --hidden <n>       hidden units (default 12)
+ *     --holdout <f>      newest fraction held out (default 0.2)
+ *     --epochs <n>       default 40
+ *     --seed <n>         default 1 (data generation, initialization, shuffling)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "log_format.h"
+#include "ml_model.h"
+#include "ml_quant.h"
+#include "ml_model_file.h"
+
+#define INPUTS (ML_FEATURE_COUNT - 1)   // Features without ML_BIAS: the layers have biases
+#define OUTPUTS ML_QUANT_OUTPUT_COUNT
+#define CHECK_VECTORS 8
+
+static int usage() {
+  fprintf(stderr, "usage: wxtrain [-o header.h] [--wxq model.wxq] [--model-id n] [--reference ref.csv]\n"
+                  "               [--synthetic days] [--hidden n] [--holdout fraction] [--epochs n] [--seed n]\n"
+                  "               <in.csv>...\n");
+  return 2;
+}
+
+// ============================================================================
+// Data
+// ============================================================================
+
+struct Row {
+  uint32_t time;
+  float values[WX_LOG_CHANNEL_COUNT];   // NAN = empty
+};
+
+/**
+ * Split one CSV line in place (no quoting in these files)
+ */
+static std::vector<char*> splitCsv(char* line) {
+  std::vector<char*> fields;
+  line[strcspn(line, "\r\n")] = '\0';
+  char* start = line;
+  for (char* p = line;; p++) {
+    if (*p == ',' || *p == '\0') {
+      bool end = *p == '\0';
+      *p = '\0';
+      fields.push_back(start);
+      if (end) break;
+      start = p + 1;
+    }
+  }
+  return fields;
+}
+
+/**
+ * Append a CSV's rows, mapping its columns onto the weather channels by name
+ */
+static bool loadCsv(const char* path, std::vector<Row>& rows) {
+  FILE* in = fopen(path, "r");
+  if (!in) { perror(path); return false; }
+
+  const LogSchema& schema = weatherLogSchema();
+  char line[1024];
+  if (!fgets(line, sizeof(line), in)) { fprintf(stderr, "%s: empty\n", path); fclose(in); return false; }
+
+  std::vector<char*> names = splitCsv(line);
+  std::vector<int> column(names.size(), -1);
+  int timeColumn = -1;
+  for (size_t i = 0; i < names.size(); i++) {
+    if (strcmp(names[i], "timestamp") == 0) timeColumn = (int)i;
+    else column[i] = schema.find(names[i]);
+  }
+  if (timeColumn < 0) { fprintf(stderr, "%s: no timestamp column\n", path); fclose(in); return false; }
+
+  while (fgets(line, sizeof(line), in)) {
+    std::vector<char*> fields = splitCsv(line);
+    Row row;
+    if ((int)fields.size() <= timeColumn || !parseIsoTime(fields[timeColumn], row.time)) continue;
+    for (float& v : row.values) v = NAN;
+    for (size_t i = 0; i < fields.size() && i < column.size(); i++) {
+      if (column[i] >= 0 && column[i] < WX_LOG_CHANNEL_COUNT && fields[i][0] != '\0') {
+        row.values[column[i]] = strtof(fields[i], nullptr);
+      }
+    }
+    rows.push_back(row);
+  }
+  fclose(in);
+  return true;
+}
+
+/**
+ * Mean of a channel over the rows that have it
+ */
+static float channelMean(const std::vector<Row>& rows, uint8_t channel, float fallback) {
+  double sum = 0;
+  size_t n = 0;
+  for (const Row& row : rows) {
+    if (!isnan(row.values[channel])) { sum += row.values[channel]; n++; }
+  }
+  return n ? (float)(sum / n) : fallback;
+}
+
+/**
+ * Days of 5-minute records: a daily temperature cycle, and fronts every few
+ * days (pressure falls for hours, the air saturates and cools, then clears)
+ */
+static std::vector<Row> synthesize(const std::vector<Row>& like, int days, std::mt19937& random) {
+  std::normal_distribution<float> gauss(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+  uint32_t time = like.empty() ? LOG_FALLBACK_EPOCH : like[0].time;
+  float pressureMean = channelMean(like, WX_LOG_PRESSURE, 1013.0f);
+  float tempMean = channelMean(like, WX_LOG_TEMP_OUTDOOR, 12.0f);
+  float humidityMean = channelMean(like, WX_LOG_HUMIDITY_OUTDOOR, 65.0f);
+  float indoorTemp = channelMean(like, WX_LOG_TEMP_INDOOR, 21.0f);
+  float indoorHumidity = channelMean(like, WX_LOG_HUMIDITY_INDOOR, 45.0f);
+
+  enum { CLEAR, APPROACHING, RAINING } state = CLEAR;
+  float pressure = pressureMean, humidity = humidityMean, front = 0, frontLength = 0, depth = 0;
+  float drift = 0;
+  std::vector<Row> rows;
+
+  for (long i = 0; i < (long)days * 288; i++, time += 300) {
+    switch (state) {
+      case CLEAR:
+        pressure += (pressureMean - pressure) * 0.003f + gauss(random) * 0.03f;
+        humidity += (humidityMean - humidity) * 0.01f + gauss(random) * 0.8f;
+        if (uniform(random) < 1.0f / 700) {
+          state = APPROACHING;
+          front = 0;
+          frontLength = 6 * 3600 + uniform(random) * 8 * 3600;
+          depth = 4 + uniform(random) * 12;
+        }
+        break;
+      case APPROACHING:
+        pressure -= depth / (frontLength / 300) + gauss(random) * 0.02f;
+        humidity += (92 - humidity) * 0.01f + gauss(random) * 0.5f;
+        front += 300;
+        if (front >= frontLength) {
+          state = uniform(random) < 0.8f ? RAINING : CLEAR;  // Some fronts pass dry
+          front = 0;
+          frontLength = 2 * 3600 + uniform(random) * 4 * 3600;
+        }
+        break;
+      case RAINING:
+        pressure += depth / 2 / (frontLength / 300) + gauss(random) * 0.02f;
+        humidity += (98 - humidity) * 0.2f + gauss(random) * 0.3f;
+        front += 300;
+        if (front >= frontLength) state = CLEAR;
+        break;
+    }
+    humidity = std::min(100.0f, std::max(15.0f, humidity));
+
+    float hour = (float)(time % 86400) / 3600.0f;
+    drift = 0.9995f * drift + gauss(random) * 0.05f;
+    float temp = tempMean + drift + 5.0f * sinf((hour - 9.0f) / 24.0f * 2.0f * (float)M_PI) -
+                 (state == RAINING ? 3.0f : 0.0f) + gauss(random) * 0.15f;
+
+    Row row;
+    row.time = time;
+    row.values[WX_LOG_TEMP_INDOOR] = roundf((indoorTemp + gauss(random) * 0.2f) * 100) / 100;
+    row.values[WX_LOG_HUMIDITY_INDOOR] = roundf((indoorHumidity + gauss(random)) * 100) / 100;
+    row.values[WX_LOG_TEMP_OUTDOOR] = roundf(temp * 100) / 100;
+    row.values[WX_LOG_HUMIDITY_OUTDOOR] = roundf(humidity * 100) / 100;
+    row.values[WX_LOG_PRESSURE] = roundf(pressure * 100) / 100;
+    row.values[WX_LOG_LIGHT] = NAN;
+    row.values[WX_LOG_IAQ] = NAN;
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+struct Example {
+  uint32_t time;
+  float x[INPUTS];
+  float full[ML_FEATURE_COUNT];         // With ML_BIAS, for MLOnlineModel
+  bool rain;
+  float tempChange;
+};
+
+/**
+ * Examples exactly as MLPredictor builds them
+ */
+static std::vector<Example> makeExamples(const std::vector<Row>& rows) {
+  MLFeatureWindow window;
+  std::vector<Example> examples;
+  for (const Row& row : rows) {
+    const float* v = row.values;
+    MLSample sample;
+    if (!mlSampleFrom(row.time, v[WX_LOG_PRESSURE], v[WX_LOG_TEMP_OUTDOOR], v[WX_LOG_HUMIDITY_OUTDOOR],
+                      v[WX_LOG_TEMP_INDOOR], v[WX_LOG_HUMIDITY_INDOOR], sample) ||
+        !window.add(sample)) {
+      continue;
+    }
+
+    Example e;
+    while (window.nextExample(e.full, e.rain, e.tempChange)) {
+      e.time = row.time - ML_HORIZON_S;  // About when it was predicted
+      memcpy(e.x, e.full + 1, sizeof(e.x));
+      examples.push_back(e);
+    }
+  }
+  return examples;
+}
+
+// ============================================================================
+// Float network
+// ============================================================================
+
+struct Network {
+  int hidden;
+  std::vector<float> w1, b1, w2, b2;    // w1: hidden x INPUTS, w2: OUTPUTS x hidden
+
+  void init(int units, std::mt19937& random) {
+    hidden = units;
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    w1.resize(hidden * INPUTS);
+    b1.assign(hidden, 0.0f);
+    w2.resize(OUTPUTS * hidden);
+    b2.assign(OUTPUTS, 0.0f);
+    for (float& w : w1) w = gauss(random) * sqrtf(2.0f / INPUTS);
+    for (float& w : w2) w = gauss(random) * sqrtf(1.0f / hidden);
+  }
+
+  void forward(const float* x, float* h, float* y) const {
+    for (int j = 0; j < hidden; j++) {
+      float a = b1[j];
+      for (int i = 0; i < INPUTS; i++) a += w1[j * INPUTS + i] * x[i];
+      h[j] = a > 0 ? a : 0;
+    }
+    for (int k = 0; k < OUTPUTS; k++) {
+      float a = b2[k];
+      for (int j = 0; j < hidden; j++) a += w2[k * hidden + j] * h[j];
+      y[k] = a;
+    }
+  }
+};
+
+/**
+ * Adam state for one parameter vector
+ */
+struct Adam {
+  std::vector<float> m, v;
+  void init(size_t n) { m.assign(n, 0); v.assign(n, 0); }
+  void step(std::vector<float>& p, const std::vector<float>& g, float rate, int t) {
+    const float b1 = 0.9f, b2 = 0.999f;
+    float c1 = 1 - powf(b1, (float)t), c2 = 1 - powf(b2, (float)t);
+    for (size_t i = 0; i < p.size(); i++) {
+      m[i] = b1 * m[i] + (1 - b1) * g[i];
+      v[i] = b2 * v[i] + (1 - b2) * g[i] * g[i];
+      p[i] -= rate * (m[i] / c1) / (sqrtf(v[i] / c2) + 1e-8f);
+    }
+  }
+};
+
+static float sigmoid(float z) {
+  return 1.0f / (1.0f + expf(-z));
+}
+
+/**
+ * Minibatch Adam on log loss (rain) + squared error (temperature, in units
+ * of 2 °C so both terms weigh about the same)
+ */
+static void train(Network& net, const std::vector<Example>& data, int epochs, std::mt19937& random) {
+  const int batch = 32;
+  const float rate = 0.005f;
+  Adam a1, c1, a2, c2;
+  a1.init(net.w1.size()); c1.init(net.b1.size()); a2.init(net.w2.size()); c2.init(net.b2.size());
+  std::vector<float> g1(net.w1.size()), gb1(net.b1.size()), g2(net.w2.size()), gb2(net.b2.size());
+  std::vector<float> h(net.hidden), dh(net.hidden);
+  std::vector<size_t> order(data.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  int t = 0;
+
+  for (int epoch = 0; epoch < epochs; epoch++) {
+    std::shuffle(order.begin(), order.end(), random);
+    for (size_t start = 0; start < order.size(); start += batch) {
+      std::fill(g1.begin(), g1.end(), 0.0f); std::fill(gb1.begin(), gb1.end(), 0.0f);
+      std::fill(g2.begin(), g2.end(), 0.0f); std::fill(gb2.begin(), gb2.end(), 0.0f);
+      size_t end = std::min(order.size(), start + batch);
+
+      for (size_t n = start; n < end; n++) {
+        const Example& e = data[order[n]];
+        float y[OUTPUTS];
+        net.forward(e.x, h.data(), y);
+        float dy[OUTPUTS] = {sigmoid(y[ML_QUANT_RAIN_LOGIT]) - (e.rain ? 1.0f : 0.0f),
+                             (y[ML_QUANT_TEMP_CHANGE] - e.tempChange) / 4.0f};
+        std::fill(dh.begin(), dh.end(), 0.0f);
+        for (int k = 0; k < OUTPUTS; k++) {
+          gb2[k] += dy[k];
+          for (int j = 0; j < net.hidden; j++) {
+            g2[k * net.hidden + j] += dy[k] * h[j];
+            dh[j] += dy[k] * net.w2[k * net.hidden + j];
+          }
+        }
+        for (int j = 0; j < net.hidden; j++) {
+          if (h[j] <= 0) continue;
+          gb1[j] += dh[j];
+          for (int i = 0; i < INPUTS; i++) g1[j * INPUTS + i] += dh[j] * e.x[i];
+        }
+      }
+
+      float scale = 1.0f / (end - start);
+      for (float& g : g1) g *= scale;
+      for (float& g : gb1) g *= scale;
+      for (float& g : g2) g *= scale;
+      for (float& g : gb2) g *= scale;
+      t++;
+      a1.step(net.w1, g1, rate, t); c1.step(net.b1, gb1, rate, t);
+      a2.step(net.w2, g2, rate, t); c2.step(net.b2, gb2, rate, t);
+    }
+  }
+}
+
+// ============================================================================
+// Quantization
+// ============================================================================
+
+struct Quantized {
+  std::vector<int8_t> w1, w2;
+  std::vector<int32_t> b1, b2;
+  MLQuantLayer layers[2];
+  MLQuantModel model;
+};
+
+static float maxAbs(const std::vector<float>& v) {
+  float m = 0;
+  for (float x : v) m = std::max(m, fabsf(x));
+  return m;
+}
+
+static int8_t quantizeWeight(float w, float scale) {
+  float q = roundf(w / scale);
+  return (int8_t)std::max(-127.0f, std::min(127.0f, q));
+}
+
+/**
+ * One scale per layer, from the weights' and the training activations' ranges
+ */
+static void quantize(const Network& net, const std::vector<Example>& data, Quantized& q) {
+  float inputMax = 0, hiddenMax = 0, outputMax = 0;
+  std::vector<float> h(net.hidden);
+  for (const Example& e : data) {
+    float y[OUTPUTS];
+    net.forward(e.x, h.data(), y);
+    for (float x : e.x) inputMax = std::max(inputMax, fabsf(x));
+    for (float a : h) hiddenMax = std::max(hiddenMax, a);
+    for (float a : y) outputMax = std::max(outputMax, fabsf(a));
+  }
+
+  float inputScale = std::max(inputMax, 1e-6f) / 127;
+  float hiddenScale = std::max(hiddenMax, 1e-6f) / 127;
+  float outputScale = std::max(outputMax, 1e-6f) / 127;
+  float w1Scale = std::max(maxAbs(net.w1), 1e-6f) / 127;
+  float w2Scale = std::max(maxAbs(net.w2), 1e-6f) / 127;
+
+  for (float w : net.w1) q.w1.push_back(quantizeWeight(w, w1Scale));
+  for (float w : net.w2) q.w2.push_back(quantizeWeight(w, w2Scale));
+  for (float b : net.b1) q.b1.push_back((int32_t)lroundf(b / (inputScale * w1Scale)));
+  for (float b : net.b2) q.b2.push_back((int32_t)lroundf(b / (hiddenScale * w2Scale)));
+
+  q.layers[0] = {INPUTS, (uint8_t)net.hidden, q.w1.data(), q.b1.data(), 0, 0, true};
+  q.layers[1] = {(uint8_t)net.hidden, OUTPUTS, q.w2.data(), q.b2.data(), 0, 0, false};
+  mlQuantMultiplier((double)inputScale * w1Scale / hiddenScale, q.layers[0].multiplier, q.layers[0].shift);
+  mlQuantMultiplier((double)hiddenScale * w2Scale / outputScale, q.layers[1].multiplier, q.layers[1].shift);
+  q.model = {2, q.layers, inputScale, outputScale};
+}
+
+// ============================================================================
+// Scoring
+// ============================================================================
+
+struct Score {
+  size_t n = 0, rain = 0, correct = 0;
+  double brier = 0, logLoss = 0, mae = 0, squared = 0;
+
+  void add(float p, bool rained, float tempPredicted, float tempActual) {
+    float y = rained ? 1.0f : 0.0f;
+    float clipped = std::min(1.0f - 1e-6f, std::max(1e-6f, p));
+    n++;
+    rain += rained;
+    correct += (p >= 0.5f) == rained;
+    brier += (p - y) * (p - y);
+    logLoss -= rained ? logf(clipped) : logf(1 - clipped);
+    mae += fabsf(tempPredicted - tempActual);
+    squared += (tempPredicted - tempActual) * (tempPredicted - tempActual);
+  }
+
+  void print(const char* name) const {
+    printf("  %-22s %8.4f %8.4f %8.1f%% %8.3f %8.3f\n", name, brier / n, logLoss / n, 100.0 * correct / n, mae / n,
+           sqrt(squared / n));
+  }
+};
+
+int main(int argc, char** argv) {
+  const char* headerPath = "esp32s3_central/ml_model_int8.h";
+  const char* referencePath = nullptr;
+  const char* modelFilePath = nullptr;
+  uint32_t modelId = (uint32_t)time(nullptr);
+  int syntheticDays = 0, hidden = 12, epochs = 40;
+  unsigned seed = 1;
+  float holdout = 0.2f;
+  std::vector<const char*> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    bool value = i + 1 < argc;
+    if (strcmp(argv[i], "-o") == 0 && value) headerPath = argv[++i];
+    else if (strcmp(argv[i], "--reference") == 0 && value) referencePath = argv[++i];
+    else if (strcmp(argv[i], "--wxq") == 0 && value) modelFilePath = argv[++i];
+    else if (strcmp(argv[i], "--model-id") == 0 && value) modelId = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--synthetic") == 0 && value) syntheticDays = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--hidden") == 0 && value) hidden = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--holdout") == 0 && value) holdout = atof(argv[++i]);
+    else if (strcmp(argv[i], "--epochs") == 0 && value) epochs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && value) seed = strtoul(argv[++i], nullptr, 10);
+    else if (argv[i][0] == '-') return usage();
+    else inputs.push_back(argv[i]);
+  }
+  if (inputs.empty() || hidden < 1 || hidden > ML_QUANT_MAX_WIDTH || holdout <= 0 || holdout >= 1) return usage();
+
+  std::vector<Row> rows;
+  for (const char* path : inputs) {
+    if (!loadCsv(path, rows)) return 1;
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.time < b.time; });
+
+  std::mt19937 random(seed);
+  char source[160];
+  if (syntheticDays > 0) {
+    rows = synthesize(rows, syntheticDays, random);
+    snprintf(source, sizeof(source), "synthetic, %d days shaped like %s (seed %u)", syntheticDays, inputs[0], seed);
+  } else {
+    snprintf(source, sizeof(source), "%s%s", inputs[0], inputs.size() > 1 ? " and more" : "");
+  }
+
+  std::vector<Example> examples = makeExamples(rows);
+  size_t testCount = (size_t)(examples.size() * holdout);
+  if (examples.size() < 100 || testCount == 0) {
+    fprintf(stderr, "%zu records give %zu examples: not enough to train (each needs 3 h of history and of outcome;"
+                    " use a longer log or --synthetic)\n", rows.size(), examples.size());
+    return 1;
+  }
+  std::vector<Example> trainSet(examples.begin(), examples.end() - testCount);
+  std::vector<Example> testSet(examples.end() - testCount, examples.end());
+  printf("%s: %zu records, %zu examples (%zu train, %zu held out)\n", source, rows.size(), examples.size(),
+         trainSet.size(), testSet.size());
+
+  Network net;
+  net.init(hidden, random);
+  train(net, trainSet, epochs, random);
+
+  Quantized q;
+  quantize(net, trainSet, q);
+
+  // Baselines: the training rain rate, no change, and the station's own online model
+  size_t trainRain = 0;
+  MLOnlineModel online;
+  for (const Example& e : trainSet) {
+    trainRain += e.rain;
+    online.train(e.full, e.rain, e.tempChange);
+  }
+  float climatology = (float)trainRain / trainSet.size();
+
+  Score floatScore, int8Score, climateScore, onlineScore;
+  float worstDrift = 0;
+  double totalDrift = 0;
+  std::vector<float> h(net.hidden);
+  MLQuantArena arena;
+  FILE* reference = referencePath ? fopen(referencePath, "w") : nullptr;
+  if (referencePath && !reference) { perror(referencePath); return 1; }
+  if (reference) {
+    fprintf(reference, "time");
+    for (int i = 0; i < INPUTS; i++) fprintf(reference, ",x%d", i);
+    for (int i = 0; i < INPUTS; i++) fprintf(reference, ",q%d", i);
+    fprintf(reference, ",out_rain,out_temp,rain_probability,temp_change\n");
+  }
+
+  std::vector<int8_t> checkInputs, checkOutputs;
+  for (size_t n = 0; n < testSet.size(); n++) {
+    const Example& e = testSet[n];
+    float y[OUTPUTS];
+    net.forward(e.x, h.data(), y);
+    floatScore.add(sigmoid(y[ML_QUANT_RAIN_LOGIT]), e.rain, y[ML_QUANT_TEMP_CHANGE], e.tempChange);
+
+    int8_t input[INPUTS], output[OUTPUTS];
+    mlQuantizeInput(q.model, e.x, input);
+    mlQuantRun(q.model, input, output, arena);
+    float rain = sigmoid(output[ML_QUANT_RAIN_LOGIT] * q.model.outputScale);
+    float temp = output[ML_QUANT_TEMP_CHANGE] * q.model.outputScale;
+    int8Score.add(rain, e.rain, temp, e.tempChange);
+    float drift = fabsf(rain - sigmoid(y[ML_QUANT_RAIN_LOGIT]));
+    worstDrift = std::max(worstDrift, drift);
+    totalDrift += drift;
+
+    climateScore.add(climatology, e.rain, 0.0f, e.tempChange);
+    onlineScore.add(online.rainProbability(e.full), e.rain, online.temperatureChange(e.full), e.tempChange);
+
+    // Check vectors spread over the held-out period
+    if (n % std::max<size_t>(1, testSet.size() / CHECK_VECTORS) == 0 && checkInputs.size() < CHECK_VECTORS * INPUTS) {
+      checkInputs.insert(checkInputs.end(), input, input + INPUTS);
+      checkOutputs.insert(checkOutputs.end(), output, output + OUTPUTS);
+    }
+
+    if (reference) {
+      fprintf(reference, "%u", e.time);
+      for (float x : e.x) fprintf(reference, ",%.6f", x);
+      for (int8_t x : input) fprintf(reference, ",%d", x);
+      fprintf(reference, ",%d,%d,%.6f,%.4f\n", output[0], output[1], rain, temp);
+    }
+  }
+  if (reference) fclose(reference);
+
+  printf("held out (%zu examples, %.1f%% rain):\n", testSet.size(), 100.0 * int8Score.rain / int8Score.n);
+  printf("  %-22s %8s %8s %9s %8s %8s\n", "model", "Brier", "logloss", "accuracy", "MAE C", "RMSE C");
+  climateScore.print("climatology / no change");
+  onlineScore.print("online (on the station)");
+  floatScore.print("MLP float");
+  int8Score.print("MLP int8");
+  printf("int8 vs float: rain probability differs by %.4f on average, %.4f at most\n", totalDrift / testSet.size(),
+         worstDrift);
+
+  // The header: weights and scales in flash, and check vectors for the device
+  FILE* out = fopen(headerPath, "w");
+  if (!out) { perror(headerPath); return 1; }
+  fprintf(out, "/**\n * @file ml_model_int8.h\n * @brief int8 weather model (generated by tools/wxtrain: do not edit)\n *\n");
+  fprintf(out, " * Data: %s\n", source);
+  fprintf(out, " * Network: %d features -> %d ReLU -> rain logit, temperature change (%d s)\n", INPUTS, hidden,
+          ML_HORIZON_S);
+  fprintf(out, " * Examples: %zu trained on, %zu held out (the newest)\n", trainSet.size(), testSet.size());
+  fprintf(out, " * Held out: Brier %.4f (float %.4f, climatology %.4f), temperature MAE %.3f C (float %.3f)\n",
+          int8Score.brier / int8Score.n, floatScore.brier / floatScore.n, climateScore.brier / climateScore.n,
+          int8Score.mae / int8Score.n, floatScore.mae / floatScore.n);
+  fprintf(out, " *\n * Regenerate it after changing the features in ml_model.h (see tools/README.md).\n");
+  fprintf(out, " */\n\n#ifndef ML_MODEL_INT8_H\n#define ML_MODEL_INT8_H\n\n#include \"ml_quant.h\"\n\n");
+  fprintf(out, "#define ML_INT8_FEATURES %d                // MLFeatureWindow features after ML_BIAS\n", INPUTS);
+  fprintf(out, "#define ML_INT8_HORIZON_S %d\n", ML_HORIZON_S);
+  fprintf(out, "#define ML_INT8_HIDDEN %d\n", hidden);
+  fprintf(out, "#define ML_INT8_CHECKS %d\n\n", CHECK_VECTORS);
+
+  auto array8 = [&](const char* name, const std::vector<int8_t>& v, int width) {
+    fprintf(out, "constexpr int8_t %s[] = {", name);
+    for (size_t i = 0; i < v.size(); i++) fprintf(out, "%s%4d,", i % width ? "" : "\n ", v[i]);
+    fprintf(out, "\n};\n\n");
+  };
+  auto array32 = [&](const char* name, const std::vector<int32_t>& v) {
+    fprintf(out, "constexpr int32_t %s[] = {", name);
+    for (size_t i = 0; i < v.size(); i++) fprintf(out, "%s %d,", i % 8 ? "" : "\n ", v[i]);
+    fprintf(out, "\n};\n\n");
+  };
+  array8("ML_INT8_W0", q.w1, INPUTS);
+  array32("ML_INT8_B0", q.b1);
+  array8("ML_INT8_W1", q.w2, hidden);
+  array32("ML_INT8_B1", q.b2);
+
+  fprintf(out, "constexpr MLQuantLayer ML_INT8_LAYERS[] = {\n");
+  const char* weights[] = {"ML_INT8_W0", "ML_INT8_W1"};
+  const char* biases[] = {"ML_INT8_B0", "ML_INT8_B1"};
+  for (int l = 0; l < 2; l++) {
+    const MLQuantLayer& layer = q.layers[l];
+    fprintf(out, "  {%d, %d, %s, %s, %d, %d, %s},\n", layer.inputs, layer.outputs, weights[l], biases[l],
+            layer.multiplier, layer.shift, layer.relu ? "true" : "false");
+  }
+  fprintf(out, "};\n\n");
+  fprintf(out, "constexpr MLQuantModel ML_INT8_MODEL = {2, ML_INT8_LAYERS, %.9gf, %.9gf};\n\n", q.model.inputScale,
+          q.model.outputScale);
+
+  fprintf(out, "// Held-out inputs and the outputs ml_quant.cpp gives for them (bit-exact)\n");
+  array8("ML_INT8_CHECK_INPUT", checkInputs, INPUTS);
+  array8("ML_INT8_CHECK_OUTPUT", checkOutputs, OUTPUTS);
+  fprintf(out, "#endif // ML_MODEL_INT8_H\n");
+  fclose(out);
+
+  printf("wrote %s: %zu weight bytes, %zu bias bytes%s%s\n", headerPath, q.w1.size() + q.w2.size(),
+         (q.b1.size() + q.b2.size()) * 4, referencePath ? ", reference " : "", referencePath ? referencePath : "");
+
+  // The same network and check vectors as a file the station can load at runtime
+  if (modelFilePath) {
+    uint8_t checks = checkOutputs.size() / OUTPUTS;
+    std::vector<uint8_t> file(mlModelFileBuild(q.model, checkInputs.data(), checkOutputs.data(), checks,
+                                               ML_HORIZON_S, modelId, nullptr, 0));
+    size_t size = mlModelFileBuild(q.model, checkInputs.data(), checkOutputs.data(), checks, ML_HORIZON_S,
+                                   modelId, file.data(), file.size());
+    FILE* wxq = fopen(modelFilePath, "wb");
+    if (!wxq) { perror(modelFilePath); return 1; }
+    bool ok = size > 0 && fwrite(file.data(), 1, size, wxq) == size;
+    fclose(wxq);
+    if (!ok) { fprintf(stderr, "%s: not written\n", modelFilePath); return 1; }
+    printf("wrote %s: model %u, %zu bytes%s\n", modelFilePath, modelId, size,
+           size > ML_MODEL_SLOT_BYTES ? " (larger than ML_MODEL_SLOT_BYTES: the station will refuse it)" : "");
+  }
+  return 0;
+}